@@ -15,37 +15,324 @@
 
 #include <core/FileLogWriter.hpp>
 
+#include <algorithm>
+#include <cstdlib>
+#include <set>
+#include <vector>
 
+#ifndef _WIN32
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/BoostThread.hpp>
 #include <core/FileInfo.hpp>
 #include <core/FileSerializer.hpp>
+#include <core/json/Json.hpp>
 #include <core/system/System.hpp>
+#include <core/system/Environment.hpp>
+
+using namespace boost::posix_time;
 
 namespace rstudio {
 namespace core {
 
+namespace {
+
+#define LOGMAX (2048*1024)  // rotate/remove every 2 megabytes
+
+// maximum number of entries waiting to be written (entries beyond this
+// are dropped)
+const std::size_t kMaxQueuedEntries = 10000;
+
+// sustained rate of messages per second (and the size of the burst above
+// that rate) allowed before messages are dropped
+const double kRateLimit = 100;
+const double kRateLimitBurst = 500;
+
+// how long a run of repeated messages or dropped messages must be quiet
+// before it is noted in the log
+const long kQuietMs = 1000;
+
+// interval after which the log file is reopened (so we follow the file if
+// another process rotates or removes it)
+const long kReopenSeconds = 10;
+
+struct Entry
+{
+   Entry() : level(core::system::kLogLevelError) {}
+
+   ptime time;
+   std::string programIdentity;
+   core::system::LogLevel level;
+   std::string message;
+};
+
+std::string levelName(core::system::LogLevel level)
+{
+   switch(level)
+   {
+      case core::system::kLogLevelError:
+         return "ERROR";
+      case core::system::kLogLevelWarning:
+         return "WARNING";
+      case core::system::kLogLevelInfo:
+         return "INFO";
+      case core::system::kLogLevelDebug:
+         return "DEBUG";
+      default:
+         return "UNKNOWN";
+   }
+}
+
+// writers which are flushed when the process exits (writers are normally
+// never destroyed so this is our only chance to write their final entries)
+boost::mutex& writersMutex()
+{
+   static boost::mutex* pMutex = new boost::mutex();
+   return *pMutex;
+}
+
+std::set<FileLogWriter*>& writers()
+{
+   static std::set<FileLogWriter*>* pWriters = new std::set<FileLogWriter*>();
+   return *pWriters;
+}
+
+#ifndef _WIN32
+// process which registered the exit hook (a forked child which exits
+// mustn't wait on the writers lock, which another parent thread may have
+// held when it was forked)
+pid_t s_atExitPid = 0;
+#endif
+
+void flushWriters()
+{
+#ifndef _WIN32
+   if (::getpid() != s_atExitPid)
+      return;
+#endif
+
+   FileLogWriter::flushAll();
+}
+
+void registerWriter(FileLogWriter* pWriter)
+{
+   static bool s_registeredAtExit = false;
+
+   boost::lock_guard<boost::mutex> lock(writersMutex());
+   if (!s_registeredAtExit)
+   {
+#ifndef _WIN32
+      s_atExitPid = ::getpid();
+#endif
+      std::atexit(flushWriters);
+      s_registeredAtExit = true;
+   }
+   writers().insert(pWriter);
+}
+
+void unregisterWriter(FileLogWriter* pWriter)
+{
+   boost::lock_guard<boost::mutex> lock(writersMutex());
+   writers().erase(pWriter);
+}
+
+} // anonymous namespace
+
+// NOTE: the queue lock is never held while writing to the file (file system
+// errors may themselves be logged, which calls back into the writer)
+struct FileLogWriter::Impl
+{
+   Impl()
+      : json(false),
+        threaded(false),
+        stopping(false),
+        tokens(kRateLimitBurst),
+        dropped(0),
+        repeats(0),
+        size(0)
+   {
+   }
+
+   std::string programIdentity;
+   FilePath logFile;
+   FilePath rotatedLogFile;
+   bool json;
+
+   // writer thread (if it couldn't be started entries are written directly)
+   boost::thread thread;
+   bool threaded;
+#ifndef _WIN32
+   pid_t pid;
+#endif
+
+   // queued entries (protected by queueMutex)
+   boost::mutex queueMutex;
+   boost::condition queueCondition;
+   std::vector<Entry> queue;
+   bool stopping;
+
+   // rate limiting and deduplication (protected by queueMutex)
+   ptime lastRefill;
+   double tokens;
+   std::size_t dropped;
+   ptime lastDropped;
+   Entry lastEntry;
+   std::size_t repeats;
+   ptime lastRepeat;
+
+   // open log file (protected by writeMutex)
+   boost::mutex writeMutex;
+   boost::shared_ptr<std::ostream> pOutput;
+   uintmax_t size;
+   ptime opened;
+
+   void enque(const Entry& entry)
+   {
+      queue.push_back(entry);
+   }
+
+   void enqueNote(const ptime& time, const std::string& message)
+   {
+      Entry entry;
+      entry.time = time;
+      entry.programIdentity = programIdentity;
+      entry.level = core::system::kLogLevelWarning;
+      entry.message = message;
+      enque(entry);
+   }
+
+   void enqueRepeats()
+   {
+      if (repeats == 0)
+         return;
+
+      enqueNote(lastRepeat,
+                "(previous message repeated " +
+                boost::lexical_cast<std::string>(repeats) + " times)");
+      repeats = 0;
+   }
+
+   void enqueDropped()
+   {
+      if (dropped == 0)
+         return;
+
+      enqueNote(lastDropped,
+                "(" + boost::lexical_cast<std::string>(dropped) +
+                " messages dropped due to logging rate limit)");
+      dropped = 0;
+   }
+
+   // whether there are repeats or dropped messages which are still
+   // waiting to be noted
+   bool hasPendingNotes() const
+   {
+      return repeats > 0 || dropped > 0;
+   }
+
+   void write(const std::string& entries)
+   {
+      ptime now = microsec_clock::universal_time();
+      if (pOutput && (now - opened) > seconds(kReopenSeconds))
+         pOutput.reset();
+
+      if (!pOutput)
+      {
+         if (logFile.open_w(&pOutput, false))
+            return;
+         size = logFile.exists() ? logFile.size() : 0;
+         opened = now;
+      }
+
+      if (size > LOGMAX)
+      {
+         // first remove the rotated log file if it exists (ignore errors
+         // because there's nothing we can do with them at this level)
+         pOutput.reset();
+         rotatedLogFile.removeIfExists();
+
+         // now rotate the log file
+         logFile.move(rotatedLogFile);
+         if (logFile.open_w(&pOutput, false))
+            return;
+         size = 0;
+         opened = now;
+      }
+
+      // swallow errors--we can't do anything anyway
+      pOutput->write(entries.data(), entries.size());
+      pOutput->flush();
+      size += entries.size();
+
+#ifdef _WIN32
+      // files are opened for exclusive access on windows so don't keep
+      // the file open (other processes may be writing to it)
+      pOutput.reset();
+#endif
+   }
+};
+
 FileLogWriter::FileLogWriter(const std::string& programIdentity,
                              int logLevel,
                              const FilePath& logDir)
                                 : programIdentity_(programIdentity),
-                                  logLevel_(logLevel)
+                                  logLevel_(logLevel),
+                                  pImpl_(new Impl())
 {
    logDir.ensureDirectory();
 
-   logFile_ = logDir.childPath(programIdentity + ".log");
-   rotatedLogFile_ = logDir.childPath(programIdentity + ".rotated.log");
+   pImpl_->programIdentity = programIdentity;
+   pImpl_->logFile = logDir.childPath(programIdentity + ".log");
+   pImpl_->rotatedLogFile = logDir.childPath(programIdentity + ".rotated.log");
+   pImpl_->json = core::system::getenv("RSTUDIO_LOG_FORMAT") == "json";
+   pImpl_->lastRefill = microsec_clock::universal_time();
 
-   if (!logFile_.exists())
+   if (!pImpl_->logFile.exists())
    {
       // swallow errors -- we can't log so it doesn't matter
-      core::appendToFile(logFile_, "");
+      core::appendToFile(pImpl_->logFile, "");
    }
+
+#ifndef _WIN32
+   pImpl_->pid = ::getpid();
+#endif
+
+   try
+   {
+      pImpl_->thread = boost::thread(boost::bind(&FileLogWriter::run, this));
+      pImpl_->threaded = true;
+   }
+   catch(const boost::thread_resource_error&)
+   {
+   }
+
+   registerWriter(this);
 }
 
 FileLogWriter::~FileLogWriter()
 {
    try
    {
-      // we don't keep a file handle open so do nothing here
+      unregisterWriter(this);
+
+      // stop the writer thread (it writes any remaining entries)
+      if (pImpl_->threaded)
+      {
+         {
+            boost::lock_guard<boost::mutex> lock(pImpl_->queueMutex);
+            pImpl_->stopping = true;
+         }
+         pImpl_->queueCondition.notify_all();
+         pImpl_->thread.join();
+      }
+
+      flush();
    }
    catch(...)
    {
@@ -65,31 +352,203 @@ void FileLogWriter::log(const std::string& programIdentity,
    if (logLevel > logLevel_)
       return;
 
-   rotateLogFile();
+   Entry entry;
+   entry.time = microsec_clock::universal_time();
+   entry.programIdentity = programIdentity;
+   entry.level = logLevel;
+   entry.message = message;
+
+   // write directly if we have no writer thread (including in a child
+   // which was forked after the thread was started)
+   bool direct = !pImpl_->threaded;
+#ifndef _WIN32
+   direct = direct || ::getpid() != pImpl_->pid;
+#endif
+   if (direct)
+   {
+      // Swallow errors--we can't do anything anyway
+      core::appendToFile(pImpl_->logFile,
+                         formatLogEntry(entry.time, programIdentity, message));
+      return;
+   }
+
+   bool notify = false;
+   try
+   {
+      boost::lock_guard<boost::mutex> lock(pImpl_->queueMutex);
+      Impl& impl = *pImpl_;
+
+      // collapse repeats of the previous message (waking the writer at the
+      // start of a run so that it notes the run once it goes quiet)
+      if (!impl.lastEntry.message.empty() &&
+          impl.lastEntry.message == message &&
+          impl.lastEntry.level == logLevel &&
+          impl.lastEntry.programIdentity == programIdentity)
+      {
+         impl.repeats++;
+         impl.lastRepeat = entry.time;
+         notify = impl.repeats == 1;
+      }
+      else
+      {
+         bool notedRepeats = impl.repeats > 0;
+         impl.enqueRepeats();
 
-   // Swallow errors--we can't do anything anyway
-   core::appendToFile(logFile_, formatLogEntry(programIdentity, message));
+         // refill the rate limit tokens based on the time since the last
+         // refill
+         double elapsed = (entry.time - impl.lastRefill).total_microseconds() /
+                          1000000.0;
+         impl.tokens = std::min(kRateLimitBurst,
+                                impl.tokens + (elapsed * kRateLimit));
+         impl.lastRefill = entry.time;
+
+         if (impl.tokens < 1 || impl.queue.size() >= kMaxQueuedEntries)
+         {
+            impl.dropped++;
+            impl.lastDropped = entry.time;
+            notify = notedRepeats || impl.dropped == 1;
+         }
+         else
+         {
+            impl.tokens -= 1;
+            impl.enqueDropped();
+            impl.enque(entry);
+            impl.lastEntry = entry;
+            notify = true;
+         }
+      }
+   }
+   catch(...)
+   {
+      return;
+   }
+
+   if (notify)
+      pImpl_->queueCondition.notify_one();
 }
 
+void FileLogWriter::flush()
+{
+   drain(true);
+}
 
+void FileLogWriter::flushAll()
+{
+   try
+   {
+      boost::lock_guard<boost::mutex> lock(writersMutex());
+      std::for_each(writers().begin(),
+                    writers().end(),
+                    boost::bind(&FileLogWriter::flush, _1));
+   }
+   catch(...)
+   {
+   }
+}
 
-#define LOGMAX (2048*1024)  // rotate/remove every 2 megabytes
-bool FileLogWriter::rotateLogFile()
+void FileLogWriter::run()
 {
-   if (logFile_.exists() && logFile_.size() > LOGMAX)
+   try
    {
-      // first remove the rotated log file if it exists (ignore errors because
-      // there's nothing we can do with them at this level)
-      rotatedLogFile_.removeIfExists();
+      while (true)
+      {
+         bool stopping = false;
+         {
+            boost::unique_lock<boost::mutex> lock(pImpl_->queueMutex);
+            if (pImpl_->queue.empty() && !pImpl_->stopping)
+            {
+               // wake periodically while there are repeats or dropped
+               // messages to note (so they are noted once things go quiet)
+               if (pImpl_->hasPendingNotes())
+                  pImpl_->queueCondition.timed_wait(lock, milliseconds(kQuietMs));
+               else
+                  pImpl_->queueCondition.wait(lock);
+            }
+            stopping = pImpl_->stopping;
+         }
 
-      // now rotate the log file
-      logFile_.move(rotatedLogFile_);
+         drain(false);
 
-      return true;
+         if (stopping)
+            break;
+      }
+   }
+   catch(...)
+   {
    }
-   return false;
 }
 
+void FileLogWriter::drain(bool noteAll)
+{
+#ifndef _WIN32
+   // a forked child doesn't write the entries queued by its parent (and the
+   // locks may have been held by other parent threads when it was forked)
+   if (::getpid() != pImpl_->pid)
+      return;
+#endif
+
+   try
+   {
+      // holding the write lock while taking the queue keeps batches in order
+      // when draining from multiple threads (e.g. flush while the writer
+      // thread is draining)
+      boost::lock_guard<boost::mutex> writeLock(pImpl_->writeMutex);
+
+      std::vector<Entry> entries;
+      {
+         boost::lock_guard<boost::mutex> lock(pImpl_->queueMutex);
+         Impl& impl = *pImpl_;
+
+         // note runs of repeats or dropped messages which have gone quiet
+         // (or all of them if we're flushing)
+         ptime now = microsec_clock::universal_time();
+         if (impl.repeats > 0 &&
+             (noteAll || (now - impl.lastRepeat) >= milliseconds(kQuietMs)))
+         {
+            impl.enqueRepeats();
+            impl.lastEntry = Entry();
+         }
+         if (impl.dropped > 0 &&
+             (noteAll || (now - impl.lastDropped) >= milliseconds(kQuietMs)))
+         {
+            impl.enqueDropped();
+         }
+
+         entries.swap(impl.queue);
+      }
+
+      if (entries.empty())
+         return;
+
+      std::string buffer;
+      for (std::vector<Entry>::const_iterator it = entries.begin();
+           it != entries.end();
+           ++it)
+      {
+         if (pImpl_->json)
+         {
+            json::Object record;
+            record["time"] = to_iso_extended_string(it->time) + "Z";
+            record["program"] = it->programIdentity;
+            record["level"] = levelName(it->level);
+            record["message"] = it->message;
+            buffer.append(json::write(record));
+            buffer.push_back('\n');
+         }
+         else
+         {
+            buffer.append(formatLogEntry(it->time,
+                                         it->programIdentity,
+                                         it->message));
+         }
+      }
+
+      pImpl_->write(buffer);
+   }
+   catch(...)
+   {
+   }
+}
 
 } // namespace core
 } // namespace rstudio
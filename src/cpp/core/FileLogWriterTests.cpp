@@ -0,0 +1,121 @@
+/*
+ * FileLogWriterTests.cpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <tests/TestThat.hpp>
+
+#include <core/FileLogWriter.hpp>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/system/System.hpp>
+
+namespace rstudio {
+namespace core {
+
+namespace {
+
+FilePath testLogDir()
+{
+   return FilePath("/tmp").complete(
+            "rstudio-log-" + core::system::generateShortenedUuid());
+}
+
+std::string logContents(const FilePath& logDir)
+{
+   std::string contents;
+   readStringFromFile(logDir.childPath("test.log"), &contents);
+   return contents;
+}
+
+std::size_t countOf(const std::string& contents, const std::string& text)
+{
+   std::size_t count = 0;
+   for (std::size_t pos = contents.find(text);
+        pos != std::string::npos;
+        pos = contents.find(text, pos + text.size()))
+   {
+      count++;
+   }
+   return count;
+}
+
+} // anonymous namespace
+
+context("FileLogWriter")
+{
+   test_that("queued entries are written by flush")
+   {
+      FilePath logDir = testLogDir();
+      FileLogWriter writer("test", core::system::kLogLevelInfo, logDir);
+
+      writer.log(core::system::kLogLevelInfo, "queued info");
+      writer.log(core::system::kLogLevelError, "an error");
+      writer.flush();
+
+      std::string contents = logContents(logDir);
+      expect_true(boost::algorithm::contains(contents, "queued info"));
+      expect_true(boost::algorithm::contains(contents, "an error"));
+
+      logDir.remove();
+   }
+
+   test_that("repeated messages are noted when flushed")
+   {
+      FilePath logDir = testLogDir();
+      FileLogWriter writer("test", core::system::kLogLevelInfo, logDir);
+
+      writer.log(core::system::kLogLevelInfo, "repeated");
+      writer.log(core::system::kLogLevelInfo, "repeated");
+      writer.log(core::system::kLogLevelInfo, "repeated");
+      writer.flush();
+
+      expect_true(boost::algorithm::contains(
+                     logContents(logDir),
+                     "(previous message repeated 2 times)"));
+
+      logDir.remove();
+   }
+
+#ifndef _WIN32
+   test_that("forked children which exit don't write queued entries")
+   {
+      FilePath logDir = testLogDir();
+      FileLogWriter writer("test", core::system::kLogLevelInfo, logDir);
+
+      writer.log(core::system::kLogLevelInfo, "queued before fork");
+
+      // exit runs the exit hook which flushes the writers
+      pid_t pid = ::fork();
+      if (pid == 0)
+         ::exit(EXIT_FAILURE);
+      ::waitpid(pid, NULL, 0);
+
+      writer.flush();
+      expect_true(countOf(logContents(logDir), "queued before fork") == 1);
+
+      logDir.remove();
+   }
+#endif
+}
+
+} // namespace core
+} // namespace rstudio
@@ -0,0 +1,729 @@
+/*
+ * FileSearch.cpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/FileSearch.hpp>
+
+#include <cctype>
+#include <cstring>
+#include <algorithm>
+#include <locale>
+#include <stdexcept>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/RegexUtils.hpp>
+#include <core/StringUtils.hpp>
+#include <core/Thread.hpp>
+#include <core/WorkerPool.hpp>
+
+namespace rstudio {
+namespace core {
+namespace file_search {
+
+namespace {
+
+// files with a NUL within this many bytes of the start are treated as binary
+const std::size_t kBinaryCheckBytes = 8192;
+
+inline char asciiToLower(char ch)
+{
+   return (ch >= 'A' && ch <= 'Z') ? static_cast<char>(ch - 'A' + 'a') : ch;
+}
+
+inline char asciiToUpper(char ch)
+{
+   return (ch >= 'a' && ch <= 'z') ? static_cast<char>(ch - 'a' + 'A') : ch;
+}
+
+// case insensitive searches follow the locale of the environment (as they
+// do for grep)
+std::locale searchLocale()
+{
+   try
+   {
+      return std::locale("");
+   }
+   catch(const std::runtime_error&)
+   {
+      return std::locale::classic();
+   }
+}
+
+// the prefilter folds the case of ascii characters only, so it can only be
+// used for characters which the locale doesn't consider the same (ignoring
+// case) as any other character
+bool hasAsciiCaseOnly(char ch, const std::ctype<char>& ctype)
+{
+   char folded = ctype.tolower(ch);
+   for (int i = 0; i < 256; i++)
+   {
+      char other = static_cast<char>(i);
+      if (ctype.tolower(other) == folded &&
+          asciiToLower(other) != asciiToLower(ch))
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
+// remove the last character (which may be multibyte) from the literal
+void removeLastCharacter(std::string* pLiteral)
+{
+   while (!pLiteral->empty() &&
+          (static_cast<unsigned char>(*pLiteral->rbegin()) & 0xC0) == 0x80)
+   {
+      pLiteral->erase(pLiteral->size() - 1);
+   }
+
+   if (!pLiteral->empty())
+      pLiteral->erase(pLiteral->size() - 1);
+}
+
+// index of the closing bracket of the bracket expression starting at pos
+std::size_t endOfBracketExpression(const std::string& pattern, std::size_t pos)
+{
+   std::size_t i = pos + 1;
+   if (i < pattern.size() && pattern[i] == '^')
+      i++;
+   if (i < pattern.size() && pattern[i] == ']')
+      i++;
+
+   while (i < pattern.size() && pattern[i] != ']')
+   {
+      // character classes, equivalence classes, and collating symbols
+      // (e.g. [:alpha:]) can contain a closing bracket
+      if (pattern[i] == '[' && i + 1 < pattern.size() &&
+          (pattern[i+1] == ':' || pattern[i+1] == '.' || pattern[i+1] == '='))
+      {
+         std::string close = std::string(1, pattern[i+1]) + "]";
+         std::size_t closePos = pattern.find(close, i + 2);
+         if (closePos == std::string::npos)
+            return pattern.size();
+         i = closePos + 2;
+      }
+      else
+      {
+         i++;
+      }
+   }
+
+   return i;
+}
+
+// convert a basic regex (including the GNU extensions) to the equivalent
+// perl regex (boost's basic syntax doesn't support the extensions)
+std::string basicToPerlRegex(const std::string& pattern)
+{
+   std::string perl;
+
+   // '*' is literal at the start of an expression (and '^' is an anchor)
+   bool atStart = true;
+   for (std::size_t i = 0; i < pattern.size(); i++)
+   {
+      bool start = false;
+      char ch = pattern[i];
+
+      if (ch == '\\' && i + 1 < pattern.size())
+      {
+         char next = pattern[++i];
+         switch (next)
+         {
+         case '(':
+         case '|':
+            perl.push_back(next);
+            start = true;
+            break;
+         case ')':
+         case '{':
+         case '}':
+         case '+':
+         case '?':
+            perl.push_back(next);
+            break;
+         case '<':
+            perl.append("\\b(?=\\w)");
+            break;
+         case '>':
+            perl.append("\\b(?<=\\w)");
+            break;
+         case '`':
+            perl.append("\\A");
+            break;
+         case '\'':
+            perl.append("\\z");
+            break;
+         default:
+            perl.push_back('\\');
+            perl.push_back(next);
+            break;
+         }
+      }
+      else if (ch == '[')
+      {
+         // backslashes are literal within bracket expressions
+         std::size_t end = std::min(endOfBracketExpression(pattern, i),
+                                    pattern.size() - 1);
+         for (; i <= end; i++)
+         {
+            if (pattern[i] == '\\')
+               perl.push_back('\\');
+            perl.push_back(pattern[i]);
+         }
+         i = end;
+      }
+      else if (ch == '^')
+      {
+         if (atStart)
+            perl.push_back(ch);
+         else
+            perl.append("\\^");
+         start = atStart;
+      }
+      else if (ch == '$')
+      {
+         std::string rest = pattern.substr(i + 1, 2);
+         if (rest.empty() || rest == "\\)" || rest == "\\|" || rest[0] == '\n')
+            perl.push_back(ch);
+         else
+            perl.append("\\$");
+      }
+      else if (ch == '*' && atStart)
+      {
+         perl.append("\\*");
+      }
+      else if (ch == '\n')
+      {
+         // grep treats each line of the pattern as an alternative
+         perl.push_back('|');
+         start = true;
+      }
+      else if (std::strchr("+?|(){}", ch) != NULL)
+      {
+         perl.push_back('\\');
+         perl.push_back(ch);
+      }
+      else
+      {
+         perl.push_back(ch);
+      }
+
+      atStart = start;
+   }
+
+   return perl;
+}
+
+} // anonymous namespace
+
+FileSearch::FileSearch(const FilePath& rootPath, const SearchOptions& options)
+   : rootPath_(rootPath),
+     options_(options),
+     matchCount_(0),
+     pendingDirectories_(0),
+     stopped_(false)
+{
+}
+
+FileSearch::~FileSearch()
+{
+   try
+   {
+      stop();
+      pPool_.reset();
+   }
+   catch(...)
+   {
+   }
+}
+
+std::string FileSearch::requiredLiteral(const std::string& pattern,
+                                        bool asRegex,
+                                        bool ignoreCase)
+{
+   std::string literal;
+
+   if (!asRegex)
+   {
+      literal = pattern;
+   }
+
+   // for regexes find the longest run of literal characters outside of any
+   // group (characters within groups or followed by a repetition may not be
+   // part of the match). alternatives (including separate lines) mean
+   // nothing is required
+   else if (pattern.find("\\|") == std::string::npos &&
+            pattern.find('\n') == std::string::npos)
+   {
+      std::string current;
+      int depth = 0;
+
+      for (std::size_t i = 0; i < pattern.size(); i++)
+      {
+         bool flush = false;
+         char ch = pattern[i];
+
+         if (ch == '\\' && i + 1 < pattern.size())
+         {
+            char next = pattern[++i];
+            if (next == '(')
+            {
+               depth++;
+               flush = true;
+            }
+            else if (next == ')')
+            {
+               depth--;
+               flush = true;
+            }
+            else if (next == '{')
+            {
+               removeLastCharacter(&current);
+               std::size_t end = pattern.find("\\}", i);
+               i = (end == std::string::npos) ? pattern.size() : end + 1;
+               flush = true;
+            }
+            else if (next == '?' || next == '+')
+            {
+               removeLastCharacter(&current);
+               flush = true;
+            }
+            else if (std::isalnum(static_cast<unsigned char>(next)) ||
+                     next == '<' || next == '>' || next == '`' || next == '\'')
+            {
+               // back references, word boundaries, and character classes
+               flush = true;
+            }
+            else if (depth == 0)
+            {
+               current.push_back(next);
+            }
+         }
+         else if (ch == '[')
+         {
+            i = endOfBracketExpression(pattern, i);
+            flush = true;
+         }
+         else if (ch == '*')
+         {
+            removeLastCharacter(&current);
+            flush = true;
+         }
+         else if (ch == '.' || ch == '^' || ch == '$' || ch == '\\')
+         {
+            flush = true;
+         }
+         else if (depth == 0)
+         {
+            current.push_back(ch);
+         }
+
+         if (flush)
+         {
+            if (current.size() > literal.size())
+               literal = current;
+            current.clear();
+         }
+      }
+
+      if (current.size() > literal.size())
+         literal = current;
+   }
+
+   // the prefilter only folds the case of ascii characters
+   if (ignoreCase)
+   {
+      std::locale locale = searchLocale();
+      const std::ctype<char>& ctype = std::use_facet<std::ctype<char> >(locale);
+      for (std::size_t i = 0; i < literal.size(); i++)
+      {
+         if (!hasAsciiCaseOnly(literal[i], ctype))
+            return std::string();
+      }
+      std::transform(literal.begin(), literal.end(), literal.begin(),
+                     asciiToLower);
+   }
+
+   return literal;
+}
+
+Error FileSearch::start()
+{
+   try
+   {
+      boost::regex::flag_type flags = options_.asRegex ?
+                                             boost::regex::perl :
+                                             boost::regex::literal;
+      if (options_.ignoreCase)
+         flags |= boost::regex::icase;
+      regex_.imbue(searchLocale());
+      regex_.assign(options_.asRegex ?
+                       basicToPerlRegex(options_.pattern) :
+                       options_.pattern,
+                    flags);
+   }
+   catch(const boost::regex_error& e)
+   {
+      Error error = systemError(boost::system::errc::invalid_argument,
+                                e.what(),
+                                ERROR_LOCATION);
+      error.addProperty("pattern", options_.pattern);
+      return error;
+   }
+
+   BOOST_FOREACH(const std::string& filePattern, options_.filePatterns)
+   {
+      filePatterns_.push_back(
+                  regex_utils::wildcardPatternToRegex(filePattern));
+   }
+
+   literal_ = requiredLiteral(options_.pattern,
+                              options_.asRegex,
+                              options_.ignoreCase);
+
+   pPool_.reset(new WorkerPool(options_.threads));
+   enque(rootPath_);
+
+   return Success();
+}
+
+void FileSearch::stop()
+{
+   LOCK_MUTEX(mutex_)
+   {
+      stopped_ = true;
+   }
+   END_LOCK_MUTEX
+
+   if (pPool_)
+      pPool_->stop();
+}
+
+bool FileSearch::takeMatches(std::vector<LineMatch>* pMatches)
+{
+   LOCK_MUTEX(mutex_)
+   {
+      bool completed = stopped_ || pendingDirectories_ == 0;
+      bool haveMatches = !matches_.empty();
+
+      pMatches->insert(pMatches->end(), matches_.begin(), matches_.end());
+      matches_.clear();
+
+      return haveMatches || !completed;
+   }
+   END_LOCK_MUTEX
+
+   return false;
+}
+
+bool FileSearch::enque(const FilePath& dirPath)
+{
+   LOCK_MUTEX(mutex_)
+   {
+      if (stopped_)
+         return false;
+      pendingDirectories_++;
+   }
+   END_LOCK_MUTEX
+
+   pPool_->enque(boost::bind(&FileSearch::searchDirectory, this, dirPath));
+   return true;
+}
+
+bool FileSearch::stopped()
+{
+   LOCK_MUTEX(mutex_)
+   {
+      return stopped_;
+   }
+   END_LOCK_MUTEX
+
+   return true;
+}
+
+void FileSearch::addMatches(std::vector<LineMatch>* pMatches)
+{
+   bool stop = false;
+
+   LOCK_MUTEX(mutex_)
+   {
+      BOOST_FOREACH(const LineMatch& match, *pMatches)
+      {
+         if (stopped_ || matchCount_ >= options_.maxMatches)
+            break;
+
+         matches_.push_back(match);
+         matchCount_++;
+      }
+
+      stop = !stopped_ && matchCount_ >= options_.maxMatches;
+   }
+   END_LOCK_MUTEX
+
+   pMatches->clear();
+
+   if (stop)
+      this->stop();
+}
+
+void FileSearch::searchDirectory(const FilePath& dirPath)
+{
+   // directories we can't read are skipped (as they would be by grep)
+   std::vector<FilePath> children;
+   Error error = dirPath.children(&children);
+   if (!error)
+   {
+      std::sort(children.begin(), children.end());
+
+      std::vector<LineMatch> matches;
+      BOOST_FOREACH(const FilePath& child, children)
+      {
+         if (stopped())
+            break;
+
+         if (child.isSymlink())
+            continue;
+
+         if (child.isDirectory())
+         {
+            if (!isExcludedDirectory(child))
+               enque(child);
+         }
+         else if (isIncludedFile(child) && !isExcludedFile(child))
+         {
+            searchFile(child, &matches);
+            if (!matches.empty())
+               addMatches(&matches);
+         }
+      }
+   }
+
+   LOCK_MUTEX(mutex_)
+   {
+      pendingDirectories_--;
+   }
+   END_LOCK_MUTEX
+}
+
+bool FileSearch::isExcludedDirectory(const FilePath& dirPath) const
+{
+   std::string path = dirPath.absolutePath();
+   BOOST_FOREACH(const std::string& excluded, options_.excludeDirectories)
+   {
+      if (boost::algorithm::ends_with(path, "/" + excluded))
+         return true;
+   }
+   return false;
+}
+
+bool FileSearch::isIncludedFile(const FilePath& filePath) const
+{
+   if (filePatterns_.empty())
+      return true;
+
+   std::string filename = filePath.filename();
+   BOOST_FOREACH(const boost::regex& pattern, filePatterns_)
+   {
+      if (boost::regex_match(filename, pattern))
+         return true;
+   }
+   return false;
+}
+
+bool FileSearch::isExcludedFile(const FilePath& filePath) const
+{
+   if (!options_.pExcludedFiles)
+      return false;
+
+   ExcludedFiles::const_iterator it =
+                  options_.pExcludedFiles->find(filePath.absolutePath());
+   return it != options_.pExcludedFiles->end() &&
+          it->second == filePath.lastWriteTime();
+}
+
+void FileSearch::searchFile(const FilePath& filePath,
+                            std::vector<LineMatch>* pMatches)
+{
+   if (filePath.size() == 0)
+      return;
+
+   boost::iostreams::mapped_file_source file;
+   try
+   {
+      file.open(string_utils::utf8ToSystem(filePath.absolutePath()));
+   }
+   catch(const std::exception&)
+   {
+      // files we can't read are skipped (as they would be by grep)
+      return;
+   }
+
+   const char* begin = file.data();
+   const char* end = begin + file.size();
+
+   // skip binary files
+   if (std::memchr(begin, 0, std::min(file.size(), kBinaryCheckBytes)))
+      return;
+
+   // jump from one occurrence of the required literal to the next (running
+   // the regex on the lines which contain it)
+   const char* lineStart = begin;
+   int line = 1;
+   while (lineStart < end)
+   {
+      const char* candidate = literal_.empty() ?
+                                 lineStart :
+                                 findLiteral(lineStart, end);
+      if (candidate == end)
+         break;
+
+      // advance to the line containing the candidate
+      while (true)
+      {
+         const char* newline = static_cast<const char*>(
+               std::memchr(lineStart, '\n', candidate - lineStart));
+         if (newline == NULL)
+            break;
+         lineStart = newline + 1;
+         line++;
+      }
+
+      const char* lineEnd = static_cast<const char*>(
+               std::memchr(lineStart, '\n', end - lineStart));
+      if (lineEnd == NULL)
+         lineEnd = end;
+
+      matchLine(filePath, line, lineStart, lineEnd, pMatches);
+
+      lineStart = lineEnd + 1;
+      line++;
+   }
+}
+
+void FileSearch::matchLine(const FilePath& filePath,
+                           int line,
+                           const char* begin,
+                           const char* end,
+                           std::vector<LineMatch>* pMatches)
+{
+   if (end > begin && *(end - 1) == '\r')
+      end--;
+
+   LineMatch match;
+   bool matched = false;
+
+   boost::cregex_iterator it(begin, end, regex_,
+                             boost::match_default |
+                             boost::match_not_dot_newline);
+   for (; it != boost::cregex_iterator(); ++it)
+   {
+      matched = true;
+
+      // empty matches (e.g. for "x*") match the line but aren't highlighted
+      const boost::cmatch& result = *it;
+      if (result.length() > 0)
+      {
+         std::size_t offset = result.position();
+         match.matches.push_back(std::make_pair(offset,
+                                                offset + result.length()));
+      }
+   }
+
+   if (matched)
+   {
+      match.file = filePath;
+      match.line = line;
+      match.contents = std::string(begin, end);
+      pMatches->push_back(match);
+   }
+}
+
+const char* FileSearch::findLiteral(const char* begin, const char* end) const
+{
+   std::size_t length = literal_.size();
+   if (static_cast<std::size_t>(end - begin) < length)
+      return end;
+   const char* last = end - length;
+
+   // memchr for the first character (which is vectorized by the c library)
+   // then compare the rest
+   if (!options_.ignoreCase)
+   {
+      const char* pos = begin;
+      while (pos <= last)
+      {
+         pos = static_cast<const char*>(
+                  std::memchr(pos, literal_[0], last - pos + 1));
+         if (pos == NULL)
+            return end;
+         if (std::memcmp(pos, literal_.data(), length) == 0)
+            return pos;
+         pos++;
+      }
+      return end;
+   }
+
+   // when ignoring case look for both cases of the first character (the
+   // literal has already been converted to lower case)
+   char lower = literal_[0];
+   char upper = asciiToUpper(lower);
+   const char* pos = begin;
+   const char* nextLower = NULL;
+   const char* nextUpper = NULL;
+   while (pos <= last)
+   {
+      if (nextLower == NULL || nextLower < pos)
+      {
+         nextLower = static_cast<const char*>(
+                  std::memchr(pos, lower, last - pos + 1));
+         if (nextLower == NULL)
+            nextLower = end;
+      }
+      if (upper == lower)
+      {
+         nextUpper = end;
+      }
+      else if (nextUpper == NULL || nextUpper < pos)
+      {
+         nextUpper = static_cast<const char*>(
+                  std::memchr(pos, upper, last - pos + 1));
+         if (nextUpper == NULL)
+            nextUpper = end;
+      }
+
+      pos = std::min(nextLower, nextUpper);
+      if (pos == end)
+         return end;
+
+      std::size_t i = 1;
+      while (i < length && asciiToLower(pos[i]) == literal_[i])
+         i++;
+      if (i == length)
+         return pos;
+
+      pos++;
+   }
+
+   return end;
+}
+
+} // namespace file_search
+} // namespace core
+} // namespace rstudio
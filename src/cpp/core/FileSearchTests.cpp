@@ -0,0 +1,165 @@
+/*
+ * FileSearchTests.cpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <tests/TestThat.hpp>
+
+#include <core/FileSearch.hpp>
+
+#include <algorithm>
+
+#include <core/Error.hpp>
+#include <core/FileSerializer.hpp>
+
+namespace rstudio {
+namespace core {
+namespace file_search {
+
+namespace {
+
+std::vector<LineMatch> search(const FilePath& rootPath,
+                              const SearchOptions& options)
+{
+   std::vector<LineMatch> matches;
+
+   FileSearch search(rootPath, options);
+   Error error = search.start();
+   if (error)
+      return matches;
+
+   while (search.takeMatches(&matches))
+      boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+
+   return matches;
+}
+
+bool compareMatches(const LineMatch& a, const LineMatch& b)
+{
+   if (a.file == b.file)
+      return a.line < b.line;
+   else
+      return a.file < b.file;
+}
+
+} // anonymous namespace
+
+context("FileSearch")
+{
+   test_that("required literals are found in regexes")
+   {
+      expect_true(FileSearch::requiredLiteral("foo", false, false) == "foo");
+      expect_true(FileSearch::requiredLiteral("Foo", false, true) == "foo");
+      expect_true(FileSearch::requiredLiteral("foo.*barbaz", true, false) == "barbaz");
+      expect_true(FileSearch::requiredLiteral("^library(", true, false) == "library(");
+      expect_true(FileSearch::requiredLiteral("abcd*", true, false) == "abc");
+      expect_true(FileSearch::requiredLiteral("ab[cdef]*x", true, false) == "ab");
+      expect_true(FileSearch::requiredLiteral("[[:alpha:]]xyz", true, false) == "xyz");
+      expect_true(FileSearch::requiredLiteral("\\(abcdef\\)*g", true, false) == "g");
+      expect_true(FileSearch::requiredLiteral("foo\\|bar", true, false).empty());
+      expect_true(FileSearch::requiredLiteral("a\\.b", true, false) == "a.b");
+      expect_true(FileSearch::requiredLiteral("foo\nbar", true, false).empty());
+   }
+
+   test_that("basic regexes support the GNU extensions")
+   {
+      FilePath rootPath;
+      FilePath::tempFilePath(&rootPath);
+      rootPath.ensureDirectory();
+      writeStringToFile(rootPath.childPath("a.R"), "xx bar foo aa\nfoobar\n*x\\y\n");
+
+      SearchOptions options;
+      options.asRegex = true;
+
+      options.pattern = "foo\\|bar";
+      expect_true(search(rootPath, options).size() == 2);
+
+      options.pattern = "fo\\+b";
+      expect_true(search(rootPath, options).size() == 1);
+
+      options.pattern = "fx\\?o\\?o ";
+      expect_true(search(rootPath, options).size() == 1);
+
+      options.pattern = "\\wbar";
+      expect_true(search(rootPath, options).size() == 1);
+
+      options.pattern = "\\bbar";
+      expect_true(search(rootPath, options).size() == 1);
+
+      options.pattern = "\\<foo";
+      expect_true(search(rootPath, options).size() == 2);
+
+      options.pattern = "r\\>";
+      expect_true(search(rootPath, options).size() == 2);
+
+      // characters which are special in extended regexes are literal
+      options.pattern = "o+\\|(b\\|a{2}";
+      expect_true(search(rootPath, options).empty());
+
+      // as are leading stars and backslashes within bracket expressions
+      options.pattern = "*x[\\]y";
+      expect_true(search(rootPath, options).size() == 1);
+      options.pattern = "[\\w]y";
+      expect_true(search(rootPath, options).size() == 1);
+
+      rootPath.remove();
+   }
+
+   test_that("matches are found and excluded directories are skipped")
+   {
+      FilePath rootPath;
+      FilePath::tempFilePath(&rootPath);
+      rootPath.ensureDirectory();
+      rootPath.childPath("src").ensureDirectory();
+      rootPath.childPath(".git").ensureDirectory();
+
+      writeStringToFile(rootPath.childPath("a.R"),
+                        "x <- 1\nfoo(x); foo(y)\n");
+      writeStringToFile(rootPath.childPath("src/b.cpp"),
+                        "int x;\r\nint FOO;\r\n");
+      writeStringToFile(rootPath.childPath(".git/c.R"), "foo\n");
+
+      SearchOptions options;
+      options.pattern = "foo";
+      options.ignoreCase = true;
+      options.excludeDirectories.push_back(".git");
+
+      std::vector<LineMatch> matches = search(rootPath, options);
+      std::sort(matches.begin(), matches.end(), compareMatches);
+
+      expect_true(matches.size() == 2);
+      if (matches.size() == 2)
+      {
+         expect_true(matches[0].file.filename() == "a.R");
+         expect_true(matches[0].line == 2);
+         expect_true(matches[0].matches.size() == 2);
+         expect_true(matches[0].matches[1].first == 8);
+         expect_true(matches[1].file.filename() == "b.cpp");
+         expect_true(matches[1].line == 2);
+         expect_true(matches[1].contents == "int FOO;");
+      }
+
+      options.ignoreCase = false;
+      options.asRegex = true;
+      options.pattern = "^int [a-z]";
+      options.filePatterns.push_back("*.cpp");
+      matches = search(rootPath, options);
+      expect_true(matches.size() == 1);
+
+      rootPath.remove();
+   }
+}
+
+} // namespace file_search
+} // namespace core
+} // namespace rstudio
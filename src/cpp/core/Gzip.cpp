@@ -0,0 +1,415 @@
+/*
+ * Gzip.cpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/Gzip.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+#include <core/BoostErrors.hpp>
+#include <core/BoostThread.hpp>
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/Log.hpp>
+#include <core/Macros.hpp>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+namespace rstudio {
+namespace core {
+namespace gzip {
+
+namespace {
+
+struct Block
+{
+   std::string input;
+   std::string output;
+   Error error;
+};
+
+Error compressBlock(const std::string& input, std::string* pOutput)
+{
+   try
+   {
+      using namespace boost::iostreams;
+      filtering_ostream compressStream;
+      compressStream.push(gzip_compressor(gzip_params(zlib::best_speed)));
+      compressStream.push(boost::iostreams::back_inserter(*pOutput));
+      compressStream.write(input.data(), input.size());
+      compressStream.reset();
+      return Success();
+   }
+   catch(const boost::iostreams::gzip_error& e)
+   {
+      Error error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+      error.addProperty("zlib-error", e.zlib_error_code());
+      return error;
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+
+   return systemError(boost::system::errc::io_error, ERROR_LOCATION);
+}
+
+// compress every stride'th block beginning at the specified offset
+void compressBlocks(std::vector<Block>* pBlocks,
+                    std::size_t offset,
+                    std::size_t stride)
+{
+   for (std::size_t i = offset; i < pBlocks->size(); i += stride)
+   {
+      Block& block = pBlocks->at(i);
+      block.output.clear();
+      block.error = compressBlock(block.input, &block.output);
+   }
+}
+
+// read up to the requested number of blocks from the stream (returns the
+// number of blocks actually read)
+std::size_t readBlocks(std::istream& input,
+                       std::size_t blockSize,
+                       std::vector<Block>* pBlocks)
+{
+   std::size_t count = 0;
+   for (; count < pBlocks->size(); count++)
+   {
+      std::string& buffer = pBlocks->at(count).input;
+      buffer.resize(blockSize);
+      input.read(&buffer[0], blockSize);
+      buffer.resize(static_cast<std::size_t>(input.gcount()));
+      if (buffer.empty())
+         break;
+   }
+   return count;
+}
+
+Error compressStream(std::istream& input,
+                     std::ostream& output,
+                     std::size_t threads,
+                     std::size_t blockSize)
+{
+   std::vector<Block> blocks(threads);
+   bool wroteBlock = false;
+   while (true)
+   {
+      std::size_t count = readBlocks(input, blockSize, &blocks);
+      if (input.bad())
+         return systemError(boost::system::errc::io_error, ERROR_LOCATION);
+
+      // an empty file still needs a (single, empty) gzip member
+      if (count == 0)
+      {
+         if (wroteBlock)
+            break;
+         count = 1;
+      }
+      blocks.resize(count);
+
+      // compress the blocks concurrently (using the calling thread for the
+      // first share of the work)
+      std::vector<boost::shared_ptr<boost::thread> > workers;
+      try
+      {
+         for (std::size_t i = 1; i < count; i++)
+         {
+            workers.push_back(boost::shared_ptr<boost::thread>(
+               new boost::thread(boost::bind(compressBlocks,
+                                             &blocks, i, count))));
+         }
+      }
+      catch(const boost::thread_resource_error& e)
+      {
+         // compress the blocks we couldn't hand off on this thread
+         LOG_ERROR(Error(boost::thread_error::ec_from_exception(e),
+                         ERROR_LOCATION));
+      }
+
+      compressBlocks(&blocks, 0, count);
+      for (std::size_t i = workers.size() + 1; i < count; i++)
+         compressBlocks(&blocks, i, count);
+
+      for (std::size_t i = 0; i < workers.size(); i++)
+         workers[i]->join();
+
+      // write the members in order
+      for (std::size_t i = 0; i < count; i++)
+      {
+         if (blocks[i].error)
+            return blocks[i].error;
+
+         output.write(blocks[i].output.data(), blocks[i].output.size());
+         if (!output.good())
+            return systemError(boost::system::errc::io_error, ERROR_LOCATION);
+      }
+      wroteBlock = true;
+
+      // a short read means we've reached the end of the input
+      if (count < threads || blocks[count - 1].input.size() < blockSize)
+         break;
+   }
+
+   return Success();
+}
+
+std::size_t defaultThreads(std::size_t threads)
+{
+   if (threads == 0)
+      return std::max(1U, boost::thread::hardware_concurrency());
+   else
+      return threads;
+}
+
+#ifndef _WIN32
+
+struct PipeCompression
+{
+   PipeCompression(const FilePath& pipePath,
+                   const FilePath& compressedPath,
+                   std::size_t threads,
+                   std::size_t blockSize)
+      : pipePath(pipePath), compressedPath(compressedPath),
+        threads(threads), blockSize(blockSize)
+   {
+   }
+
+   void run()
+   {
+      try
+      {
+         // blocks until the pipe is opened for writing
+         boost::shared_ptr<std::istream> pInput;
+         error = pipePath.open_r(&pInput);
+         if (error)
+            return;
+
+         boost::shared_ptr<std::ostream> pOutput;
+         error = compressedPath.open_w(&pOutput);
+         if (!error)
+            error = compressStream(*pInput, *pOutput, threads, blockSize);
+         if (!error)
+         {
+            pOutput->flush();
+            if (!pOutput->good())
+               error = systemError(boost::system::errc::io_error,
+                                   ERROR_LOCATION);
+         }
+
+         // if we failed then drain the pipe (so the writer doesn't block
+         // waiting for us to read the rest of its output)
+         if (error)
+         {
+            char buffer[4096];
+            while (pInput->read(buffer, sizeof(buffer)) || pInput->gcount() > 0)
+            {
+            }
+         }
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   FilePath pipePath;
+   FilePath compressedPath;
+   std::size_t threads;
+   std::size_t blockSize;
+   Error error;
+};
+
+// open the write end of the pipe once the compression thread has opened
+// the read end. holding it open until the write function has returned means
+// the compression thread sees the end of the input only once the write
+// function is done with the pipe (even if it never opens it)
+Error openPipeWriter(const FilePath& pipePath,
+                     boost::thread* pCompressionThread,
+                     int* pFd)
+{
+   while (true)
+   {
+      int fd = ::open(pipePath.absolutePath().c_str(), O_WRONLY | O_NONBLOCK);
+      if (fd != -1)
+      {
+         *pFd = fd;
+         return Success();
+      }
+
+      // ENXIO means the pipe has no reader yet
+      if (errno != ENXIO)
+      {
+         Error error = systemError(errno, ERROR_LOCATION);
+         error.addProperty("path", pipePath);
+         return error;
+      }
+
+      // the compression thread exits without opening the pipe only if
+      // it failed to open it
+      if (pCompressionThread->timed_join(boost::posix_time::milliseconds(1)))
+         return systemError(boost::system::errc::broken_pipe, ERROR_LOCATION);
+   }
+}
+
+#endif
+
+} // anonymous namespace
+
+Error compressFile(const FilePath& filePath,
+                   std::size_t threads,
+                   std::size_t blockSize)
+{
+   threads = defaultThreads(threads);
+   if (blockSize == 0)
+      return systemError(boost::system::errc::invalid_argument,
+                         ERROR_LOCATION);
+
+   FilePath compressedPath(filePath.absolutePath() + ".gz.partial");
+
+   // compress into the partial file
+   {
+      boost::shared_ptr<std::istream> pInput;
+      Error error = filePath.open_r(&pInput);
+      if (error)
+         return error;
+
+      boost::shared_ptr<std::ostream> pOutput;
+      error = compressedPath.open_w(&pOutput);
+      if (error)
+         return error;
+
+      error = compressStream(*pInput, *pOutput, threads, blockSize);
+      if (!error)
+      {
+         pOutput->flush();
+         if (!pOutput->good())
+            error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+      }
+
+      if (error)
+      {
+         error.addProperty("path", filePath);
+         pOutput.reset();
+         Error removeError = compressedPath.removeIfExists();
+         if (removeError)
+            LOG_ERROR(removeError);
+         return error;
+      }
+   }
+
+   // replace the original
+   return compressedPath.move(filePath);
+}
+
+Error compressOutput(
+            const boost::function<Error(const FilePath&)>& writeFunction,
+            const FilePath& targetPath,
+            std::size_t threads,
+            std::size_t blockSize)
+{
+#ifdef _WIN32
+   // no named pipes so write the output and then compress it
+   Error error = writeFunction(targetPath);
+   if (error)
+      return error;
+   return compressFile(targetPath, threads, blockSize);
+#else
+   threads = defaultThreads(threads);
+   if (blockSize == 0)
+      return systemError(boost::system::errc::invalid_argument,
+                         ERROR_LOCATION);
+
+   FilePath pipePath(targetPath.absolutePath() + ".pipe");
+   FilePath compressedPath(targetPath.absolutePath() + ".gz.partial");
+
+   Error error = pipePath.removeIfExists();
+   if (error)
+      return error;
+   if (::mkfifo(pipePath.absolutePath().c_str(), S_IRUSR | S_IWUSR) == -1)
+   {
+      error = systemError(errno, ERROR_LOCATION);
+      error.addProperty("path", pipePath);
+      return error;
+   }
+
+   // compress the pipe's contents on another thread
+   PipeCompression compression(pipePath, compressedPath, threads, blockSize);
+   boost::thread compressionThread;
+   try
+   {
+      boost::thread t(boost::bind(&PipeCompression::run, &compression));
+      compressionThread = MOVE_THREAD(t);
+   }
+   catch(const boost::thread_resource_error& e)
+   {
+      LOG_ERROR(Error(boost::thread_error::ec_from_exception(e),
+                      ERROR_LOCATION));
+
+      // fall back to writing the output and then compressing it
+      Error removeError = pipePath.removeIfExists();
+      if (removeError)
+         LOG_ERROR(removeError);
+      error = writeFunction(targetPath);
+      if (error)
+         return error;
+      return compressFile(targetPath, threads, blockSize);
+   }
+
+   int writerFd = -1;
+   error = openPipeWriter(pipePath, &compressionThread, &writerFd);
+   if (!error)
+   {
+      error = writeFunction(pipePath);
+      ::close(writerFd);
+   }
+   else
+   {
+      // make sure the compression thread isn't left waiting on a writer
+      int fd = ::open(pipePath.absolutePath().c_str(), O_RDWR | O_NONBLOCK);
+      if (fd != -1)
+         ::close(fd);
+   }
+   compressionThread.join();
+   if (!error)
+      error = compression.error;
+
+   Error removeError = pipePath.removeIfExists();
+   if (removeError)
+      LOG_ERROR(removeError);
+
+   if (error)
+   {
+      error.addProperty("path", targetPath);
+      removeError = compressedPath.removeIfExists();
+      if (removeError)
+         LOG_ERROR(removeError);
+      return error;
+   }
+
+   return compressedPath.move(targetPath);
+#endif
+}
+
+} // namespace gzip
+} // namespace core
+} // namespace rstudio
@@ -0,0 +1,177 @@
+/*
+ * GzipTests.cpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <tests/TestThat.hpp>
+
+#include <core/Gzip.hpp>
+
+#include <cstring>
+
+#include <zlib.h>
+
+#include <boost/bind.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/SafeConvert.hpp>
+#include <core/system/System.hpp>
+
+namespace rstudio {
+namespace core {
+namespace gzip {
+
+namespace {
+
+FilePath testFilePath()
+{
+   return FilePath("/tmp").complete(
+            "rstudio-gzip-" + core::system::generateShortenedUuid());
+}
+
+std::string testContents()
+{
+   std::string contents;
+   for (int i = 0; i < 2000; i++)
+      contents += "line " + safe_convert::numberToString(i) + "\n";
+   return contents;
+}
+
+// decompress all of the gzip members in the file
+bool readCompressed(const FilePath& filePath, std::string* pContents)
+{
+   std::string compressed;
+   if (readStringFromFile(filePath, &compressed))
+      return false;
+
+   z_stream stream;
+   std::memset(&stream, 0, sizeof(stream));
+   if (::inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK)
+      return false;
+
+   stream.next_in = reinterpret_cast<Bytef*>(&compressed[0]);
+   stream.avail_in = static_cast<uInt>(compressed.size());
+
+   bool ok = true;
+   char buffer[4096];
+   while (ok)
+   {
+      stream.next_out = reinterpret_cast<Bytef*>(buffer);
+      stream.avail_out = sizeof(buffer);
+      int result = ::inflate(&stream, Z_NO_FLUSH);
+      pContents->append(buffer, sizeof(buffer) - stream.avail_out);
+
+      if (result == Z_STREAM_END)
+      {
+         // continue with the next member (if any)
+         if (stream.avail_in == 0)
+            break;
+         ok = ::inflateReset(&stream) == Z_OK;
+      }
+      else if (result != Z_OK)
+      {
+         ok = false;
+      }
+   }
+
+   ::inflateEnd(&stream);
+   return ok;
+}
+
+Error writeContents(const std::string& contents, const FilePath& filePath)
+{
+   return writeStringToFile(filePath, contents);
+}
+
+Error failAfterWriting(const FilePath& filePath)
+{
+   Error error = writeStringToFile(filePath, "partial");
+   if (error)
+      return error;
+   return systemError(boost::system::errc::io_error, ERROR_LOCATION);
+}
+
+Error failWithoutWriting(const FilePath&)
+{
+   return systemError(boost::system::errc::io_error, ERROR_LOCATION);
+}
+
+} // anonymous namespace
+
+context("Gzip")
+{
+   test_that("files are compressed in blocks on multiple threads")
+   {
+      FilePath filePath = testFilePath();
+      expect_false(writeStringToFile(filePath, testContents()));
+
+      expect_false(compressFile(filePath, 3, 1000));
+
+      std::string contents;
+      expect_true(readCompressed(filePath, &contents));
+      expect_true(contents == testContents());
+
+      filePath.remove();
+   }
+
+   test_that("empty files are compressed")
+   {
+      FilePath filePath = testFilePath();
+      expect_false(writeStringToFile(filePath, ""));
+
+      expect_false(compressFile(filePath));
+
+      std::string contents;
+      expect_true(readCompressed(filePath, &contents));
+      expect_true(contents.empty());
+
+      filePath.remove();
+   }
+
+   test_that("output is compressed as it is written")
+   {
+      FilePath filePath = testFilePath();
+
+      expect_false(compressOutput(boost::bind(writeContents, testContents(), _1),
+                                  filePath, 2, 1000));
+
+      std::string contents;
+      expect_true(readCompressed(filePath, &contents));
+      expect_true(contents == testContents());
+      expect_false(FilePath(filePath.absolutePath() + ".pipe").exists());
+
+      filePath.remove();
+   }
+
+   test_that("failed writes leave the existing file in place")
+   {
+      FilePath filePath = testFilePath();
+      expect_false(writeStringToFile(filePath, "original"));
+
+      expect_true(compressOutput(failAfterWriting, filePath));
+      expect_true(compressOutput(failWithoutWriting, filePath));
+
+      std::string contents;
+      expect_false(readStringFromFile(filePath, &contents));
+      expect_true(contents == "original");
+      expect_false(FilePath(filePath.absolutePath() + ".gz.partial").exists());
+
+      filePath.remove();
+   }
+}
+
+} // namespace gzip
+} // namespace core
+} // namespace rstudio
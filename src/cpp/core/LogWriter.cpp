@@ -26,6 +26,17 @@ namespace core {
 std::string LogWriter::formatLogEntry(const std::string& programIdentity,
                                       const std::string& message,
                                       bool escapeNewlines)
+{
+   return formatLogEntry(boost::posix_time::microsec_clock::universal_time(),
+                         programIdentity,
+                         message,
+                         escapeNewlines);
+}
+
+std::string LogWriter::formatLogEntry(const boost::posix_time::ptime& time,
+                                      const std::string& programIdentity,
+                                      const std::string& message,
+                                      bool escapeNewlines)
 {
    // replace newlines with standard escape sequence if requested
    std::string cleanedMessage(message);
@@ -33,8 +44,6 @@ std::string LogWriter::formatLogEntry(const std::string& programIdentity,
       boost::algorithm::replace_all(cleanedMessage, "\n", "|||");
 
    // generate time string
-   using namespace boost::posix_time;
-   ptime time = microsec_clock::universal_time();
    std::string dateTime = date_time::format(time,  "%d %b %Y %H:%M:%S");
 
    // generate log entry
@@ -21,6 +21,7 @@
 
 #include <core/Algorithm.hpp>
 #include <core/collection/Position.hpp>
+#include <core/collection/LruCache.hpp>
 
 namespace rstudio {
 namespace unit_tests {
@@ -39,6 +40,39 @@ context("Position")
    
 }
 
+context("LruCache")
+{
+   test_that("The least recently used entry is evicted")
+   {
+      LruCache<std::string, int> cache(2);
+      cache.insert("a", 1);
+      cache.insert("b", 2);
+
+      int value = 0;
+      expect_true(cache.get("a", &value));
+      expect_true(value == 1);
+
+      cache.insert("c", 3);
+      expect_true(cache.size() == 2);
+      expect_false(cache.get("b", &value));
+      expect_true(cache.get("a", &value));
+      expect_true(cache.get("c", &value));
+      expect_true(value == 3);
+   }
+
+   test_that("Inserting an existing key replaces its value")
+   {
+      LruCache<std::string, int> cache(2);
+      cache.insert("a", 1);
+      cache.insert("a", 2);
+
+      int value = 0;
+      expect_true(cache.size() == 1);
+      expect_true(cache.get("a", &value));
+      expect_true(value == 2);
+   }
+}
+
 context("Splitting")
 {
    test_that("core::algorithm::split handles multi-character delimiters")
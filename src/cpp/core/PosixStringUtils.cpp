@@ -15,10 +15,13 @@
 
 #include <core/StringUtils.hpp>
 
+#include <cerrno>
 #include <cstdlib>
 
 #include <vector>
 
+#include <iconv.h>
+
 #include <core/Log.hpp>
 #include <core/Error.hpp>
 
@@ -38,6 +41,74 @@ namespace rstudio {
 namespace core {
 namespace string_utils {
 
+core::Error iconvstr(const std::string& value,
+                     const std::string& from,
+                     const std::string& to,
+                     bool allowSubstitution,
+                     std::string* pResult)
+{
+   std::string effectiveFrom = from;
+   if (effectiveFrom.empty())
+      effectiveFrom = "UTF-8";
+   std::string effectiveTo = to;
+   if (effectiveTo.empty())
+      effectiveTo = "UTF-8";
+
+   if (effectiveFrom == effectiveTo)
+   {
+      *pResult = value;
+      return Success();
+   }
+
+   std::vector<char> output;
+   output.reserve(value.length());
+
+   ::iconv_t handle = ::iconv_open(effectiveTo.c_str(), effectiveFrom.c_str());
+   if (handle == (::iconv_t)(-1))
+      return systemError(errno, ERROR_LOCATION);
+
+   char* pIn = const_cast<char*>(value.data());
+   size_t inBytes = value.size();
+
+   char buffer[256];
+   while (inBytes > 0)
+   {
+      const char* pInOrig = pIn;
+      char* pOut = buffer;
+      size_t outBytes = sizeof(buffer);
+
+      size_t result = ::iconv(handle, &pIn, &inBytes, &pOut, &outBytes);
+      if (buffer != pOut)
+         output.insert(output.end(), buffer, pOut);
+
+      if (result == (size_t)(-1))
+      {
+         if ((errno == EILSEQ || errno == EINVAL) && allowSubstitution)
+         {
+            output.push_back('?');
+            pIn++;
+            inBytes--;
+         }
+         else if (errno == E2BIG && pInOrig != pIn)
+         {
+            continue;
+         }
+         else
+         {
+            Error error = systemError(errno, ERROR_LOCATION);
+            ::iconv_close(handle);
+            error.addProperty("str", value);
+            error.addProperty("len", value.length());
+            return error;
+         }
+      }
+   }
+   ::iconv_close(handle);
+
+   *pResult = std::string(output.begin(), output.end());
+   return Success();
+}
+
 std::string wideToUtf8(const std::wstring& value)
 {
    try
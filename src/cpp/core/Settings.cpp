@@ -15,31 +15,112 @@
 
 #include <core/Settings.hpp>
 
+#ifndef _WIN32
+#include <errno.h>
+#include <sys/stat.h>
+#endif
+
+#include <boost/bind.hpp>
 #include <boost/lexical_cast.hpp>
 
 #include <core/Log.hpp>
 #include <core/FilePath.hpp>
 #include <core/SafeConvert.hpp>
 #include <core/FileSerializer.hpp>
+#include <core/system/System.hpp>
 
 namespace rstudio {
 namespace core {
 
+namespace {
+
+// give the replacement for a file the same permissions as the file
+Error copyFileMode(const FilePath& sourcePath, const FilePath& targetPath)
+{
+#ifndef _WIN32
+   struct stat st;
+   if (::stat(sourcePath.absolutePath().c_str(), &st) == -1)
+   {
+      if (errno == ENOENT)
+         return Success();
+
+      Error error = systemError(errno, ERROR_LOCATION);
+      error.addProperty("path", sourcePath);
+      return error;
+   }
+
+   if (::chmod(targetPath.absolutePath().c_str(), st.st_mode & 07777) == -1)
+   {
+      Error error = systemError(errno, ERROR_LOCATION);
+      error.addProperty("path", targetPath);
+      return error;
+   }
+#endif
+
+   return Success();
+}
+
+} // anonymous namespace
+
 Settings::Settings()
    : updatePending_(false),
-     isDirty_(false)
+     isDirty_(false),
+     writeScheduled_(false)
 {
 }
 
 Settings::~Settings()
 {
+   try
+   {
+      flush();
+   }
+   CATCH_UNEXPECTED_EXCEPTION
 }
 
 Error Settings::initialize(const FilePath& filePath) 
 {
+   // unwritten changes survive re-reading the same file
+   std::map<std::string, std::string> unwritten;
+   if (filePath == settingsFile_)
+   {
+      for (std::set<std::string>::const_iterator it = unwrittenNames_.begin();
+           it != unwrittenNames_.end();
+           ++it)
+      {
+         unwritten[*it] = settingsMap_[*it];
+      }
+   }
+   else
+   {
+      unwrittenNames_.clear();
+      isDirty_ = false;
+   }
+
+   std::map<std::string, std::string> previousMap;
+   previousMap.swap(settingsMap_);
+
    settingsFile_ = filePath ;
-   settingsMap_.clear() ;
    Error error = core::readStringMapFromFile(settingsFile_, &settingsMap_) ;
+   for (std::map<std::string, std::string>::const_iterator it =
+         unwritten.begin(); it != unwritten.end(); ++it)
+   {
+      settingsMap_[it->first] = it->second;
+   }
+
+   // notify of values changed by the file
+   if (!changeHandlers_.empty())
+   {
+      for (std::map<std::string, std::string>::const_iterator it =
+            settingsMap_.begin(); it != settingsMap_.end(); ++it)
+      {
+         std::map<std::string, std::string>::const_iterator prev =
+                                                previousMap.find(it->first);
+         if (prev == previousMap.end() || prev->second != it->second)
+            notifyChanged(it->first, it->second);
+      }
+   }
+
    if (error)
    {
       // we don't consider file-not-found and error because it is a 
@@ -54,15 +135,33 @@ Error Settings::initialize(const FilePath& filePath)
    return Success() ;
 }
 
+void Settings::setWriteBehind(const ScheduleWriteFunction& scheduleWrite)
+{
+   scheduleWrite_ = scheduleWrite;
+}
+
+void Settings::flush()
+{
+   writeScheduled_ = false;
+   if (isDirty_ && !updatePending_)
+      writeSettings();
+}
+
+void Settings::addChangeHandler(const ChangeHandler& handler)
+{
+   changeHandlers_.push_back(handler);
+}
+
 void Settings::set(const std::string& name, const std::string& value)
 {
    if (value != settingsMap_[name])
    {
       settingsMap_[name] = value ;
+      unwrittenNames_.insert(name);
       isDirty_ = true;
-      
-      if (!updatePending_)
-         writeSettings() ;
+
+      notifyChanged(name, value);
+      onChanged();
    }
 }
    
@@ -145,18 +244,71 @@ void Settings::endUpdate()
 {
    updatePending_ = false ;
    if (isDirty_)
+      onChanged();
+}
+
+void Settings::onChanged()
+{
+   if (updatePending_)
+      return;
+
+   if (!scheduleWrite_)
+   {
       writeSettings();
+   }
+   else if (!writeScheduled_)
+   {
+      writeScheduled_ = true;
+      scheduleWrite_(boost::bind(&Settings::flush, this));
+   }
+}
+
+void Settings::notifyChanged(const std::string& name, const std::string& value)
+{
+   for (std::vector<ChangeHandler>::const_iterator it = changeHandlers_.begin();
+        it != changeHandlers_.end();
+        ++it)
+   {
+      (*it)(name, value);
+   }
 }
 
 void Settings::writeSettings() 
 {
    isDirty_ = false;
-   Error error = core::writeStringMapToFile(settingsFile_, settingsMap_) ; 
+   unwrittenNames_.clear();
+
+   // replace the file the settings path resolves to (so that a symlinked
+   // settings file stays a symlink)
+   FilePath targetFile = settingsFile_;
+   if (settingsFile_.exists())
+   {
+      Error error = core::system::realPath(settingsFile_, &targetFile);
+      if (error)
+      {
+         LOG_ERROR(error);
+         targetFile = settingsFile_;
+      }
+   }
+
+   // write to a temporary file and then rename it over the settings file
+   // so that readers (including other processes) never see a partial file
+   FilePath tempFile(targetFile.absolutePath() + ".tmp-" +
+                     core::system::generateShortenedUuid());
+   Error error = core::writeStringMapToFile(tempFile, settingsMap_) ;
+   if (!error)
+      error = copyFileMode(targetFile, tempFile);
+   if (!error)
+      error = tempFile.move(targetFile);
    if (error)
-     LOG_ERROR(error);
+   {
+      LOG_ERROR(error);
+      Error removeError = tempFile.removeIfExists();
+      if (removeError)
+         LOG_ERROR(removeError);
+   }
 }
 
-
 }
 }
 
@@ -0,0 +1,138 @@
+/*
+ * SettingsTests.cpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef _WIN32
+
+#include <tests/TestThat.hpp>
+
+#include <core/Settings.hpp>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <boost/bind.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/system/System.hpp>
+
+namespace rstudio {
+namespace core {
+
+namespace {
+
+FilePath testDir()
+{
+   FilePath dir = FilePath("/tmp").complete(
+            "rstudio-settings-" + core::system::generateShortenedUuid());
+   dir.ensureDirectory();
+   return dir;
+}
+
+mode_t fileMode(const FilePath& filePath)
+{
+   struct stat st;
+   if (::stat(filePath.absolutePath().c_str(), &st) == -1)
+      return 0;
+   return st.st_mode & 07777;
+}
+
+void recordChange(const std::string& name,
+                  const std::string& value,
+                  std::map<std::string,std::string>* pChanges)
+{
+   (*pChanges)[name] = value;
+}
+
+} // anonymous namespace
+
+context("Settings")
+{
+   test_that("writes keep the permissions of the settings file")
+   {
+      FilePath dir = testDir();
+      FilePath settingsFile = dir.complete("settings");
+      expect_false(writeStringToFile(settingsFile, "a=\"1\"\n"));
+      ::chmod(settingsFile.absolutePath().c_str(), 0600);
+
+      {
+         Settings settings;
+         expect_false(settings.initialize(settingsFile));
+         settings.set("a", std::string("2"));
+      }
+
+      expect_true(fileMode(settingsFile) == 0600);
+
+      Settings settings;
+      expect_false(settings.initialize(settingsFile));
+      expect_true(settings.get("a") == "2");
+
+      dir.remove();
+   }
+
+   test_that("writes go through symlinked settings files")
+   {
+      FilePath dir = testDir();
+      FilePath targetFile = dir.complete("target");
+      FilePath linkFile = dir.complete("settings");
+      expect_false(writeStringToFile(targetFile, "a=\"1\"\n"));
+      expect_true(::symlink(targetFile.absolutePath().c_str(),
+                            linkFile.absolutePath().c_str()) == 0);
+
+      {
+         Settings settings;
+         expect_false(settings.initialize(linkFile));
+         settings.set("a", std::string("2"));
+      }
+
+      expect_true(linkFile.isSymlink());
+
+      Settings settings;
+      expect_false(settings.initialize(targetFile));
+      expect_true(settings.get("a") == "2");
+
+      dir.remove();
+   }
+
+   test_that("change handlers are notified of values changed by reloading")
+   {
+      FilePath dir = testDir();
+      FilePath settingsFile = dir.complete("settings");
+      expect_false(writeStringToFile(settingsFile, "a=\"1\"\nb=\"1\"\n"));
+
+      Settings settings;
+      expect_false(settings.initialize(settingsFile));
+
+      std::map<std::string,std::string> changes;
+      settings.addChangeHandler(boost::bind(recordChange, _1, _2, &changes));
+
+      // re-reading an unchanged file changes nothing
+      expect_false(settings.initialize(settingsFile));
+      expect_true(changes.empty());
+
+      expect_false(writeStringToFile(settingsFile, "a=\"1\"\nb=\"2\"\n"));
+      expect_false(settings.initialize(settingsFile));
+      expect_true(changes.size() == 1);
+      expect_true(changes["b"] == "2");
+
+      dir.remove();
+   }
+}
+
+} // namespace core
+} // namespace rstudio
+
+#endif // _WIN32
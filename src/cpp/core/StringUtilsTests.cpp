@@ -55,6 +55,23 @@ context("isSubsequence")
       expect_true(trimWhitespace("abc") == "abc");
       expect_true(trimWhitespace("") == "");
    }
+
+   test_that("iconvstr converts between encodings")
+   {
+      std::string latin1;
+      expect_false(iconvstr("caf\xc3\xa9", "UTF-8", "ISO8859-1", false, &latin1));
+      expect_true(latin1 == "caf\xe9");
+
+      std::string utf8;
+      expect_false(iconvstr(latin1, "ISO8859-1", "UTF-8", false, &utf8));
+      expect_true(utf8 == "caf\xc3\xa9");
+
+      // characters which can't be represented are only substituted on request
+      std::string result;
+      expect_true(iconvstr("\xe2\x82\xac", "UTF-8", "ISO8859-1", false, &result));
+      expect_false(iconvstr("a\xe2\x82\xac", "UTF-8", "ISO8859-1", true, &result));
+      expect_true(result.substr(0, 2) == "a?");
+   }
 }
 
 } // end namespace string_utils
@@ -16,11 +16,21 @@
 
 #include <core/Trace.hpp>
 
+#include <csignal>
+#include <deque>
+#include <list>
 #include <map>
 
+#include <boost/cstdint.hpp>
+#include <boost/foreach.hpp>
 #include <boost/utility.hpp>
+#include <boost/thread/tss.hpp>
 
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
 #include <core/Thread.hpp>
+#include <core/json/Json.hpp>
+#include <core/system/System.hpp>
 
 namespace rstudio {
 namespace core {
@@ -30,6 +40,135 @@ namespace {
 
 boost::mutex s_traceMutex ;
 
+// spans kept per thread, and the number of buffers of exited threads kept
+const std::size_t kBufferCapacity = 8192;
+const std::size_t kMaxRetiredBuffers = 32;
+
+// read by every span so it isn't guarded by a mutex (a stale read only
+// means a span is or isn't recorded around the time tracing is switched)
+volatile sig_atomic_t s_enabled = 0;
+
+struct Event
+{
+   const char* category;
+   std::string name;
+   boost::int64_t startMicros;
+   boost::int64_t durationMicros;
+};
+
+struct Buffer : boost::noncopyable
+{
+   explicit Buffer(int threadId) : threadId(threadId), next(0) {}
+
+   void add(const Event& event)
+   {
+      LOCK_MUTEX(mutex)
+      {
+         if (events.size() < kBufferCapacity)
+         {
+            events.push_back(event);
+         }
+         else
+         {
+            // overwrite the oldest event
+            events[next] = event;
+            next = (next + 1) % kBufferCapacity;
+         }
+      }
+      END_LOCK_MUTEX
+   }
+
+   const int threadId;
+   boost::mutex mutex;
+   std::vector<Event> events;
+   std::size_t next;
+};
+
+// buffers are allocated on the heap and never freed so that spans can be
+// recorded during static destruction
+struct Buffers : boost::noncopyable
+{
+   Buffers() : nextThreadId(1) {}
+
+   boost::mutex mutex;
+   std::list<Buffer*> active;
+   std::deque<Buffer*> retired;
+   int nextThreadId;
+};
+
+Buffers& buffers()
+{
+   static Buffers* pBuffers = new Buffers();
+   return *pBuffers;
+}
+
+// keep the spans of exited threads (up to a limit)
+void retireBuffer(Buffer* pBuffer)
+{
+   LOCK_MUTEX(buffers().mutex)
+   {
+      buffers().active.remove(pBuffer);
+      buffers().retired.push_back(pBuffer);
+      if (buffers().retired.size() > kMaxRetiredBuffers)
+      {
+         delete buffers().retired.front();
+         buffers().retired.pop_front();
+      }
+   }
+   END_LOCK_MUTEX
+}
+
+boost::thread_specific_ptr<Buffer> s_pThreadBuffer(retireBuffer);
+
+Buffer* threadBuffer()
+{
+   Buffer* pBuffer = s_pThreadBuffer.get();
+   if (pBuffer == NULL)
+   {
+      LOCK_MUTEX(buffers().mutex)
+      {
+         pBuffer = new Buffer(buffers().nextThreadId++);
+         buffers().active.push_back(pBuffer);
+      }
+      END_LOCK_MUTEX
+
+      if (pBuffer == NULL)
+         return NULL;
+
+      s_pThreadBuffer.reset(pBuffer);
+   }
+   return pBuffer;
+}
+
+boost::int64_t microsSinceEpoch(const boost::posix_time::ptime& time)
+{
+   static const boost::posix_time::ptime epoch(
+                                    boost::gregorian::date(1970, 1, 1));
+   return (time - epoch).total_microseconds();
+}
+
+void appendEvents(Buffer* pBuffer, json::Array* pEvents)
+{
+   static const int pid = static_cast<int>(core::system::currentProcessId());
+
+   LOCK_MUTEX(pBuffer->mutex)
+   {
+      BOOST_FOREACH(const Event& event, pBuffer->events)
+      {
+         json::Object eventJson;
+         eventJson["name"] = event.name;
+         eventJson["cat"] = event.category;
+         eventJson["ph"] = "X";
+         eventJson["ts"] = event.startMicros;
+         eventJson["dur"] = event.durationMicros;
+         eventJson["pid"] = pid;
+         eventJson["tid"] = pBuffer->threadId;
+         pEvents->push_back(eventJson);
+      }
+   }
+   END_LOCK_MUTEX
+}
+
 } // anonymous namespace
 
 
@@ -42,6 +181,111 @@ void add(void* key, const std::string& functionName)
    END_LOCK_MUTEX
 }
 
+void setEnabled(bool enabled)
+{
+   s_enabled = enabled ? 1 : 0;
+}
+
+bool enabled()
+{
+   return s_enabled != 0;
+}
+
+void clear()
+{
+   LOCK_MUTEX(buffers().mutex)
+   {
+      BOOST_FOREACH(Buffer* pBuffer, buffers().active)
+      {
+         LOCK_MUTEX(pBuffer->mutex)
+         {
+            pBuffer->events.clear();
+            pBuffer->next = 0;
+         }
+         END_LOCK_MUTEX
+      }
+
+      BOOST_FOREACH(Buffer* pBuffer, buffers().retired)
+      {
+         delete pBuffer;
+      }
+      buffers().retired.clear();
+   }
+   END_LOCK_MUTEX
+}
+
+void record(const char* category,
+            const std::string& name,
+            const boost::posix_time::ptime& startTime,
+            const boost::posix_time::ptime& endTime)
+{
+   if (!enabled() || startTime.is_not_a_date_time())
+      return;
+
+   Buffer* pBuffer = threadBuffer();
+   if (pBuffer == NULL)
+      return;
+
+   Event event;
+   event.category = category;
+   event.name = name;
+   event.startMicros = microsSinceEpoch(startTime);
+   event.durationMicros = (endTime - startTime).total_microseconds();
+   pBuffer->add(event);
+}
+
+void write(std::ostream& os)
+{
+   json::Array events;
+   LOCK_MUTEX(buffers().mutex)
+   {
+      BOOST_FOREACH(Buffer* pBuffer, buffers().retired)
+      {
+         appendEvents(pBuffer, &events);
+      }
+
+      BOOST_FOREACH(Buffer* pBuffer, buffers().active)
+      {
+         appendEvents(pBuffer, &events);
+      }
+   }
+   END_LOCK_MUTEX
+
+   json::Object trace;
+   trace["traceEvents"] = events;
+   trace["displayTimeUnit"] = "ms";
+   json::write(trace, os);
+}
+
+Error write(const FilePath& filePath)
+{
+   boost::shared_ptr<std::ostream> pStream;
+   Error error = filePath.open_w(&pStream);
+   if (error)
+      return error;
+
+   write(*pStream);
+   pStream->flush();
+   return Success();
+}
+
+Span::~Span()
+{
+   try
+   {
+      if (recording())
+      {
+         record(category_,
+                name_,
+                startTime_,
+                boost::posix_time::microsec_clock::universal_time());
+      }
+   }
+   catch(...)
+   {
+   }
+}
+
 } // namespace trace
 } // namespace core
 } // namespace rstudio
@@ -0,0 +1,358 @@
+/*
+ * TrigramIndex.cpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/TrigramIndex.hpp>
+
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+
+#include <boost/foreach.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/StringUtils.hpp>
+#include <core/system/System.hpp>
+
+namespace rstudio {
+namespace core {
+namespace file_search {
+
+namespace {
+
+// files larger than this aren't indexed
+const uintmax_t kMaxFileBytes = 4 * 1024 * 1024;
+
+// files with a NUL within this many bytes of the start are treated as binary
+// (this must match the check made by FileSearch)
+const std::size_t kBinaryCheckBytes = 8192;
+
+// approximate overhead of each file in the index (beyond its path and
+// trigrams)
+const std::size_t kEntryOverheadBytes = 64;
+
+const char * const kIndexFileHeader = "RSTUDIO-TRIGRAM-INDEX";
+const boost::uint32_t kIndexFileVersion = 1;
+
+// bytes left to read from the stream (sizes read from the index file are
+// checked against this so that a corrupt file can't cause huge allocations)
+boost::uint64_t remainingBytes(std::istream& istr, boost::uint64_t size)
+{
+   std::streamoff pos = istr.tellg();
+   if (pos < 0 || static_cast<boost::uint64_t>(pos) > size)
+      return 0;
+   return size - static_cast<boost::uint64_t>(pos);
+}
+
+inline boost::uint32_t foldCase(unsigned char ch)
+{
+   return (ch >= 'A' && ch <= 'Z') ? (ch - 'A' + 'a') : ch;
+}
+
+// trigrams spanning lines are skipped (searches match within lines)
+void addTrigrams(const char* begin, const char* end, Trigrams* pTrigrams)
+{
+   boost::uint32_t trigram = 0;
+   int length = 0;
+   for (const char* it = begin; it != end; ++it)
+   {
+      if (*it == '\n' || *it == '\r')
+      {
+         length = 0;
+         continue;
+      }
+
+      trigram = ((trigram << 8) | foldCase(*it)) & 0xFFFFFF;
+      if (++length >= 3)
+         pTrigrams->push_back(trigram);
+   }
+
+   std::sort(pTrigrams->begin(), pTrigrams->end());
+   pTrigrams->erase(std::unique(pTrigrams->begin(), pTrigrams->end()),
+                    pTrigrams->end());
+}
+
+template <typename T>
+void writeValue(std::ostream& ostr, const T& value)
+{
+   ostr.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool readValue(std::istream& istr, T* pValue)
+{
+   istr.read(reinterpret_cast<char*>(pValue), sizeof(T));
+   return istr.good();
+}
+
+Error invalidIndexError(const FilePath& filePath,
+                        const ErrorLocation& location)
+{
+   Error error = systemError(boost::system::errc::illegal_byte_sequence,
+                             "Invalid trigram index",
+                             location);
+   error.addProperty("path", filePath);
+   return error;
+}
+
+} // anonymous namespace
+
+bool TrigramIndex::computeTrigrams(const FilePath& filePath,
+                                   Trigrams* pTrigrams)
+{
+   pTrigrams->clear();
+
+   uintmax_t size = filePath.size();
+   if (size > kMaxFileBytes)
+      return false;
+   else if (size == 0)
+      return true;
+
+   boost::iostreams::mapped_file_source file;
+   try
+   {
+      file.open(string_utils::utf8ToSystem(filePath.absolutePath()));
+   }
+   catch(const std::exception&)
+   {
+      return false;
+   }
+
+   const char* begin = file.data();
+   const char* end = begin + file.size();
+
+   // binary files have no trigrams
+   if (std::memchr(begin, 0, std::min(file.size(), kBinaryCheckBytes)))
+      return true;
+
+   pTrigrams->reserve(file.size());
+   addTrigrams(begin, end, pTrigrams);
+
+   // release the excess capacity
+   Trigrams(*pTrigrams).swap(*pTrigrams);
+
+   return true;
+}
+
+std::size_t TrigramIndex::entryBytes(const std::string& path,
+                                     const Entry& entry)
+{
+   return kEntryOverheadBytes +
+          path.size() +
+          (entry.trigrams.size() * sizeof(boost::uint32_t));
+}
+
+bool TrigramIndex::update(const std::string& path,
+                          std::time_t lastWriteTime,
+                          const Trigrams& trigrams)
+{
+   remove(path);
+
+   Entry entry;
+   entry.lastWriteTime = lastWriteTime;
+   entry.trigrams = trigrams;
+
+   std::size_t bytes = entryBytes(path, entry);
+   if (bytes_ + bytes > maxBytes_)
+      return false;
+
+   files_[path] = entry;
+   bytes_ += bytes;
+   return true;
+}
+
+void TrigramIndex::remove(const std::string& path)
+{
+   Files::iterator it = files_.find(path);
+   if (it != files_.end())
+   {
+      bytes_ -= entryBytes(it->first, it->second);
+      files_.erase(it);
+   }
+}
+
+void TrigramIndex::clear()
+{
+   files_.clear();
+   bytes_ = 0;
+}
+
+bool TrigramIndex::contains(const std::string& path) const
+{
+   return files_.find(path) != files_.end();
+}
+
+bool TrigramIndex::isCurrent(const std::string& path,
+                             std::time_t lastWriteTime) const
+{
+   Files::const_iterator it = files_.find(path);
+   return it != files_.end() && it->second.lastWriteTime == lastWriteTime;
+}
+
+std::vector<std::string> TrigramIndex::paths() const
+{
+   std::vector<std::string> paths;
+   paths.reserve(files_.size());
+   BOOST_FOREACH(const Files::value_type& file, files_)
+   {
+      paths.push_back(file.first);
+   }
+   return paths;
+}
+
+void TrigramIndex::excludedFiles(const std::string& literal,
+                                 ExcludedFiles* pExcluded) const
+{
+   Trigrams required;
+   addTrigrams(literal.data(), literal.data() + literal.size(), &required);
+   if (required.empty())
+      return;
+
+   BOOST_FOREACH(const Files::value_type& file, files_)
+   {
+      const Trigrams& trigrams = file.second.trigrams;
+      BOOST_FOREACH(boost::uint32_t trigram, required)
+      {
+         if (!std::binary_search(trigrams.begin(), trigrams.end(), trigram))
+         {
+            (*pExcluded)[file.first] = file.second.lastWriteTime;
+            break;
+         }
+      }
+   }
+}
+
+Error TrigramIndex::write(const FilePath& filePath) const
+{
+   // write to a temporary file and then move it into place so that an
+   // interrupted write doesn't leave a truncated index behind (the name is
+   // unique so that concurrent writes don't collide)
+   FilePath tempPath(filePath.absolutePath() + ".tmp-" +
+                     core::system::generateShortenedUuid());
+   boost::shared_ptr<std::ostream> pStream;
+   Error error = tempPath.open_w(&pStream);
+   if (error)
+      return error;
+
+   std::ostream& ostr = *pStream;
+   ostr.write(kIndexFileHeader, std::strlen(kIndexFileHeader));
+   writeValue(ostr, kIndexFileVersion);
+   writeValue(ostr, static_cast<boost::uint64_t>(files_.size()));
+
+   BOOST_FOREACH(const Files::value_type& file, files_)
+   {
+      writeValue(ostr, static_cast<boost::uint32_t>(file.first.size()));
+      ostr.write(file.first.data(), file.first.size());
+      writeValue(ostr, static_cast<boost::int64_t>(file.second.lastWriteTime));
+
+      const Trigrams& trigrams = file.second.trigrams;
+      writeValue(ostr, static_cast<boost::uint32_t>(trigrams.size()));
+      if (!trigrams.empty())
+      {
+         ostr.write(reinterpret_cast<const char*>(&trigrams[0]),
+                    trigrams.size() * sizeof(boost::uint32_t));
+      }
+   }
+
+   ostr.flush();
+   if (!ostr.good())
+   {
+      pStream.reset();
+      tempPath.removeIfExists();
+      error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+      error.addProperty("path", filePath);
+      return error;
+   }
+
+   pStream.reset();
+   return tempPath.move(filePath);
+}
+
+Error TrigramIndex::read(const FilePath& filePath)
+{
+   clear();
+
+   boost::shared_ptr<std::istream> pStream;
+   Error error = filePath.open_r(&pStream);
+   if (error)
+      return error;
+
+   std::istream& istr = *pStream;
+   boost::uint64_t fileSize = filePath.size();
+
+   std::vector<char> header(std::strlen(kIndexFileHeader));
+   istr.read(&header[0], header.size());
+   boost::uint32_t version = 0;
+   boost::uint64_t count = 0;
+   if (!istr.good() ||
+       std::string(header.begin(), header.end()) != kIndexFileHeader ||
+       !readValue(istr, &version) || version != kIndexFileVersion ||
+       !readValue(istr, &count))
+   {
+      return invalidIndexError(filePath, ERROR_LOCATION);
+   }
+
+   for (boost::uint64_t i = 0; i < count; i++)
+   {
+      boost::uint32_t pathSize = 0;
+      if (!readValue(istr, &pathSize) ||
+          pathSize > remainingBytes(istr, fileSize))
+      {
+         break;
+      }
+      std::string path(pathSize, '\0');
+      if (pathSize > 0)
+         istr.read(&path[0], pathSize);
+
+      boost::int64_t lastWriteTime = 0;
+      boost::uint32_t trigramCount = 0;
+      if (!readValue(istr, &lastWriteTime) ||
+          !readValue(istr, &trigramCount) ||
+          trigramCount > kMaxFileBytes ||
+          static_cast<boost::uint64_t>(trigramCount) * sizeof(boost::uint32_t) >
+                                          remainingBytes(istr, fileSize))
+      {
+         break;
+      }
+
+      Trigrams trigrams(trigramCount);
+      if (trigramCount > 0)
+      {
+         istr.read(reinterpret_cast<char*>(&trigrams[0]),
+                   trigramCount * sizeof(boost::uint32_t));
+         if (!istr.good())
+            break;
+      }
+
+      // stop once the budget is used (the remaining files will be indexed
+      // again if there is room once changes are processed)
+      if (!update(path, static_cast<std::time_t>(lastWriteTime), trigrams))
+         return Success();
+
+      if (i + 1 == count)
+         return Success();
+   }
+
+   if (count == 0)
+      return Success();
+
+   clear();
+   return invalidIndexError(filePath, ERROR_LOCATION);
+}
+
+} // namespace file_search
+} // namespace core
+} // namespace rstudio
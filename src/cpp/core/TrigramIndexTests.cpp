@@ -0,0 +1,128 @@
+/*
+ * TrigramIndexTests.cpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <tests/TestThat.hpp>
+
+#include <core/TrigramIndex.hpp>
+
+#include <cstring>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+
+namespace rstudio {
+namespace core {
+namespace file_search {
+
+context("TrigramIndex")
+{
+   test_that("files without the literal's trigrams are excluded")
+   {
+      FilePath dirPath;
+      FilePath::tempFilePath(&dirPath);
+      dirPath.ensureDirectory();
+
+      FilePath aPath = dirPath.childPath("a.R");
+      FilePath bPath = dirPath.childPath("b.R");
+      writeStringToFile(aPath, "library(Rcpp)\nx <- 1\n");
+      writeStringToFile(bPath, "y <- 2\nLIBRARY\n");
+
+      TrigramIndex index(1024 * 1024);
+      Trigrams trigrams;
+      expect_true(TrigramIndex::computeTrigrams(aPath, &trigrams));
+      expect_true(index.update(aPath.absolutePath(), 1, trigrams));
+      expect_true(TrigramIndex::computeTrigrams(bPath, &trigrams));
+      expect_true(index.update(bPath.absolutePath(), 2, trigrams));
+
+      ExcludedFiles excluded;
+      index.excludedFiles("rcpp", &excluded);
+      expect_true(excluded.size() == 1);
+      expect_true(excluded.count(bPath.absolutePath()) == 1);
+
+      // trigrams don't span lines
+      excluded.clear();
+      index.excludedFiles(")x", &excluded);
+      expect_true(excluded.empty());
+      index.excludedFiles("p)x", &excluded);
+      expect_true(excluded.size() == 2);
+
+      // case is folded
+      excluded.clear();
+      index.excludedFiles("library", &excluded);
+      expect_true(excluded.empty());
+
+      // round trip through a file
+      FilePath indexPath = dirPath.childPath("index");
+      expect_false(index.write(indexPath));
+      TrigramIndex read(1024 * 1024);
+      expect_false(read.read(indexPath));
+      expect_true(read.fileCount() == 2);
+      expect_true(read.bytes() == index.bytes());
+      excluded.clear();
+      read.excludedFiles("rcpp", &excluded);
+      expect_true(excluded.size() == 1);
+      expect_true(excluded[bPath.absolutePath()] == 2);
+
+      dirPath.remove();
+   }
+
+   test_that("files beyond the size budget aren't indexed")
+   {
+      TrigramIndex index(200);
+      Trigrams trigrams(10, 1);
+      expect_true(index.update("a", 0, trigrams));
+      expect_false(index.update("b", 0, trigrams));
+      expect_false(index.contains("b"));
+      index.remove("a");
+      expect_true(index.bytes() == 0);
+      expect_true(index.update("b", 0, trigrams));
+   }
+
+   test_that("sizes in corrupt index files aren't trusted")
+   {
+      FilePath indexPath;
+      FilePath::tempFilePath(&indexPath);
+
+      TrigramIndex index(1024 * 1024);
+      expect_true(index.update("/a", 1, Trigrams(10, 1)));
+      expect_false(index.write(indexPath));
+
+      std::string contents;
+      expect_false(readStringFromFile(indexPath, &contents));
+
+      // a path size (following the header, version and count) beyond the
+      // end of the file
+      std::string corrupt = contents;
+      std::size_t offset = std::strlen("RSTUDIO-TRIGRAM-INDEX") + 4 + 8;
+      corrupt.replace(offset, 4, std::string(4, '\xFF'));
+      expect_false(writeStringToFile(indexPath, corrupt));
+      TrigramIndex read(1024 * 1024);
+      expect_true(read.read(indexPath));
+      expect_true(read.fileCount() == 0);
+
+      // a truncated list of trigrams
+      corrupt = contents.substr(0, contents.size() - 4);
+      expect_false(writeStringToFile(indexPath, corrupt));
+      expect_true(read.read(indexPath));
+      expect_true(read.fileCount() == 0);
+
+      indexPath.remove();
+   }
+}
+
+} // namespace file_search
+} // namespace core
+} // namespace rstudio
@@ -15,8 +15,13 @@
 
 #include <core/StringUtils.hpp>
 
+#include <cstdlib>
+#include <cstring>
+
 #include <windows.h>
 
+#include <boost/algorithm/string/predicate.hpp>
+
 #include <core/Log.hpp>
 #include <core/Error.hpp>
 
@@ -24,6 +29,109 @@ namespace rstudio {
 namespace core {
 namespace string_utils {
 
+namespace {
+
+// map the iconv names of the encodings used by dictionaries (and R) onto
+// windows code pages (returns 0 if there is no corresponding code page)
+UINT codePageForEncoding(const std::string& encoding)
+{
+   using namespace boost::algorithm;
+
+   if (encoding.empty() ||
+       iequals(encoding, "UTF-8") || iequals(encoding, "UTF8"))
+      return CP_UTF8;
+
+   if (istarts_with(encoding, "ISO8859-") || istarts_with(encoding, "ISO-8859-"))
+   {
+      int part = std::atoi(encoding.c_str() + encoding.find_last_of('-') + 1);
+      return part > 0 ? 28590 + part : 0;
+   }
+
+   if (iequals(encoding, "KOI8-R"))
+      return 20866;
+   if (iequals(encoding, "KOI8-U"))
+      return 21866;
+   if (istarts_with(encoding, "TIS620"))
+      return 874;
+
+   const char* prefixes[] = { "microsoft-cp", "windows-", "cp" };
+   for (std::size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++)
+   {
+      if (istarts_with(encoding, prefixes[i]))
+         return std::atoi(encoding.c_str() + std::strlen(prefixes[i]));
+   }
+
+   return 0;
+}
+
+} // anonymous namespace
+
+core::Error iconvstr(const std::string& value,
+                     const std::string& from,
+                     const std::string& to,
+                     bool allowSubstitution,
+                     std::string* pResult)
+{
+   UINT fromCodePage = codePageForEncoding(from);
+   UINT toCodePage = codePageForEncoding(to);
+   if (fromCodePage == 0 || toCodePage == 0)
+   {
+      Error error = systemError(boost::system::errc::invalid_argument,
+                                ERROR_LOCATION);
+      error.addProperty("from", from);
+      error.addProperty("to", to);
+      return error;
+   }
+
+   if (fromCodePage == toCodePage || value.empty())
+   {
+      *pResult = value;
+      return Success();
+   }
+
+   // convert to utf-16 (invalid input becomes U+FFFD unless we are strict)
+   DWORD toWideFlags = allowSubstitution ? 0 : MB_ERR_INVALID_CHARS;
+   int chars = ::MultiByteToWideChar(fromCodePage, toWideFlags,
+                                     value.data(), value.size(),
+                                     NULL, 0);
+   if (chars == 0)
+      return systemError(::GetLastError(), ERROR_LOCATION);
+
+   std::vector<wchar_t> wide(chars, 0);
+   ::MultiByteToWideChar(fromCodePage, toWideFlags,
+                         value.data(), value.size(),
+                         &(wide[0]), wide.size());
+
+   // then to the target code page (unconvertible characters become '?'; the
+   // utf-8 code page doesn't support reporting substitutions)
+   BOOL usedDefaultChar = FALSE;
+   LPBOOL pUsedDefaultChar = toCodePage == CP_UTF8 ? NULL : &usedDefaultChar;
+   LPCSTR defaultChar = toCodePage == CP_UTF8 ? NULL : "?";
+   int bytes = ::WideCharToMultiByte(toCodePage, 0,
+                                     &(wide[0]), wide.size(),
+                                     NULL, 0, defaultChar, pUsedDefaultChar);
+   if (bytes == 0)
+      return systemError(::GetLastError(), ERROR_LOCATION);
+
+   std::vector<char> result(bytes, 0);
+   ::WideCharToMultiByte(toCodePage, 0,
+                         &(wide[0]), wide.size(),
+                         &(result[0]), result.size(),
+                         defaultChar, pUsedDefaultChar);
+
+   if (usedDefaultChar && !allowSubstitution)
+   {
+      Error error = systemError(boost::system::errc::illegal_byte_sequence,
+                                ERROR_LOCATION);
+      error.addProperty("str", value);
+      error.addProperty("len", value.length());
+      return error;
+   }
+
+   *pResult = std::string(result.begin(), result.end());
+   return Success();
+}
+
 std::string wideToUtf8(const std::wstring& value)
 {
    if (value.size() == 0)
@@ -0,0 +1,288 @@
+/*
+ * WorkerPool.cpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/WorkerPool.hpp>
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/Thread.hpp>
+
+namespace rstudio {
+namespace core {
+
+namespace detail {
+
+struct WorkState
+{
+   WorkState() : cancelled(false) {}
+
+   boost::mutex mutex;
+   bool cancelled;
+};
+
+} // namespace detail
+
+namespace {
+
+// the state of the work running on each pool thread (not owned, so the
+// cleanup function does nothing)
+void noCleanup(detail::WorkState*)
+{
+}
+
+boost::thread_specific_ptr<detail::WorkState>& currentWork()
+{
+   static boost::thread_specific_ptr<detail::WorkState>* pCurrent =
+         new boost::thread_specific_ptr<detail::WorkState>(noCleanup);
+   return *pCurrent;
+}
+
+bool isCancelled(detail::WorkState* pState)
+{
+   LOCK_MUTEX(pState->mutex)
+   {
+      return pState->cancelled;
+   }
+   END_LOCK_MUTEX
+
+   return false;
+}
+
+} // anonymous namespace
+
+void WorkHandle::cancel() const
+{
+   if (!pState_)
+      return;
+
+   LOCK_MUTEX(pState_->mutex)
+   {
+      pState_->cancelled = true;
+   }
+   END_LOCK_MUTEX
+}
+
+bool WorkHandle::cancelled() const
+{
+   return pState_ && isCancelled(pState_.get());
+}
+
+WorkerPool::WorkerPool(std::size_t threads)
+   : maxThreads_(std::max(threads, std::size_t(1))),
+     threadCount_(0),
+     idleThreads_(0),
+     wakeups_(0),
+     sequence_(0),
+     stopped_(false)
+{
+}
+
+WorkerPool::~WorkerPool()
+{
+   try
+   {
+      stop();
+      threads_.join_all();
+   }
+   catch(...)
+   {
+   }
+}
+
+WorkHandle WorkerPool::enque(const boost::function<void()>& work,
+                             WorkPriority priority)
+{
+   boost::shared_ptr<detail::WorkState> pState(new detail::WorkState());
+
+   bool runHere = false;
+   LOCK_MUTEX(mutex_)
+   {
+      if (stopped_)
+      {
+         pState->cancelled = true;
+         return WorkHandle(pState);
+      }
+
+      Item item;
+      item.priority = priority;
+      item.sequence = sequence_++;
+      item.pState = pState;
+      item.work = work;
+      queue_.push(item);
+
+      // hand the work to an idle thread if there is one (it is no longer
+      // counted as idle from here so that a burst of work isn't all
+      // promised to the same thread)
+      if (idleThreads_ > 0)
+      {
+         idleThreads_--;
+         wakeups_++;
+      }
+
+      // otherwise start another thread. threads are started on demand (so
+      // a pool which is never used doesn't cost anything)
+      else if (threadCount_ < maxThreads_)
+      {
+         try
+         {
+            threads_.create_thread(boost::bind(&WorkerPool::run, this));
+            threadCount_++;
+         }
+         catch(const boost::thread_resource_error& e)
+         {
+            LOG_ERROR(Error(boost::thread_error::ec_from_exception(e),
+                            ERROR_LOCATION));
+
+            // the work will still be executed by the existing threads (if
+            // there are none it is executed here rather than waiting)
+            runHere = (threadCount_ == 0);
+         }
+      }
+   }
+   END_LOCK_MUTEX
+
+   if (runHere)
+      runQueued();
+   else
+      queueCondition_.notify_one();
+
+   return WorkHandle(pState);
+}
+
+std::size_t WorkerPool::pending()
+{
+   LOCK_MUTEX(mutex_)
+   {
+      return queue_.size();
+   }
+   END_LOCK_MUTEX
+
+   return 0;
+}
+
+void WorkerPool::stop()
+{
+   LOCK_MUTEX(mutex_)
+   {
+      stopped_ = true;
+      while (!queue_.empty())
+      {
+         WorkHandle(queue_.top().pState).cancel();
+         queue_.pop();
+      }
+   }
+   END_LOCK_MUTEX
+
+   queueCondition_.notify_all();
+}
+
+bool WorkerPool::cancelled()
+{
+   detail::WorkState* pState = currentWork().get();
+   return pState != NULL && isCancelled(pState);
+}
+
+bool WorkerPool::nextItem(boost::unique_lock<boost::mutex>& lock,
+                          bool wait,
+                          Item* pItem)
+{
+   while (true)
+   {
+      if (stopped_)
+         return false;
+
+      if (!queue_.empty())
+      {
+         *pItem = queue_.top();
+         queue_.pop();
+         return true;
+      }
+
+      if (!wait)
+         return false;
+
+      // wait until work is handed to us (enque takes us off the idle count
+      // when it does). the work may have been taken by a thread finishing
+      // other work by the time we run, in which case we wait again
+      idleThreads_++;
+      while (wakeups_ == 0 && !stopped_)
+         queueCondition_.wait(lock);
+      if (wakeups_ > 0)
+         wakeups_--;
+   }
+}
+
+void WorkerPool::execute(const Item& item)
+{
+   if (isCancelled(item.pState.get()))
+      return;
+
+   currentWork().reset(item.pState.get());
+   try
+   {
+      item.work();
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+   currentWork().reset();
+}
+
+void WorkerPool::run()
+{
+   try
+   {
+      while (true)
+      {
+         Item item;
+         {
+            boost::unique_lock<boost::mutex> lock(mutex_);
+            if (!nextItem(lock, true, &item))
+               return;
+         }
+
+         execute(item);
+      }
+   }
+   catch(const boost::thread_interrupted&)
+   {
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+}
+
+void WorkerPool::runQueued()
+{
+   try
+   {
+      while (true)
+      {
+         Item item;
+         {
+            boost::unique_lock<boost::mutex> lock(mutex_);
+            if (!nextItem(lock, false, &item))
+               return;
+         }
+
+         execute(item);
+      }
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+}
+
+} // namespace core
+} // namespace rstudio
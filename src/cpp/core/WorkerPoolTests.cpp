@@ -0,0 +1,185 @@
+/*
+ * WorkerPoolTests.cpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <tests/TestThat.hpp>
+
+#include <core/WorkerPool.hpp>
+
+#include <vector>
+
+#include <boost/bind.hpp>
+
+#include <core/Thread.hpp>
+
+namespace rstudio {
+namespace core {
+
+namespace {
+
+boost::mutex s_mutex;
+
+void increment(int* pCount)
+{
+   LOCK_MUTEX(s_mutex)
+   {
+      (*pCount)++;
+   }
+   END_LOCK_MUTEX
+}
+
+void record(std::vector<int>* pOrder, int value)
+{
+   LOCK_MUTEX(s_mutex)
+   {
+      pOrder->push_back(value);
+   }
+   END_LOCK_MUTEX
+}
+
+void block(boost::mutex* pGate)
+{
+   boost::lock_guard<boost::mutex> lock(*pGate);
+}
+
+void incrementThenBlock(int* pCount, boost::mutex* pGate)
+{
+   increment(pCount);
+   block(pGate);
+}
+
+// wait (up to a limit) for the count to reach the expected value
+bool waitForCount(int* pCount, int expected)
+{
+   for (int i = 0; i < 5000; i++)
+   {
+      {
+         boost::lock_guard<boost::mutex> lock(s_mutex);
+         if (*pCount == expected)
+            return true;
+      }
+      boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+   }
+   return false;
+}
+
+} // anonymous namespace
+
+context("WorkerPool")
+{
+   test_that("all queued work is executed")
+   {
+      int count = 0;
+      {
+         WorkerPool pool(4);
+         for (int i = 0; i < 1000; i++)
+            pool.enque(boost::bind(increment, &count));
+
+         while (pool.pending() > 0)
+            boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+      }
+      expect_true(count == 1000);
+   }
+
+   test_that("work is executed in priority order")
+   {
+      std::vector<int> order;
+      boost::mutex gate;
+      {
+         WorkerPool pool(1);
+
+         // hold the only thread so the remaining work queues up
+         gate.lock();
+         pool.enque(boost::bind(block, &gate));
+         while (pool.pending() > 0)
+            boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+
+         pool.enque(boost::bind(record, &order, 1), WorkPriorityLow);
+         pool.enque(boost::bind(record, &order, 2), WorkPriorityNormal);
+         pool.enque(boost::bind(record, &order, 3), WorkPriorityHigh);
+         pool.enque(boost::bind(record, &order, 4), WorkPriorityNormal);
+         gate.unlock();
+
+         while (pool.pending() > 0)
+            boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+      }
+
+      expect_true(order.size() == 4);
+      expect_true(order[0] == 3);
+      expect_true(order[1] == 2);
+      expect_true(order[2] == 4);
+      expect_true(order[3] == 1);
+   }
+
+   test_that("a burst of work is spread over idle and new threads")
+   {
+      int count = 0;
+      boost::mutex gate;
+      {
+         WorkerPool pool(4);
+
+         // leave one thread idle
+         pool.enque(boost::bind(increment, &count));
+         expect_true(waitForCount(&count, 1));
+         boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+
+         // all of the work can only start if each item gets its own thread
+         gate.lock();
+         for (int i = 0; i < 4; i++)
+            pool.enque(boost::bind(incrementThenBlock, &count, &gate));
+         expect_true(waitForCount(&count, 5));
+         gate.unlock();
+      }
+   }
+
+   test_that("cancelled work is not executed")
+   {
+      int cancelledCount = 0;
+      std::vector<int> order;
+      boost::mutex gate;
+      {
+         WorkerPool pool(1);
+
+         // hold the only thread so the work queues up behind it
+         gate.lock();
+         pool.enque(boost::bind(block, &gate));
+         while (pool.pending() > 0)
+            boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+
+         WorkHandle handle = pool.enque(boost::bind(increment,
+                                                    &cancelledCount));
+         pool.enque(boost::bind(record, &order, 1));
+         handle.cancel();
+         expect_true(handle.cancelled());
+         gate.unlock();
+
+         // the work queued after the cancelled work runs once the pool
+         // has passed over it (and before the pool is destroyed, which
+         // would discard any queued work anyway)
+         while (true)
+         {
+            boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+            boost::lock_guard<boost::mutex> lock(s_mutex);
+            if (!order.empty())
+               break;
+         }
+
+         boost::lock_guard<boost::mutex> lock(s_mutex);
+         expect_true(cancelledCount == 0);
+      }
+   }
+}
+
+} // namespace core
+} // namespace rstudio
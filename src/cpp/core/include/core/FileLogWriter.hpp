@@ -16,12 +16,22 @@
 #ifndef FILE_LOG_WRITER_HPP
 #define FILE_LOG_WRITER_HPP
 
+#include <boost/shared_ptr.hpp>
+
 #include <core/FilePath.hpp>
 #include <core/LogWriter.hpp>
 
 namespace rstudio {
 namespace core {
 
+// log writer which appends to a file in the specified directory. entries
+// are queued by the logging thread and written in batches by a background
+// thread (so logging never blocks on file i/o). repeated messages are
+// collapsed into a single entry and messages logged faster than the rate
+// limit are dropped (with the number dropped noted in the log). queued
+// entries are written when the process exits or aborts (see flushAll) but
+// are lost if it crashes before the writer thread gets to them. setting
+// RSTUDIO_LOG_FORMAT=json writes entries as json lines rather than text
 class FileLogWriter : public LogWriter
 {
 public:
@@ -36,14 +46,22 @@ public:
                      core::system::LogLevel level,
                      const std::string& message);
 
+    // write all queued entries (waits until they have been written)
+    void flush();
+
+    // write the queued entries of all writers (for fatal paths which are
+    // about to take the process down)
+    static void flushAll();
 
 private:
-    bool rotateLogFile();
+    void run();
+    void drain(bool noteAll);
 
     std::string programIdentity_;
     int logLevel_;
-    FilePath logFile_;
-    FilePath rotatedLogFile_;
+
+    struct Impl;
+    boost::shared_ptr<Impl> pImpl_;
 };
 
 } // namespace core
@@ -0,0 +1,158 @@
+/*
+ * FileSearch.hpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_FILE_SEARCH_HPP
+#define CORE_FILE_SEARCH_HPP
+
+#include <ctime>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include <boost/regex.hpp>
+#include <boost/utility.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <core/BoostThread.hpp>
+#include <core/FilePath.hpp>
+
+namespace rstudio {
+namespace core {
+
+class Error;
+class WorkerPool;
+
+namespace file_search {
+
+// files (by absolute path) known not to contain a match, along with their
+// write time at the time this was determined
+typedef boost::unordered_map<std::string, std::time_t> ExcludedFiles;
+
+struct SearchOptions
+{
+   SearchOptions()
+      : asRegex(false), ignoreCase(false), maxMatches(1000), threads(2)
+   {
+   }
+
+   // text to search for (in the encoding of the files being searched).
+   // regular expressions use the basic syntax accepted by grep (including
+   // the GNU extensions such as \| and \w). case is ignored according to
+   // the locale of the environment
+   std::string pattern;
+   bool asRegex;
+   bool ignoreCase;
+
+   // wildcard patterns for the names of the files to search (all files are
+   // searched if there are none)
+   std::vector<std::string> filePatterns;
+
+   // directories which aren't searched (e.g. ".git" or "packrat/lib"). these
+   // are compared with the trailing components of each directory's path
+   std::vector<std::string> excludeDirectories;
+
+   // files which are skipped (unless they have been written since)
+   boost::shared_ptr<const ExcludedFiles> pExcludedFiles;
+
+   // the search stops once this many matching lines have been found
+   std::size_t maxMatches;
+
+   std::size_t threads;
+};
+
+struct LineMatch
+{
+   LineMatch() : line(0) {}
+
+   FilePath file;
+   int line;
+
+   // contents of the line (in the encoding of the file) along with the
+   // byte offsets of the matches within it
+   std::string contents;
+   std::vector<std::pair<std::size_t, std::size_t> > matches;
+};
+
+// searches the files within a directory (on background threads). binary
+// files are skipped, as are symlinks and the excluded directories (which
+// aren't walked at all). files are memory mapped and checked for the
+// literal text any match must contain before the regex is applied
+class FileSearch : boost::noncopyable
+{
+public:
+   FileSearch(const FilePath& rootPath, const SearchOptions& options);
+
+   // stops the search and waits for the threads to exit
+   virtual ~FileSearch();
+
+   // returns an error if the pattern isn't a valid regex
+   Error start();
+
+   // stop searching (matches which have already been found can still be
+   // taken)
+   void stop();
+
+   // move the matches found since the last call into pMatches. returns
+   // false once the search has completed and all matches have been taken
+   bool takeMatches(std::vector<LineMatch>* pMatches);
+
+   // literal text which must appear in any match of the pattern (empty if
+   // there is no such text, e.g. for patterns with alternatives)
+   static std::string requiredLiteral(const std::string& pattern,
+                                      bool asRegex,
+                                      bool ignoreCase);
+
+private:
+   void searchDirectory(const FilePath& dirPath);
+   void searchFile(const FilePath& filePath,
+                   std::vector<LineMatch>* pMatches);
+   void matchLine(const FilePath& filePath,
+                  int line,
+                  const char* begin,
+                  const char* end,
+                  std::vector<LineMatch>* pMatches);
+   const char* findLiteral(const char* begin, const char* end) const;
+
+   bool isExcludedDirectory(const FilePath& dirPath) const;
+   bool isIncludedFile(const FilePath& filePath) const;
+   bool isExcludedFile(const FilePath& filePath) const;
+
+   bool enque(const FilePath& dirPath);
+   void addMatches(std::vector<LineMatch>* pMatches);
+   bool stopped();
+
+private:
+   FilePath rootPath_;
+   SearchOptions options_;
+   boost::regex regex_;
+   std::string literal_;
+   std::vector<boost::regex> filePatterns_;
+
+   boost::scoped_ptr<WorkerPool> pPool_;
+
+   boost::mutex mutex_;
+   std::vector<LineMatch> matches_;
+   std::size_t matchCount_;
+   std::size_t pendingDirectories_;
+   bool stopped_;
+};
+
+} // namespace file_search
+} // namespace core
+} // namespace rstudio
+
+#endif // CORE_FILE_SEARCH_HPP
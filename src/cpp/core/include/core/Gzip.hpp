@@ -0,0 +1,54 @@
+/*
+ * Gzip.hpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_GZIP_HPP
+#define CORE_GZIP_HPP
+
+#include <cstddef>
+
+#include <boost/function.hpp>
+
+namespace rstudio {
+namespace core {
+
+class Error;
+class FilePath;
+
+namespace gzip {
+
+// compress a file in place using multiple threads. the file is split into
+// blocks which are compressed concurrently and written as consecutive gzip
+// members (RFC 1952 permits this and gunzip, zlib and R's gzfile all read
+// such files transparently). a thread count of 0 uses one thread per core
+Error compressFile(const FilePath& filePath,
+                   std::size_t threads = 0,
+                   std::size_t blockSize = 4 * 1024 * 1024);
+
+// compress the output of writeFunction as it is written (rather than writing
+// it uncompressed and then compressing it). writeFunction is passed the path
+// of a pipe to write its output to, which is compressed as above. the result
+// replaces targetPath only if both writing and compression succeed
+Error compressOutput(
+            const boost::function<Error(const FilePath&)>& writeFunction,
+            const FilePath& targetPath,
+            std::size_t threads = 0,
+            std::size_t blockSize = 4 * 1024 * 1024);
+
+} // namespace gzip
+} // namespace core
+} // namespace rstudio
+
+
+#endif // CORE_GZIP_HPP
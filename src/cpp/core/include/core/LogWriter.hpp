@@ -16,6 +16,8 @@
 #ifndef LOG_WRITER_HPP
 #define LOG_WRITER_HPP
 
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
 #include <core/system/System.hpp>
 
 namespace rstudio {
@@ -42,6 +44,12 @@ protected:
    std::string formatLogEntry(const std::string& programIdentify,
                               const std::string& message,
                               bool escapeNewlines = true);
+
+   // format an entry which was logged at the specified (utc) time
+   std::string formatLogEntry(const boost::posix_time::ptime& time,
+                              const std::string& programIdentify,
+                              const std::string& message,
+                              bool escapeNewlines = true);
 };
 
 namespace system {
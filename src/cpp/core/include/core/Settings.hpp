@@ -18,6 +18,8 @@
 
 #include <string>
 #include <map>
+#include <set>
+#include <vector>
 
 #include <boost/utility.hpp>
 #include <boost/function.hpp>
@@ -36,8 +38,25 @@ public:
    virtual ~Settings() ;
    // COPYING: boost::noncopyable
 
+   // (re-)read the settings file. when re-reading the same file, changes
+   // which haven't been written yet take precedence over the file contents
    Error initialize(const FilePath& filePath) ;
 
+   // defer writes so that changes made within a short window are coalesced
+   // into a single write. the passed function is called with the function
+   // that performs the write when the first change is made after a write
+   typedef boost::function<void(const boost::function<void()>&)>
+                                                      ScheduleWriteFunction;
+   void setWriteBehind(const ScheduleWriteFunction& scheduleWrite);
+
+   // write any pending changes immediately
+   void flush();
+
+   // notification of changed values (from either set or re-reading the file)
+   typedef boost::function<void(const std::string&, const std::string&)>
+                                                      ChangeHandler;
+   void addChangeHandler(const ChangeHandler& handler);
+
 public:
    void set(const std::string& name, const std::string& value);
    void set(const std::string& name, int value);
@@ -58,13 +77,19 @@ public:
    void endUpdate();
 
 private:
+   void onChanged();
+   void notifyChanged(const std::string& name, const std::string& value);
    void writeSettings() ;
 
 private:
    FilePath settingsFile_ ;
    std::map<std::string, std::string> settingsMap_ ;
+   std::set<std::string> unwrittenNames_;
    bool updatePending_ ;
    bool isDirty_;
+   ScheduleWriteFunction scheduleWrite_;
+   bool writeScheduled_;
+   std::vector<ChangeHandler> changeHandlers_;
 };
 
 }
@@ -157,6 +157,16 @@ Error utf8Advance(InputIterator begin,
    *pResult = begin;
    return Success();
 }
+
+// convert between encodings (without going through R, so this can be used
+// from any thread). characters which can't be converted are replaced with
+// '?' if allowSubstitution is true (otherwise they are an error)
+core::Error iconvstr(const std::string& value,
+                     const std::string& from,
+                     const std::string& to,
+                     bool allowSubstitution,
+                     std::string* pResult);
+
 std::string wideToUtf8(const std::wstring& value);
 std::wstring utf8ToWide(const std::string& value,
                         const std::string& context = std::string());
@@ -19,14 +19,73 @@
 #include <iosfwd>
 #include <string>
 
+#include <boost/utility.hpp>
 #include <boost/current_function.hpp>
+#include <boost/preprocessor/cat.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 namespace rstudio {
 namespace core { 
+
+class Error;
+class FilePath;
+
 namespace trace {
 
 void add(void* key, const std::string& functionName);
 
+// spans are recorded (when tracing is enabled) into a fixed size ring buffer
+// for each thread, so only the most recent spans of each thread are kept.
+// tracing can be enabled and disabled at any time
+void setEnabled(bool enabled);
+bool enabled();
+
+// discard all recorded spans
+void clear();
+
+// record a span which has already completed (for operations which start
+// and end in different scopes, e.g. asynchronous requests)
+void record(const char* category,
+            const std::string& name,
+            const boost::posix_time::ptime& startTime,
+            const boost::posix_time::ptime& endTime);
+
+// write the recorded spans in the chrome trace event format (this can be
+// loaded by chrome://tracing and the perfetto ui)
+void write(std::ostream& os);
+Error write(const FilePath& filePath);
+
+// names of spans are truncated to a reasonable length
+inline std::string spanName(const std::string& name)
+{
+   return name.substr(0, 128);
+}
+
+// record a span covering the lifetime of the object. the category must
+// be a string literal
+class Span : boost::noncopyable
+{
+public:
+   Span(const char* category, const std::string& name)
+      : category_(category)
+   {
+      if (enabled())
+      {
+         name_ = spanName(name);
+         startTime_ = boost::posix_time::microsec_clock::universal_time();
+      }
+   }
+
+   ~Span();
+
+   bool recording() const { return !startTime_.is_not_a_date_time(); }
+
+private:
+   const char* category_;
+   std::string name_;
+   boost::posix_time::ptime startTime_;
+};
+
 } // namespace trace
 } // namespace core 
 } // namespace rstudio
@@ -34,5 +93,14 @@ void add(void* key, const std::string& functionName);
 #define TRACE_CURRENT_METHOD \
    core::trace::add(this, BOOST_CURRENT_FUNCTION);
 
-#endif // CORE_PERFORMANCE_TIMER_HPP
+// the name expression is only evaluated (and copied) when tracing is enabled
+#define TRACE_SCOPE(category, name) \
+   ::rstudio::core::trace::Span BOOST_PP_CAT(traceSpan, __LINE__)( \
+      category, \
+      ::rstudio::core::trace::enabled() ? \
+         ::rstudio::core::trace::spanName(name) : std::string());
+
+#define TRACE_FUNCTION TRACE_SCOPE("function", BOOST_CURRENT_FUNCTION)
+
+#endif // CORE_TRACE_HPP
 
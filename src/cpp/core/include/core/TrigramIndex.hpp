@@ -0,0 +1,101 @@
+/*
+ * TrigramIndex.hpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_TRIGRAM_INDEX_HPP
+#define CORE_TRIGRAM_INDEX_HPP
+
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <core/FileSearch.hpp>
+
+namespace rstudio {
+namespace core {
+
+class Error;
+class FilePath;
+
+namespace file_search {
+
+typedef std::vector<boost::uint32_t> Trigrams;
+
+// index of the trigrams (sequences of three bytes, with ascii characters
+// folded to lower case) contained in each of a set of files. this is used
+// to find the files which can't contain the literal text required by a
+// search so that they needn't be read. the index is limited to a maximum
+// size (files which don't fit aren't indexed and so are always searched)
+class TrigramIndex
+{
+public:
+   explicit TrigramIndex(std::size_t maxBytes) : bytes_(0), maxBytes_(maxBytes)
+   {
+   }
+
+   // COPYING: via compiler
+
+   // compute the (sorted, unique) trigrams of a file. this doesn't touch the
+   // index so can be called from any thread. binary files have no trigrams
+   // (they are never searched). returns false if the file is too large to
+   // index or can't be read
+   static bool computeTrigrams(const FilePath& filePath, Trigrams* pTrigrams);
+
+   // returns false if there isn't room for the file in the index
+   bool update(const std::string& path,
+               std::time_t lastWriteTime,
+               const Trigrams& trigrams);
+
+   void remove(const std::string& path);
+   void clear();
+
+   bool contains(const std::string& path) const;
+   bool isCurrent(const std::string& path, std::time_t lastWriteTime) const;
+   std::vector<std::string> paths() const;
+   std::size_t fileCount() const { return files_.size(); }
+   std::size_t bytes() const { return bytes_; }
+
+   // add the files which can't contain the literal (along with the write
+   // time they were indexed at) to pExcluded. nothing is added for literals
+   // shorter than a trigram
+   void excludedFiles(const std::string& literal,
+                      ExcludedFiles* pExcluded) const;
+
+   Error write(const FilePath& filePath) const;
+   Error read(const FilePath& filePath);
+
+private:
+   struct Entry
+   {
+      Entry() : lastWriteTime(0) {}
+      std::time_t lastWriteTime;
+      Trigrams trigrams;
+   };
+
+   static std::size_t entryBytes(const std::string& path, const Entry& entry);
+
+   typedef boost::unordered_map<std::string, Entry> Files;
+   Files files_;
+   std::size_t bytes_;
+   std::size_t maxBytes_;
+};
+
+} // namespace file_search
+} // namespace core
+} // namespace rstudio
+
+#endif // CORE_TRIGRAM_INDEX_HPP
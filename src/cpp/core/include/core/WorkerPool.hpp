@@ -0,0 +1,133 @@
+/*
+ * WorkerPool.hpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_WORKER_POOL_HPP
+#define CORE_WORKER_POOL_HPP
+
+#include <queue>
+#include <vector>
+
+#include <boost/utility.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <core/BoostThread.hpp>
+
+namespace rstudio {
+namespace core {
+
+enum WorkPriority
+{
+   WorkPriorityLow = 0,
+   WorkPriorityNormal = 1,
+   WorkPriorityHigh = 2
+};
+
+namespace detail {
+   struct WorkState;
+}
+
+// handle to work queued on a WorkerPool. cancelling work which hasn't
+// started prevents it from running; work which is already running can
+// poll WorkerPool::cancelled to find out that it should stop early
+class WorkHandle
+{
+public:
+   WorkHandle() {}
+   explicit WorkHandle(const boost::shared_ptr<detail::WorkState>& pState)
+      : pState_(pState)
+   {
+   }
+   // COPYING: via compiler
+
+   bool empty() const { return !pState_; }
+
+   void cancel() const;
+   bool cancelled() const;
+
+private:
+   boost::shared_ptr<detail::WorkState> pState_;
+};
+
+// bounded pool of threads which execute queued work in priority order
+// (work of equal priority is executed in the order it was queued)
+class WorkerPool : boost::noncopyable
+{
+public:
+   explicit WorkerPool(std::size_t threads);
+
+   // stops the pool and waits for running work to complete
+   virtual ~WorkerPool();
+
+public:
+   // queue work (if no thread can be started to execute it and the pool
+   // has none then it is executed on the calling thread)
+   WorkHandle enque(const boost::function<void()>& work,
+                    WorkPriority priority = WorkPriorityNormal);
+
+   // number of queued work items which haven't yet started
+   std::size_t pending();
+
+   // cancel all queued work and have the threads exit once their
+   // current work is complete (further work is not accepted)
+   void stop();
+
+   // whether the work running on the calling thread has been cancelled
+   static bool cancelled();
+
+private:
+   struct Item
+   {
+      WorkPriority priority;
+      unsigned long sequence;
+      boost::shared_ptr<detail::WorkState> pState;
+      boost::function<void()> work;
+
+      bool operator<(const Item& other) const
+      {
+         if (priority != other.priority)
+            return priority < other.priority;
+         else
+            return sequence > other.sequence;
+      }
+   };
+
+   bool nextItem(boost::unique_lock<boost::mutex>& lock,
+                 bool wait,
+                 Item* pItem);
+   void execute(const Item& item);
+   void run();
+   void runQueued();
+
+private:
+   std::size_t maxThreads_;
+   boost::thread_group threads_;
+   std::size_t threadCount_;
+   // threads waiting for work which hasn't been handed any, and the
+   // number of waiting threads which have been handed work but not woken
+   std::size_t idleThreads_;
+   std::size_t wakeups_;
+
+   boost::mutex mutex_;
+   boost::condition queueCondition_;
+   std::priority_queue<Item> queue_;
+   unsigned long sequence_;
+   bool stopped_;
+};
+
+} // namespace core
+} // namespace rstudio
+
+#endif // CORE_WORKER_POOL_HPP
@@ -0,0 +1,118 @@
+/*
+ * LruCache.hpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_COLLECTION_LRU_CACHE_HPP
+#define CORE_COLLECTION_LRU_CACHE_HPP
+
+#include <list>
+#include <utility>
+
+#include <boost/unordered_map.hpp>
+
+namespace rstudio {
+namespace core {
+namespace collection {
+
+// map with a fixed capacity which evicts the least recently used entry
+// when it is full (both lookups and inserts count as a use)
+template <typename K, typename V>
+class LruCache
+{
+private:
+   typedef std::list<std::pair<K, V> > List;
+   typedef boost::unordered_map<K, typename List::iterator> Map;
+
+public:
+
+   explicit LruCache(std::size_t capacity)
+      : capacity_(capacity == 0 ? 1 : capacity)
+   {
+   }
+
+   // COPYING: prohibited (the map holds iterators into the list)
+
+   bool get(const K& key, V* pValue)
+   {
+      typename Map::iterator it = map_.find(key);
+      if (it == map_.end())
+         return false;
+
+      // move to the front of the list
+      list_.splice(list_.begin(), list_, it->second);
+      *pValue = it->second->second;
+      return true;
+   }
+
+   void insert(const K& key, const V& value)
+   {
+      typename Map::iterator it = map_.find(key);
+      if (it != map_.end())
+      {
+         it->second->second = value;
+         list_.splice(list_.begin(), list_, it->second);
+         return;
+      }
+
+      if (map_.size() >= capacity_)
+      {
+         map_.erase(list_.back().first);
+         list_.pop_back();
+      }
+
+      list_.push_front(std::make_pair(key, value));
+      map_[key] = list_.begin();
+   }
+
+   void erase(const K& key)
+   {
+      typename Map::iterator it = map_.find(key);
+      if (it == map_.end())
+         return;
+
+      list_.erase(it->second);
+      map_.erase(it);
+   }
+
+   void clear()
+   {
+      map_.clear();
+      list_.clear();
+   }
+
+   std::size_t size() const
+   {
+      return map_.size();
+   }
+
+   std::size_t capacity() const
+   {
+      return capacity_;
+   }
+
+private:
+   LruCache(const LruCache&);
+   LruCache& operator=(const LruCache&);
+
+private:
+   std::size_t capacity_;
+   List list_;
+   Map map_;
+};
+
+} // namespace collection
+} // namespace core
+} // namespace rstudio
+
+#endif // CORE_COLLECTION_LRU_CACHE_HPP
@@ -22,8 +22,12 @@
 
 #include <boost/function.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
 
+#include <core/BoostThread.hpp>
 #include <core/FilePath.hpp>
+#include <core/WorkerPool.hpp>
 
 #include "clang-c/Index.h"
 
@@ -62,7 +66,11 @@ public:
 
    int verbose() const { return verbose_; }
 
-   // functions used to keep the index "hot" based on recent user edits
+   // functions used to keep the index "hot" based on recent user edits.
+   // these parse (or reparse) the translation unit on a background thread
+   // (priming is for the file being edited so is done ahead of repriming).
+   // the translation unit is handed back the next time the index is used
+   // (or waited for if it is the one which is requested)
    void primeEditorTranslationUnit(const std::string& filename);
    void reprimeEditorTranslationUnit(const std::string& filename);
 
@@ -80,6 +88,26 @@ public:
 
    Cursor referencedCursorForFileLocation(const FileLocation& loc);
 
+private:
+   struct ParseJob;
+
+   void enqueParse(const std::string& filename, WorkPriority priority);
+   void runParse(boost::shared_ptr<ParseJob> pJob);
+   bool waitForParse(const std::string& filename);
+   void collectParsed();
+
+   CXIndex acquireIndex(unsigned globalOptions);
+   void releaseIndex(CXIndex index);
+
+   void storeTranslationUnit(const std::string& filename,
+                             const std::vector<std::string>& compileArgs,
+                             std::time_t lastWriteTime,
+                             unsigned long unsavedGeneration,
+                             CXTranslationUnit tu);
+   void disposeTranslationUnit(const std::string& filename);
+   void enforceMemoryBudget();
+   bool includesChangedOnDisk(CXTranslationUnit tu);
+
 private:
 
    UnsavedFiles unsavedFiles_;
@@ -88,19 +116,34 @@ private:
 
    struct StoredTranslationUnit
    {
-      StoredTranslationUnit() : lastWriteTime(0), tu(NULL) {}
-      StoredTranslationUnit(const std::vector<std::string>& compileArgs,
-                            std::time_t lastWriteTime,
-                            CXTranslationUnit tu)
-         : compileArgs(compileArgs), lastWriteTime(lastWriteTime), tu(tu)
+      StoredTranslationUnit()
+         : lastWriteTime(0), unsavedGeneration(0), tu(NULL),
+           memoryUsage(0), lastUsed(0)
       {
       }
       std::vector<std::string> compileArgs;
       std::time_t lastWriteTime;
+      unsigned long unsavedGeneration;
       CXTranslationUnit tu;
+      unsigned long memoryUsage;
+      unsigned long lastUsed;
    };
    typedef std::map<std::string,StoredTranslationUnit> TranslationUnits;
    TranslationUnits translationUnits_;
+   unsigned long useCount_;
+
+   // the file most recently primed (never evicted to satisfy the budget)
+   std::string activeFilename_;
+
+   // background parsing (the jobs are only added and removed on the thread
+   // which owns the index, their state is synchronized using the mutex)
+   typedef std::map<std::string,boost::shared_ptr<ParseJob> > ParseJobs;
+   ParseJobs parseJobs_;
+   boost::mutex mutex_;
+   boost::condition parseCondition_;
+   std::vector<CXIndex> allIndexes_;
+   std::vector<CXIndex> freeIndexes_;
+   boost::scoped_ptr<WorkerPool> pParsePool_;
 
    CompilationDatabase compilationDB_;
 
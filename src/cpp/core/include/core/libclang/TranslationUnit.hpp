@@ -82,6 +82,9 @@ public:
                                       unsigned line,
                                       unsigned column) const;
 
+   // total memory used by the translation unit (in bytes)
+   unsigned long memoryUsage() const;
+
    void printResourceUsage(std::ostream& ostr, bool detailed = false) const;
 
 private:
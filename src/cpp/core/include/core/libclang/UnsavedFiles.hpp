@@ -31,7 +31,7 @@ namespace libclang {
 class UnsavedFiles : boost::noncopyable
 {
 public:
-   UnsavedFiles() {}
+   UnsavedFiles() : generation_(0) {}
    virtual ~UnsavedFiles();
 
    void update(const std::string& filename,
@@ -40,12 +40,19 @@ public:
    void remove(const std::string& filename);
    void removeAll();
 
+   // copy the current set of unsaved files (e.g. for use on another thread)
+   void copyTo(UnsavedFiles* pTarget) const;
+
+   // incremented whenever the set of unsaved files changes
+   unsigned long generation() const { return generation_; }
+
    CXUnsavedFile* unsavedFilesArray() { return &(files_[0]); }
    unsigned numUnsavedFiles() { return files_.size(); }
 
 private:
    // vector of unsaved files we pass to various clang functions
    std::vector<CXUnsavedFile> files_;
+   unsigned long generation_;
 };
 
 //  diagnosic helpers
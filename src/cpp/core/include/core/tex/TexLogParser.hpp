@@ -19,6 +19,9 @@
 #include <string>
 #include <vector>
 
+#include <boost/utility.hpp>
+#include <boost/scoped_ptr.hpp>
+
 #include <core/FilePath.hpp>
 
 namespace rstudio {
@@ -75,6 +78,31 @@ private:
 
 typedef std::vector<LogEntry> LogEntries;
 
+// parses a latex log incrementally, so that a log can be parsed while the
+// compiler is still writing it. each line is processed as soon as enough of
+// the log following it is available (to unwrap it and complete its entry)
+class LatexLogParser : boost::noncopyable
+{
+public:
+   explicit LatexLogParser(const FilePath& logFilePath);
+   virtual ~LatexLogParser();
+   // COPYING: prohibited
+
+public:
+   // add the next chunk of the log (needn't end on a line boundary)
+   void addOutput(const std::string& output);
+
+   // process the lines which are still pending. an incomplete final line
+   // is ignored (as it is when reading the log from disk)
+   void finish();
+
+   const LogEntries& logEntries() const;
+
+private:
+   struct Impl;
+   boost::scoped_ptr<Impl> pImpl_;
+};
+
 Error parseLatexLog(const FilePath& logFilePath, LogEntries* pLogEntries);
 
 Error parseBibtexLog(const FilePath& logFilePath, LogEntries* pLogEntries);
@@ -0,0 +1,83 @@
+/*
+ * Rope.hpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_TEXT_ROPE_HPP
+#define CORE_TEXT_ROPE_HPP
+
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace rstudio {
+namespace core {
+namespace text {
+
+// UTF-8 text stored as a sequence of immutable chunks. edits rebuild only
+// the chunks they touch and copies share chunks, so both cost time
+// proportional to the edit rather than to the text. each chunk caches
+// its character count and crc32, so character offsets and the checksum
+// of the whole text are computed without visiting the text itself
+class Rope
+{
+public:
+   Rope();
+   explicit Rope(const std::string& text);
+   // COPYING: via compiler (chunks are shared between copies)
+
+   void assign(const std::string& text);
+
+   std::size_t size() const { return size_; }
+   bool empty() const { return size_ == 0; }
+
+   std::string str() const;
+
+   // convert a character offset to a byte offset. offsets past the end
+   // are clamped to the end. returns false if the text preceding the
+   // offset isn't valid UTF-8
+   bool byteOffset(std::size_t characterOffset, std::size_t* pByteOffset) const;
+
+   // replace the bytes [offset, offset + length) with text (the range is
+   // clamped to the end of the text)
+   void replace(std::size_t offset,
+                std::size_t length,
+                const std::string& text);
+
+   // crc32 of the whole text (identical to boost::crc_32_type)
+   boost::uint32_t crc32() const;
+
+private:
+   struct Chunk
+   {
+      explicit Chunk(const std::string& text);
+      std::string text;
+      std::size_t characters;
+      bool validUtf8;
+      boost::uint32_t crc;
+   };
+   typedef boost::shared_ptr<const Chunk> ChunkPtr;
+
+   static void split(const std::string& text, std::vector<ChunkPtr>* pChunks);
+
+   std::vector<ChunkPtr> chunks_;
+   std::size_t size_;
+};
+
+} // namespace text
+} // namespace core
+} // namespace rstudio
+
+#endif // CORE_TEXT_ROPE_HPP
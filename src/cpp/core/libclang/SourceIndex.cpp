@@ -15,15 +15,21 @@
 
 #include <core/libclang/SourceIndex.hpp>
 
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 
+#include <core/Error.hpp>
 #include <core/FilePath.hpp>
+#include <core/Log.hpp>
 #include <core/PerformanceTimer.hpp>
+#include <core/Thread.hpp>
+#include <core/Trace.hpp>
 
 #include <core/system/ProcessArgs.hpp>
 
 #include <core/libclang/LibClang.hpp>
 #include <core/libclang/UnsavedFiles.hpp>
+#include <core/libclang/Utils.hpp>
 
 namespace rstudio {
 namespace core {
@@ -42,6 +48,84 @@ bool isHeaderExtension(const std::string& ex)
    return ex == ".h" || ex == ".hh" || ex == ".hpp";
 }
 
+// number of threads used to parse translation units in the background
+const std::size_t kParseThreads = 2;
+
+// indexed translation units beyond this are removed (least recently used
+// first). typical Rcpp translation units use 100-300MB
+const unsigned long kMemoryBudget = 1024UL * 1024UL * 1024UL;
+
+CXTranslationUnit parseTranslationUnit(CXIndex index,
+                                       const std::string& filename,
+                                       std::vector<std::string> args,
+                                       UnsavedFiles& unsavedFiles,
+                                       int verbose)
+{
+   // add verbose output if requested
+   if (verbose >= 2)
+     args.push_back("-v");
+
+   // get the args in the fashion libclang expects (char**)
+   core::system::ProcessArgs argsArray(args);
+
+   if (verbose > 0)
+      std::cerr << "  (Creating new index)" << std::endl;
+
+   // create a new translation unit from the file
+   unsigned options = applyTranslationUnitOptions(
+                           clang().defaultEditingTranslationUnitOptions());
+   CXTranslationUnit tu = clang().parseTranslationUnit(
+                         index,
+                         filename.c_str(),
+                         argsArray.args(),
+                         argsArray.argCount(),
+                         unsavedFiles.unsavedFilesArray(),
+                         unsavedFiles.numUnsavedFiles(),
+                         options);
+
+   if (tu == NULL)
+      LOG_ERROR_MESSAGE("Error parsing translation unit " + filename);
+
+   return tu;
+}
+
+bool reparseTranslationUnit(CXTranslationUnit tu,
+                            const std::string& filename,
+                            UnsavedFiles& unsavedFiles)
+{
+   unsigned options = applyTranslationUnitOptions(
+                              clang().defaultReparseOptions(tu));
+   int ret = clang().reparseTranslationUnit(
+                          tu,
+                          unsavedFiles.numUnsavedFiles(),
+                          unsavedFiles.unsavedFilesArray(),
+                          options);
+   if (ret != 0)
+   {
+      LOG_ERROR_MESSAGE("Error re-parsing translation unit " + filename);
+      return false;
+   }
+
+   return true;
+}
+
+// checks whether any of the files included by a translation unit have been
+// written since it was parsed
+void checkInclusionChanged(CXFile file,
+                           CXSourceLocation*,
+                           unsigned,
+                           CXClientData data)
+{
+   bool* pChanged = static_cast<bool*>(data);
+   if (*pChanged)
+      return;
+
+   std::time_t parsedTime = clang().getFileTime(file);
+   FilePath filePath(toStdString(clang().getFileName(file)));
+   if (filePath.exists() && filePath.lastWriteTime() != parsedTime)
+      *pChanged = true;
+}
+
 } // anonymous namespace
 
 bool SourceIndex::isSourceFile(const FilePath& filePath)
@@ -63,20 +147,71 @@ bool SourceIndex::isHeaderFile(const FilePath& filePath)
 }
 
 SourceIndex::SourceIndex(CompilationDatabase compilationDB, int verbose)
+   : useCount_(0)
 {
    verbose_ = verbose;
    index_ = clang().createIndex(0, (verbose_ > 0) ? 1 : 0);
    compilationDB_ = compilationDB;
 }
 
+// a translation unit being parsed in the background. the translation unit
+// (if any) is removed from the index while the job is pending so that it
+// is only ever used by one thread at a time
+struct SourceIndex::ParseJob
+{
+   ParseJob()
+      : lastWriteTime(0), unsavedGeneration(0), globalOptions(0),
+        verbose(0), tu(NULL), started(false), done(false),
+        cancelled(false), discard(false), rerun(false),
+        rerunPriority(WorkPriorityLow)
+   {
+   }
+
+   std::string filename;
+   std::vector<std::string> compileArgs;
+   std::time_t lastWriteTime;
+   UnsavedFiles unsavedFiles;
+   unsigned long unsavedGeneration;
+   unsigned globalOptions;
+   int verbose;
+
+   // in: the translation unit to reparse (NULL to parse from scratch)
+   // out: the parsed translation unit (NULL if parsing failed)
+   CXTranslationUnit tu;
+
+   // synchronized by the index mutex
+   bool started;
+   bool done;
+   bool cancelled;
+
+   // only used by the thread which owns the index
+   bool discard;
+   bool rerun;
+   WorkPriority rerunPriority;
+};
+
 SourceIndex::~SourceIndex()
 {
    try
    {
+      // stop background parsing (waits for running jobs to complete) then
+      // dispose of any translation units held by jobs
+      pParsePool_.reset();
+      BOOST_FOREACH(ParseJobs::value_type& job, parseJobs_)
+      {
+         if (job.second->tu != NULL)
+            clang().disposeTranslationUnit(job.second->tu);
+      }
+      parseJobs_.clear();
+
       // remove all
       removeAllTranslationUnits();
 
-      // dispose the index
+      // dispose the indexes
+      BOOST_FOREACH(CXIndex index, allIndexes_)
+      {
+         clang().disposeIndex(index);
+      }
       if (index_ != NULL)
          clang().disposeIndex(index_);
    }
@@ -97,18 +232,25 @@ void SourceIndex::setGlobalOptions(unsigned options)
 
 void SourceIndex::removeTranslationUnit(const std::string& filename)
 {
-   TranslationUnits::iterator it = translationUnits_.find(filename);
-   if (it != translationUnits_.end())
+   // if it's being parsed then dispose of it when the parse completes
+   ParseJobs::iterator jobIt = parseJobs_.find(filename);
+   if (jobIt != parseJobs_.end())
    {
-      if (verbose_ > 0)
-         std::cerr << "CLANG REMOVE INDEX: " << it->first << std::endl;
-      clang().disposeTranslationUnit(it->second.tu);
-      translationUnits_.erase(it->first);
+      jobIt->second->discard = true;
+      collectParsed();
    }
+
+   disposeTranslationUnit(filename);
 }
 
 void SourceIndex::removeAllTranslationUnits()
 {
+   BOOST_FOREACH(ParseJobs::value_type& job, parseJobs_)
+   {
+      job.second->discard = true;
+   }
+   collectParsed();
+
    for(TranslationUnits::const_iterator it = translationUnits_.begin();
        it != translationUnits_.end(); ++it)
    {
@@ -121,25 +263,341 @@ void SourceIndex::removeAllTranslationUnits()
    translationUnits_.clear();
 }
 
+void SourceIndex::disposeTranslationUnit(const std::string& filename)
+{
+   TranslationUnits::iterator it = translationUnits_.find(filename);
+   if (it != translationUnits_.end())
+   {
+      if (verbose_ > 0)
+         std::cerr << "CLANG REMOVE INDEX: " << it->first << std::endl;
+      clang().disposeTranslationUnit(it->second.tu);
+      translationUnits_.erase(it);
+   }
+}
+
 
 void SourceIndex::primeEditorTranslationUnit(const std::string& filename)
 {
-   // if we have no record of this translation unit then do a first pass
-   if (translationUnits_.find(filename) == translationUnits_.end())
-      getTranslationUnit(filename);
+   collectParsed();
+
+   // (re)parse the file being edited ahead of everything else
+   activeFilename_ = filename;
+   enqueParse(filename, WorkPriorityHigh);
 }
 
 void SourceIndex::reprimeEditorTranslationUnit(const std::string& filename)
 {
+   collectParsed();
+
    // if we have already indexed this translation unit then re-index it
-   if (translationUnits_.find(filename) != translationUnits_.end())
-      getTranslationUnit(filename);
+   if (translationUnits_.find(filename) != translationUnits_.end() ||
+       parseJobs_.find(filename) != parseJobs_.end())
+   {
+      enqueParse(filename, WorkPriorityNormal);
+   }
+}
+
+void SourceIndex::enqueParse(const std::string& filename,
+                             WorkPriority priority)
+{
+   // if it's already being parsed then parse it again once that completes
+   // (the pending parse may not reflect the latest edits)
+   ParseJobs::iterator jobIt = parseJobs_.find(filename);
+   if (jobIt != parseJobs_.end())
+   {
+      jobIt->second->rerun = true;
+      jobIt->second->rerunPriority = std::max(jobIt->second->rerunPriority,
+                                              priority);
+      return;
+   }
+
+   boost::shared_ptr<ParseJob> pJob(new ParseJob());
+   pJob->filename = filename;
+   if (compilationDB_.compileArgsForTranslationUnit)
+   {
+      pJob->compileArgs =
+            compilationDB_.compileArgsForTranslationUnit(filename, true);
+      if (pJob->compileArgs.empty())
+         return;
+   }
+   pJob->lastWriteTime = FilePath(filename).lastWriteTime();
+   pJob->globalOptions = getGlobalOptions();
+   pJob->verbose = verbose_;
+
+   // check out the existing translation unit for reparsing (if the compile
+   // arguments have changed it needs to be parsed from scratch)
+   TranslationUnits::iterator it = translationUnits_.find(filename);
+   if (it != translationUnits_.end())
+   {
+      if (it->second.compileArgs == pJob->compileArgs)
+      {
+         pJob->tu = it->second.tu;
+         translationUnits_.erase(it);
+      }
+      else
+      {
+         disposeTranslationUnit(filename);
+      }
+   }
+
+   // parse against a snapshot of the unsaved files
+   unsavedFiles_.copyTo(&pJob->unsavedFiles);
+   pJob->unsavedGeneration = unsavedFiles_.generation();
+
+   if (!pParsePool_)
+      pParsePool_.reset(new WorkerPool(kParseThreads));
+
+   parseJobs_[filename] = pJob;
+   pParsePool_->enque(boost::bind(&SourceIndex::runParse, this, pJob),
+                      priority);
+}
+
+void SourceIndex::runParse(boost::shared_ptr<ParseJob> pJob)
+{
+   LOCK_MUTEX(mutex_)
+   {
+      if (pJob->cancelled)
+         return;
+      pJob->started = true;
+   }
+   END_LOCK_MUTEX
+
+   TRACE_SCOPE("index", pJob->filename);
+
+   boost::scoped_ptr<core::PerformanceTimer> pTimer;
+   if (pJob->verbose > 0)
+   {
+      std::cerr << "CLANG INDEXING (BACKGROUND): " << pJob->filename
+                << std::endl;
+      pTimer.reset(new core::PerformanceTimer(
+                                 FilePath(pJob->filename).filename()));
+   }
+
+   // reparse if we can, otherwise parse from scratch
+   if (pJob->tu != NULL)
+   {
+      if (!reparseTranslationUnit(pJob->tu,
+                                  pJob->filename,
+                                  pJob->unsavedFiles))
+      {
+         clang().disposeTranslationUnit(pJob->tu);
+         pJob->tu = NULL;
+      }
+   }
+
+   if (pJob->tu == NULL)
+   {
+      CXIndex index = acquireIndex(pJob->globalOptions);
+      pJob->tu = parseTranslationUnit(index,
+                                      pJob->filename,
+                                      pJob->compileArgs,
+                                      pJob->unsavedFiles,
+                                      pJob->verbose);
+      releaseIndex(index);
+   }
+
+   LOCK_MUTEX(mutex_)
+   {
+      pJob->done = true;
+   }
+   END_LOCK_MUTEX
+
+   parseCondition_.notify_all();
+}
+
+bool SourceIndex::waitForParse(const std::string& filename)
+{
+   bool stale = false;
+   ParseJobs::iterator it = parseJobs_.find(filename);
+   if (it != parseJobs_.end())
+   {
+      boost::shared_ptr<ParseJob> pJob = it->second;
+
+      // the caller reparses against the latest edits itself, so don't
+      // parse it again in the background (which would check the translation
+      // unit out from under the caller)
+      stale = pJob->rerun;
+      pJob->rerun = false;
+
+      try
+      {
+         // if the parse hasn't started yet we'll do it ourselves, otherwise
+         // wait for it to complete
+         boost::unique_lock<boost::mutex> lock(mutex_);
+         if (!pJob->started)
+            pJob->cancelled = true;
+         else
+         {
+            while (!pJob->done)
+               parseCondition_.wait(lock);
+         }
+      }
+      catch(const boost::thread_resource_error& e)
+      {
+         LOG_ERROR(Error(boost::thread_error::ec_from_exception(e),
+                         ERROR_LOCATION));
+      }
+   }
+
+   collectParsed();
+   return stale;
+}
+
+void SourceIndex::collectParsed()
+{
+   std::vector<boost::shared_ptr<ParseJob> > completed;
+   LOCK_MUTEX(mutex_)
+   {
+      BOOST_FOREACH(ParseJobs::value_type& job, parseJobs_)
+      {
+         if (job.second->done || job.second->cancelled)
+            completed.push_back(job.second);
+      }
+   }
+   END_LOCK_MUTEX
+
+   if (completed.empty())
+      return;
+
+   std::vector<std::pair<std::string,WorkPriority> > reruns;
+   BOOST_FOREACH(boost::shared_ptr<ParseJob> pJob, completed)
+   {
+      parseJobs_.erase(pJob->filename);
+
+      if (pJob->discard)
+      {
+         if (pJob->tu != NULL)
+            clang().disposeTranslationUnit(pJob->tu);
+         continue;
+      }
+
+      if (pJob->tu != NULL)
+      {
+         // a cancelled job returns the translation unit as it was when it
+         // was checked out (so ensure it's treated as out of date)
+         storeTranslationUnit(pJob->filename,
+                              pJob->compileArgs,
+                              pJob->cancelled ? 0 : pJob->lastWriteTime,
+                              pJob->cancelled ? 0 : pJob->unsavedGeneration,
+                              pJob->tu);
+      }
+
+      if (pJob->rerun)
+         reruns.push_back(std::make_pair(pJob->filename, pJob->rerunPriority));
+   }
+
+   typedef std::pair<std::string,WorkPriority> Rerun;
+   BOOST_FOREACH(const Rerun& rerun, reruns)
+   {
+      enqueParse(rerun.first, rerun.second);
+   }
+
+   enforceMemoryBudget();
+}
+
+CXIndex SourceIndex::acquireIndex(unsigned globalOptions)
+{
+   // each background thread parses into its own index (parses which share
+   // an index are serialized by libclang)
+   CXIndex index = NULL;
+   LOCK_MUTEX(mutex_)
+   {
+      if (!freeIndexes_.empty())
+      {
+         index = freeIndexes_.back();
+         freeIndexes_.pop_back();
+      }
+   }
+   END_LOCK_MUTEX
+
+   if (index == NULL)
+   {
+      index = clang().createIndex(0, (verbose_ > 0) ? 1 : 0);
+
+      LOCK_MUTEX(mutex_)
+      {
+         allIndexes_.push_back(index);
+      }
+      END_LOCK_MUTEX
+   }
+
+   // apply the options in effect when the parse was queued
+   clang().CXIndex_setGlobalOptions(index, globalOptions);
+   return index;
+}
+
+void SourceIndex::releaseIndex(CXIndex index)
+{
+   LOCK_MUTEX(mutex_)
+   {
+      freeIndexes_.push_back(index);
+   }
+   END_LOCK_MUTEX
+}
+
+void SourceIndex::storeTranslationUnit(
+                           const std::string& filename,
+                           const std::vector<std::string>& compileArgs,
+                           std::time_t lastWriteTime,
+                           unsigned long unsavedGeneration,
+                           CXTranslationUnit tu)
+{
+   disposeTranslationUnit(filename);
+
+   StoredTranslationUnit& stored = translationUnits_[filename];
+   stored.compileArgs = compileArgs;
+   stored.lastWriteTime = lastWriteTime;
+   stored.unsavedGeneration = unsavedGeneration;
+   stored.tu = tu;
+   stored.memoryUsage = TranslationUnit(filename, tu, NULL).memoryUsage();
+   stored.lastUsed = ++useCount_;
+}
+
+bool SourceIndex::includesChangedOnDisk(CXTranslationUnit tu)
+{
+   bool changed = false;
+   clang().getInclusions(tu, checkInclusionChanged, &changed);
+   return changed;
+}
+
+void SourceIndex::enforceMemoryBudget()
+{
+   while (true)
+   {
+      unsigned long totalBytes = 0;
+      TranslationUnits::iterator lru = translationUnits_.end();
+      for (TranslationUnits::iterator it = translationUnits_.begin();
+           it != translationUnits_.end(); ++it)
+      {
+         totalBytes += it->second.memoryUsage;
+
+         // never evict the active file or the one just used (which the
+         // caller may be about to return)
+         if (it->first != activeFilename_ &&
+             it->second.lastUsed != useCount_ &&
+             (lru == translationUnits_.end() ||
+              it->second.lastUsed < lru->second.lastUsed))
+         {
+            lru = it;
+         }
+      }
+
+      if (totalBytes <= kMemoryBudget || lru == translationUnits_.end())
+         break;
+
+      if (verbose_ > 0)
+         std::cerr << "CLANG EVICT INDEX (MEMORY BUDGET): " << lru->first
+                   << std::endl;
+      disposeTranslationUnit(lru->first);
+   }
 }
 
 
 std::map<std::string,TranslationUnit>
                            SourceIndex::getIndexedTranslationUnits()
 {
+   collectParsed();
+
    std::map<std::string,TranslationUnit> units;
    BOOST_FOREACH(TranslationUnits::value_type& t, translationUnits_)
    {
@@ -154,6 +612,12 @@ TranslationUnit SourceIndex::getTranslationUnit(const std::string& filename,
 {
    FilePath filePath(filename);
 
+   // pick up the result of any background parse of this file (which must
+   // be reparsed if it was edited while being parsed)
+   bool forceReparse = waitForParse(filename) || alwaysReparse;
+
+   TRACE_SCOPE("index", filename);
+
    boost::scoped_ptr<core::PerformanceTimer> pTimer;
    if (verbose_ > 0)
    {
@@ -179,9 +643,14 @@ TranslationUnit SourceIndex::getTranslationUnit(const std::string& filename,
    {
       // alias record
       StoredTranslationUnit& stored = it->second;
-
-      // already up to date?
-      if (!alwaysReparse &&
+      stored.lastUsed = ++useCount_;
+
+      // already up to date? (a forced reparse isn't required if the
+      // translation unit was parsed against the current unsaved files and
+      // none of the files it includes have changed on disk since)
+      if ((!forceReparse ||
+           (stored.unsavedGeneration == unsavedFiles_.generation() &&
+            !includesChangedOnDisk(stored.tu))) &&
           (args == stored.compileArgs) &&
           (lastWriteTime == stored.lastWriteTime))
       {
@@ -195,32 +664,25 @@ TranslationUnit SourceIndex::getTranslationUnit(const std::string& filename,
       {
          if (verbose_ > 0)
          {
-            std::string reason = alwaysReparse ?
+            std::string reason = forceReparse ?
                                        "(Forced reparse)" :
                                        "(File changed on disk, reparsing)";
 
             std::cerr << "  " << reason << std::endl;
          }
 
-         unsigned options = applyTranslationUnitOptions(
-                                    clang().defaultReparseOptions(stored.tu));
-         int ret = clang().reparseTranslationUnit(
-                                stored.tu,
-                                unsavedFiles().numUnsavedFiles(),
-                                unsavedFiles().unsavedFilesArray(),
-                                options);
-
-         if (ret == 0)
+         if (reparseTranslationUnit(stored.tu, filename, unsavedFiles_))
          {
-            // update last write time
+            // update last write time and memory usage
             stored.lastWriteTime = lastWriteTime;
+            stored.unsavedGeneration = unsavedFiles_.generation();
+            stored.memoryUsage =
+                  TranslationUnit(filename, stored.tu, NULL).memoryUsage();
+            CXTranslationUnit tu = stored.tu;
+            enforceMemoryBudget();
 
             // return it
-            return TranslationUnit(filename, stored.tu, &unsavedFiles_);
-         }
-         else
-         {
-            LOG_ERROR_MESSAGE("Error re-parsing translation unit " + filename);
+            return TranslationUnit(filename, tu, &unsavedFiles_);
          }
       }
    }
@@ -228,37 +690,24 @@ TranslationUnit SourceIndex::getTranslationUnit(const std::string& filename,
    // if we got this far then there either was no existing translation
    // unit or we require a full rebuild. in all cases remove any existing
    // translation unit we have
-   removeTranslationUnit(filename);
-
-   // add verbose output if requested
-   if (verbose_ >= 2)
-     args.push_back("-v");
-
-   // get the args in the fashion libclang expects (char**)
-   core::system::ProcessArgs argsArray(args);
-
-   if (verbose_ > 0)
-      std::cerr << "  (Creating new index)" << std::endl;
+   disposeTranslationUnit(filename);
 
    // create a new translation unit from the file
-   unsigned options = applyTranslationUnitOptions(
-                           clang().defaultEditingTranslationUnitOptions());
-   CXTranslationUnit tu = clang().parseTranslationUnit(
-                         index_,
-                         filename.c_str(),
-                         argsArray.args(),
-                         argsArray.argCount(),
-                         unsavedFiles().unsavedFilesArray(),
-                         unsavedFiles().numUnsavedFiles(),
-                         options);
-
+   CXTranslationUnit tu = parseTranslationUnit(index_,
+                                               filename,
+                                               args,
+                                               unsavedFiles_,
+                                               verbose_);
 
    // save and return it if we succeeded
    if (tu != NULL)
    {
-      translationUnits_[filename] = StoredTranslationUnit(args,
-                                                          lastWriteTime,
-                                                          tu);
+      storeTranslationUnit(filename,
+                           args,
+                           lastWriteTime,
+                           unsavedFiles_.generation(),
+                           tu);
+      enforceMemoryBudget();
 
       TranslationUnit unit(filename, tu, &unsavedFiles_);
       if (verbose_ > 0)
@@ -267,7 +716,6 @@ TranslationUnit SourceIndex::getTranslationUnit(const std::string& filename,
    }
    else
    {
-      LOG_ERROR_MESSAGE("Error parsing translation unit " + filename);
       return TranslationUnit();
    }
 }
@@ -0,0 +1,72 @@
+/*
+ * SourceIndexTests.cpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <tests/TestThat.hpp>
+
+#include <core/libclang/SourceIndex.hpp>
+
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/system/System.hpp>
+
+#include <core/libclang/LibClang.hpp>
+
+namespace rstudio {
+namespace core {
+namespace libclang {
+
+context("SourceIndex")
+{
+   test_that("edits made during a background parse are reflected")
+   {
+      // libclang isn't available on every system
+      if (!clang().isLoaded() && !clang().load())
+         return;
+
+      FilePath dir = FilePath("/tmp").complete(
+               "rstudio-clang-" + core::system::generateShortenedUuid());
+      expect_false(dir.ensureDirectory());
+      std::string filename = dir.complete("test.cpp").absolutePath();
+      expect_false(writeStringToFile(FilePath(filename),
+                                     "int main() { return 0; }\n"));
+
+      {
+         SourceIndex index;
+
+         // edit the file while it is (or is about to be) parsed
+         index.primeEditorTranslationUnit(filename);
+         index.unsavedFiles().update(filename,
+                                     "int main() { return undeclared; }\n",
+                                     true);
+         index.reprimeEditorTranslationUnit(filename);
+
+         // the translation unit reflects the edit
+         TranslationUnit tu = index.getTranslationUnit(filename, true);
+         expect_false(tu.empty());
+         expect_true(tu.getNumDiagnostics() > 0);
+
+         // and it isn't replaced by another background parse
+         TranslationUnit again = index.getTranslationUnit(filename);
+         expect_true(again.getCXTranslationUnit() ==
+                     tu.getCXTranslationUnit());
+      }
+
+      dir.remove();
+   }
+}
+
+} // namespace libclang
+} // namespace core
+} // namespace rstudio
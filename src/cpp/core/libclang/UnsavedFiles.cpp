@@ -49,6 +49,7 @@ void UnsavedFiles::update(const std::string& filename,
 {
    // always remove any existing version
    remove(filename);
+   generation_++;
 
    // add it if it's dirty
    if (dirty)
@@ -83,6 +84,7 @@ void UnsavedFiles::remove(const std::string& filename)
       {
          freeUnsavedFile(*pos);
          files_.erase(pos);
+         generation_++;
          break;
       }
    }
@@ -95,6 +97,19 @@ void UnsavedFiles::removeAll()
 
    // empty out our data structures
    files_.clear();
+   generation_++;
+}
+
+void UnsavedFiles::copyTo(UnsavedFiles* pTarget) const
+{
+   pTarget->removeAll();
+   for (std::vector<CXUnsavedFile>::const_iterator it = files_.begin();
+        it != files_.end(); ++it)
+   {
+      pTarget->update(it->Filename,
+                      std::string(it->Contents, it->Length),
+                      true);
+   }
 }
 
 std::ostream& operator << (std::ostream& ostr, UnsavedFiles& unsaved)
@@ -707,6 +707,8 @@ void fixupExecutablePath(FilePath* pExePath)
 
 void abort()
 {
+   // ::abort doesn't run exit handlers so write queued log entries first
+   FileLogWriter::flushAll();
 	::abort();
 }
 
@@ -15,6 +15,9 @@
 
 #include <core/tex/TexLogParser.hpp>
 
+#include <algorithm>
+#include <iterator>
+
 #include <boost/foreach.hpp>
 #include <boost/regex.hpp>
 #include <boost/lexical_cast.hpp>
@@ -139,71 +142,35 @@ FilePath resolveFilename(const FilePath& rootDir,
 }
 
 // TeX wraps lines hard at 79 characters. We use heuristics as described in
-// Sublime Text's TeX plugin to determine where these breaks are.
-void unwrapLines(std::vector<std::string>* pLines,
-                 std::vector<size_t>* pLinesUnwrapped=NULL)
+// Sublime Text's TeX plugin to determine where these breaks are. Returns true
+// if the line can't be the continuation of a wrapped line.
+bool endsWrappedLine(const std::string& nextLine)
 {
    static boost::regex regexLine("^l\\.(\\d+)\\s");
    static boost::regex regexAssignment("^\\\\.*?=");
 
-   std::vector<std::string>::iterator pos = pLines->begin();
-
-   for ( ; pos != pLines->end(); pos++)
-   {
-      // The first line is always long, and not artificially wrapped
-      if (pos == pLines->begin())
-         continue;
-
-      if (pos->length() != 79)
-         continue;
-
-      // The **<filename> line may be long, but we don't care about it
-      if (beginsWith(*pos, "**"))
-         continue;
-
-      while (true)
-      {
-         std::vector<std::string>::iterator nextPos = pos + 1;
-         // No more lines to add
-         if (nextPos == pLines->end())
-            break;
-
-         if (nextPos->empty())
-            break;
-
-         // Underfull/Overfull terminator
-         if (*nextPos == " []")
-            break;
-
-         // Common prefixes
-         if (beginsWith(*nextPos, "File:", "Package:", "Document Class:"))
-            break;
+   if (nextLine.empty())
+      return true;
 
-         // More prefixes
-         if (beginsWith(*nextPos, "LaTeX Warning:", "LaTeX Info:", "LaTeX2e <"))
-            break;
+   // Underfull/Overfull terminator
+   if (nextLine == " []")
+      return true;
 
-         if (boost::regex_search(*nextPos, regexAssignment))
-            break;
+   // Common prefixes
+   if (beginsWith(nextLine, "File:", "Package:", "Document Class:"))
+      return true;
 
-         if (boost::regex_search(*nextPos, regexLine))
-            break;
+   // More prefixes
+   if (beginsWith(nextLine, "LaTeX Warning:", "LaTeX Info:", "LaTeX2e <"))
+      return true;
 
-         bool breakAfterAppend = nextPos->length() != 79;
+   if (boost::regex_search(nextLine, regexAssignment))
+      return true;
 
-         pos->append(*nextPos);
-         // NOTE: Erase is a simple but inefficient way of handling this. Would
-         //    be way faster to maintain an output iterator that points to the
-         //    correct point in pLines, and when finished, truncate whatever
-         //    elements come after the final position of the output iterator.
-         pLines->erase(nextPos, nextPos+1);
-         if (pLinesUnwrapped)
-            pLinesUnwrapped->push_back(1 + (pos - pLines->begin()));
+   if (boost::regex_search(nextLine, regexLine))
+      return true;
 
-         if (breakAfterAppend)
-            break;
-      }
-   }
+   return false;
 }
 
 class FileStack : public boost::noncopyable
@@ -310,25 +277,99 @@ FilePath texFilePath(const std::string& logPath, const FilePath& compileDir)
    }
 }
 
-size_t calculateWrappedLine(const std::vector<size_t>& unwrappedLines,
-                               size_t unwrappedLineNum)
+} // anonymous namespace
+
+struct LatexLogParser::Impl
 {
-   for (std::vector<size_t>::const_iterator it = unwrappedLines.begin();
-        it != unwrappedLines.end();
-        it++)
+   enum State
+   {
+      StateNone,
+      StateBox,      // skipping the remaining lines of an overfull/underfull
+      StateError,    // looking for the l.<n> line of an error
+      StateWarning   // looking for the end of a warning
+   };
+
+   explicit Impl(const FilePath& logFilePath)
+      : logFilePath(logFilePath),
+        fileStack(logFilePath.parent()),
+        physicalLines(0),
+        pendingLineStart(0),
+        pendingLineWrapped(false),
+        state(StateNone),
+        entryLogLine(0)
+   {
+   }
+
+   void addPhysicalLine(const std::string& line);
+   void addLine(const std::string& line, int logLineNum);
+   void addEntry(LogEntry::Type type, int lineNum);
+   void finish();
+
+   FilePath logFilePath;
+   FileStack fileStack;
+   LogEntries logEntries;
+
+   // output following the last complete line
+   std::string partialLine;
+   int physicalLines;
+
+   // line which may still be continued by the next one (when wrapped). the
+   // start is the number of its first line within the log (0 if none)
+   std::string pendingLine;
+   int pendingLineStart;
+   bool pendingLineWrapped;
+
+   // entry which is still being read
+   State state;
+   int entryLogLine;
+   FilePath entryFile;
+   std::string entryMessage;
+};
+
+void LatexLogParser::Impl::addPhysicalLine(const std::string& line)
+{
+   int lineNum = ++physicalLines;
+
+   if (pendingLineStart > 0)
    {
-      if (*it >= unwrappedLineNum)
+      if (pendingLineWrapped && !endsWrappedLine(line))
       {
-         return unwrappedLineNum + (it - unwrappedLines.begin());
+         pendingLine.append(line);
+         pendingLineWrapped = line.length() == 79;
+         if (pendingLineWrapped)
+            return;
       }
+      else
+      {
+         addLine(pendingLine, pendingLineStart);
+         pendingLine = line;
+         pendingLineStart = lineNum;
+         pendingLineWrapped = line.length() == 79 && !beginsWith(line, "**");
+         if (pendingLineWrapped)
+            return;
+      }
+   }
+   else
+   {
+      // The first line is always long, and not artificially wrapped (and
+      // the **<filename> line may be long, but we don't care about it)
+      pendingLine = line;
+      pendingLineStart = lineNum;
+      pendingLineWrapped = lineNum > 1 &&
+                           line.length() == 79 &&
+                           !beginsWith(line, "**");
+      if (pendingLineWrapped)
+         return;
    }
 
-   return unwrappedLineNum + unwrappedLines.size();
+   // the line can't be continued so process it now
+   addLine(pendingLine, pendingLineStart);
+   pendingLine.clear();
+   pendingLineStart = 0;
+   pendingLineWrapped = false;
 }
 
-} // anonymous namespace
-
-Error parseLatexLog(const FilePath& logFilePath, LogEntries* pLogEntries)
+void LatexLogParser::Impl::addLine(const std::string& line, int logLineNum)
 {
    static boost::regex regexOverUnderfullLines(" at lines (\\d+)--(\\d+)\\s*(?:\\[])?$");
    static boost::regex regexWarning("^(?:.*?) Warning: (.+)");
@@ -336,174 +377,216 @@ Error parseLatexLog(const FilePath& logFilePath, LogEntries* pLogEntries)
    static boost::regex regexLnn("^l\\.(\\d+)\\s");
    static boost::regex regexCStyleError("^(.+):(\\d+):\\s(.+)$");
 
-   std::vector<std::string> lines;
-   Error error = readStringVectorFromFile(logFilePath, &lines, false);
-   if (error)
-      return error;
-
-   std::vector<size_t> linesUnwrapped;
-   unwrapLines(&lines, &linesUnwrapped);
-
-   FilePath rootDir = logFilePath.parent();
-   FileStack fileStack(rootDir);
-
-   for (std::vector<std::string>::const_iterator it = lines.begin();
-        it != lines.end();
-        it++)
+   switch (state)
    {
-      const std::string& line = *it;
-      int logLineNum = (it - lines.begin()) + 1;
+   case StateBox:
+   {
+      // For multi-line case, we're looking for " []" on a line by itself
+      if (line == " []")
+         state = StateNone;
+      return;
+   }
 
-      // We slurp overfull/underfull messages with no further processing
-      // (i.e. not manipulating the file stack)
+   case StateError:
+   {
+      boost::smatch match;
+      if (boost::regex_search(line, match, regexLnn))
+         addEntry(LogEntry::Error, safe_convert::stringTo<int>(match[1], -1));
+      return;
+   }
 
-      if (beginsWith(line, "Overfull ", "Underfull "))
+   case StateWarning:
+   {
+      entryMessage.append(line);
+      if (boost::algorithm::ends_with(entryMessage, "."))
       {
-         std::string msg = line;
          int lineNum = -1;
+         boost::smatch warningEndMatch;
+         if (boost::regex_search(line, warningEndMatch, regexWarningEnd))
+            lineNum = safe_convert::stringTo<int>(warningEndMatch[1], -1);
+         addEntry(LogEntry::Warning, lineNum);
+      }
+      return;
+   }
 
-         // Parse lines, if present
-         boost::smatch overUnderfullLinesMatch;
-         if (boost::regex_search(line,
-                                 overUnderfullLinesMatch,
-                                 regexOverUnderfullLines))
-         {
-            lineNum = safe_convert::stringTo<int>(overUnderfullLinesMatch[1],
-                                                  -1);
-         }
+   case StateNone:
+      break;
+   }
 
-         // Single line case
-         bool singleLine = boost::algorithm::ends_with(line, "[]");
+   // We slurp overfull/underfull messages with no further processing
+   // (i.e. not manipulating the file stack)
 
-         if (singleLine)
-         {
-            msg.erase(line.size()-2, 2);
-            boost::algorithm::trim_right(msg);
-         }
+   if (beginsWith(line, "Overfull ", "Underfull "))
+   {
+      std::string msg = line;
+      int lineNum = -1;
+
+      // Parse lines, if present
+      boost::smatch overUnderfullLinesMatch;
+      if (boost::regex_search(line,
+                              overUnderfullLinesMatch,
+                              regexOverUnderfullLines))
+      {
+         lineNum = safe_convert::stringTo<int>(overUnderfullLinesMatch[1],
+                                               -1);
+      }
 
-         pLogEntries->push_back(LogEntry(logFilePath,
-                                         calculateWrappedLine(linesUnwrapped,
-                                                              logLineNum),
-                                         LogEntry::Box,
-                                         fileStack.currentFile(),
-                                         lineNum,
-                                         msg));
+      // Single line case
+      bool singleLine = boost::algorithm::ends_with(line, "[]");
 
-         if (singleLine)
-            continue;
+      if (singleLine)
+      {
+         msg.erase(line.size()-2, 2);
+         boost::algorithm::trim_right(msg);
+      }
 
-         for (; it != lines.end(); it++)
-         {
-            // For multi-line case, we're looking for " []" on a line by itself
-            if (*it == " []")
-               break;
-         }
+      logEntries.push_back(LogEntry(logFilePath,
+                                    logLineNum,
+                                    LogEntry::Box,
+                                    fileStack.currentFile(),
+                                    lineNum,
+                                    msg));
 
-         // The iterator would be incremented by the outer for loop, must not
-         // let it go past the end! (If we did get to the end, it would
-         // mean the log file was malformed, but we still can't crash in this
-         // situation.)
-         if (it == lines.end())
-            break;
-         else
-            continue;
-      }
+      if (!singleLine)
+         state = StateBox;
+      return;
+   }
 
-      fileStack.processLine(line);
+   fileStack.processLine(line);
 
-      // Now see if it's an error or warning
+   // Now see if it's an error or warning
 
-      if (beginsWith(line, "! "))
-      {
-         std::string errorMsg = line.substr(2);
-         int lineNum = -1;
+   if (beginsWith(line, "! "))
+   {
+      state = StateError;
+      entryLogLine = logLineNum;
+      entryFile = fileStack.currentFile();
+      entryMessage = line.substr(2);
+      return;
+   }
 
-         boost::smatch match;
-         for (it++; it != lines.end(); it++)
-         {
-            if (boost::regex_search(*it, match, regexLnn))
-            {
-               lineNum = safe_convert::stringTo<int>(match[1], -1);
-               break;
-            }
-         }
+   boost::smatch warningMatch;
+   if (boost::regex_search(line, warningMatch, regexWarning))
+   {
+      state = StateWarning;
+      entryLogLine = logLineNum;
+      entryFile = fileStack.currentFile();
+      entryMessage = warningMatch[1];
 
-         pLogEntries->push_back(LogEntry(logFilePath,
-                                         calculateWrappedLine(linesUnwrapped,
-                                                              logLineNum),
-                                         LogEntry::Error,
-                                         fileStack.currentFile(),
-                                         lineNum,
-                                         errorMsg));
-
-         // The iterator would be incremented by the outer for loop, must not
-         // let it go past the end! (If we did get to the end, it would
-         // mean the log file was malformed, but we still can't crash in this
-         // situation.)
-         if (it == lines.end())
-            break;
-         else
-            continue;
+      if (boost::algorithm::ends_with(entryMessage, "."))
+      {
+         int lineNum = -1;
+         boost::smatch warningEndMatch;
+         if (boost::regex_search(line, warningEndMatch, regexWarningEnd))
+            lineNum = safe_convert::stringTo<int>(warningEndMatch[1], -1);
+         addEntry(LogEntry::Warning, lineNum);
       }
+      return;
+   }
 
-      boost::smatch warningMatch;
-      if (boost::regex_search(line, warningMatch, regexWarning))
+   boost::smatch cStyleErrorMatch;
+   if (boost::regex_search(line, cStyleErrorMatch, regexCStyleError))
+   {
+      FilePath cstyleFile = resolveFilename(logFilePath.parent(),
+                                            cStyleErrorMatch[1]);
+      if (cstyleFile.exists())
       {
-         std::string warningMsg = warningMatch[1];
-         int lineNum = -1;
-         while (true)
-         {
-            if (boost::algorithm::ends_with(warningMsg, "."))
-            {
-               boost::smatch warningEndMatch;
-               if (boost::regex_search(*it, warningEndMatch, regexWarningEnd))
-               {
-                  lineNum = safe_convert::stringTo<int>(warningEndMatch[1], -1);
-               }
-               break;
-            }
+         int lineNum = safe_convert::stringTo<int>(cStyleErrorMatch[2], -1);
+         logEntries.push_back(LogEntry(logFilePath,
+                                       logLineNum,
+                                       LogEntry::Error,
+                                       cstyleFile,
+                                       lineNum,
+                                       cStyleErrorMatch[3]));
+      }
+   }
+}
 
-            if (++it == lines.end())
-               break;
-            warningMsg.append(*it);
-         }
+void LatexLogParser::Impl::addEntry(LogEntry::Type type, int lineNum)
+{
+   logEntries.push_back(LogEntry(logFilePath,
+                                 entryLogLine,
+                                 type,
+                                 entryFile,
+                                 lineNum,
+                                 entryMessage));
+   state = StateNone;
+   entryMessage.clear();
+}
 
-         pLogEntries->push_back(LogEntry(logFilePath,
-                                         calculateWrappedLine(linesUnwrapped,
-                                                              logLineNum),
-                                         LogEntry::Warning,
-                                         fileStack.currentFile(),
-                                         lineNum,
-                                         warningMsg));
-
-         // The iterator would be incremented by the outer for loop, must not
-         // let it go past the end! (If we did get to the end, it would
-         // mean the log file was malformed, but we still can't crash in this
-         // situation.)
-         if (it == lines.end())
-            break;
-         else
-            continue;
-      }
+void LatexLogParser::Impl::finish()
+{
+   if (pendingLineStart > 0)
+   {
+      addLine(pendingLine, pendingLineStart);
+      pendingLine.clear();
+      pendingLineStart = 0;
+      pendingLineWrapped = false;
+   }
+
+   // entries which were cut off by the end of the log are still reported
+   // (the log is malformed, but that's when they are most useful)
+   if (state == StateError || state == StateWarning)
+      addEntry(state == StateError ? LogEntry::Error : LogEntry::Warning, -1);
+   state = StateNone;
+}
+
+LatexLogParser::LatexLogParser(const FilePath& logFilePath)
+   : pImpl_(new Impl(logFilePath))
+{
+}
 
-      boost::smatch cStyleErrorMatch;
-      if (boost::regex_search(line, cStyleErrorMatch, regexCStyleError))
+LatexLogParser::~LatexLogParser()
+{
+}
+
+void LatexLogParser::addOutput(const std::string& output)
+{
+   std::string::size_type pos = 0;
+   std::string::size_type next;
+   while ((next = output.find('\n', pos)) != std::string::npos)
+   {
+      if (pImpl_->partialLine.empty())
       {
-         FilePath cstyleFile = resolveFilename(rootDir, cStyleErrorMatch[1]);
-         if (cstyleFile.exists())
-         {
-            int lineNum = safe_convert::stringTo<int>(cStyleErrorMatch[2], -1);
-            pLogEntries->push_back(LogEntry(logFilePath,
-                                            calculateWrappedLine(linesUnwrapped,
-                                                                 logLineNum),
-                                            LogEntry::Error,
-                                            cstyleFile,
-                                            lineNum,
-                                            cStyleErrorMatch[3]));
-         }
+         pImpl_->addPhysicalLine(output.substr(pos, next - pos));
+      }
+      else
+      {
+         pImpl_->partialLine.append(output, pos, next - pos);
+         pImpl_->addPhysicalLine(pImpl_->partialLine);
+         pImpl_->partialLine.clear();
       }
+      pos = next + 1;
    }
 
+   pImpl_->partialLine.append(output, pos, std::string::npos);
+}
+
+void LatexLogParser::finish()
+{
+   pImpl_->finish();
+}
+
+const LogEntries& LatexLogParser::logEntries() const
+{
+   return pImpl_->logEntries;
+}
+
+Error parseLatexLog(const FilePath& logFilePath, LogEntries* pLogEntries)
+{
+   std::string contents;
+   Error error = readStringFromFile(logFilePath, &contents);
+   if (error)
+      return error;
+
+   LatexLogParser parser(logFilePath);
+   parser.addOutput(contents);
+   parser.finish();
+
+   std::copy(parser.logEntries().begin(),
+             parser.logEntries().end(),
+             std::back_inserter(*pLogEntries));
+
    return Success();
 }
 
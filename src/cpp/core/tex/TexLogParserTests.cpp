@@ -0,0 +1,116 @@
+/*
+ * TexLogParserTests.cpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <tests/TestThat.hpp>
+
+#include <core/tex/TexLogParser.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+
+namespace rstudio {
+namespace core {
+namespace tex {
+
+namespace {
+
+std::string sampleLog()
+{
+   // the warning is wrapped at 79 characters
+   return
+      "This is pdfTeX, Version 3.14159265-2.6-1.40.16 (TeX Live 2015) (preloaded format=pdflatex)\n"
+      "**sample.tex\n"
+      "(./sample.tex\n"
+      "LaTeX Warning: Citation `knuth84' on page 1 undefined on input line 12.\n"
+      "\n"
+      "LaTeX Warning: Reference `fig:one' on page 12 undefined because it is not found\n"
+      " on input line 20.\n"
+      "\n"
+      "Overfull \\hbox (12.0pt too wide) in paragraph at lines 30--31\n"
+      "[]\\OT1/cmr/m/n/10 long line\n"
+      " []\n"
+      "\n"
+      "! Undefined control sequence.\n"
+      "l.42 \\foo\n"
+      "         \n"
+      ")\n";
+}
+
+LogEntries parse(const std::string& log, std::size_t chunkSize)
+{
+   LatexLogParser parser(FilePath("/tmp/sample.log"));
+   for (std::size_t i = 0; i < log.size(); i += chunkSize)
+      parser.addOutput(log.substr(i, chunkSize));
+   parser.finish();
+   return parser.logEntries();
+}
+
+} // anonymous namespace
+
+context("TexLogParser")
+{
+   test_that("errors, warnings and boxes are parsed")
+   {
+      LogEntries entries = parse(sampleLog(), sampleLog().size());
+      expect_true(entries.size() == 4);
+
+      expect_true(entries[0].type() == LogEntry::Warning);
+      expect_true(entries[0].line() == 12);
+      expect_true(entries[0].logLine() == 4);
+
+      // wrapped lines are unwrapped but log lines refer to the log itself
+      expect_true(entries[1].type() == LogEntry::Warning);
+      expect_true(entries[1].line() == 20);
+      expect_true(entries[1].logLine() == 6);
+
+      expect_true(entries[2].type() == LogEntry::Box);
+      expect_true(entries[2].line() == 30);
+      expect_true(entries[2].logLine() == 9);
+
+      expect_true(entries[3].type() == LogEntry::Error);
+      expect_true(entries[3].message() == "Undefined control sequence.");
+      expect_true(entries[3].line() == 42);
+      expect_true(entries[3].logLine() == 13);
+   }
+
+   test_that("parsing in chunks gives the same entries")
+   {
+      LogEntries expected = parse(sampleLog(), sampleLog().size());
+      for (std::size_t chunkSize = 1; chunkSize < 20; chunkSize++)
+      {
+         LogEntries entries = parse(sampleLog(), chunkSize);
+         expect_true(entries.size() == expected.size());
+         for (std::size_t i = 0; i < entries.size() && i < expected.size(); i++)
+         {
+            expect_true(entries[i].type() == expected[i].type());
+            expect_true(entries[i].line() == expected[i].line());
+            expect_true(entries[i].logLine() == expected[i].logLine());
+            expect_true(entries[i].message() == expected[i].message());
+         }
+      }
+   }
+
+   test_that("entries cut off by the end of the log are reported")
+   {
+      LogEntries entries = parse("(./sample.tex\n! Emergency stop.\n", 7);
+      expect_true(entries.size() == 1);
+      expect_true(entries[0].type() == LogEntry::Error);
+      expect_true(entries[0].line() == -1);
+   }
+}
+
+} // namespace tex
+} // namespace core
+} // namespace rstudio
@@ -0,0 +1,238 @@
+/*
+ * Rope.cpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/text/Rope.hpp>
+
+#include <algorithm>
+
+#include <boost/crc.hpp>
+
+#include <zlib.h>
+
+#include <core/Error.hpp>
+#include <core/StringUtils.hpp>
+
+namespace rstudio {
+namespace core {
+namespace text {
+
+namespace {
+
+// chunks are split to this size and edits which leave a chunk smaller
+// than the minimum merge it with its neighbor
+const std::size_t kChunkSize = 8 * 1024;
+const std::size_t kMaxChunkSize = 2 * kChunkSize;
+const std::size_t kMinChunkSize = kChunkSize / 4;
+
+bool isContinuationByte(char ch)
+{
+   return (static_cast<unsigned char>(ch) & 0xC0) == 0x80;
+}
+
+} // anonymous namespace
+
+Rope::Chunk::Chunk(const std::string& text)
+   : text(text), characters(0), validUtf8(true)
+{
+   Error error = string_utils::utf8Distance(this->text.begin(),
+                                            this->text.end(),
+                                            &characters);
+   if (error)
+   {
+      validUtf8 = false;
+      characters = 0;
+      for (std::string::const_iterator it = this->text.begin();
+           it != this->text.end();
+           ++it)
+      {
+         if (!isContinuationByte(*it))
+            characters++;
+      }
+   }
+
+   boost::crc_32_type result;
+   result.process_bytes(this->text.data(), this->text.length());
+   crc = result.checksum();
+}
+
+Rope::Rope()
+   : size_(0)
+{
+}
+
+Rope::Rope(const std::string& text)
+   : size_(0)
+{
+   assign(text);
+}
+
+void Rope::assign(const std::string& text)
+{
+   chunks_.clear();
+   split(text, &chunks_);
+   size_ = text.size();
+}
+
+std::string Rope::str() const
+{
+   std::string text;
+   text.reserve(size_);
+   for (std::vector<ChunkPtr>::const_iterator it = chunks_.begin();
+        it != chunks_.end();
+        ++it)
+   {
+      text.append((*it)->text);
+   }
+   return text;
+}
+
+bool Rope::byteOffset(std::size_t characterOffset,
+                      std::size_t* pByteOffset) const
+{
+   std::size_t offset = 0;
+   for (std::vector<ChunkPtr>::const_iterator it = chunks_.begin();
+        it != chunks_.end();
+        ++it)
+   {
+      const Chunk& chunk = **it;
+      if (!chunk.validUtf8)
+         return false;
+
+      if (characterOffset <= chunk.characters)
+      {
+         std::string::const_iterator pos = chunk.text.begin();
+         Error error = string_utils::utf8Advance(pos,
+                                                 characterOffset,
+                                                 chunk.text.end(),
+                                                 &pos);
+         if (error)
+            return false;
+
+         *pByteOffset = offset + (pos - chunk.text.begin());
+         return true;
+      }
+
+      characterOffset -= chunk.characters;
+      offset += chunk.text.size();
+   }
+
+   *pByteOffset = size_;
+   return true;
+}
+
+void Rope::replace(std::size_t offset,
+                   std::size_t length,
+                   const std::string& text)
+{
+   offset = std::min(offset, size_);
+   length = std::min(length, size_ - offset);
+   std::size_t end = offset + length;
+
+   if (chunks_.empty())
+   {
+      assign(text);
+      return;
+   }
+
+   // find the first chunk containing the range (an offset at the very end
+   // of the text belongs to the last chunk)
+   std::size_t first = 0;
+   std::size_t firstStart = 0;
+   while (first < chunks_.size() - 1 &&
+          firstStart + chunks_[first]->text.size() <= offset)
+   {
+      firstStart += chunks_[first]->text.size();
+      first++;
+   }
+
+   // find the last chunk containing the range
+   std::size_t last = first;
+   std::size_t lastStart = firstStart;
+   while (last < chunks_.size() - 1 &&
+          lastStart + chunks_[last]->text.size() < end)
+   {
+      lastStart += chunks_[last]->text.size();
+      last++;
+   }
+
+   // build the replacement for the affected chunks
+   std::string replacement = chunks_[first]->text.substr(0, offset - firstStart);
+   replacement.append(text);
+   replacement.append(chunks_[last]->text.substr(end - lastStart));
+
+   // merge small results with a neighbor so edits don't fragment the text
+   if (replacement.size() < kMinChunkSize)
+   {
+      if (last + 1 < chunks_.size())
+      {
+         last++;
+         replacement.append(chunks_[last]->text);
+      }
+      else if (first > 0)
+      {
+         first--;
+         replacement.insert(0, chunks_[first]->text);
+      }
+   }
+
+   std::vector<ChunkPtr> replacementChunks;
+   split(replacement, &replacementChunks);
+
+   chunks_.erase(chunks_.begin() + first, chunks_.begin() + last + 1);
+   chunks_.insert(chunks_.begin() + first,
+                  replacementChunks.begin(),
+                  replacementChunks.end());
+
+   size_ = size_ - length + text.size();
+}
+
+boost::uint32_t Rope::crc32() const
+{
+   uLong crc = ::crc32(0L, Z_NULL, 0);
+   for (std::vector<ChunkPtr>::const_iterator it = chunks_.begin();
+        it != chunks_.end();
+        ++it)
+   {
+      crc = ::crc32_combine(crc,
+                            (*it)->crc,
+                            static_cast<z_off_t>((*it)->text.size()));
+   }
+   return static_cast<boost::uint32_t>(crc);
+}
+
+void Rope::split(const std::string& text, std::vector<ChunkPtr>* pChunks)
+{
+   std::size_t pos = 0;
+   while (pos < text.size())
+   {
+      std::size_t remaining = text.size() - pos;
+      std::size_t length = remaining;
+      if (remaining > kMaxChunkSize)
+      {
+         // split on a character boundary where possible
+         length = kChunkSize;
+         std::size_t limit = 3;
+         while (limit-- > 0 && isContinuationByte(text[pos + length]))
+            length--;
+      }
+
+      pChunks->push_back(ChunkPtr(new Chunk(text.substr(pos, length))));
+      pos += length;
+   }
+}
+
+} // namespace text
+} // namespace core
+} // namespace rstudio
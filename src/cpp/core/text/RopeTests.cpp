@@ -0,0 +1,103 @@
+/*
+ * RopeTests.cpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <tests/TestThat.hpp>
+
+#include <boost/crc.hpp>
+
+#include <core/text/Rope.hpp>
+
+namespace rstudio {
+namespace core {
+namespace text {
+
+namespace {
+
+boost::uint32_t crc32(const std::string& text)
+{
+   boost::crc_32_type result;
+   result.process_bytes(text.data(), text.length());
+   return result.checksum();
+}
+
+std::string largeText()
+{
+   // multi-byte characters throughout so chunks split inside them
+   std::string text;
+   for (int i = 0; i < 10000; i++)
+      text.append("line \xc3\xa9\xe2\x82\xac\n");
+   return text;
+}
+
+} // anonymous namespace
+
+context("Rope")
+{
+   test_that("Edits match the equivalent string operations")
+   {
+      std::string text = largeText();
+      Rope rope(text);
+      expect_true(rope.str() == text);
+
+      rope.replace(5, 2, "e");
+      text.replace(5, 2, "e");
+      expect_true(rope.str() == text);
+
+      rope.replace(text.size() - 3, 3, "end");
+      text.replace(text.size() - 3, 3, "end");
+      expect_true(rope.str() == text);
+
+      rope.replace(20000, 30000, std::string());
+      text.replace(20000, 30000, std::string());
+      expect_true(rope.str() == text);
+
+      rope.replace(text.size(), 0, "more");
+      text.append("more");
+      expect_true(rope.str() == text);
+      expect_true(rope.size() == text.size());
+   }
+
+   test_that("Checksums match those of the flattened text")
+   {
+      std::string text = largeText();
+      Rope rope(text);
+      expect_true(rope.crc32() == crc32(text));
+
+      rope.replace(12345, 10, "inserted");
+      text.replace(12345, 10, "inserted");
+      expect_true(rope.crc32() == crc32(text));
+
+      expect_true(Rope().crc32() == crc32(std::string()));
+   }
+
+   test_that("Character offsets are converted to byte offsets")
+   {
+      // each line is 5 + 1 + 1 + 1 characters and 5 + 2 + 3 + 1 bytes
+      Rope rope(largeText());
+      std::size_t offset = 0;
+      expect_true(rope.byteOffset(8 * 5000 + 6, &offset));
+      expect_true(offset == 11 * 5000 + 7);
+
+      expect_true(rope.byteOffset(1000000, &offset));
+      expect_true(offset == rope.size());
+
+      Rope invalid(std::string("ab\xff") + "cd");
+      expect_false(invalid.byteOffset(4, &offset));
+   }
+}
+
+} // namespace text
+} // namespace core
+} // namespace rstudio
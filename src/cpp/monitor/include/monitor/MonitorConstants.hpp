@@ -19,6 +19,8 @@
 #define kMonitorSocketPath         "/tmp/rstudio-rserver/rserver-monitor.socket"
 #define kMonitorSharedSecretEnvVar "RS_MONITOR_SHARED_SECRET"
 #define kMonitorIntervalSeconds    "monitor-interval-seconds"
+#define kMonitorMetricsPath        "monitor-metrics-path"
+#define kMonitorMetricsIntervalSeconds "monitor-metrics-interval-seconds"
 
 #endif // MONITOR_CONSTANTS_HPP
 
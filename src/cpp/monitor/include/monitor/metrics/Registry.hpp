@@ -0,0 +1,136 @@
+/*
+ * Registry.hpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef MONITOR_METRICS_REGISTRY_HPP
+#define MONITOR_METRICS_REGISTRY_HPP
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include <boost/utility.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace rstudio {
+namespace core {
+   class Error;
+}
+}
+
+namespace rstudio {
+namespace monitor {
+namespace metrics {
+
+// metrics registered by name within the process. counters and histograms
+// are recorded into per-thread cells (so threads recording the same metric
+// don't contend with each other) which are summed when the metrics are
+// written. metric handles are cheap to copy and remain valid for the life
+// of the process so they can be obtained once and kept in a static
+
+namespace detail {
+   class Family;
+}
+
+class Counter
+{
+public:
+   Counter() : pFamily_(NULL) {}
+   explicit Counter(detail::Family* pFamily) : pFamily_(pFamily) {}
+   // COPYING: via compiler
+
+   void increment(double amount = 1) const;
+
+private:
+   detail::Family* pFamily_;
+};
+
+class Gauge
+{
+public:
+   Gauge() : pFamily_(NULL) {}
+   explicit Gauge(detail::Family* pFamily) : pFamily_(pFamily) {}
+   // COPYING: via compiler
+
+   void set(double value) const;
+   void add(double amount) const;
+
+private:
+   detail::Family* pFamily_;
+};
+
+class Histogram
+{
+public:
+   Histogram() : pFamily_(NULL) {}
+   explicit Histogram(detail::Family* pFamily) : pFamily_(pFamily) {}
+   // COPYING: via compiler
+
+   void observe(double value) const;
+
+private:
+   detail::Family* pFamily_;
+};
+
+// get (registering if necessary) the metric with the given name. names
+// should be of the form <program>_<subsystem>_<name>_<unit> (for example
+// rsession_http_request_duration_seconds). counter names must not end in
+// _total since the suffix is appended when they are written
+Counter counter(const std::string& name, const std::string& help);
+Gauge gauge(const std::string& name, const std::string& help);
+
+// histogram buckets are the upper bounds of each bucket (the default
+// buckets are suitable for latencies measured in seconds)
+Histogram histogram(const std::string& name,
+                    const std::string& help,
+                    const std::vector<double>& buckets = std::vector<double>());
+
+// record the lifetime of the timer (in seconds) into a histogram
+class ScopedTimer : boost::noncopyable
+{
+public:
+   explicit ScopedTimer(const Histogram& histogram)
+      : histogram_(histogram),
+        start_(boost::posix_time::microsec_clock::universal_time())
+   {
+   }
+
+   ~ScopedTimer();
+
+private:
+   Histogram histogram_;
+   boost::posix_time::ptime start_;
+};
+
+// write all registered metrics using the OpenMetrics text format
+void writeOpenMetrics(std::ostream& os);
+
+// write the metrics to the specified path. if the path is a unix domain
+// socket the metrics are sent to it, otherwise they are written to the path
+// as a file (replacing it atomically, so concurrent writers don't collide)
+core::Error exportMetrics(const std::string& path);
+
+// periodically export the metrics to the specified path
+core::Error startExporter(const std::string& path, int intervalSeconds);
+
+// expand the %u (user) and %p (process id) placeholders in an export path
+// so that each process can be given its own file
+std::string expandExportPath(const std::string& path,
+                             const std::string& user);
+
+} // namespace metrics
+} // namespace monitor
+} // namespace rstudio
+
+#endif // MONITOR_METRICS_REGISTRY_HPP
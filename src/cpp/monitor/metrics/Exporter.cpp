@@ -0,0 +1,180 @@
+/*
+ * Exporter.cpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <monitor/metrics/Registry.hpp>
+
+#include <sstream>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/algorithm/string/replace.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/SafeConvert.hpp>
+#include <core/Thread.hpp>
+#include <core/system/System.hpp>
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace monitor {
+namespace metrics {
+
+namespace {
+
+#ifndef _WIN32
+
+bool isSocket(const std::string& path)
+{
+   struct stat st;
+   return ::stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode);
+}
+
+Error sendToSocket(const std::string& path, const std::string& metrics)
+{
+   struct sockaddr_un address;
+   if (path.size() >= sizeof(address.sun_path))
+      return systemError(boost::system::errc::filename_too_long,
+                         ERROR_LOCATION);
+
+   int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+   if (fd == -1)
+      return systemError(errno, ERROR_LOCATION);
+
+   ::memset(&address, 0, sizeof(address));
+   address.sun_family = AF_UNIX;
+   ::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+   Error error;
+   if (::connect(fd, (struct sockaddr*)&address, sizeof(address)) == -1)
+   {
+      error = systemError(errno, ERROR_LOCATION);
+   }
+   else
+   {
+      std::size_t written = 0;
+      while (written < metrics.size())
+      {
+         ssize_t result = ::write(fd,
+                                  metrics.data() + written,
+                                  metrics.size() - written);
+         if (result == -1)
+         {
+            if (errno == EINTR)
+               continue;
+            error = systemError(errno, ERROR_LOCATION);
+            break;
+         }
+         written += result;
+      }
+   }
+
+   ::close(fd);
+   if (error)
+      error.addProperty("path", path);
+   return error;
+}
+
+#endif
+
+void exporterThreadMain(const std::string& path, int intervalSeconds)
+{
+   try
+   {
+      // only log the first of a run of failures (the target may be missing
+      // for extended periods and we don't want to flood the log)
+      bool failing = false;
+      while (true)
+      {
+         boost::this_thread::sleep(boost::posix_time::seconds(intervalSeconds));
+
+         Error error = exportMetrics(path);
+         if (error && !failing)
+            LOG_ERROR(error);
+         failing = !!error;
+      }
+   }
+   catch(const boost::thread_interrupted&)
+   {
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+}
+
+} // anonymous namespace
+
+Error exportMetrics(const std::string& path)
+{
+   std::ostringstream ostr;
+   writeOpenMetrics(ostr);
+
+#ifndef _WIN32
+   if (isSocket(path))
+      return sendToSocket(path, ostr.str());
+#endif
+
+   // write to a temporary file and then rename it into place so readers
+   // never see a partially written file (the temporary file is unique to
+   // this write so that other processes exporting to the same path can't
+   // write into it)
+   FilePath targetPath(path);
+   FilePath tempPath(path + ".tmp-" + core::system::generateShortenedUuid());
+   Error error = writeStringToFile(tempPath, ostr.str());
+   if (!error)
+      error = tempPath.move(targetPath);
+   if (error)
+   {
+      Error removeError = tempPath.removeIfExists();
+      if (removeError)
+         LOG_ERROR(removeError);
+   }
+   return error;
+}
+
+Error startExporter(const std::string& path, int intervalSeconds)
+{
+   if (path.empty() || intervalSeconds <= 0)
+      return systemError(boost::system::errc::invalid_argument, ERROR_LOCATION);
+
+   thread::safeLaunchThread(boost::bind(exporterThreadMain,
+                                        path,
+                                        intervalSeconds));
+   return Success();
+}
+
+std::string expandExportPath(const std::string& path, const std::string& user)
+{
+   std::string expanded = boost::algorithm::replace_all_copy(path, "%u", user);
+   boost::algorithm::replace_all(
+            expanded,
+            "%p",
+            safe_convert::numberToString(core::system::currentProcessId()));
+   return expanded;
+}
+
+} // namespace metrics
+} // namespace monitor
+} // namespace rstudio
@@ -0,0 +1,434 @@
+/*
+ * Registry.cpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <monitor/metrics/Registry.hpp>
+
+#include <cmath>
+#include <iomanip>
+#include <map>
+#include <set>
+#include <sstream>
+
+#include <boost/cstdint.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/Thread.hpp>
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace monitor {
+namespace metrics {
+
+namespace detail {
+
+enum FamilyType
+{
+   CounterFamily,
+   GaugeFamily,
+   HistogramFamily
+};
+
+struct Cell
+{
+   Cell(Family* pFamily, std::size_t buckets)
+      : pFamily(pFamily), value(0), count(0), buckets(buckets, 0)
+   {
+   }
+
+   void add(const Cell& other)
+   {
+      value += other.value;
+      count += other.count;
+      for (std::size_t i = 0; i < buckets.size(); i++)
+         buckets[i] += other.buckets[i];
+   }
+
+   Family* pFamily;
+   boost::mutex mutex;
+
+   // the counter or gauge value (or the sum of the observed values for
+   // histograms) along with the observation count and per-bucket counts
+   double value;
+   boost::uint64_t count;
+   std::vector<boost::uint64_t> buckets;
+};
+
+void retireCell(Cell* pCell);
+
+class Family : boost::noncopyable
+{
+public:
+   Family(const std::string& name,
+          const std::string& help,
+          FamilyType type,
+          const std::vector<double>& bounds)
+      : name_(name),
+        help_(help),
+        type_(type),
+        bounds_(bounds),
+        threadCell_(retireCell),
+        total_(this, bounds.size() + 1)
+   {
+   }
+
+   const std::string& name() const { return name_; }
+   FamilyType type() const { return type_; }
+
+   // the cell for the calling thread
+   Cell& threadCell()
+   {
+      Cell* pCell = threadCell_.get();
+      if (pCell == NULL)
+      {
+         pCell = new Cell(this, bounds_.size() + 1);
+         LOCK_MUTEX(mutex_)
+         {
+            cells_.insert(pCell);
+         }
+         END_LOCK_MUTEX
+         threadCell_.reset(pCell);
+      }
+      return *pCell;
+   }
+
+   void observe(double value)
+   {
+      std::size_t bucket = 0;
+      while (bucket < bounds_.size() && value > bounds_[bucket])
+         bucket++;
+
+      Cell& cell = threadCell();
+      LOCK_MUTEX(cell.mutex)
+      {
+         cell.value += value;
+         cell.count++;
+         cell.buckets[bucket]++;
+      }
+      END_LOCK_MUTEX
+   }
+
+   // gauges have a single value (setting them can't be split across threads)
+   void setValue(double value, bool add)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         total_.value = add ? total_.value + value : value;
+      }
+      END_LOCK_MUTEX
+   }
+
+   // fold the cell of a thread which is exiting into the total
+   void retire(Cell* pCell)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         LOCK_MUTEX(pCell->mutex)
+         {
+            total_.add(*pCell);
+         }
+         END_LOCK_MUTEX
+         cells_.erase(pCell);
+      }
+      END_LOCK_MUTEX
+      delete pCell;
+   }
+
+   void write(std::ostream& os);
+
+private:
+   void snapshot(Cell* pSnapshot);
+
+   std::string name_;
+   std::string help_;
+   FamilyType type_;
+   std::vector<double> bounds_;
+
+   boost::thread_specific_ptr<Cell> threadCell_;
+
+   // protects the set of cells and the total (which holds the values of
+   // retired cells and the value of gauges)
+   boost::mutex mutex_;
+   std::set<Cell*> cells_;
+   Cell total_;
+};
+
+void retireCell(Cell* pCell)
+{
+   pCell->pFamily->retire(pCell);
+}
+
+} // namespace detail
+
+namespace {
+
+using namespace detail;
+
+std::string formatNumber(double value)
+{
+   std::ostringstream ostr;
+   if (value == std::floor(value) && std::fabs(value) < 1e15)
+      ostr << static_cast<boost::int64_t>(value);
+   else
+      ostr << std::setprecision(15) << value;
+   return ostr.str();
+}
+
+std::string escapeHelp(const std::string& help)
+{
+   std::string escaped;
+   for (std::string::const_iterator it = help.begin(); it != help.end(); ++it)
+   {
+      if (*it == '\\')
+         escaped.append("\\\\");
+      else if (*it == '\n')
+         escaped.append("\\n");
+      else
+         escaped.push_back(*it);
+   }
+   return escaped;
+}
+
+// metric names may only contain letters, digits, underscores and colons
+std::string metricName(const std::string& name)
+{
+   std::string result = name;
+   for (std::size_t i = 0; i < result.size(); i++)
+   {
+      char ch = result[i];
+      bool valid = (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') ||
+                   (ch >= '0' && ch <= '9' && i > 0) || ch == '_' || ch == ':';
+      if (!valid)
+         result[i] = '_';
+   }
+   return result;
+}
+
+std::vector<double> defaultBuckets()
+{
+   const double buckets[] = { 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025,
+                              0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10 };
+   return std::vector<double>(buckets,
+                              buckets + sizeof(buckets) / sizeof(double));
+}
+
+// the registry (allocated on the heap and never freed so that metrics can
+// be recorded during static destruction)
+boost::mutex& registryMutex()
+{
+   static boost::mutex* pMutex = new boost::mutex();
+   return *pMutex;
+}
+
+typedef std::map<std::string, Family*> Families;
+Families& families()
+{
+   static Families* pFamilies = new Families();
+   return *pFamilies;
+}
+
+Family* registerFamily(const std::string& name,
+                       const std::string& help,
+                       FamilyType type,
+                       const std::vector<double>& bounds)
+{
+   std::string familyName = metricName(name);
+
+   LOCK_MUTEX(registryMutex())
+   {
+      Families::iterator it = families().find(familyName);
+      if (it != families().end())
+      {
+         if (it->second->type() != type)
+         {
+            LOG_ERROR_MESSAGE("Metric " + familyName +
+                              " registered with conflicting types");
+            return NULL;
+         }
+         return it->second;
+      }
+
+      Family* pFamily = new Family(familyName, help, type, bounds);
+      families()[familyName] = pFamily;
+      return pFamily;
+   }
+   END_LOCK_MUTEX
+
+   return NULL;
+}
+
+} // anonymous namespace
+
+void detail::Family::snapshot(Cell* pSnapshot)
+{
+   LOCK_MUTEX(mutex_)
+   {
+      pSnapshot->add(total_);
+      BOOST_FOREACH(Cell* pCell, cells_)
+      {
+         LOCK_MUTEX(pCell->mutex)
+         {
+            pSnapshot->add(*pCell);
+         }
+         END_LOCK_MUTEX
+      }
+   }
+   END_LOCK_MUTEX
+}
+
+void detail::Family::write(std::ostream& os)
+{
+   Cell cell(this, bounds_.size() + 1);
+   snapshot(&cell);
+
+   switch (type_)
+   {
+      case CounterFamily:
+         os << "# TYPE " << name_ << " counter\n"
+            << "# HELP " << name_ << " " << escapeHelp(help_) << "\n"
+            << name_ << "_total " << formatNumber(cell.value) << "\n";
+         break;
+
+      case GaugeFamily:
+         os << "# TYPE " << name_ << " gauge\n"
+            << "# HELP " << name_ << " " << escapeHelp(help_) << "\n"
+            << name_ << " " << formatNumber(cell.value) << "\n";
+         break;
+
+      case HistogramFamily:
+      {
+         os << "# TYPE " << name_ << " histogram\n"
+            << "# HELP " << name_ << " " << escapeHelp(help_) << "\n";
+
+         // buckets are cumulative
+         boost::uint64_t count = 0;
+         for (std::size_t i = 0; i < cell.buckets.size(); i++)
+         {
+            count += cell.buckets[i];
+            std::string bound = i < bounds_.size() ? formatNumber(bounds_[i])
+                                                   : std::string("+Inf");
+            os << name_ << "_bucket{le=\"" << bound << "\"} " << count << "\n";
+         }
+         os << name_ << "_sum " << formatNumber(cell.value) << "\n"
+            << name_ << "_count " << cell.count << "\n";
+         break;
+      }
+   }
+}
+
+void Counter::increment(double amount) const
+{
+   if (pFamily_ == NULL)
+      return;
+
+   Cell& cell = pFamily_->threadCell();
+   LOCK_MUTEX(cell.mutex)
+   {
+      cell.value += amount;
+   }
+   END_LOCK_MUTEX
+}
+
+void Gauge::set(double value) const
+{
+   if (pFamily_ != NULL)
+      pFamily_->setValue(value, false);
+}
+
+void Gauge::add(double amount) const
+{
+   if (pFamily_ != NULL)
+      pFamily_->setValue(amount, true);
+}
+
+void Histogram::observe(double value) const
+{
+   if (pFamily_ != NULL)
+      pFamily_->observe(value);
+}
+
+Counter counter(const std::string& name, const std::string& help)
+{
+   // the _total suffix is appended when counters are written
+   if (boost::algorithm::ends_with(name, "_total"))
+   {
+      LOG_ERROR_MESSAGE("Counter " + name + " must not end with _total");
+      return Counter();
+   }
+
+   return Counter(registerFamily(name,
+                                 help,
+                                 CounterFamily,
+                                 std::vector<double>()));
+}
+
+Gauge gauge(const std::string& name, const std::string& help)
+{
+   return Gauge(registerFamily(name, help, GaugeFamily, std::vector<double>()));
+}
+
+Histogram histogram(const std::string& name,
+                    const std::string& help,
+                    const std::vector<double>& buckets)
+{
+   return Histogram(registerFamily(name,
+                                   help,
+                                   HistogramFamily,
+                                   buckets.empty() ? defaultBuckets()
+                                                   : buckets));
+}
+
+ScopedTimer::~ScopedTimer()
+{
+   try
+   {
+      boost::posix_time::time_duration elapsed =
+            boost::posix_time::microsec_clock::universal_time() - start_;
+      histogram_.observe(elapsed.total_microseconds() / 1000000.0);
+   }
+   catch(...)
+   {
+   }
+}
+
+void writeOpenMetrics(std::ostream& os)
+{
+   // copy the families so we don't hold the registry lock while writing
+   std::vector<Family*> familiesCopy;
+   LOCK_MUTEX(registryMutex())
+   {
+      for (Families::const_iterator it = families().begin();
+           it != families().end();
+           ++it)
+      {
+         familiesCopy.push_back(it->second);
+      }
+   }
+   END_LOCK_MUTEX
+
+   BOOST_FOREACH(Family* pFamily, familiesCopy)
+   {
+      pFamily->write(os);
+   }
+   os << "# EOF\n";
+}
+
+} // namespace metrics
+} // namespace monitor
+} // namespace rstudio
@@ -18,6 +18,7 @@
 
 #include <core/FilePath.hpp>
 #include <core/Log.hpp>
+#include <core/Trace.hpp>
 
 #include <r/RErrorCategory.hpp>
 #include <r/RSourceManager.hpp>
@@ -236,6 +237,8 @@ Error evaluateString(const std::string& str,
                      SEXP* pSEXP, 
                      sexp::Protect* pProtect)
 {
+   TRACE_SCOPE("r", str);
+
    // refresh source if necessary (no-op in production)
    r::sourceManager().reloadIfNecessary();
    
@@ -344,6 +347,8 @@ Error RFunction::call(SEXP evalNS, SEXP* pResultSEXP, sexp::Protect* pProtect)
 Error RFunction::call(SEXP evalNS, bool safely, SEXP* pResultSEXP,
                       sexp::Protect* pProtect)
 {
+   TRACE_SCOPE("r", functionName_);
+
    // verify the function
    if (functionSEXP_ == R_UnboundValue)
    {
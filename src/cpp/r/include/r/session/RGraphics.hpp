@@ -173,6 +173,9 @@ const boost::system::error_category& rGraphicsCategory() ;
 
 std::string extraBitmapParams();
 
+// block until any pending (asynchronous) write of the image completes
+void waitForImage(const core::FilePath& imagePath);
+
 namespace errc {
    
 inline boost::system::error_code make_error_code( errc_t e )
@@ -0,0 +1,73 @@
+/*
+ * RGraphicsPngWriter.hpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef R_SESSION_GRAPHICS_PNG_WRITER_HPP
+#define R_SESSION_GRAPHICS_PNG_WRITER_HPP
+
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+namespace rstudio {
+namespace core {
+   class Error;
+   class FilePath;
+}
+}
+
+namespace rstudio {
+namespace r {
+namespace session {
+namespace graphics {
+namespace png_writer {
+
+// raster captured from a graphics device. pixels are R colors (packed
+// as in R_RGBA) stored row major from the top left of the image
+struct Raster
+{
+   Raster() : width(0), height(0), res(96) {}
+   int width;
+   int height;
+   int res;
+   std::vector<unsigned int> pixels;
+};
+
+// synchronously encode a raster as a PNG file
+core::Error write(const Raster& raster, const core::FilePath& targetPath);
+
+// queue a raster for encoding on the background writer thread. any
+// write already queued for the same target path is replaced
+void writeAsync(boost::shared_ptr<Raster> pRaster,
+                const core::FilePath& targetPath);
+
+// discard a queued write for the target path (returns false if there was
+// no such write). if the write is already in progress we wait for it
+bool cancel(const core::FilePath& targetPath);
+
+// block until any queued or in-progress write of the target path completes
+void waitFor(const core::FilePath& targetPath);
+
+// block until all queued writes are complete
+void waitForAll();
+
+} // namespace png_writer
+} // namespace graphics
+} // namespace session
+} // namespace r
+} // namespace rstudio
+
+
+#endif // R_SESSION_GRAPHICS_PNG_WRITER_HPP
+
@@ -21,11 +21,15 @@
 
 #include "RSearchPath.hpp"
 
+#include <cctype>
+#include <set>
 #include <string>
 #include <vector>
 #include <algorithm>
 
 #include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/function.hpp>
 #include <boost/format.hpp>
 #include <boost/lexical_cast.hpp>
@@ -34,13 +38,16 @@
 #include <core/Log.hpp>
 #include <core/Error.hpp>
 #include <core/FilePath.hpp>
+#include <core/Gzip.hpp>
 #include <core/SafeConvert.hpp>
+#include <core/Thread.hpp>
 #include <core/FileSerializer.hpp>
 
 #define R_INTERNAL_FUNCTIONS
 #include <r/RInternal.hpp>
 #include <r/RExec.hpp>
 #include <r/RInterface.hpp>
+#include <r/session/RConsoleHistory.hpp>
 
 using namespace rstudio::core ;
 
@@ -60,6 +67,10 @@ const char * const kSearchPathDir = "search_path";
 const char * const kSearchPathElementsDir = "search_path_elements";
 const char * const kPackagePaths = "package_paths";
 const char * const kEnvDataDir = "environment_data";
+const char * const kEnvironmentObjectsDir = "environment_objects";
+
+// number of console history entries scanned for recently used names
+const int kRecentHistoryEntries = 1000;
 
 void reportRestoreError(const std::string& context, 
                         const Error& error,
@@ -80,11 +91,39 @@ void reportRestoreError(const std::string& context,
    REprintf(report.c_str());
 }   
    
+Error saveGlobalEnvironmentImage(const FilePath& imageFile)
+{
+   std::string imagePath = string_utils::utf8ToSystem(imageFile.absolutePath());
+   return executeSafely(boost::bind(R_SaveGlobalEnvToFile, imagePath.c_str()));
+}
+
 Error saveGlobalEnvironmentToFile(const FilePath& environmentFile)
 {
-   std::string envPath =
-            string_utils::utf8ToSystem(environmentFile.absolutePath());
-   return executeSafely(boost::bind(R_SaveGlobalEnvToFile, envPath.c_str()));
+   // if the image would be gzip compressed then have R write it uncompressed
+   // and compress it ourselves as it is written -- R compresses on a single
+   // thread which dominates the time required to save large workspaces
+   r::sexp::Protect rProtect;
+   SEXP compressionStateSEXP = R_NilValue;
+   Error error = RFunction(".rs.deferSaveImageCompression")
+                        .call(&compressionStateSEXP, &rProtect);
+   if (error)
+   {
+      LOG_ERROR(error);
+      compressionStateSEXP = R_NilValue;
+   }
+
+   if (compressionStateSEXP == R_NilValue)
+      return saveGlobalEnvironmentImage(environmentFile);
+
+   // load reads the resulting multi-member gzip file transparently
+   error = gzip::compressOutput(saveGlobalEnvironmentImage, environmentFile);
+
+   Error restoreError = RFunction(".rs.restoreSaveImageCompression",
+                                  compressionStateSEXP).call();
+   if (restoreError)
+      LOG_ERROR(restoreError);
+
+   return error;
 }
    
 Error restoreGlobalEnvironment(const core::FilePath& environmentFile)
@@ -96,6 +135,182 @@ Error restoreGlobalEnvironment(const core::FilePath& environmentFile)
    return RFunction("load", environmentFile.absolutePath()).call();
 }
 
+// names referenced in recent console input (most recent first). these are
+// used to order lazily restored objects so the ones in active use are
+// prefetched first
+std::vector<std::string> recentlyUsedNames()
+{
+   std::vector<std::string> names;
+   std::set<std::string> seen;
+
+   const ConsoleHistory& history = consoleHistory();
+   int entries = 0;
+   for (ConsoleHistory::const_iterator it = history.end();
+        it != history.begin() && entries < kRecentHistoryEntries;
+        entries++)
+   {
+      const std::string& input = *(--it);
+      std::string::const_iterator pos = input.begin();
+      while (pos != input.end())
+      {
+         unsigned char ch = *pos;
+         if (!std::isalpha(ch) && ch != '.')
+         {
+            ++pos;
+            continue;
+         }
+
+         std::string::const_iterator end = pos;
+         while (end != input.end() &&
+                (std::isalnum(static_cast<unsigned char>(*end)) ||
+                 *end == '.' || *end == '_'))
+         {
+            ++end;
+         }
+
+         std::string name(pos, end);
+         if (seen.insert(name).second)
+            names.push_back(name);
+         pos = end;
+      }
+   }
+
+   return names;
+}
+
+// objects in the global environment which were lazily restored and haven't
+// yet been touched (they can be saved without reading them back in)
+std::vector<std::string> unforcedGlobalEnvironmentObjects()
+{
+   std::vector<std::string> names;
+
+   r::sexp::Protect rProtect;
+   std::vector<r::sexp::Variable> variables;
+   r::sexp::listEnvironment(R_GlobalEnv, true, false, &rProtect, &variables);
+   BOOST_FOREACH(const r::sexp::Variable& variable, variables)
+   {
+      if (TYPEOF(variable.second) == PROMSXP &&
+          PRVALUE(variable.second) == R_UnboundValue)
+      {
+         names.push_back(variable.first);
+      }
+   }
+
+   return names;
+}
+
+Error saveGlobalEnvironmentObjects(const FilePath& objectsDir)
+{
+   // write into a staging directory so the objects we're replacing remain
+   // available until the save is complete
+   FilePath stagingDir(objectsDir.absolutePath() + ".new");
+   Error error = stagingDir.resetDirectory();
+   if (error)
+      return error;
+
+   bool compress = false;
+   error = RFunction(".rs.saveImageUsesGzip").call(&compress);
+   if (error)
+      LOG_ERROR(error);
+
+   RFunction saveObjects(".rs.saveEnvironmentObjects");
+   saveObjects.addParam(
+            string_utils::utf8ToSystem(stagingDir.absolutePath()));
+   saveObjects.addParam(recentlyUsedNames());
+   saveObjects.addParam(unforcedGlobalEnvironmentObjects());
+   std::vector<std::string> writtenFiles;
+   error = saveObjects.call(&writtenFiles);
+   if (error)
+      return error;
+
+   // objects are written uncompressed and then compressed on all cores
+   // (readRDS reads the multi-member gzip files transparently)
+   if (compress)
+   {
+      BOOST_FOREACH(const std::string& file, writtenFiles)
+      {
+         error = gzip::compressFile(stagingDir.complete(file));
+         if (error)
+            return error;
+      }
+   }
+
+   error = objectsDir.removeIfExists();
+   if (error)
+      return error;
+   return stagingDir.move(objectsDir);
+}
+
+// read the object files in order so that they are in the page cache by the
+// time they are needed (lazily restored objects are read on first use)
+void prefetchObjectFiles(const FilePath& objectsDir,
+                         const std::vector<std::string>& files)
+{
+   try
+   {
+      std::vector<char> buffer(1024 * 1024);
+      BOOST_FOREACH(const std::string& file, files)
+      {
+         // tolerate files removed by a subsequent save
+         boost::shared_ptr<std::istream> pStream;
+         Error error = objectsDir.complete(file).open_r(&pStream);
+         if (error)
+            continue;
+
+         while (pStream->good())
+            pStream->read(&buffer[0], buffer.size());
+      }
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+}
+
+Error restoreGlobalEnvironmentObjects(const FilePath& objectsDir)
+{
+   std::vector<std::string> files;
+   Error error = RFunction(".rs.restoreEnvironmentObjects",
+                           string_utils::utf8ToSystem(
+                              objectsDir.absolutePath())).call(&files);
+   if (error)
+      return error;
+
+   core::thread::safeLaunchThread(
+            boost::bind(prefetchObjectFiles, objectsDir, files));
+
+   return Success();
+}
+
+Error saveGlobalEnvironmentState(const FilePath& statePath, bool lazy)
+{
+   FilePath environmentFile = statePath.complete(kEnvironmentFile);
+   FilePath objectsDir = statePath.complete(kEnvironmentObjectsDir);
+
+   // save in the requested form then remove the other (note that saving the
+   // image reads any lazily restored objects so they must remain until then)
+   if (lazy)
+   {
+      Error error = saveGlobalEnvironmentObjects(objectsDir);
+      if (error)
+         return error;
+      return environmentFile.removeIfExists();
+   }
+   else
+   {
+      Error error = saveGlobalEnvironmentToFile(environmentFile);
+      if (error)
+         return error;
+      return objectsDir.removeIfExists();
+   }
+}
+
+Error restoreGlobalEnvironmentState(const FilePath& statePath)
+{
+   FilePath objectsDir = statePath.complete(kEnvironmentObjectsDir);
+   if (objectsDir.exists())
+      return restoreGlobalEnvironmentObjects(objectsDir);
+   else
+      return restoreGlobalEnvironment(statePath.complete(kEnvironmentFile));
+}
+
 bool isPackage(const std::string& elementName, std::string* pPackageName)
 {
    std::string packagePrefix("package:");
@@ -226,11 +441,10 @@ void attachEnvironmentData(const FilePath& dataFilePath,
 } // anonymous namespace
    
 
-Error save(const FilePath& statePath)
+Error save(const FilePath& statePath, bool lazyGlobalEnvironment)
 {
    // save the global environment
-   FilePath environmentFile = statePath.complete(kEnvironmentFile);
-   Error error = saveGlobalEnvironmentToFile(environmentFile);
+   Error error = saveGlobalEnvironmentState(statePath, lazyGlobalEnvironment);
    if (error)
       return error;
    
@@ -320,17 +534,16 @@ Error save(const FilePath& statePath)
 }
 
 
-Error saveGlobalEnvironment(const FilePath& statePath)
+Error saveGlobalEnvironment(const FilePath& statePath,
+                            bool lazyGlobalEnvironment)
 {
-   FilePath environmentFile = statePath.complete(kEnvironmentFile);
-   return saveGlobalEnvironmentToFile(environmentFile);
+   return saveGlobalEnvironmentState(statePath, lazyGlobalEnvironment);
 }
 
 Error restore(const FilePath& statePath)
 {
    // restore global environment
-   FilePath environmentFile = statePath.complete(kEnvironmentFile);
-   Error error = restoreGlobalEnvironment(environmentFile);
+   Error error = restoreGlobalEnvironmentState(statePath);
    if (error)
       return error;
    
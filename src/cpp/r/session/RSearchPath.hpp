@@ -28,8 +28,13 @@ namespace r {
 namespace session {
 namespace search_path {
 
-core::Error save(const core::FilePath& statePath);
-core::Error saveGlobalEnvironment(const core::FilePath& statePath);
+// the global environment is saved as an image unless lazyGlobalEnvironment
+// is specified, in which case each object is saved to its own file and
+// restored as a promise that reads the object on first use
+core::Error save(const core::FilePath& statePath,
+                 bool lazyGlobalEnvironment = false);
+core::Error saveGlobalEnvironment(const core::FilePath& statePath,
+                                  bool lazyGlobalEnvironment = false);
 core::Error restore(const core::FilePath& statePath);
    
 } // namespace search_path
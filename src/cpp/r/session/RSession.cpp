@@ -213,7 +213,8 @@ bool saveSessionState(const RSuspendOptions& options,
       return r::session::state::save(suspendedSessionPath,
                                      s_options.serverMode,
                                      options.excludePackages,
-                                     disableSaveCompression);
+                                     disableSaveCompression,
+                                     s_options.lazyWorkspaceRestore);
    }
 }
    
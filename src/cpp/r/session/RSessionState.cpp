@@ -16,10 +16,16 @@
 #include "RSessionState.hpp"
 
 #include <algorithm>
+#include <vector>
 
+#include <boost/bind.hpp>
 #include <boost/function.hpp>
 #include <boost/foreach.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
 
+#include <core/BoostErrors.hpp>
+#include <core/BoostThread.hpp>
 #include <core/Error.hpp>
 #include <core/FilePath.hpp>
 #include <core/Settings.hpp>
@@ -62,6 +68,7 @@ const char * const kPlotsFile = "plots";
 const char * const kPlotsDir = "plots_dir";
 const char * const kSearchPath = "search_path";
 const char * const kGlobalEnvironment = "global_environment";
+const char * const kManifestFile = "manifest";
 
 // settings
 const char * const kWorkingDirectory = "working_directory";
@@ -69,6 +76,10 @@ const char * const kDevModeOn = "dev_mode_on";
 const char * const kPackratModeOn = "packrat_mode_on";
 const char * const kRProfileOnRestore = "r_profile_on_restore";
 
+// manifest component status
+const char * const kComponentSaved = "saved";
+const char * const kComponentFailed = "failed";
+
 
 Error saveLibPaths(const FilePath& libPathsFile)
 {
@@ -94,7 +105,10 @@ bool isRLocationVariable(const std::string& name)
          name == "R_SHARE_DIR";
 }
 
-Error saveEnvironmentVars(const FilePath& envFile)
+// the environment is snapshotted by the caller (on the R thread) since
+// it can continue to be modified while the file is being written
+Error saveEnvironmentVars(const core::system::Options& env,
+                          const FilePath& envFile)
 {
    // remove then create settings file
    Error error = envFile.removeIfExists();
@@ -105,9 +119,7 @@ Error saveEnvironmentVars(const FilePath& envFile)
    if (error)
       return error;
 
-   // get environment and write it to the file
-   core::system::Options env;
-   core::system::environment(&env);
+   // write the environment to the file
    envSettings.beginUpdate();
    BOOST_FOREACH(const core::system::Option& var, env)
    {
@@ -206,6 +218,150 @@ struct ErrorRecorder
    std::string* pMessages_ ;
 };
 
+// the manifest records the status of each saved component. components
+// which failed to save are skipped at restore time (their files may be
+// partially written). it is written last so its presence also indicates
+// that the save ran to completion
+class SaveManifest : boost::noncopyable
+{
+public:
+   void initialize(const FilePath& statePath, bool* pSaved)
+   {
+      FilePath manifestPath = statePath.complete(kManifestFile);
+      Error error = manifestPath.removeIfExists();
+      if (!error)
+         error = settings_.initialize(manifestPath);
+      if (error)
+      {
+         reportError(kSaving, kManifestFile, error, ERROR_LOCATION);
+         *pSaved = false;
+      }
+
+      // defer writing until all components are recorded
+      settings_.beginUpdate();
+   }
+
+   void record(const std::string& component,
+               const Error& error,
+               const ErrorLocation& location,
+               bool* pSaved)
+   {
+      if (error)
+      {
+         reportError(kSaving, component, error, location);
+         *pSaved = false;
+      }
+      settings_.set(component, error ? kComponentFailed : kComponentSaved);
+   }
+
+   void write()
+   {
+      settings_.endUpdate();
+   }
+
+private:
+   Settings settings_;
+};
+
+bool componentSaved(const Settings& manifest, const std::string& component)
+{
+   // states without a manifest restore everything
+   return manifest.get(component, kComponentSaved) != kComponentFailed;
+}
+
+// saves components that don't require R on background threads (so they are
+// written concurrently with the components the R thread is saving)
+class ConcurrentSave : boost::noncopyable
+{
+public:
+   ~ConcurrentSave()
+   {
+      try
+      {
+         joinThreads();
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   void launch(const std::string& component,
+               const boost::function<Error()>& saveFunction)
+   {
+      boost::shared_ptr<Task> pTask(new Task(component, saveFunction));
+      tasks_.push_back(pTask);
+      try
+      {
+         pTask->pThread.reset(
+                  new boost::thread(boost::bind(&Task::run, pTask.get())));
+      }
+      catch(const boost::thread_resource_error& e)
+      {
+         LOG_ERROR(Error(boost::thread_error::ec_from_exception(e),
+                         ERROR_LOCATION));
+         pTask->run();
+      }
+   }
+
+   // wait for all components to be written and record their status
+   void join(SaveManifest* pManifest, bool* pSaved)
+   {
+      joinThreads();
+      BOOST_FOREACH(const boost::shared_ptr<Task>& pTask, tasks_)
+      {
+         pManifest->record(pTask->component, pTask->error,
+                           ERROR_LOCATION, pSaved);
+      }
+      tasks_.clear();
+   }
+
+private:
+   struct Task
+   {
+      Task(const std::string& component,
+           const boost::function<Error()>& saveFunction)
+         : component(component), saveFunction(saveFunction)
+      {
+      }
+
+      void run()
+      {
+         try
+         {
+            error = saveFunction();
+         }
+         CATCH_UNEXPECTED_EXCEPTION
+      }
+
+      std::string component;
+      boost::function<Error()> saveFunction;
+      boost::shared_ptr<boost::thread> pThread;
+      Error error;
+   };
+
+   void joinThreads()
+   {
+      BOOST_FOREACH(const boost::shared_ptr<Task>& pTask, tasks_)
+      {
+         if (pTask->pThread)
+         {
+            pTask->pThread->join();
+            pTask->pThread.reset();
+         }
+      }
+   }
+
+   std::vector<boost::shared_ptr<Task> > tasks_;
+};
+
+Error saveHistory(const FilePath& historyPath)
+{
+   return consoleHistory().saveToFile(historyPath);
+}
+
+Error saveConsoleActions(const FilePath& consoleActionsPath)
+{
+   return consoleActions().saveToFile(consoleActionsPath);
+}
+
 void saveDevMode(Settings* pSettings)
 {
    // check if dev-mode is on -- if it is then note this and turn it off
@@ -252,16 +408,16 @@ void initSaveContext(const FilePath& statePath,
 
 void saveWorkingContext(const FilePath& statePath,
                         Settings* pSettings,
-                        bool* pSaved)
+                        ConcurrentSave* pConcurrentSave)
 {
-   // save history
-   FilePath historyPath = statePath.complete(kHistoryFile);
-   Error error = consoleHistory().saveToFile(historyPath);
-   if (error)
-   {
-      reportError(kSaving, kHistoryFile, error, ERROR_LOCATION);
-      *pSaved = false;
-   }
+   // save history and console actions (console actions are synchronized
+   // and history isn't modified while we are suspending)
+   pConcurrentSave->launch(kHistoryFile,
+                           boost::bind(saveHistory,
+                                       statePath.complete(kHistoryFile)));
+   pConcurrentSave->launch(kConsoleActionsFile,
+                           boost::bind(saveConsoleActions,
+                                       statePath.complete(kConsoleActionsFile)));
 
    // save client metrics
    client_metrics::save(pSettings);
@@ -271,15 +427,6 @@ void saveWorkingContext(const FilePath& statePath,
                                        utils::safeCurrentPath(),
                                        r::session::utils::userHomePath());
    pSettings->set(kWorkingDirectory, workingDirectory);
-
-   // save console actions
-   FilePath consoleActionsPath = statePath.complete(kConsoleActionsFile);
-   error = consoleActions().saveToFile(consoleActionsPath);
-   if (error)
-   {
-      reportError(kSaving, kConsoleActionsFile, error, ERROR_LOCATION);
-      *pSaved = false;
-   }
 }
 
 } // anonymous namespace
@@ -289,12 +436,16 @@ void saveWorkingContext(const FilePath& statePath,
 bool save(const FilePath& statePath,
           bool serverMode,
           bool excludePackages,
-          bool disableSaveCompression)
+          bool disableSaveCompression,
+          bool lazyGlobalEnvironment)
 {
    // initialize context
    Settings settings;
    bool saved = true;
    initSaveContext(statePath, &settings, &saved);
+   SaveManifest manifest;
+   manifest.initialize(statePath, &saved);
+   ConcurrentSave concurrentSave;
    
    // check and save packrat mode status
    bool packratModeOn = r::session::utils::isPackratModeOn();
@@ -304,32 +455,25 @@ bool save(const FilePath& statePath,
    settings.set(kRProfileOnRestore, !excludePackages || packratModeOn);
 
    // save environment variables
-   Error error = saveEnvironmentVars(statePath.complete(kEnvironmentVars));
-   if (error)
-   {
-      reportError(kSaving, kEnvironmentVars, error, ERROR_LOCATION);
-      saved = false;
-   }
+   core::system::Options env;
+   core::system::environment(&env);
+   concurrentSave.launch(kEnvironmentVars,
+                         boost::bind(saveEnvironmentVars,
+                                     env,
+                                     statePath.complete(kEnvironmentVars)));
 
    // if we are in server mode then we just need to write the plot
    // state index (because the location of the graphics directory is stable)
    if (serverMode)
    {
-      error = graphics::plotManager().savePlotsState();
-      if (error)
-      {
-         reportError(kSaving, kPlotsFile, error, ERROR_LOCATION);
-         saved = false;
-      }
+      Error error = graphics::plotManager().savePlotsState();
+      manifest.record(kPlotsFile, error, ERROR_LOCATION, &saved);
    }
    else
    {
-      error = graphics::plotManager().serialize(statePath.complete(kPlotsDir));
-      if (error)
-      {
-         reportError(kSaving, kPlotsDir, error, ERROR_LOCATION);
-         saved = false;
-      }
+      Error error = graphics::plotManager().serialize(
+                                          statePath.complete(kPlotsDir));
+      manifest.record(kPlotsDir, error, ERROR_LOCATION, &saved);
    }
 
    // handle dev mode -- note that this MUST be executed before
@@ -338,25 +482,18 @@ bool save(const FilePath& statePath,
    saveDevMode(&settings);
 
    // save libpaths
-   error = saveLibPaths(statePath.complete(kLibPathsFile));
-   if (error)
-   {
-      reportError(kSaving, kLibPathsFile, error, ERROR_LOCATION);
-      saved = false;
-   }
+   Error error = saveLibPaths(statePath.complete(kLibPathsFile));
+   manifest.record(kLibPathsFile, error, ERROR_LOCATION, &saved);
 
    // save options 
    error = r::options::saveOptions(statePath.complete(kOptionsFile));
-   if (error)
-   {
-      reportError(kSaving, kOptionsFile, error, ERROR_LOCATION);
-      saved = false;
-   }
+   manifest.record(kOptionsFile, error, ERROR_LOCATION, &saved);
    
    // save working context
-   saveWorkingContext(statePath, &settings, &saved);
+   saveWorkingContext(statePath, &settings, &concurrentSave);
 
-   // save search path (disable save compression if requested)
+   // save search path (disable save compression if requested -- otherwise
+   // a gzip compressed workspace is compressed on multiple threads)
    if (disableSaveCompression)
    {
       error = r::exec::RFunction(".rs.disableSaveCompression").call();
@@ -366,23 +503,20 @@ bool save(const FilePath& statePath,
 
    if (!excludePackages)
    {
-      error = search_path::save(statePath);
-      if (error)
-      {
-         reportError(kSaving, kSearchPath, error, ERROR_LOCATION);
-         saved = false;
-      }
+      error = search_path::save(statePath, lazyGlobalEnvironment);
+      manifest.record(kSearchPath, error, ERROR_LOCATION, &saved);
    }
    else
    {
-      error = search_path::saveGlobalEnvironment(statePath);
-      if (error)
-      {
-         reportError(kSaving, kGlobalEnvironment, error, ERROR_LOCATION);
-         saved = false;
-      }
+      error = search_path::saveGlobalEnvironment(statePath,
+                                                 lazyGlobalEnvironment);
+      manifest.record(kGlobalEnvironment, error, ERROR_LOCATION, &saved);
    }
 
+   // wait for the concurrently saved components then write the manifest
+   concurrentSave.join(&manifest, &saved);
+   manifest.write();
+
    // return status
    return saved;
 }
@@ -395,6 +529,9 @@ bool saveMinimal(const core::FilePath& statePath,
    Settings settings;
    bool saved = true;
    initSaveContext(statePath, &settings, &saved);
+   SaveManifest manifest;
+   manifest.initialize(statePath, &saved);
+   ConcurrentSave concurrentSave;
 
    // set r profile on restore
    settings.set(kRProfileOnRestore, true);
@@ -406,7 +543,7 @@ bool saveMinimal(const core::FilePath& statePath,
    saveDevMode(&settings);
 
    // save working context
-   saveWorkingContext(statePath, &settings, &saved);
+   saveWorkingContext(statePath, &settings, &concurrentSave);
 
    // save global environment if requested
    if (saveGlobalEnvironment)
@@ -417,14 +554,12 @@ bool saveMinimal(const core::FilePath& statePath,
          LOG_ERROR(error);
 
       error = search_path::saveGlobalEnvironment(statePath);
-      if (error)
-      {
-         reportError(kSaving, kGlobalEnvironment, error, ERROR_LOCATION);
-         saved = false;
-      }
+      manifest.record(kGlobalEnvironment, error, ERROR_LOCATION, &saved);
    }
 
-
+   // wait for the concurrently saved components then write the manifest
+   concurrentSave.join(&manifest, &saved);
+   manifest.write();
 
    // return status
    return saved;
@@ -447,6 +582,11 @@ bool getBoolSetting(const core::FilePath& statePath,
    return settings.getBool(name, defaultValue);
 }
 
+Error initManifest(const core::FilePath& statePath, Settings* pManifest)
+{
+   return pManifest->initialize(statePath.complete(kManifestFile));
+}
+
 } // anonymous namespace
 
 bool rProfileOnRestore(const core::FilePath& statePath)
@@ -461,10 +601,19 @@ bool packratModeEnabled(const core::FilePath& statePath)
 
 Error deferredRestore(const FilePath& statePath, bool serverMode)
 {
-   // search path
-   Error error = search_path::restore(statePath);
+   Settings manifest;
+   Error error = initManifest(statePath, &manifest);
    if (error)
-      return error;
+      LOG_ERROR(error);
+
+   // search path (skipped if the workspace wasn't completely written)
+   if (componentSaved(manifest, kSearchPath) &&
+       componentSaved(manifest, kGlobalEnvironment))
+   {
+      error = search_path::restore(statePath);
+      if (error)
+         return error;
+   }
 
    // if we are in server mode we just need to read the plots state
    // file (because the location of the graphics directory is stable)
@@ -475,7 +624,7 @@ Error deferredRestore(const FilePath& statePath, bool serverMode)
    else
    {
       FilePath plotsDir = statePath.complete(kPlotsDir);
-      if (plotsDir.exists())
+      if (plotsDir.exists() && componentSaved(manifest, kPlotsDir))
          return graphics::plotManager().deserialize(plotsDir);
       else
          return Success();
@@ -495,12 +644,21 @@ bool restore(const FilePath& statePath,
    Error error = settings.initialize(statePath.complete(kSettingsFile));
    if (error)
       reportError(kRestoring, kSettingsFile, error, ERROR_LOCATION, er);
+
+   // read the manifest (components which failed to save are skipped)
+   Settings manifest;
+   error = initManifest(statePath, &manifest);
+   if (error)
+      reportError(kRestoring, kManifestFile, error, ERROR_LOCATION, er);
    
    // restore console actions
-   FilePath consoleActionsPath = statePath.complete(kConsoleActionsFile);
-   error = consoleActions().loadFromFile(consoleActionsPath);
-   if (error)
-      reportError(kRestoring, kConsoleActionsFile, error, ERROR_LOCATION, er);
+   if (componentSaved(manifest, kConsoleActionsFile))
+   {
+      FilePath consoleActionsPath = statePath.complete(kConsoleActionsFile);
+      error = consoleActions().loadFromFile(consoleActionsPath);
+      if (error)
+         reportError(kRestoring, kConsoleActionsFile, error, ERROR_LOCATION, er);
+   }
       
    // restore working directory
    std::string workingDir = settings.get(kWorkingDirectory);
@@ -511,7 +669,7 @@ bool restore(const FilePath& statePath,
    
    // restore options
    FilePath optionsPath = statePath.complete(kOptionsFile);
-   if (optionsPath.exists())
+   if (optionsPath.exists() && componentSaved(manifest, kOptionsFile))
    {
       error = r::options::restoreOptions(optionsPath);
       if (error)
@@ -520,7 +678,7 @@ bool restore(const FilePath& statePath,
 
    // restore libpaths -- but only if packrat mode is off
    bool packratModeOn = settings.getBool(kPackratModeOn, false);
-   if (!packratModeOn)
+   if (!packratModeOn && componentSaved(manifest, kLibPathsFile))
    {
       error = restoreLibPaths(statePath.complete(kLibPathsFile));
       if (error)
@@ -539,15 +697,21 @@ bool restore(const FilePath& statePath,
    client_metrics::restore(settings);
 
    // restore history
-   FilePath historyFilePath = statePath.complete(kHistoryFile);
-   error = consoleHistory().loadFromFile(historyFilePath, false);
-   if (error)
-      reportError(kRestoring, kHistoryFile, error, ERROR_LOCATION, er);
+   if (componentSaved(manifest, kHistoryFile))
+   {
+      FilePath historyFilePath = statePath.complete(kHistoryFile);
+      error = consoleHistory().loadFromFile(historyFilePath, false);
+      if (error)
+         reportError(kRestoring, kHistoryFile, error, ERROR_LOCATION, er);
+   }
 
    // restore environment vars
-   error = restoreEnvironmentVars(statePath.complete(kEnvironmentVars));
-   if (error)
-      reportError(kRestoring, kEnvironmentVars, error, ERROR_LOCATION, er);
+   if (componentSaved(manifest, kEnvironmentVars))
+   {
+      error = restoreEnvironmentVars(statePath.complete(kEnvironmentVars));
+      if (error)
+         reportError(kRestoring, kEnvironmentVars, error, ERROR_LOCATION, er);
+   }
 
    // set deferred restore action. this encapsulates parts of the restore
    // process that are potentially highly latent. this allows clients
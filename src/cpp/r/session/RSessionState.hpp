@@ -36,7 +36,8 @@ namespace state {
 bool save(const core::FilePath& statePath,
           bool serverMode,
           bool excludePackages,
-          bool disableSaveCompression);
+          bool disableSaveCompression,
+          bool lazyGlobalEnvironment);
 
 bool saveMinimal(const core::FilePath& statePath,
                  bool saveGlobalEnvironment);
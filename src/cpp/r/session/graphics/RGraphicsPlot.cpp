@@ -27,6 +27,7 @@
 
 #include <r/RExec.hpp>
 #include <r/session/RGraphics.hpp>
+#include <r/session/RGraphicsPngWriter.hpp>
 
 using namespace rstudio::core ;
 
@@ -40,6 +41,7 @@ Plot::Plot(const GraphicsDeviceFunctions& graphicsDevice,
            SEXP manipulatorSEXP)
    : graphicsDevice_(graphicsDevice), 
      baseDirPath_(baseDirPath),
+     renderedDevicePixelRatio_(0),
      needsUpdate_(false),
      manipulator_(manipulatorSEXP)
 {
@@ -53,6 +55,7 @@ Plot::Plot(const GraphicsDeviceFunctions& graphicsDevice,
      baseDirPath_(baseDirPath), 
      storageUuid_(storageUuid),
      renderedSize_(renderedSize),
+     renderedDevicePixelRatio_(graphicsDevice.devicePixelRatio()),
      needsUpdate_(false),
      manipulator_()
 {
@@ -121,31 +124,87 @@ void Plot::saveManipulator() const
    
 Error Plot::renderFromDisplay()
 {
+   DisplaySize displaySize = graphicsDevice_.displaySize();
+   double devicePixelRatio = graphicsDevice_.devicePixelRatio();
+
    // we can use our cached representation if we don't need an update and our 
    // rendered size is the same as the current graphics device size
    if ( !needsUpdate_ &&
-        (renderedSize() == graphicsDevice_.displaySize()) )
+        (renderedSize() == displaySize) &&
+        (renderedDevicePixelRatio_ == devicePixelRatio) )
    {
       return Success();
    }
    
    // generate a new storage uuid
    std::string storageUuid = core::system::generateUuid();
-   
-   // generate snapshot and image files
-   Error error = graphicsDevice_.saveSnapshot(snapshotFilePath(storageUuid),
-                                              imageFilePath(storageUuid));
-   if (error)
-      return Error(errc::PlotRenderingError, error, ERROR_LOCATION);
+
+   // if only the size of the device changed then keep the existing image
+   // as a rendition and check whether we've already rendered at this size
+   bool haveRendition = false;
+   bool retainedRendition = false;
+   Rendition rendition(DisplaySize(), 0, FilePath());
+   if (!needsUpdate_ && hasStorage())
+   {
+      for (std::deque<Rendition>::iterator it = renditions_.begin();
+           it != renditions_.end();
+           ++it)
+      {
+         if (it->size == displaySize &&
+             it->devicePixelRatio == devicePixelRatio)
+         {
+            rendition = *it;
+            renditions_.erase(it);
+            haveRendition = true;
+            break;
+         }
+      }
+
+      retainRendition();
+      retainedRendition = true;
+   }
+   else
+   {
+      removeRenditions();
+   }
+
+   // re-use the rendition if we have one
+   Error error;
+   if (haveRendition)
+   {
+      error = renderFromRendition(rendition, storageUuid);
+      if (error)
+      {
+         LOG_ERROR(error);
+         haveRendition = false;
+      }
+   }
+
+   // otherwise generate snapshot and image files
+   if (!haveRendition)
+   {
+      error = graphicsDevice_.saveSnapshot(snapshotFilePath(storageUuid),
+                                           imageFilePath(storageUuid));
+      if (error)
+      {
+         // the existing image remains the current image
+         if (retainedRendition)
+            renditions_.pop_front();
+
+         return Error(errc::PlotRenderingError, error, ERROR_LOCATION);
+      }
+   }
    
    // save rendered size
-   renderedSize_ = graphicsDevice_.displaySize();
+   renderedSize_ = displaySize;
+   renderedDevicePixelRatio_ = devicePixelRatio;
    
    // save manipulator (if any)
    saveManipulator(storageUuid);
 
-   // delete existing files (if any)
-   Error removeError = removeFiles();
+   // delete existing files (if any) -- the image is retained as a rendition
+   // unless the contents of the plot changed
+   Error removeError = removeStorageFiles(needsUpdate_);
         
    // update state
    storageUuid_ = storageUuid;
@@ -183,6 +242,7 @@ Error Plot::renderFromDisplaySnapshot(SEXP snapshot)
    
    // save rendered size
    renderedSize_ = graphicsDevice_.displaySize();
+   renderedDevicePixelRatio_ = graphicsDevice_.devicePixelRatio();
 
    // save manipulator (if any)
    saveManipulator(storageUuid);
@@ -220,13 +280,41 @@ Error Plot::renderToDisplay()
 }
    
 Error Plot::removeFiles()
+{
+   removeRenditions();
+   return removeStorageFiles(true);
+}
+
+void Plot::removeRenditions()
+{
+   for (std::deque<Rendition>::const_iterator it = renditions_.begin();
+        it != renditions_.end();
+        ++it)
+   {
+      png_writer::cancel(it->imagePath);
+      Error error = it->imagePath.removeIfExists();
+      if (error)
+         LOG_ERROR(error);
+   }
+   renditions_.clear();
+}
+
+Error Plot::removeStorageFiles(bool includeImage)
 {
    // bail if we don't have any storage
    if (storageUuid_.empty())
       return Success();
+
+   // discard any pending write of the image (this is what allows us to
+   // skip encoding of frames superseded by a subsequent render)
+   Error imageError;
+   if (includeImage)
+   {
+      png_writer::cancel(imageFilePath(storageUuid_));
+      imageError = imageFilePath(storageUuid_).removeIfExists();
+   }
    
    Error snapshotError = snapshotFilePath(storageUuid_).removeIfExists();
-   Error imageError = imageFilePath(storageUuid_).removeIfExists();
    Error manipulatorError = manipulatorFilePath(storageUuid_).removeIfExists();
    
    if (snapshotError)
@@ -244,6 +332,49 @@ void Plot::purgeInMemoryResources()
    manipulator_.clear();
 }
 
+void Plot::retainRendition()
+{
+   // we only keep a handful of renditions per plot
+   const std::size_t kMaxRenditions = 4;
+
+   renditions_.push_front(Rendition(renderedSize_,
+                                    renderedDevicePixelRatio_,
+                                    imageFilePath(storageUuid_)));
+   while (renditions_.size() > kMaxRenditions)
+   {
+      const FilePath& imagePath = renditions_.back().imagePath;
+      png_writer::cancel(imagePath);
+      Error error = imagePath.removeIfExists();
+      if (error)
+         LOG_ERROR(error);
+      renditions_.pop_back();
+   }
+}
+
+Error Plot::renderFromRendition(const Rendition& rendition,
+                                const std::string& storageUuid)
+{
+   // the rendition may still be being written in the background
+   png_writer::waitFor(rendition.imagePath);
+
+   // the snapshot is independent of the device size so we can just copy it
+   Error error = snapshotFilePath().copy(snapshotFilePath(storageUuid));
+   if (error)
+      return error;
+
+   // move the image into place
+   error = rendition.imagePath.move(imageFilePath(storageUuid));
+   if (error)
+   {
+      Error removeError = snapshotFilePath(storageUuid).removeIfExists();
+      if (removeError)
+         LOG_ERROR(removeError);
+      return error;
+   }
+
+   return Success();
+}
+
 bool Plot::hasStorage() const
 {
    return !storageUuid_.empty();
@@ -17,6 +17,7 @@
 #define R_SESSION_GRAPHICS_PLOT_HPP
 
 #include <string>
+#include <deque>
 
 #include <boost/utility.hpp>
 
@@ -57,6 +58,7 @@ public:
    std::string storageUuid() const;  
    bool hasValidStorage() const;
    const DisplaySize& renderedSize() const { return renderedSize_; }
+   double renderedDevicePixelRatio() const { return renderedDevicePixelRatio_; }
 
    bool hasManipulator() const;
    SEXP manipulatorSEXP() const;
@@ -72,11 +74,13 @@ public:
    core::Error renderToDisplay();
    
    core::Error removeFiles();
+   void removeRenditions();
 
    void purgeInMemoryResources();
    
 private:
    bool hasStorage() const;
+   core::Error removeStorageFiles(bool includeImage);
 
    core::FilePath snapshotFilePath() const ;
    core::FilePath snapshotFilePath(const std::string& storageUuid) const;
@@ -87,12 +91,35 @@ private:
    void loadManipulatorIfNecessary() const;
    void saveManipulator(const std::string& storageUuid) const;
 
+   // images previously rendered for the current plot contents at other
+   // sizes (allows us to avoid re-rendering when e.g. toggling zoom or
+   // restoring the size of the plots pane)
+   struct Rendition
+   {
+      Rendition(const DisplaySize& size,
+                double devicePixelRatio,
+                const core::FilePath& imagePath)
+         : size(size),
+           devicePixelRatio(devicePixelRatio),
+           imagePath(imagePath)
+      {
+      }
+      DisplaySize size;
+      double devicePixelRatio;
+      core::FilePath imagePath;
+   };
+   void retainRendition();
+   core::Error renderFromRendition(const Rendition& rendition,
+                                   const std::string& storageUuid);
+
 private:
    GraphicsDeviceFunctions graphicsDevice_;
    core::FilePath baseDirPath_;
    std::string storageUuid_ ;
    DisplaySize renderedSize_ ;
+   double renderedDevicePixelRatio_;
    bool needsUpdate_;
+   std::deque<Rendition> renditions_;
 
    // manipulator and protection scope for it
    mutable PlotManipulator manipulator_;
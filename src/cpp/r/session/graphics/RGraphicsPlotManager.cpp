@@ -32,6 +32,7 @@
 #include <r/ROptions.hpp>
 #include <r/RErrorCategory.hpp>
 #include <r/session/RSessionUtils.hpp>
+#include <r/session/RGraphicsPngWriter.hpp>
 
 #include "RGraphicsUtils.hpp"
 #include "RGraphicsDevice.hpp"
@@ -568,6 +569,17 @@ Error PlotManager::savePlotsState()
    if (!graphicsPath_.exists())
       return Success() ;
 
+   // discard renditions of plots at other sizes (these aren't persisted)
+   for (boost::circular_buffer<PtrPlot>::iterator it = plots_.begin();
+        it != plots_.end();
+        ++it)
+   {
+      (*it)->removeRenditions();
+   }
+
+   // make sure all plot images have been written
+   png_writer::waitForAll();
+
    // list to write
    std::vector<std::string> plots ;
    
@@ -803,8 +815,10 @@ void PlotManager::onDeviceResized()
 {
    if (suppressDeviceEvents_)
       return;
-   
-   invalidateActivePlot();
+
+   // the contents of the plot haven't changed so we don't invalidate it
+   // (this allows it to re-use images previously rendered at this size)
+   setDisplayHasChanges(true);
 }
 
 void PlotManager::onDeviceClosed()
@@ -818,6 +832,9 @@ void PlotManager::onDeviceClosed()
    
    // trip changes flag to ensure repaint
    setDisplayHasChanges(true);
+
+   // let pending image writes finish before removing their directory
+   png_writer::waitForAll();
    
    // remove all files
    Error error = plotsStateFile_.removeIfExists();
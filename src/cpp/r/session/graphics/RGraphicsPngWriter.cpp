@@ -0,0 +1,378 @@
+/*
+ * RGraphicsPngWriter.cpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <r/session/RGraphicsPngWriter.hpp>
+
+#include <deque>
+
+#include <boost/crc.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/Thread.hpp>
+
+#include <r/session/RGraphics.hpp>
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace r {
+namespace session {
+namespace graphics {
+namespace png_writer {
+
+namespace {
+
+// png constants
+const unsigned char kPngSignature[] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+const unsigned char kBitDepth = 8;
+const unsigned char kColorTypeRGBA = 6;
+const unsigned char kFilterSub = 1;
+const int kBytesPerPixel = 4;
+
+void appendUInt32(boost::uint32_t value, std::string* pBuffer)
+{
+   pBuffer->push_back(static_cast<char>((value >> 24) & 0xFF));
+   pBuffer->push_back(static_cast<char>((value >> 16) & 0xFF));
+   pBuffer->push_back(static_cast<char>((value >> 8) & 0xFF));
+   pBuffer->push_back(static_cast<char>(value & 0xFF));
+}
+
+void appendChunk(const char* type, const std::string& data, std::string* pPng)
+{
+   appendUInt32(static_cast<boost::uint32_t>(data.size()), pPng);
+
+   boost::crc_32_type crc;
+   crc.process_bytes(type, 4);
+   crc.process_bytes(data.data(), data.size());
+
+   pPng->append(type, 4);
+   pPng->append(data);
+   appendUInt32(crc.checksum(), pPng);
+}
+
+// build the filtered scanlines for the image data. we use the Sub filter
+// for every row -- it is cheap to compute and compresses plots (which
+// are dominated by runs of identical pixels) very well
+void filterScanlines(const Raster& raster, std::string* pScanlines)
+{
+   std::size_t rowBytes = raster.width * kBytesPerPixel;
+   pScanlines->reserve(raster.height * (rowBytes + 1));
+
+   unsigned char previous[kBytesPerPixel];
+   for (int y = 0; y < raster.height; y++)
+   {
+      pScanlines->push_back(static_cast<char>(kFilterSub));
+
+      std::fill(previous, previous + kBytesPerPixel, 0);
+      const unsigned int* pRow = &raster.pixels[y * raster.width];
+      for (int x = 0; x < raster.width; x++)
+      {
+         // R colors are packed as R_RGBA (red in the low order byte)
+         unsigned int color = pRow[x];
+         unsigned char rgba[kBytesPerPixel];
+         rgba[0] = color & 0xFF;
+         rgba[1] = (color >> 8) & 0xFF;
+         rgba[2] = (color >> 16) & 0xFF;
+         rgba[3] = (color >> 24) & 0xFF;
+
+         for (int i = 0; i < kBytesPerPixel; i++)
+         {
+            pScanlines->push_back(static_cast<char>(
+                                     (unsigned char)(rgba[i] - previous[i])));
+            previous[i] = rgba[i];
+         }
+      }
+   }
+}
+
+Error compress(const std::string& input, std::string* pOutput)
+{
+   try
+   {
+      using namespace boost::iostreams;
+      filtering_ostream compressStream;
+      compressStream.push(zlib_compressor(zlib_params(zlib::best_speed)));
+      compressStream.push(boost::iostreams::back_inserter(*pOutput));
+      compressStream.write(input.data(), input.size());
+      compressStream.reset();
+      return Success();
+   }
+   catch(const boost::iostreams::zlib_error& e)
+   {
+      Error error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+      error.addProperty("zlib-error", e.error());
+      return error;
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+
+   return systemError(boost::system::errc::io_error, ERROR_LOCATION);
+}
+
+struct WriteRequest
+{
+   WriteRequest() {}
+
+   WriteRequest(boost::shared_ptr<Raster> pRaster, const FilePath& targetPath)
+      : pRaster(pRaster), targetPath(targetPath)
+   {
+   }
+
+   boost::shared_ptr<Raster> pRaster;
+   FilePath targetPath;
+};
+
+// write queue (shared between the R thread and the writer thread)
+boost::mutex s_mutex;
+boost::condition s_condition;
+std::deque<WriteRequest> s_requests;
+std::string s_inProgressPath;
+bool s_writerThreadStarted = false;
+
+bool isPending(const std::string& path)
+{
+   if (s_inProgressPath == path)
+      return true;
+
+   for (std::deque<WriteRequest>::const_iterator it = s_requests.begin();
+        it != s_requests.end();
+        ++it)
+   {
+      if (it->targetPath.absolutePath() == path)
+         return true;
+   }
+
+   return false;
+}
+
+bool removeRequest(const std::string& path)
+{
+   for (std::deque<WriteRequest>::iterator it = s_requests.begin();
+        it != s_requests.end();
+        ++it)
+   {
+      if (it->targetPath.absolutePath() == path)
+      {
+         s_requests.erase(it);
+         return true;
+      }
+   }
+
+   return false;
+}
+
+void writerThreadMain()
+{
+   try
+   {
+      while (true)
+      {
+         WriteRequest request;
+
+         // wait for the next request
+         {
+            boost::unique_lock<boost::mutex> lock(s_mutex);
+            while (s_requests.empty())
+               s_condition.wait(lock);
+
+            request = s_requests.front();
+            s_requests.pop_front();
+            s_inProgressPath = request.targetPath.absolutePath();
+         }
+
+         // encode (outside of the lock)
+         Error error = write(*request.pRaster, request.targetPath);
+         if (error)
+            LOG_ERROR(error);
+
+         // mark completed and notify waiters
+         {
+            boost::unique_lock<boost::mutex> lock(s_mutex);
+            s_inProgressPath.clear();
+         }
+         s_condition.notify_all();
+      }
+   }
+   catch(const boost::thread_interrupted&)
+   {
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+}
+
+} // anonymous namespace
+
+Error write(const Raster& raster, const FilePath& targetPath)
+{
+   if (raster.width <= 0 || raster.height <= 0 ||
+       raster.pixels.size() !=
+            static_cast<std::size_t>(raster.width * raster.height))
+   {
+      return systemError(boost::system::errc::invalid_argument,
+                         ERROR_LOCATION);
+   }
+
+   // compress the image data
+   std::string scanlines;
+   filterScanlines(raster, &scanlines);
+   std::string imageData;
+   Error error = compress(scanlines, &imageData);
+   if (error)
+      return error;
+
+   // header
+   std::string header;
+   appendUInt32(raster.width, &header);
+   appendUInt32(raster.height, &header);
+   header.push_back(static_cast<char>(kBitDepth));
+   header.push_back(static_cast<char>(kColorTypeRGBA));
+   header.push_back(0); // compression method
+   header.push_back(0); // filter method
+   header.push_back(0); // interlace method
+
+   // physical dimensions (pixels per meter) so viewers honor the resolution
+   // the same way they do for images written by the png device
+   std::string physical;
+   boost::uint32_t pixelsPerMeter =
+         static_cast<boost::uint32_t>(raster.res / 0.0254 + 0.5);
+   appendUInt32(pixelsPerMeter, &physical);
+   appendUInt32(pixelsPerMeter, &physical);
+   physical.push_back(1); // unit is meters
+
+   // assemble the file
+   std::string png(reinterpret_cast<const char*>(kPngSignature),
+                   sizeof(kPngSignature));
+   appendChunk("IHDR", header, &png);
+   appendChunk("pHYs", physical, &png);
+   appendChunk("IDAT", imageData, &png);
+   appendChunk("IEND", std::string(), &png);
+
+   // write to a temporary file and then move it into place so that the
+   // image is never served partially written
+   FilePath tempPath(targetPath.absolutePath() + ".partial");
+   error = writeStringToFile(tempPath, png);
+   if (error)
+      return error;
+
+   return tempPath.move(targetPath);
+}
+
+void writeAsync(boost::shared_ptr<Raster> pRaster, const FilePath& targetPath)
+{
+   bool queued = false;
+
+   LOCK_MUTEX(s_mutex)
+   {
+      // launch the writer thread on demand
+      if (!s_writerThreadStarted)
+      {
+         boost::thread writerThread;
+         core::thread::safeLaunchThread(writerThreadMain, &writerThread);
+         s_writerThreadStarted = writerThread.joinable();
+      }
+
+      // replace any queued write for this path
+      if (s_writerThreadStarted)
+      {
+         removeRequest(targetPath.absolutePath());
+         s_requests.push_back(WriteRequest(pRaster, targetPath));
+         queued = true;
+      }
+   }
+   END_LOCK_MUTEX
+
+   if (queued)
+   {
+      s_condition.notify_all();
+   }
+   else
+   {
+      // couldn't launch the writer thread so write synchronously (queued
+      // writes would otherwise never complete and waiters would block)
+      Error error = write(*pRaster, targetPath);
+      if (error)
+         LOG_ERROR(error);
+   }
+}
+
+bool cancel(const FilePath& targetPath)
+{
+   std::string path = targetPath.absolutePath();
+   bool cancelled = false;
+
+   try
+   {
+      boost::unique_lock<boost::mutex> lock(s_mutex);
+      cancelled = removeRequest(path);
+      while (s_inProgressPath == path)
+         s_condition.wait(lock);
+   }
+   catch(const boost::thread_resource_error& e)
+   {
+      LOG_ERROR(Error(boost::thread_error::ec_from_exception(e),
+                      ERROR_LOCATION));
+   }
+
+   return cancelled;
+}
+
+void waitFor(const FilePath& targetPath)
+{
+   std::string path = targetPath.absolutePath();
+
+   try
+   {
+      boost::unique_lock<boost::mutex> lock(s_mutex);
+      while (isPending(path))
+         s_condition.wait(lock);
+   }
+   catch(const boost::thread_resource_error& e)
+   {
+      LOG_ERROR(Error(boost::thread_error::ec_from_exception(e),
+                      ERROR_LOCATION));
+   }
+}
+
+void waitForAll()
+{
+   try
+   {
+      boost::unique_lock<boost::mutex> lock(s_mutex);
+      while (!s_requests.empty() || !s_inProgressPath.empty())
+         s_condition.wait(lock);
+   }
+   catch(const boost::thread_resource_error& e)
+   {
+      LOG_ERROR(Error(boost::thread_error::ec_from_exception(e),
+                      ERROR_LOCATION));
+   }
+}
+
+} // namespace png_writer
+
+void waitForImage(const FilePath& imagePath)
+{
+   png_writer::waitFor(imagePath);
+}
+
+} // namespace graphics
+} // namespace session
+} // namespace r
+} // namespace rstudio
@@ -17,13 +17,16 @@
 
 #include <boost/bind.hpp>
 #include <boost/format.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include <core/system/System.hpp>
 #include <core/StringUtils.hpp>
 
 #include <r/RExec.hpp>
+#include <r/RSexp.hpp>
 #include <r/session/RSessionUtils.hpp>
 #include <r/session/RGraphics.hpp>
+#include <r/session/RGraphicsPngWriter.hpp>
 
 #undef TRUE
 #undef FALSE
@@ -70,8 +73,12 @@ private:
 
 struct ShadowDeviceData
 {
-   ShadowDeviceData() : pShadowPngDevice(NULL) {}
+   ShadowDeviceData() : pShadowPngDevice(NULL), needsSync(false) {}
    pDevDesc pShadowPngDevice;
+
+   // set when the shadow device is (re)created and so hasn't yet seen
+   // the primitives already drawn on the rstudio device
+   bool needsSync;
 };
 
 void shadowDevOff(DeviceContext* pDC)
@@ -127,6 +134,7 @@ Error shadowDevDesc(DeviceContext* pDC, pDevDesc* pDev)
 
       // save reference to shadow device
       pDevData->pShadowPngDevice = GEcurrentDevice()->dev;
+      pDevData->needsSync = true;
    }
 
    // return shadow device
@@ -199,6 +207,50 @@ void shadowDevSync(DeviceContext* pDC)
       if (error && !r::isCodeExecutionError(error))
          LOG_ERROR(error);
    }
+
+   ShadowDeviceData* pDevData = (ShadowDeviceData*)pDC->pDeviceSpecific;
+   pDevData->needsSync = false;
+}
+
+// capture the contents of the shadow device. returns false if the
+// underlying png device doesn't support capture (e.g. the windows
+// bitmap device) in which case the device needs to write the file itself
+bool shadowDevCapture(DeviceContext* pDC, png_writer::Raster* pRaster)
+{
+   ShadowDeviceData* pDevData = (ShadowDeviceData*)pDC->pDeviceSpecific;
+   pDevDesc dev = pDevData->pShadowPngDevice;
+   if (dev == NULL || dev->cap == NULL || ndevNumber(dev) == 0)
+      return false;
+
+   SEXP rasterSEXP = R_NilValue;
+   Error error = r::exec::executeSafely<SEXP>(boost::bind(dev->cap, dev),
+                                              &rasterSEXP);
+   if (error)
+   {
+      if (!r::isCodeExecutionError(error))
+         LOG_ERROR(error);
+      return false;
+   }
+
+   r::sexp::Protect rProtect(rasterSEXP);
+   if (TYPEOF(rasterSEXP) != INTSXP)
+      return false;
+
+   // captured rasters are height x width and stored row major
+   SEXP dimSEXP = Rf_getAttrib(rasterSEXP, R_DimSymbol);
+   if (TYPEOF(dimSEXP) != INTSXP || Rf_length(dimSEXP) != 2)
+      return false;
+   int height = INTEGER(dimSEXP)[0];
+   int width = INTEGER(dimSEXP)[1];
+   if (width <= 0 || height <= 0 || (width * height) != Rf_length(rasterSEXP))
+      return false;
+
+   const unsigned int* pPixels = (const unsigned int*)INTEGER(rasterSEXP);
+   pRaster->width = width;
+   pRaster->height = height;
+   pRaster->res = 96 * pDC->devicePixelRatio;
+   pRaster->pixels.assign(pPixels, pPixels + (width * height));
+   return true;
 }
 
 } // anonymous namespace
@@ -306,8 +358,27 @@ void onAfterAddDevice(DeviceContext* pDC)
 
 Error writeToPNG(const FilePath& targetPath, DeviceContext* pDC)
 {
+   // if the shadow device supports capture then we can grab its raster
+   // and leave PNG encoding to the background writer. this avoids
+   // cycling the shadow device (which encodes the PNG on the R thread
+   // and then requires a full replay of the display list). note that the
+   // shadow device has received every primitive drawn since it was
+   // created so we only need to sync it if it was just (re)created.
+   ShadowDeviceData* pDevData = (ShadowDeviceData*)pDC->pDeviceSpecific;
+   bool synced = pDevData->needsSync;
+   if (synced)
+      shadowDevSync(pDC);
+
+   boost::shared_ptr<png_writer::Raster> pRaster(new png_writer::Raster());
+   if (shadowDevCapture(pDC, pRaster.get()))
+   {
+      png_writer::writeAsync(pRaster, targetPath);
+      return Success();
+   }
+
    // sync the shadow device to ensure we have the full playlist,
-   shadowDevSync(pDC);
+   if (!synced)
+      shadowDevSync(pDC);
 
    // turn the shadow device off to write the file
    shadowDevOff(pDC);
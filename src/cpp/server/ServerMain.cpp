@@ -21,6 +21,8 @@
 #include <core/LogWriter.hpp>
 #include <core/ProgramStatus.hpp>
 #include <core/ProgramOptions.hpp>
+#include <core/PeriodicCommand.hpp>
+#include <core/Trace.hpp>
 
 #include <core/text/TemplateFilter.hpp>
 
@@ -35,6 +37,7 @@
 #include <core/gwt/GwtFileHandler.hpp>
 
 #include <monitor/MonitorClient.hpp>
+#include <monitor/metrics/Registry.hpp>
 
 #include <session/SessionConstants.hpp>
 
@@ -60,6 +63,7 @@
 #include "ServerOffline.hpp"
 #include "ServerPAMAuth.hpp"
 #include "ServerREnvironment.hpp"
+#include "ServerSessionPrelaunch.hpp"
 
 using namespace rstudio;
 using namespace rstudio::core;
@@ -220,6 +224,15 @@ void httpServerAddHandlers()
 }
 
 
+bool writeTrace()
+{
+   Error error = core::trace::write(
+                        FilePath(server::options().serverTracePath()));
+   if (error)
+      LOG_ERROR(error);
+   return true;
+}
+
 // bogus SIGCHLD handler (never called)
 void handleSIGCHLD(int)
 {
@@ -455,6 +468,16 @@ int main(int argc, char * const argv[])
       core::system::addLogWriter(
                 monitor::client().createLogWriter(kProgramIdentity));
 
+      // trace if requested (periodically writing the trace)
+      if (!server::options().serverTracePath().empty())
+      {
+         core::trace::setEnabled(true);
+         scheduler::addCommand(boost::shared_ptr<ScheduledCommand>(
+               new PeriodicCommand(boost::posix_time::seconds(10),
+                                   writeTrace,
+                                   false)));
+      }
+
       // call overlay initialize
       error = overlay::initialize();
       if (error)
@@ -492,6 +515,12 @@ int main(int argc, char * const argv[])
             if (error)
                return core::system::exitFailure(error, ERROR_LOCATION);
          }
+
+         // prelaunch sessions of recently active users (needs to happen
+         // prior to dropping privilege so we can set up its state file)
+         error = session_prelaunch::initialize();
+         if (error)
+            LOG_ERROR(error);
       }
 
       // enforce restricted mode if we are running under app armor
@@ -518,6 +547,17 @@ int main(int argc, char * const argv[])
             return core::system::exitFailure(error, ERROR_LOCATION);
       }
 
+      // export metrics if requested (after dropping privilege so the
+      // metrics file is owned by the user that rewrites it)
+      if (!server::options().monitorMetricsPath().empty())
+      {
+         error = monitor::metrics::startExporter(
+                           server::options().monitorMetricsPath(),
+                           server::options().monitorMetricsIntervalSeconds());
+         if (error)
+            LOG_ERROR(error);
+      }
+
       // run special verify installation mode if requested
       if (options.verifyInstallation())
       {
@@ -201,7 +201,10 @@ ProgramStatus Options::read(int argc,
          "is app armor enabled for this session")
       ("server-set-umask",
          value<bool>(&serverSetUmask_)->default_value(1),
-         "set the umask to 022 on startup");
+         "set the umask to 022 on startup")
+      ("server-trace-path",
+         value<std::string>(&serverTracePath_)->default_value(""),
+         "path to periodically write trace spans to");
 
    // www - web server options
    options_description www("www") ;
@@ -251,6 +254,16 @@ ProgramStatus Options::read(int argc,
       ("rsession-config-file",
          value<std::string>(&rsessionConfigFile_)->default_value(""),
          "path to rsession config file")
+      ("rsession-prelaunch-count",
+         value<int>(&rsessionPrelaunchCount_)->default_value(0),
+         "number of sessions of recently active users to keep launched "
+         "ahead of their next request (0 to disable)")
+      ("rsession-prelaunch-concurrency",
+         value<int>(&rsessionPrelaunchConcurrency_)->default_value(2),
+         "maximum number of sessions launched ahead of requests at once")
+      ("rsession-prelaunch-check-seconds",
+         value<int>(&rsessionPrelaunchCheckSeconds_)->default_value(5),
+         "interval between health checks of prelaunched sessions")
       ("rsession-memory-limit-mb",
          value<int>(&dep.memoryLimitMb)->default_value(dep.memoryLimitMb),
          "rsession memory limit (mb) - DEPRECATED")
@@ -297,7 +310,13 @@ ProgramStatus Options::read(int argc,
    monitor.add_options()
       (kMonitorIntervalSeconds,
        value<int>(&monitorIntervalSeconds_)->default_value(300),
-       "monitoring interval");
+       "monitoring interval")
+      (kMonitorMetricsPath,
+       value<std::string>(&monitorMetricsPath_)->default_value(""),
+       "path (file or unix socket) to export metrics to")
+      (kMonitorMetricsIntervalSeconds,
+       value<int>(&monitorMetricsIntervalSeconds_)->default_value(10),
+       "metrics export interval");
 
    // define program options
    FilePath defaultConfigPath("/etc/rstudio/rserver.conf");
@@ -15,12 +15,16 @@
 
 #include <server/ServerProcessSupervisor.hpp>
 
+#include <boost/bind.hpp>
+
 #include <core/Error.hpp>
 #include <core/DateTime.hpp>
 #include <core/Thread.hpp>
 #include <core/PeriodicCommand.hpp>
 #include <core/system/Process.hpp>
 
+#include <monitor/metrics/Registry.hpp>
+
 #include <server/ServerScheduler.hpp>
 
 using namespace rstudio::core ;
@@ -51,6 +55,22 @@ bool pollProcessSupervisor()
    return true;
 }
 
+monitor::metrics::Counter s_programsLaunched = monitor::metrics::counter(
+      "rserver_supervised_programs_launched",
+      "Programs launched by the process supervisor");
+
+monitor::metrics::Gauge s_programsRunning = monitor::metrics::gauge(
+      "rserver_supervised_programs_running",
+      "Programs currently running under the process supervisor");
+
+void onProgramCompleted(
+  const boost::function<void(const core::system::ProcessResult&)>& onCompleted,
+  const core::system::ProcessResult& result)
+{
+   s_programsRunning.add(-1);
+   onCompleted(result);
+}
+
 } // anonymous namespace
 
 Error runProgram(
@@ -62,11 +82,17 @@ Error runProgram(
 {
    LOCK_MUTEX(s_mutex)
    {
-      return processSupervisor().runProgram(executable,
-                                            args,
-                                            input,
-                                            options,
-                                            onCompleted);
+      s_programsLaunched.increment();
+      s_programsRunning.add(1);
+      Error error = processSupervisor().runProgram(
+                                 executable,
+                                 args,
+                                 input,
+                                 options,
+                                 boost::bind(onProgramCompleted, onCompleted, _1));
+      if (error)
+         s_programsRunning.add(-1);
+      return error;
    }
    END_LOCK_MUTEX
 
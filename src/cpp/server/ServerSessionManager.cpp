@@ -38,6 +38,7 @@
 #include <server/auth/ServerValidateUser.hpp>
 
 #include "ServerREnvironment.hpp"
+#include "ServerSessionPrelaunch.hpp"
 
 
 using namespace rstudio::core;
@@ -199,6 +200,9 @@ Error SessionManager::launchSession(const r_util::SessionContext& context)
    }
    END_LOCK_MUTEX
 
+   // note the launch so the session can be prelaunched after a restart
+   session_prelaunch::onSessionLaunch(context);
+
    // determine launch options
    r_util::SessionLaunchProfile profile;
    profile.context = context;
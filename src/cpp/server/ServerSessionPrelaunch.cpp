@@ -0,0 +1,509 @@
+/*
+ * ServerSessionPrelaunch.cpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "ServerSessionPrelaunch.hpp"
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/foreach.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/DateTime.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/SafeConvert.hpp>
+#include <core/Thread.hpp>
+#include <core/PeriodicCommand.hpp>
+#include <core/system/FileMode.hpp>
+#include <core/system/PosixSystem.hpp>
+#include <core/system/PosixUser.hpp>
+
+#include <monitor/metrics/Registry.hpp>
+
+#include <session/SessionLocalStreams.hpp>
+
+#include <server/ServerOptions.hpp>
+#include <server/ServerScheduler.hpp>
+#include <server/ServerSessionManager.hpp>
+
+#include <server/auth/ServerValidateUser.hpp>
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace server {
+namespace session_prelaunch {
+
+namespace {
+
+// sessions last active longer ago than this aren't launched ahead
+// of their users (they are likely not coming back soon)
+const boost::posix_time::time_duration kRecentSessionMaxAge =
+                                          boost::posix_time::hours(24);
+
+// number of recently active sessions we remember
+const std::size_t kMaxRecentSessions = 100;
+
+// time a prelaunched session has to start accepting connections before
+// we consider the launch failed (matches the session manager's limit
+// for pending launches)
+const boost::posix_time::time_duration kLaunchTimeout =
+                                          boost::posix_time::minutes(1);
+
+struct RecentSession
+{
+   RecentSession(const r_util::SessionContext& context, double time)
+      : context(context), time(time)
+   {
+   }
+
+   r_util::SessionContext context;
+   double time;
+};
+
+enum PrelaunchState
+{
+   PrelaunchStarting,
+   PrelaunchReady
+};
+
+struct PrelaunchedSession
+{
+   PrelaunchState state;
+   boost::posix_time::ptime launchTime;
+};
+
+// mutex that protects the state below (sessions are launched and
+// requested from the http server's threads)
+boost::mutex s_mutex;
+
+// recently active sessions (most recent first)
+std::vector<RecentSession> s_recentSessions;
+
+// sessions to launch ahead of their users (most recent first)
+std::deque<r_util::SessionContext> s_candidates;
+
+// sessions we launched that haven't been requested by their users yet
+typedef std::map<r_util::SessionContext,PrelaunchedSession> PrelaunchMap;
+PrelaunchMap s_prelaunched;
+
+// resolved once by initialize (before privilege is dropped) since the
+// location depends on whether we are running as root
+FilePath s_recentSessionsPath;
+
+monitor::metrics::Counter s_sessionsPrelaunched = monitor::metrics::counter(
+      "rserver_sessions_prelaunched",
+      "Sessions launched ahead of their users' requests");
+
+monitor::metrics::Counter s_prelaunchesClaimed = monitor::metrics::counter(
+      "rserver_session_prelaunches_claimed",
+      "Prelaunched sessions subsequently requested by their users");
+
+monitor::metrics::Counter s_prelaunchesFailed = monitor::metrics::counter(
+      "rserver_session_prelaunches_failed",
+      "Prelaunched sessions that failed to start");
+
+monitor::metrics::Gauge s_prelaunchesPending = monitor::metrics::gauge(
+      "rserver_session_prelaunches_pending",
+      "Prelaunched sessions not yet requested by their users");
+
+bool isEnabled()
+{
+   return server::options().rsessionPrelaunchCount() > 0;
+}
+
+FilePath resolveRecentSessionsPath()
+{
+   // same locations as the secure key files
+   const char * const kRecentSessionsFile = "recent-sessions";
+   if (core::system::effectiveUserIsRoot())
+      return FilePath("/var/lib/rstudio-server").complete(kRecentSessionsFile);
+   else
+      return FilePath("/tmp/rstudio-server").complete(kRecentSessionsFile);
+}
+
+std::string recentSessionAsString(const RecentSession& session)
+{
+   return safe_convert::numberToString(static_cast<long>(session.time)) +
+          "\t" + session.context.username +
+          "\t" + session.context.scope.project() +
+          "\t" + session.context.scope.id();
+}
+
+bool recentSessionFromString(const std::string& line, RecentSession* pSession)
+{
+   std::vector<std::string> fields;
+   boost::algorithm::split(fields, line, boost::algorithm::is_any_of("\t"));
+   if (fields.size() < 2 || fields[1].empty())
+      return false;
+
+   // trailing empty fields (no project or scope) are trimmed from the line
+   fields.resize(4);
+
+   pSession->time = safe_convert::stringTo<double>(fields[0], 0);
+   pSession->context.username = fields[1];
+   if (!fields[2].empty() || !fields[3].empty())
+   {
+      pSession->context.scope = r_util::SessionScope::fromProjectId(
+                                    r_util::ProjectId(fields[2]), fields[3]);
+   }
+   return true;
+}
+
+Error readRecentSessions(std::vector<RecentSession>* pSessions)
+{
+   const FilePath& recentPath = s_recentSessionsPath;
+   if (!recentPath.exists())
+      return Success();
+
+   std::vector<std::string> lines;
+   Error error = readStringVectorFromFile(recentPath, &lines);
+   if (error)
+      return error;
+
+   BOOST_FOREACH(const std::string& line, lines)
+   {
+      RecentSession session(r_util::SessionContext(), 0);
+      if (recentSessionFromString(line, &session))
+         pSessions->push_back(session);
+   }
+
+   return Success();
+}
+
+Error writeRecentSessions()
+{
+   std::vector<std::string> lines;
+   BOOST_FOREACH(const RecentSession& session, s_recentSessions)
+   {
+      lines.push_back(recentSessionAsString(session));
+   }
+   return writeStringVectorToFile(s_recentSessionsPath, lines);
+}
+
+// requires s_mutex to be held
+void recordRecentSession(const r_util::SessionContext& context)
+{
+   for (std::vector<RecentSession>::iterator it = s_recentSessions.begin();
+        it != s_recentSessions.end();
+        ++it)
+   {
+      if (it->context == context)
+      {
+         s_recentSessions.erase(it);
+         break;
+      }
+   }
+
+   s_recentSessions.insert(s_recentSessions.begin(),
+                           RecentSession(context,
+                                         date_time::secondsSinceEpoch()));
+   if (s_recentSessions.size() > kMaxRecentSessions)
+      s_recentSessions.erase(s_recentSessions.begin() + kMaxRecentSessions,
+                             s_recentSessions.end());
+
+   Error error = writeRecentSessions();
+   if (error)
+      LOG_ERROR(error);
+}
+
+// check whether a session is accepting connections
+bool isSessionAvailable(const r_util::SessionContext& context)
+{
+   FilePath streamPath = session::local_streams::streamPath(
+                                       r_util::sessionContextFile(context));
+   if (!streamPath.exists())
+      return false;
+
+   using boost::asio::local::stream_protocol;
+   boost::asio::io_service ioService;
+   stream_protocol::socket socket(ioService);
+   boost::system::error_code ec;
+   socket.connect(stream_protocol::endpoint(streamPath.absolutePath()), ec);
+   if (ec)
+      return false;
+
+   socket.close(ec);
+   return true;
+}
+
+void prelaunchSession(const r_util::SessionContext& context)
+{
+   // don't launch for users who can no longer sign in and leave sessions
+   // which are already running (e.g. they outlived a restart) alone
+   if (!auth::validateUser(context.username,
+                           server::options().authRequiredUserGroup(),
+                           server::options().authMinimumUserId(),
+                           false) ||
+       isSessionAvailable(context))
+   {
+      return;
+   }
+
+   LOCK_MUTEX(s_mutex)
+   {
+      PrelaunchedSession prelaunched;
+      prelaunched.state = PrelaunchStarting;
+      prelaunched.launchTime = boost::posix_time::second_clock::universal_time();
+      s_prelaunched[context] = prelaunched;
+   }
+   END_LOCK_MUTEX
+
+   Error error = session::local_streams::ensureStreamsDir();
+   if (error)
+      LOG_ERROR(error);
+
+   error = sessionManager().launchSession(context);
+   if (error)
+   {
+      LOG_ERROR(error);
+      s_prelaunchesFailed.increment();
+
+      LOCK_MUTEX(s_mutex)
+      {
+         s_prelaunched.erase(context);
+      }
+      END_LOCK_MUTEX
+
+      return;
+   }
+
+   s_sessionsPrelaunched.increment();
+}
+
+bool checkPrelaunchedSessions()
+{
+   using namespace boost::posix_time;
+
+   // check the sessions without holding the lock (they may be
+   // requested by their users in the meantime)
+   PrelaunchMap prelaunched;
+   LOCK_MUTEX(s_mutex)
+   {
+      prelaunched = s_prelaunched;
+   }
+   END_LOCK_MUTEX
+
+   std::map<r_util::SessionContext,bool> available;
+   BOOST_FOREACH(const PrelaunchMap::value_type& entry, prelaunched)
+   {
+      available[entry.first] = isSessionAvailable(entry.first);
+   }
+
+   ptime now = second_clock::universal_time();
+   std::vector<r_util::SessionContext> toLaunch;
+   bool keepChecking = true;
+   LOCK_MUTEX(s_mutex)
+   {
+      BOOST_FOREACH(const PrelaunchMap::value_type& entry, prelaunched)
+      {
+         const r_util::SessionContext& context = entry.first;
+         PrelaunchMap::iterator pos = s_prelaunched.find(context);
+         if (pos == s_prelaunched.end())
+            continue;
+
+         if (available[context])
+         {
+            pos->second.state = PrelaunchReady;
+         }
+         else if (entry.second.state == PrelaunchReady)
+         {
+            // the session exited without being requested (e.g. it was
+            // suspended after the session timeout)
+            s_prelaunched.erase(pos);
+         }
+         else if (now > entry.second.launchTime + kLaunchTimeout)
+         {
+            LOG_WARNING_MESSAGE("Prelaunched session for user " +
+                                context.username + " failed to start");
+            s_prelaunchesFailed.increment();
+            s_prelaunched.erase(pos);
+         }
+      }
+
+      // start more sessions while we are below the pool size (limiting
+      // the number that are starting at once)
+      std::size_t poolSize = std::max(
+                        server::options().rsessionPrelaunchCount(), 0);
+      std::size_t concurrency = std::max(
+                        server::options().rsessionPrelaunchConcurrency(), 1);
+      std::size_t starting = 0;
+      BOOST_FOREACH(const PrelaunchMap::value_type& entry, s_prelaunched)
+      {
+         if (entry.second.state == PrelaunchStarting)
+            starting++;
+      }
+
+      while (!s_candidates.empty() &&
+             s_prelaunched.size() + toLaunch.size() < poolSize &&
+             starting + toLaunch.size() < concurrency)
+      {
+         r_util::SessionContext context = s_candidates.front();
+         s_candidates.pop_front();
+         if (s_prelaunched.find(context) == s_prelaunched.end())
+            toLaunch.push_back(context);
+      }
+
+      s_prelaunchesPending.set(s_prelaunched.size() + toLaunch.size());
+
+      // once all candidates are launched we only need to keep checking
+      // until the remaining sessions are requested or exit
+      keepChecking = !s_candidates.empty() || !s_prelaunched.empty() ||
+                     !toLaunch.empty();
+   }
+   END_LOCK_MUTEX
+
+   BOOST_FOREACH(const r_util::SessionContext& context, toLaunch)
+   {
+      prelaunchSession(context);
+   }
+
+   return keepChecking;
+}
+
+Error initializeRecentSessionsFile()
+{
+   const FilePath& recentPath = s_recentSessionsPath;
+   Error error = recentPath.parent().ensureDirectory();
+   if (error)
+      return error;
+
+   if (!recentPath.exists())
+   {
+      error = writeStringToFile(recentPath, "");
+      if (error)
+         return error;
+   }
+
+   // the list of users is readable only by us
+   error = core::system::changeFileMode(recentPath,
+                                        core::system::UserReadWriteMode);
+   if (error)
+      return error;
+
+   // we write the file after dropping privilege so it needs to
+   // be owned by the server user
+   std::string serverUser = server::options().serverUser();
+   if (core::system::effectiveUserIsRoot() && !serverUser.empty())
+   {
+      core::system::user::User user;
+      error = core::system::user::userFromUsername(serverUser, &user);
+      if (error)
+         return error;
+
+      if (::chown(recentPath.absolutePath().c_str(),
+                  user.userId,
+                  user.groupId) != 0)
+      {
+         error = systemError(errno, ERROR_LOCATION);
+         error.addProperty("path", recentPath.absolutePath());
+         return error;
+      }
+   }
+
+   return Success();
+}
+
+} // anonymous namespace
+
+void onSessionLaunch(const r_util::SessionContext& context)
+{
+   if (!isEnabled())
+      return;
+
+   LOCK_MUTEX(s_mutex)
+   {
+      // launches we initiated don't count as activity
+      if (s_prelaunched.find(context) != s_prelaunched.end())
+         return;
+
+      std::deque<r_util::SessionContext>::iterator pos =
+               std::find(s_candidates.begin(), s_candidates.end(), context);
+      if (pos != s_candidates.end())
+         s_candidates.erase(pos);
+
+      recordRecentSession(context);
+   }
+   END_LOCK_MUTEX
+}
+
+void onSessionRequest(const r_util::SessionContext& context)
+{
+   if (!isEnabled())
+      return;
+
+   LOCK_MUTEX(s_mutex)
+   {
+      PrelaunchMap::iterator pos = s_prelaunched.find(context);
+      if (pos == s_prelaunched.end())
+         return;
+
+      s_prelaunched.erase(pos);
+      s_prelaunchesClaimed.increment();
+      s_prelaunchesPending.set(s_prelaunched.size());
+      recordRecentSession(context);
+   }
+   END_LOCK_MUTEX
+}
+
+Error initialize()
+{
+   if (!isEnabled())
+      return Success();
+
+   s_recentSessionsPath = resolveRecentSessionsPath();
+   Error error = initializeRecentSessionsFile();
+   if (error)
+      return error;
+
+   error = readRecentSessions(&s_recentSessions);
+   if (error)
+      return error;
+
+   // sessions active recently are launched ahead of their users
+   double minTime = date_time::secondsSinceEpoch() -
+                    kRecentSessionMaxAge.total_seconds();
+   BOOST_FOREACH(const RecentSession& session, s_recentSessions)
+   {
+      if (session.time >= minTime)
+         s_candidates.push_back(session.context);
+   }
+
+   if (!s_candidates.empty())
+   {
+      int checkSeconds = std::max(
+                  server::options().rsessionPrelaunchCheckSeconds(), 1);
+      scheduler::addCommand(boost::shared_ptr<ScheduledCommand>(
+            new PeriodicCommand(boost::posix_time::seconds(checkSeconds),
+                                checkPrelaunchedSessions,
+                                false)));
+   }
+
+   return Success();
+}
+
+} // namespace session_prelaunch
+} // namespace server
+} // namespace rstudio
@@ -0,0 +1,49 @@
+/*
+ * ServerSessionPrelaunch.hpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SERVER_SESSION_PRELAUNCH_HPP
+#define SERVER_SESSION_PRELAUNCH_HPP
+
+#include <core/r_util/RSessionContext.hpp>
+
+namespace rstudio {
+namespace core {
+   class Error;
+}
+}
+
+namespace rstudio {
+namespace server {
+namespace session_prelaunch {
+
+// Sessions of recently active users are launched ahead of their next
+// request (e.g. after rserver or the machine restarts) so that they don't
+// all wait on R starting up at once. At most rsession-prelaunch-count of
+// these sessions are kept running unclaimed, and they are periodically
+// checked to make sure they came up (and are still up).
+
+// notification that a session is being launched on behalf of a user
+void onSessionLaunch(const core::r_util::SessionContext& context);
+
+// notification that a user made a request of a session
+void onSessionRequest(const core::r_util::SessionContext& context);
+
+core::Error initialize();
+
+} // namespace session_prelaunch
+} // namespace server
+} // namespace rstudio
+
+#endif // SERVER_SESSION_PRELAUNCH_HPP
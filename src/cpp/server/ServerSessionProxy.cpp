@@ -33,6 +33,7 @@
 #include <core/BoostErrors.hpp>
 #include <core/Log.hpp>
 #include <core/Thread.hpp>
+#include <core/Trace.hpp>
 #include <core/WaitUtils.hpp>
 
 #include <core/http/SocketUtils.hpp>
@@ -49,6 +50,8 @@
 
 #include <core/json/JsonRpc.hpp>
 
+#include <monitor/metrics/Registry.hpp>
+
 #include <session/SessionConstants.hpp>
 #include <session/SessionLocalStreams.hpp>
 #include <session/SessionInvalidScope.hpp>
@@ -62,6 +65,8 @@
 
 #include <server/ServerConstants.hpp>
 
+#include "ServerSessionPrelaunch.hpp"
+
 using namespace rstudio::core ;
 
 namespace rstudio {
@@ -144,11 +149,29 @@ bool sessionContextForRequest(
    }
 }
 
+monitor::metrics::Counter s_proxyRequests = monitor::metrics::counter(
+      "rserver_proxy_requests",
+      "Requests proxied to sessions");
+
+monitor::metrics::Histogram s_proxyDuration = monitor::metrics::histogram(
+      "rserver_proxy_request_duration_seconds",
+      "Time from proxying a request to a session until its response");
+
 void handleProxyResponse(
       boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
       const r_util::SessionContext& context,
+      const boost::posix_time::ptime& startTime,
       const http::Response& response)
 {
+   boost::posix_time::ptime endTime =
+         boost::posix_time::microsec_clock::universal_time();
+   s_proxyDuration.observe(
+            (endTime - startTime).total_microseconds() / 1000000.0);
+   core::trace::record("proxy",
+                       ptrConnection->request().uri(),
+                       startTime,
+                       endTime);
+
    // if there was a launch pending then remove it
    sessionManager().removePendingLaunch(context);
 
@@ -495,6 +518,9 @@ void proxyRequest(
       const http::ErrorHandler& errorHandler,
       const http::ConnectionRetryProfile& connectionRetryProfile)
 {
+   // claim the session if it was launched ahead of this request
+   session_prelaunch::onSessionRequest(context);
+
    // apply optional proxy filter
    if (applyProxyFilter(ptrConnection, context))
       return;
@@ -533,8 +559,13 @@ void proxyRequest(
       s_proxyRequestFilter(&(pClient->request()));
 
    // execute
+   s_proxyRequests.increment();
    pClient->execute(
-         boost::bind(handleProxyResponse, ptrConnection, context, _1),
+         boost::bind(handleProxyResponse,
+                     ptrConnection,
+                     context,
+                     boost::posix_time::microsec_clock::universal_time(),
+                     _1),
          errorHandler);
 }
 
@@ -78,6 +78,11 @@ public:
 
    bool serverSetUmask() const { return serverSetUmask_; }
 
+   std::string serverTracePath() const
+   {
+      return std::string(serverTracePath_.c_str());
+   }
+
    // www 
    std::string wwwAddress() const
    { 
@@ -191,6 +196,21 @@ public:
       return std::string(rsessionConfigFile_.c_str()); 
    }
 
+   int rsessionPrelaunchCount() const
+   {
+      return rsessionPrelaunchCount_;
+   }
+
+   int rsessionPrelaunchConcurrency() const
+   {
+      return rsessionPrelaunchConcurrency_;
+   }
+
+   int rsessionPrelaunchCheckSeconds() const
+   {
+      return rsessionPrelaunchCheckSeconds_;
+   }
+
    std::string monitorSharedSecret() const
    {
       return std::string(monitorSharedSecret_.c_str());
@@ -201,6 +221,16 @@ public:
       return monitorIntervalSeconds_;
    }
 
+   std::string monitorMetricsPath() const
+   {
+      return std::string(monitorMetricsPath_.c_str());
+   }
+
+   int monitorMetricsIntervalSeconds() const
+   {
+      return monitorMetricsIntervalSeconds_;
+   }
+
    std::string gwtPrefix() const;
    
    std::string getOverlayOption(const std::string& name)
@@ -247,6 +277,7 @@ private:
    bool serverDaemonize_;
    bool serverAppArmorEnabled_;
    bool serverSetUmask_;
+   std::string serverTracePath_;
    bool serverOffline_;
    std::string wwwAddress_ ;
    std::string wwwPort_ ;
@@ -268,8 +299,13 @@ private:
    std::string rldpathPath_;
    std::string rsessionConfigFile_;
    std::string rsessionLdLibraryPath_;
+   int rsessionPrelaunchCount_;
+   int rsessionPrelaunchConcurrency_;
+   int rsessionPrelaunchCheckSeconds_;
    std::string monitorSharedSecret_;
    int monitorIntervalSeconds_;
+   std::string monitorMetricsPath_;
+   int monitorMetricsIntervalSeconds_;
    std::map<std::string,std::string> overlayOptions_;
 };
       
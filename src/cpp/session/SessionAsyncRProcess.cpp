@@ -26,6 +26,8 @@
 
 #include <session/SessionAsyncRProcess.hpp>
 
+#include "SessionAsyncRWorkerPool.hpp"
+
 namespace rstudio {
 namespace session {
 namespace async_r {
@@ -68,6 +70,22 @@ void AsyncRProcess::start(const char* rCommand,
       rSourceFiles.insert(rSourceFiles.begin(), rTools);
    }
 
+   // run on a resident R process if requested (and the pool is enabled)
+   if (rOptions & R_PROCESS_POOLED)
+   {
+      isRunning_ = true;
+      if (runOnWorker(shared_from_this(),
+                      rCommand,
+                      environment,
+                      workingDir,
+                      rOptions,
+                      rSourceFiles))
+      {
+         return;
+      }
+      isRunning_ = false;
+   }
+
    // args
    std::vector<std::string> args;
    args.push_back("--slave");
@@ -0,0 +1,695 @@
+/*
+ * SessionAsyncRWorkerPool.cpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionAsyncRWorkerPool.hpp"
+
+#include <set>
+#include <map>
+#include <deque>
+#include <algorithm>
+#include <sstream>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/utility.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/algorithm/string/replace.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/SafeConvert.hpp>
+#include <core/system/System.hpp>
+#include <core/system/Process.hpp>
+#include <core/system/Environment.hpp>
+
+#include <session/SessionOptions.hpp>
+#include <session/SessionModuleContext.hpp>
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace session {
+namespace async_r {
+
+namespace {
+
+struct RJob
+{
+   boost::shared_ptr<AsyncRProcess> pProcess;
+   std::string key;
+   AsyncRProcessOptions rOptions;
+   std::string rCommand;
+   core::system::Options environment;
+   core::FilePath workingDir;
+   bool redirectStdErr;
+   std::vector<core::FilePath> rSourceFiles;
+};
+
+// worker processes are shared by jobs started with the same options (and
+// library paths)
+std::string workerKey(AsyncRProcessOptions rOptions)
+{
+   int keyOptions = rOptions & (R_PROCESS_VANILLA | R_PROCESS_NO_RDATA);
+   return safe_convert::numberToString(keyOptions) + "|" +
+          module_context::libPathsString();
+}
+
+std::string rStringLiteral(const std::string& str)
+{
+   std::string escaped = str;
+   boost::algorithm::replace_all(escaped, "\\", "\\\\");
+   boost::algorithm::replace_all(escaped, "'", "\\'");
+   return "'" + escaped + "'";
+}
+
+// the loop run by each worker. it reads jobs (the length of their code on a
+// line of its own followed by the code) from stdin and writes a line with
+// the token to stderr and then a line with the token, the job's exit status,
+// the memory in use (in Mb) and the paths of the loaded namespaces to stdout
+// once each job is done. it avoids double quotes and backslashes so that it
+// can be passed as is to R -e
+std::string workerLoop(const std::string& token)
+{
+   std::string loop =
+      "local({"
+      "con <- file('stdin', open = 'rb'); "
+      "nl <- intToUtf8(10L); "
+      "tab <- intToUtf8(9L); "
+      "token <- '" + token + "'; "
+      "repeat { "
+         "header <- readLines(con, n = 1L); "
+         "if (length(header) == 0L) break; "
+         "code <- rawToChar(readBin(con, 'raw', as.integer(header))); "
+         "wd <- getwd(); "
+         "env <- Sys.getenv(); "
+         "status <- tryCatch({ "
+            "withCallingHandlers("
+               "eval(parse(text = code), envir = globalenv()), "
+               "warning = function(w) { "
+                  "cat('Warning message:', nl, conditionMessage(w), nl, "
+                      "sep = '', file = stderr()); "
+                  "invokeRestart('muffleWarning') "
+               "}); "
+            "0L "
+         "}, error = function(e) { "
+            "cat('Error: ', conditionMessage(e), nl, sep = '', file = stderr()); "
+            "1L "
+         "}); "
+         "try(setwd(wd), silent = TRUE); "
+         "added <- setdiff(names(Sys.getenv()), names(env)); "
+         "if (length(added)) Sys.unsetenv(added); "
+         "do.call(Sys.setenv, as.list(env)); "
+         "used <- sum(gc()[, 2L]); "
+         "cat(nl, token, nl, sep = '', file = stderr()); "
+         "paths <- find.package(loadedNamespaces(), quiet = TRUE); "
+         "cat(nl, token, ' ', status, ' ', used, tab, "
+             "paste(paths, collapse = tab), nl, sep = ''); "
+         "flush(stderr()); "
+         "flush(stdout()) "
+      "} "
+      "})";
+
+#ifdef _WIN32
+   // passed on the command line as a single argument
+   loop = "\"" + loop + "\"";
+#endif
+
+   return loop;
+}
+
+// the write time of an installed package (which changes when the package
+// is reinstalled)
+std::time_t packageWriteTime(const std::string& packagePath)
+{
+   return FilePath(packagePath).childPath("DESCRIPTION").lastWriteTime();
+}
+
+void dispatchJobs();
+void onWorkerExited();
+
+} // anonymous namespace
+
+void JobOutputReader::read(const std::string& output, std::string* pJobOutput)
+{
+   if (done_)
+      return;
+   buffer_.append(output);
+
+   std::string::size_type pos = buffer_.find(marker_);
+   if (pos == std::string::npos)
+   {
+      // hold back enough output to contain the start of the marker
+      std::size_t holdBack = marker_.size() - 1;
+      if (buffer_.size() > holdBack)
+      {
+         std::size_t size = buffer_.size() - holdBack;
+         pJobOutput->append(buffer_, 0, size);
+         buffer_.erase(0, size);
+      }
+      return;
+   }
+
+   pJobOutput->append(buffer_, 0, pos);
+   buffer_.erase(0, pos);
+
+   // wait for the rest of the marker line
+   std::string::size_type end = buffer_.find('\n', marker_.size());
+   if (end == std::string::npos)
+      return;
+
+   status_ = buffer_.substr(marker_.size(), end - marker_.size());
+   buffer_.clear();
+   done_ = true;
+}
+
+void JobOutputReader::flush(std::string* pJobOutput)
+{
+   pJobOutput->append(buffer_);
+   buffer_.clear();
+}
+
+void JobOutputReader::reset()
+{
+   buffer_.clear();
+   status_.clear();
+   done_ = false;
+}
+
+bool parseJobStatus(const std::string& status, JobStatus* pStatus)
+{
+   std::vector<std::string> fields;
+   boost::algorithm::split(fields, status, boost::algorithm::is_any_of("\t"));
+
+   std::istringstream istr(fields[0]);
+   istr >> pStatus->exitStatus >> pStatus->memoryMb;
+   if (istr.fail())
+      return false;
+
+   pStatus->namespacePaths.clear();
+   for (std::size_t i = 1; i < fields.size(); i++)
+   {
+      if (!fields[i].empty())
+         pStatus->namespacePaths.push_back(fields[i]);
+   }
+   return true;
+}
+
+// a resident R process which runs jobs one at a time
+class RWorker : boost::noncopyable,
+                public boost::enable_shared_from_this<RWorker>
+{
+public:
+   static boost::shared_ptr<RWorker> create(const std::string& key,
+                                            AsyncRProcessOptions rOptions)
+   {
+      boost::shared_ptr<RWorker> pWorker(new RWorker(key));
+      Error error = pWorker->start(rOptions);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return boost::shared_ptr<RWorker>();
+      }
+      return pWorker;
+   }
+
+   // complete a job which couldn't be run
+   static void failJob(const RJob& job)
+   {
+      job.pProcess->onProcessCompleted(EXIT_FAILURE);
+   }
+
+   const std::string& key() const { return key_; }
+   bool isIdle() const { return !pJob_ && !retired_ && !exited_; }
+   bool isAvailable() const { return !retired_ && !exited_; }
+
+   // whether any of the packages the worker has loaded has since been
+   // reinstalled (the worker would still be using the old version)
+   bool hasStaleNamespaces() const
+   {
+      for (std::map<std::string, std::time_t>::const_iterator it =
+            namespaces_.begin(); it != namespaces_.end(); ++it)
+      {
+         if (packageWriteTime(it->first) != it->second)
+            return true;
+      }
+      return false;
+   }
+
+   void runJob(const boost::shared_ptr<RJob>& pJob)
+   {
+      pJob_ = pJob;
+      stdoutReader_.reset();
+      stderrReader_.reset();
+      status_ = JobStatus();
+      newSourceFiles_.clear();
+
+      std::ostringstream code;
+
+      // files are only sourced once per worker (until they change)
+      BOOST_FOREACH(const FilePath& sourceFile, pJob->rSourceFiles)
+      {
+         std::string sourced = sourceFile.absolutePath() + ":" +
+               safe_convert::numberToString(sourceFile.lastWriteTime());
+         if (sourced_.count(sourced) == 0)
+         {
+            code << "source(" << rStringLiteral(sourceFile.absolutePath())
+                 << ");";
+            newSourceFiles_.push_back(sourced);
+         }
+      }
+
+      // the worker restores its environment and working directory once
+      // the job is done
+      BOOST_FOREACH(const core::system::Option& var, pJob->environment)
+      {
+         code << "Sys.setenv(`" << var.first << "` = "
+              << rStringLiteral(var.second) << ");";
+      }
+      if (!pJob->workingDir.empty())
+         code << "setwd(" << rStringLiteral(pJob->workingDir.absolutePath())
+              << ");";
+
+      code << pJob->rCommand;
+
+      std::string job = code.str();
+      input_ += safe_convert::numberToString(job.size()) + "\n" + job;
+   }
+
+   // exit once the current job (if any) is done
+   void retire()
+   {
+      retired_ = true;
+      if (!pJob_)
+         closeInput_ = true;
+   }
+
+private:
+   explicit RWorker(const std::string& key)
+      : key_(key),
+        token_("RSTUDIO-WORKER-" + core::system::generateShortenedUuid()),
+        jobs_(0),
+        closeInput_(false),
+        retired_(false),
+        exited_(false),
+        stdoutReader_(token_),
+        stderrReader_(token_)
+   {
+   }
+
+   Error start(AsyncRProcessOptions rOptions)
+   {
+      FilePath rProgramPath;
+      Error error = module_context::rScriptPath(&rProgramPath);
+      if (error)
+         return error;
+
+      std::vector<std::string> args;
+      args.push_back("--slave");
+      if (rOptions & R_PROCESS_VANILLA)
+         args.push_back("--vanilla");
+      if (rOptions & R_PROCESS_NO_RDATA)
+      {
+         args.push_back("--no-save");
+         args.push_back("--no-restore");
+      }
+      args.push_back("-e");
+      args.push_back(workerLoop(token_));
+
+      core::system::ProcessOptions options;
+      options.terminateChildren = true;
+
+      // forward R_LIBS so the worker has access to the same libraries we do
+      core::system::Options childEnv;
+      core::system::environment(&childEnv);
+      std::string libPaths = module_context::libPathsString();
+      if (!libPaths.empty())
+         core::system::setenv(&childEnv, "R_LIBS", libPaths);
+      options.environment = childEnv;
+
+      core::system::ProcessCallbacks cb;
+      cb.onContinue = boost::bind(&RWorker::onContinue,
+                                  shared_from_this(), _1);
+      cb.onStdout = boost::bind(&RWorker::onStdout,
+                                shared_from_this(), _2);
+      cb.onStderr = boost::bind(&RWorker::onStderr,
+                                shared_from_this(), _2);
+      cb.onExit = boost::bind(&RWorker::onExit,
+                              shared_from_this(), _1);
+
+      return module_context::processSupervisor().runProgram(
+                                             rProgramPath.absolutePath(),
+                                             args,
+                                             options,
+                                             cb);
+   }
+
+   bool onContinue(core::system::ProcessOperations& operations)
+   {
+      // terminating a job means terminating the worker running it
+      if (pJob_ && !pJob_->pProcess->onContinue())
+         return false;
+
+      if (!input_.empty())
+      {
+         Error error = operations.writeToStdin(input_, false);
+         if (error)
+            LOG_ERROR(error);
+         input_.clear();
+      }
+
+      if (closeInput_)
+      {
+         Error error = operations.writeToStdin(std::string(), true);
+         if (error)
+            LOG_ERROR(error);
+         closeInput_ = false;
+      }
+
+      return true;
+   }
+
+   void onStdout(const std::string& output)
+   {
+      // output between jobs isn't of interest
+      if (!pJob_ || stdoutReader_.done())
+         return;
+
+      std::string jobOutput;
+      stdoutReader_.read(output, &jobOutput);
+      forwardOutput(jobOutput, false);
+      if (!stdoutReader_.done())
+         return;
+
+      if (!parseJobStatus(stdoutReader_.status(), &status_))
+      {
+         LOG_WARNING_MESSAGE("Unexpected R worker status: " +
+                             stdoutReader_.status());
+      }
+      recordNamespaces(status_.namespacePaths);
+
+      if (stderrReader_.done())
+         completeJob(status_.exitStatus);
+   }
+
+   void onStderr(const std::string& output)
+   {
+      if (!pJob_ || stderrReader_.done())
+         return;
+
+      std::string jobOutput;
+      stderrReader_.read(output, &jobOutput);
+      forwardOutput(jobOutput, true);
+
+      if (stderrReader_.done() && stdoutReader_.done())
+         completeJob(status_.exitStatus);
+   }
+
+   void forwardOutput(const std::string& output, bool isError)
+   {
+      if (output.empty())
+         return;
+
+      if (isError && !pJob_->redirectStdErr)
+         pJob_->pProcess->onStderr(output);
+      else
+         pJob_->pProcess->onStdout(output);
+   }
+
+   // note the packages loaded by the worker (along with the write time
+   // they were loaded at)
+   void recordNamespaces(const std::vector<std::string>& packagePaths)
+   {
+      BOOST_FOREACH(const std::string& packagePath, packagePaths)
+      {
+         if (namespaces_.find(packagePath) == namespaces_.end())
+            namespaces_[packagePath] = packageWriteTime(packagePath);
+      }
+   }
+
+   void onExit(int exitStatus)
+   {
+      exited_ = true;
+
+      if (pJob_)
+      {
+         std::string output;
+         stdoutReader_.flush(&output);
+         forwardOutput(output, false);
+         output.clear();
+         stderrReader_.flush(&output);
+         forwardOutput(output, true);
+         completeJob(exitStatus);
+      }
+
+      onWorkerExited();
+   }
+
+   void completeJob(int exitStatus)
+   {
+      boost::shared_ptr<RJob> pJob = pJob_;
+      pJob_.reset();
+      stdoutReader_.reset();
+      stderrReader_.reset();
+      jobs_++;
+
+      if (exitStatus == EXIT_SUCCESS)
+         sourced_.insert(newSourceFiles_.begin(), newSourceFiles_.end());
+
+      // replace workers which have run many jobs or have grown large (e.g.
+      // by loading many packages)
+      int maxJobs = session::options().rWorkerJobs();
+      int maxMemoryMb = session::options().rWorkerMemoryMb();
+      if (!exited_ &&
+          ((maxJobs > 0 && jobs_ >= static_cast<std::size_t>(maxJobs)) ||
+           (maxMemoryMb > 0 && status_.memoryMb > maxMemoryMb)))
+      {
+         retire();
+      }
+
+      pJob->pProcess->onProcessCompleted(exitStatus);
+
+      if (!exited_)
+         dispatchJobs();
+   }
+
+private:
+   std::string key_;
+   std::string token_;
+   std::size_t jobs_;
+   std::set<std::string> sourced_;
+   std::vector<std::string> newSourceFiles_;
+   std::map<std::string, std::time_t> namespaces_;
+
+   std::string input_;
+   bool closeInput_;
+   bool retired_;
+   bool exited_;
+
+   boost::shared_ptr<RJob> pJob_;
+   JobOutputReader stdoutReader_;
+   JobOutputReader stderrReader_;
+   JobStatus status_;
+};
+
+namespace {
+
+std::vector<boost::shared_ptr<RWorker> > s_workers;
+std::deque<boost::shared_ptr<RJob> > s_pendingJobs;
+
+std::size_t maxWorkers()
+{
+   return static_cast<std::size_t>(
+            std::max(0, session::options().rWorkers()));
+}
+
+bool isUnavailable(const boost::shared_ptr<RWorker>& pWorker)
+{
+   return !pWorker->isAvailable();
+}
+
+void removeUnavailableWorkers()
+{
+   s_workers.erase(std::remove_if(s_workers.begin(),
+                                  s_workers.end(),
+                                  isUnavailable),
+                   s_workers.end());
+}
+
+// workers which have loaded packages that were since reinstalled would give
+// results for the old versions (which could then be cached as results for
+// the new ones), so they are replaced
+void retireStaleWorkers()
+{
+   BOOST_FOREACH(const boost::shared_ptr<RWorker>& pWorker, s_workers)
+   {
+      if (pWorker->isIdle() && pWorker->hasStaleNamespaces())
+         pWorker->retire();
+   }
+}
+
+boost::shared_ptr<RWorker> idleWorker(const std::string& key)
+{
+   BOOST_FOREACH(const boost::shared_ptr<RWorker>& pWorker, s_workers)
+   {
+      if (pWorker->isIdle() && (key.empty() || pWorker->key() == key))
+         return pWorker;
+   }
+   return boost::shared_ptr<RWorker>();
+}
+
+boost::shared_ptr<RWorker> workerForJob(const RJob& job)
+{
+   boost::shared_ptr<RWorker> pWorker = idleWorker(job.key);
+   if (pWorker)
+      return pWorker;
+
+   // make room for a worker with the right options by retiring an idle
+   // worker with other options
+   if (s_workers.size() >= maxWorkers())
+   {
+      boost::shared_ptr<RWorker> pOtherWorker = idleWorker(std::string());
+      if (!pOtherWorker)
+         return boost::shared_ptr<RWorker>();
+
+      pOtherWorker->retire();
+      removeUnavailableWorkers();
+   }
+
+   pWorker = RWorker::create(job.key, job.rOptions);
+   if (pWorker)
+      s_workers.push_back(pWorker);
+   return pWorker;
+}
+
+bool isTerminated(const boost::shared_ptr<RJob>& pJob)
+{
+   return pJob->pProcess->terminationRequested();
+}
+
+// jobs which were aborted while waiting for a worker are completed without
+// running them (running them would mean terminating the worker)
+void removeTerminatedJobs()
+{
+   std::vector<boost::shared_ptr<RJob> > terminated;
+   BOOST_FOREACH(const boost::shared_ptr<RJob>& pJob, s_pendingJobs)
+   {
+      if (isTerminated(pJob))
+         terminated.push_back(pJob);
+   }
+   if (terminated.empty())
+      return;
+
+   s_pendingJobs.erase(std::remove_if(s_pendingJobs.begin(),
+                                      s_pendingJobs.end(),
+                                      isTerminated),
+                       s_pendingJobs.end());
+
+   BOOST_FOREACH(const boost::shared_ptr<RJob>& pJob, terminated)
+   {
+      RWorker::failJob(*pJob);
+   }
+}
+
+void dispatchJobs()
+{
+   removeTerminatedJobs();
+   if (!s_pendingJobs.empty())
+      retireStaleWorkers();
+   removeUnavailableWorkers();
+
+   while (!s_pendingJobs.empty())
+   {
+      boost::shared_ptr<RJob> pJob = s_pendingJobs.front();
+
+      bool atCapacity = s_workers.size() >= maxWorkers() &&
+                        !idleWorker(std::string());
+      if (atCapacity)
+         return;
+
+      boost::shared_ptr<RWorker> pWorker = workerForJob(*pJob);
+      s_pendingJobs.pop_front();
+      if (pWorker)
+      {
+         pWorker->runJob(pJob);
+      }
+      else
+      {
+         // couldn't start a worker (the error has been logged)
+         RWorker::failJob(*pJob);
+      }
+   }
+}
+
+void onWorkerExited()
+{
+   dispatchJobs();
+}
+
+void prestartWorker()
+{
+   if (maxWorkers() == 0 || !s_workers.empty())
+      return;
+
+   // warm up a worker with the options most background jobs use
+   boost::shared_ptr<RWorker> pWorker = RWorker::create(
+                                 workerKey(R_PROCESS_VANILLA),
+                                 R_PROCESS_VANILLA);
+   if (pWorker)
+      s_workers.push_back(pWorker);
+}
+
+} // anonymous namespace
+
+bool runOnWorker(const boost::shared_ptr<AsyncRProcess>& pProcess,
+                 const std::string& rCommand,
+                 const core::system::Options& environment,
+                 const core::FilePath& workingDir,
+                 AsyncRProcessOptions rOptions,
+                 const std::vector<core::FilePath>& rSourceFiles)
+{
+   if (maxWorkers() == 0)
+      return false;
+
+   boost::shared_ptr<RJob> pJob(new RJob());
+   pJob->pProcess = pProcess;
+   pJob->key = workerKey(rOptions);
+   pJob->rOptions = rOptions;
+   pJob->rCommand = rCommand;
+   pJob->environment = environment;
+   pJob->workingDir = workingDir;
+   pJob->redirectStdErr = (rOptions & R_PROCESS_REDIRECTSTDERR) != 0;
+   pJob->rSourceFiles = rSourceFiles;
+
+   s_pendingJobs.push_back(pJob);
+   dispatchJobs();
+   return true;
+}
+
+Error initializeWorkerPool()
+{
+   if (maxWorkers() > 0)
+   {
+      module_context::scheduleDelayedWork(boost::posix_time::seconds(5),
+                                          prestartWorker);
+   }
+
+   return Success();
+}
+
+} // namespace async_r
+} // namespace session
+} // namespace rstudio
@@ -0,0 +1,109 @@
+/*
+ * SessionAsyncRWorkerPool.hpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_ASYNC_R_WORKER_POOL_HPP
+#define SESSION_ASYNC_R_WORKER_POOL_HPP
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include <core/FilePath.hpp>
+#include <core/system/Types.hpp>
+
+#include <session/SessionAsyncRProcess.hpp>
+
+namespace rstudio {
+namespace core {
+   class Error;
+}
+}
+
+namespace rstudio {
+namespace session {
+namespace async_r {
+
+// reads the output of a job run by a worker, which ends with a line holding
+// a marker (the worker's token) and the job's status
+class JobOutputReader
+{
+public:
+   explicit JobOutputReader(const std::string& token)
+      : marker_("\n" + token), done_(false)
+   {
+   }
+
+   // COPYING: via compiler
+
+   // add output from the worker. output which belongs to the job is
+   // appended to pJobOutput (output which could be the start of the marker
+   // is held back until it's known not to be)
+   void read(const std::string& output, std::string* pJobOutput);
+
+   // true once the marker line has been read
+   bool done() const { return done_; }
+
+   // the remainder of the marker line (following the token)
+   const std::string& status() const { return status_; }
+
+   // take any output held back (e.g. when the worker exits mid job)
+   void flush(std::string* pJobOutput);
+
+   // prepare to read the output of the next job
+   void reset();
+
+private:
+   std::string marker_;
+   std::string buffer_;
+   std::string status_;
+   bool done_;
+};
+
+struct JobStatus
+{
+   JobStatus() : exitStatus(EXIT_FAILURE), memoryMb(0) {}
+
+   int exitStatus;
+   double memoryMb;
+
+   // paths of the packages whose namespaces are loaded in the worker
+   std::vector<std::string> namespacePaths;
+};
+
+// parse the status reported at the end of a job's output (its exit status,
+// the memory in use, and then the tab separated paths of the loaded
+// namespaces). returns false if the status is malformed
+bool parseJobStatus(const std::string& status, JobStatus* pStatus);
+
+// run the command of a process started with R_PROCESS_POOLED on one of the
+// resident R worker processes (it's queued if they are all busy). returns
+// false if the pool is disabled, in which case the caller should start an
+// R process of its own
+bool runOnWorker(const boost::shared_ptr<AsyncRProcess>& pProcess,
+                 const std::string& rCommand,
+                 const core::system::Options& environment,
+                 const core::FilePath& workingDir,
+                 AsyncRProcessOptions rOptions,
+                 const std::vector<core::FilePath>& rSourceFiles);
+
+core::Error initializeWorkerPool();
+
+} // namespace async_r
+} // namespace session
+} // namespace rstudio
+
+#endif // SESSION_ASYNC_R_WORKER_POOL_HPP
@@ -0,0 +1,90 @@
+/*
+ * SessionAsyncRWorkerPoolTests.cpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <tests/TestThat.hpp>
+
+#include "SessionAsyncRWorkerPool.hpp"
+
+namespace rstudio {
+namespace session {
+namespace async_r {
+
+context("RWorkerPool")
+{
+   test_that("job output is read up to the marker")
+   {
+      JobOutputReader reader("TOKEN");
+      std::string output;
+
+      reader.read("hello\nworld\n", &output);
+      expect_false(reader.done());
+
+      // the marker can arrive split across reads
+      reader.read("\nTO", &output);
+      reader.read("KEN 0 12.5", &output);
+      expect_false(reader.done());
+      expect_true(output == "hello\nworld\n");
+
+      reader.read("\nafter the job\n", &output);
+      expect_true(reader.done());
+      expect_true(reader.status() == " 0 12.5");
+      expect_true(output == "hello\nworld\n");
+
+      // nothing more is read until the reader is reset
+      reader.read("more", &output);
+      expect_true(output == "hello\nworld\n");
+
+      reader.reset();
+      output.clear();
+      reader.read("next\n\nTOKEN\n", &output);
+      expect_true(reader.done());
+      expect_true(output == "next\n");
+      expect_true(reader.status().empty());
+   }
+
+   test_that("output which isn't a marker is passed on")
+   {
+      JobOutputReader reader("TOKEN");
+      std::string output;
+
+      reader.read("a\nTOK", &output);
+      reader.read("EN-ish", &output);
+      expect_false(reader.done());
+
+      reader.flush(&output);
+      expect_true(output == "a\nTOKEN-ish");
+   }
+
+   test_that("job status is parsed")
+   {
+      JobStatus status;
+      expect_true(parseJobStatus(" 1 256.25\t/lib/base\t/lib/my pkg", &status));
+      expect_true(status.exitStatus == 1);
+      expect_true(status.memoryMb == 256.25);
+      expect_true(status.namespacePaths.size() == 2);
+      expect_true(status.namespacePaths[1] == "/lib/my pkg");
+
+      expect_true(parseJobStatus(" 0 10", &status));
+      expect_true(status.exitStatus == 0);
+      expect_true(status.namespacePaths.empty());
+
+      expect_false(parseJobStatus("garbage", &status));
+      expect_false(parseJobStatus("", &status));
+   }
+}
+
+} // namespace async_r
+} // namespace session
+} // namespace rstudio
@@ -27,6 +27,8 @@
 
 #include <r/session/RConsoleActions.hpp>
 
+#include <monitor/metrics/Registry.hpp>
+
 using namespace rstudio::core ;
 
 namespace rstudio {
@@ -34,6 +36,18 @@ namespace session {
  
 namespace {
 ClientEventQueue* s_pClientEventQueue = NULL;
+
+monitor::metrics::Counter s_eventsAdded = monitor::metrics::counter(
+      "rsession_client_events_added",
+      "Events added to the client event queue");
+
+monitor::metrics::Counter s_eventsDelivered = monitor::metrics::counter(
+      "rsession_client_events_delivered",
+      "Events removed from the client event queue for delivery");
+
+monitor::metrics::Gauge s_queueDepth = monitor::metrics::gauge(
+      "rsession_client_event_queue_depth",
+      "Events waiting in the client event queue");
 }
 
 void initializeClientEventQueue()
@@ -98,6 +112,9 @@ void ClientEventQueue::add(const ClientEvent& event)
          // add event to queue
          pendingEvents_.push_back(event) ;
       }
+
+      s_eventsAdded.increment();
+      s_queueDepth.set(pendingEvents_.size());
       
       lastEventAddTime_ = boost::posix_time::microsec_clock::universal_time();
    }
@@ -130,6 +147,9 @@ void ClientEventQueue::remove(std::vector<ClientEvent>* pEvents)
       pEvents->insert(pEvents->begin(), 
                       pendingEvents_.begin(), 
                       pendingEvents_.end());
+
+      s_eventsDelivered.increment(pendingEvents_.size());
+      s_queueDepth.set(0);
    
       // clear pending events
       pendingEvents_.clear();
@@ -47,6 +47,7 @@
 #include <core/Scope.hpp>
 #include <core/Settings.hpp>
 #include <core/Thread.hpp>
+#include <core/Trace.hpp>
 #include <core/Log.hpp>
 #include <core/LogWriter.hpp>
 #include <core/system/System.hpp>
@@ -86,6 +87,7 @@
 extern "C" const char *locale2charset(const char *);
 
 #include <monitor/MonitorClient.hpp>
+#include <monitor/metrics/Registry.hpp>
 
 #include <session/SessionConstants.hpp>
 #include <session/SessionOptions.hpp>
@@ -97,6 +99,7 @@ extern "C" const char *locale2charset(const char *);
 #include <session/RVersionSettings.hpp>
 
 #include "SessionAddins.hpp"
+#include "SessionAsyncRWorkerPool.hpp"
 
 #include "SessionModuleContextInternal.hpp"
 
@@ -133,6 +136,7 @@ extern "C" const char *locale2charset(const char *);
 #include "modules/SessionRSConnect.hpp"
 #include "modules/SessionShinyViewer.hpp"
 #include "modules/SessionSpelling.hpp"
+#include "modules/SessionTrace.hpp"
 #include "modules/SessionSource.hpp"
 #include "modules/SessionUpdates.hpp"
 #include "modules/SessionVCS.hpp"
@@ -304,6 +308,7 @@ inline std::string clientVersion()
 
 void detectChanges(module_context::ChangeSource source)
 {
+   TRACE_SCOPE("session", "onDetectChanges");
    module_context::events().onDetectChanges(source);
 }
  
@@ -788,6 +793,8 @@ void handleRpcRequest(const core::json::JsonRpcRequest& request,
                       boost::shared_ptr<HttpConnection> ptrConnection,
                       ConnectionType connectionType)
 {
+   TRACE_SCOPE("rpc", request.method);
+
    // record the time just prior to execution of the event
    // (so we can determine if any events were added during execution)
    using namespace boost::posix_time; 
@@ -926,6 +933,18 @@ void endHandleConnection(boost::shared_ptr<HttpConnection> ptrConnection,
 void handleConnection(boost::shared_ptr<HttpConnection> ptrConnection,
                       ConnectionType connectionType)
 {
+   static const monitor::metrics::Counter requests = monitor::metrics::counter(
+         "rsession_http_requests",
+         "HTTP requests handled by the session");
+   static const monitor::metrics::Histogram duration =
+         monitor::metrics::histogram(
+            "rsession_http_request_duration_seconds",
+            "Time spent handling HTTP requests");
+   requests.increment();
+   monitor::metrics::ScopedTimer timer(duration);
+
+   TRACE_SCOPE("http", ptrConnection->request().uri());
+
    // check for a uri handler registered by a module
    const http::Request& request = ptrConnection->request();
    std::string uri = request.uri();
@@ -1780,6 +1799,9 @@ Error rInit(const rstudio::r::session::RInitInfo& rInitInfo)
 
       // console processes
       (console_process::initialize)
+
+      // resident R processes for background jobs
+      (async_r::initializeWorkerPool)
          
       // r utils
       (r_utils::initialize)
@@ -1835,6 +1857,7 @@ Error rInit(const rstudio::r::session::RInitInfo& rInitInfo)
       (modules::snippets::initialize)
       (modules::user_commands::initialize)
       (modules::r_addins::initialize)
+      (modules::trace::initialize)
 
       // workers
       (workers::web_request::initialize)
@@ -1983,6 +2006,7 @@ void consolePrompt(const std::string& prompt, bool addToHistory)
    detectChanges(module_context::ChangeSourceREPL);   
 
    // call prompt hook
+   TRACE_SCOPE("session", "onConsolePrompt");
    module_context::events().onConsolePrompt(prompt);
 }
 
@@ -1991,8 +2015,34 @@ void reissueLastConsolePrompt()
    consolePrompt(s_lastPrompt, false);
 }
 
+void recordBusyTime(bool executing)
+{
+   static const monitor::metrics::Counter busySeconds =
+         monitor::metrics::counter(
+            "rsession_r_busy_seconds",
+            "Time the R thread has spent processing console input");
+   static const monitor::metrics::Gauge busy = monitor::metrics::gauge(
+            "rsession_r_busy",
+            "Whether the R thread is processing console input");
+   static boost::posix_time::ptime s_busySince;
+
+   using namespace boost::posix_time;
+   if (executing)
+   {
+      s_busySince = microsec_clock::universal_time();
+   }
+   else if (!s_busySince.is_not_a_date_time())
+   {
+      time_duration elapsed = microsec_clock::universal_time() - s_busySince;
+      busySeconds.increment(elapsed.total_microseconds() / 1000000.0);
+      s_busySince = ptime(not_a_date_time);
+   }
+   busy.set(executing ? 1 : 0);
+}
+
 void setExecuting(bool executing)
 {
+   recordBusyTime(executing);
    s_rProcessingInput = executing;
    module_context::activeSession().setExecuting(executing);
 }
@@ -2369,6 +2419,12 @@ void logExitEvent(const monitor::Event& precipitatingEvent)
    client().logEvent(Event(kSessionScope, kSessionExitEvent));
 }
    
+void flushSettings()
+{
+   userSettings().flush();
+   persistentState().flush();
+}
+
 void rSuspended(const rstudio::r::session::RSuspendOptions& options)
 {
    // log to monitor
@@ -2380,6 +2436,9 @@ void rSuspended(const rstudio::r::session::RSuspendOptions& options)
 
    // fire event
    module_context::onSuspended(options, &(persistentState().settings()));
+
+   // write settings changes still pending
+   flushSettings();
 }
    
 void rResumed()
@@ -2502,6 +2561,9 @@ void rCleanup(bool terminatedNormally)
       // fire shutdown event to modules
       module_context::events().onShutdown(terminatedNormally);
 
+      // write settings changes still pending
+      flushSettings();
+
       // destroy session if requested
       if (s_destroySession)
       {
@@ -3134,6 +3196,18 @@ int main (int argc, char * const argv[])
                                                 options.programIdentity()));
       }
 
+      // export metrics if requested
+      if (!options.metricsPath().empty())
+      {
+         error = monitor::metrics::startExporter(options.metricsPath(),
+                                                 options.metricsIntervalSeconds());
+         if (error)
+            LOG_ERROR(error);
+      }
+
+      // enable tracing if requested (it can also be toggled at runtime)
+      core::trace::setEnabled(options.traceEnabled());
+
       // initialize file lock config
       FileLock::initialize();
 
@@ -3326,6 +3400,7 @@ int main (int argc, char * const argv[])
       rOptions.saveWorkspace = saveWorkspaceOption();
       rOptions.rProfileOnResume = serverMode &&
                                   userSettings().rProfileOnResume();
+      rOptions.lazyWorkspaceRestore = options.lazyWorkspaceRestore();
       rOptions.sessionScope = options.sessionScope();
       
       // r callbacks
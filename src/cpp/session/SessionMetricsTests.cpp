@@ -0,0 +1,97 @@
+/*
+ * SessionMetricsTests.cpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <tests/TestThat.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/SafeConvert.hpp>
+#include <core/system/System.hpp>
+
+#include <monitor/metrics/Registry.hpp>
+
+namespace rstudio {
+namespace session {
+
+using namespace core;
+
+namespace {
+
+void exportRepeatedly(const std::string& path, int* pFailures)
+{
+   for (int i = 0; i < 200; i++)
+   {
+      if (monitor::metrics::exportMetrics(path))
+         (*pFailures)++;
+   }
+}
+
+} // anonymous namespace
+
+context("Metrics")
+{
+   test_that("export paths are expanded for each user and process")
+   {
+      std::string pid = safe_convert::numberToString(
+                                       core::system::currentProcessId());
+      expect_true(monitor::metrics::expandExportPath(
+                     "/tmp/metrics-%u-%p.txt", "jdoe") ==
+                  "/tmp/metrics-jdoe-" + pid + ".txt");
+      expect_true(monitor::metrics::expandExportPath(
+                     "/tmp/metrics.txt", "jdoe") == "/tmp/metrics.txt");
+   }
+
+   test_that("concurrent exports to the same path don't collide")
+   {
+      monitor::metrics::counter("rsession_test_exports",
+                                "Test exports").increment();
+
+      FilePath dir = FilePath("/tmp").complete(
+               "rstudio-metrics-" + core::system::generateShortenedUuid());
+      expect_false(dir.ensureDirectory());
+      std::string path = dir.complete("metrics.txt").absolutePath();
+
+      int failures1 = 0, failures2 = 0;
+      boost::thread writer1(boost::bind(exportRepeatedly, path, &failures1));
+      boost::thread writer2(boost::bind(exportRepeatedly, path, &failures2));
+      writer1.join();
+      writer2.join();
+
+      expect_true(failures1 == 0);
+      expect_true(failures2 == 0);
+
+      std::string metrics;
+      expect_false(readStringFromFile(FilePath(path), &metrics));
+      expect_true(boost::algorithm::contains(metrics,
+                                             "rsession_test_exports_total "));
+      expect_false(boost::algorithm::contains(metrics, "_total_total"));
+      expect_true(boost::algorithm::ends_with(metrics, "# EOF\n"));
+
+      // no temporary files are left behind
+      std::vector<FilePath> children;
+      expect_false(dir.children(&children));
+      expect_true(children.size() == 1);
+
+      dir.remove();
+   }
+}
+
+} // namespace session
+} // namespace rstudio
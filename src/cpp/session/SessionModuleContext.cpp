@@ -15,6 +15,7 @@
 
 #include "SessionModuleContextInternal.hpp"
 
+#include <map>
 #include <vector>
 
 #include <boost/assert.hpp>
@@ -33,6 +34,9 @@
 #include <core/Settings.hpp>
 #include <core/DateTime.hpp>
 #include <core/FileSerializer.hpp>
+#include <core/SafeConvert.hpp>
+#include <core/Trace.hpp>
+#include <core/WorkerPool.hpp>
 #include <core/system/FileScanner.hpp>
 #include <core/IncrementalCommand.hpp>
 #include <core/PeriodicCommand.hpp>
@@ -687,6 +691,95 @@ void scheduleDelayedWork(const boost::posix_time::time_duration& period,
 }
 
 
+void scheduleSettingsWrite(const boost::function<void()>& write)
+{
+   scheduleDelayedWork(boost::posix_time::seconds(1), write, false);
+}
+
+
+namespace {
+
+typedef std::pair<boost::shared_ptr<WorkHandle>, boost::function<void()> >
+                                                      BackgroundCompletion;
+
+// completions are queued by the worker threads and executed on the main
+// thread (allocated on the heap and never freed since worker threads may
+// still be running during static destruction)
+core::thread::ThreadsafeQueue<BackgroundCompletion>& backgroundCompletions()
+{
+   static core::thread::ThreadsafeQueue<BackgroundCompletion>* pQueue =
+         new core::thread::ThreadsafeQueue<BackgroundCompletion>();
+   return *pQueue;
+}
+
+WorkerPool& workerPool()
+{
+   static WorkerPool* pPool = NULL;
+   if (pPool == NULL)
+   {
+      int threads = session::options().workerThreads();
+      if (threads <= 0)
+      {
+         int cores = static_cast<int>(boost::thread::hardware_concurrency());
+         threads = std::max(1, std::min(4, cores));
+      }
+      pPool = new WorkerPool(threads);
+   }
+   return *pPool;
+}
+
+void performBackgroundWork(const boost::function<void()>& work,
+                           const boost::function<void()>& onCompleted,
+                           boost::shared_ptr<WorkHandle> pHandle)
+{
+   // the completion is still delivered if the work fails (so that callers
+   // tracking whether work is outstanding don't need to handle failure)
+   try
+   {
+      TRACE_SCOPE("session", "backgroundWork");
+      work();
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+
+   if (onCompleted && !WorkerPool::cancelled())
+      backgroundCompletions().enque(std::make_pair(pHandle, onCompleted));
+}
+
+void executeBackgroundCompletions()
+{
+   BackgroundCompletion completion;
+   while (backgroundCompletions().deque(&completion))
+   {
+      // the work may have been cancelled after it completed
+      if (completion.first->cancelled())
+         continue;
+
+      try
+      {
+         completion.second();
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+}
+
+} // anonymous namespace
+
+WorkHandle scheduleBackgroundWork(const boost::function<void()>& work,
+                                  const boost::function<void()>& onCompleted,
+                                  WorkPriority priority)
+{
+   // the handle is filled in before any completion can be executed (since
+   // completions are only executed on this thread)
+   boost::shared_ptr<WorkHandle> pHandle(new WorkHandle());
+   *pHandle = workerPool().enque(boost::bind(performBackgroundWork,
+                                             work,
+                                             onCompleted,
+                                             pHandle),
+                                 priority);
+   return *pHandle;
+}
+
+
 void onBackgroundProcessing(bool isIdle)
 {
    // allow process supervisor to poll for events
@@ -696,8 +789,12 @@ void onBackgroundProcessing(bool isIdle)
    core::system::file_monitor::checkForChanges();
 
    // fire event
+   TRACE_SCOPE("session", "onBackgroundProcessing");
    events().onBackgroundProcessing(isIdle);
 
+   // execute completions of background work
+   executeBackgroundCompletions();
+
    // execute incremental commands
    executeScheduledCommands(&s_scheduledCommands);
    if (isIdle)
@@ -1823,6 +1920,189 @@ Events& events()
    return instance;
 }
 
+namespace detail {
+
+// handlers are demoted after exceeding their budget on several consecutive
+// calls and promoted again after a run of calls within budget
+const int kDemoteAfterCalls = 3;
+const int kPromoteAfterCalls = 10;
+
+// statistics are kept per signal and handler name (so they accumulate
+// across handlers which are connected and disconnected repeatedly)
+struct SignalHandlerStats
+{
+   SignalHandlerStats(const std::string& signal, const std::string& name)
+      : signal(signal),
+        name(name),
+        budget(boost::posix_time::pos_infin),
+        calls(0),
+        deferredCalls(0),
+        overBudgetCalls(0),
+        overBudgetStreak(0),
+        withinBudgetStreak(0),
+        demoted(false)
+   {
+   }
+
+   void record(const boost::posix_time::time_duration& elapsed)
+   {
+      calls++;
+      total += elapsed;
+      if (elapsed > max)
+         max = elapsed;
+
+      if (elapsed > budget)
+      {
+         overBudgetCalls++;
+         overBudgetStreak++;
+         withinBudgetStreak = 0;
+         if (!demoted && overBudgetStreak >= kDemoteAfterCalls)
+         {
+            demoted = true;
+            LOG_WARNING_MESSAGE(
+               "Deferring " + name + " handler for " + signal +
+               " to idle time (took " +
+               safe_convert::numberToString(elapsed.total_milliseconds()) +
+               "ms with a budget of " +
+               safe_convert::numberToString(budget.total_milliseconds()) +
+               "ms)");
+         }
+      }
+      else
+      {
+         overBudgetStreak = 0;
+         withinBudgetStreak++;
+         if (demoted && withinBudgetStreak >= kPromoteAfterCalls)
+            demoted = false;
+      }
+   }
+
+   std::string signal;
+   std::string name;
+   boost::posix_time::time_duration budget;
+   int calls;
+   int deferredCalls;
+   int overBudgetCalls;
+   int overBudgetStreak;
+   int withinBudgetStreak;
+   boost::posix_time::time_duration total;
+   boost::posix_time::time_duration max;
+   bool demoted;
+};
+
+namespace {
+
+typedef std::map<std::pair<std::string, std::string>,
+                 boost::shared_ptr<SignalHandlerStats> > SignalHandlerStatsMap;
+
+SignalHandlerStatsMap& signalHandlerStatsMap()
+{
+   static SignalHandlerStatsMap instance;
+   return instance;
+}
+
+} // anonymous namespace
+
+SignalSlot::SignalSlot(const std::string& signal,
+                       const std::string& name,
+                       const boost::posix_time::time_duration& budget)
+   : deferred_(false)
+{
+   boost::shared_ptr<SignalHandlerStats>& pStats =
+         signalHandlerStatsMap()[std::make_pair(signal, name)];
+   if (!pStats)
+      pStats.reset(new SignalHandlerStats(signal, name));
+   pStats_ = pStats;
+
+   // resolve the default budget
+   if (!budget.is_not_a_date_time())
+      pStats_->budget = budget;
+   else if (session::options().handlerBudgetMs() > 0)
+      pStats_->budget = boost::posix_time::milliseconds(
+                                    session::options().handlerBudgetMs());
+   else
+      pStats_->budget = boost::posix_time::pos_infin;
+}
+
+void SignalSlot::invoke(const boost::function<void()>& call)
+{
+   if (pStats_->demoted)
+      defer(call);
+   else
+      execute(call);
+}
+
+void SignalSlot::execute(const boost::function<void()>& call)
+{
+   using namespace boost::posix_time;
+
+   TRACE_SCOPE("handler", pStats_->name);
+   ptime start = microsec_clock::universal_time();
+   call();
+   pStats_->record(microsec_clock::universal_time() - start);
+}
+
+void SignalSlot::defer(const boost::function<void()>& call)
+{
+   pStats_->deferredCalls++;
+
+   // coalesce with a pending deferred call (keeping the latest arguments)
+   deferredCall_ = call;
+   if (deferred_)
+      return;
+
+   deferred_ = true;
+   boost::weak_ptr<SignalSlot> pWeakSlot = shared_from_this();
+   scheduleDelayedWork(boost::posix_time::milliseconds(0),
+                       boost::bind(&SignalSlot::executeDeferred, pWeakSlot),
+                       true);
+}
+
+void SignalSlot::executeDeferred(boost::weak_ptr<SignalSlot> pWeakSlot)
+{
+   boost::shared_ptr<SignalSlot> pSlot = pWeakSlot.lock();
+   if (!pSlot)
+      return;
+
+   boost::function<void()> call = pSlot->deferredCall_;
+   pSlot->deferred_ = false;
+   pSlot->deferredCall_.clear();
+
+   // don't call handlers which have been disconnected in the meantime
+   if (pSlot->connection_.connected())
+      pSlot->execute(call);
+}
+
+} // namespace detail
+
+json::Array signalHandlerStats()
+{
+   json::Array statsJson;
+   BOOST_FOREACH(const detail::SignalHandlerStatsMap::value_type& entry,
+                 detail::signalHandlerStatsMap())
+   {
+      const detail::SignalHandlerStats& stats = *entry.second;
+      json::Object statJson;
+      statJson["signal"] = stats.signal;
+      statJson["name"] = stats.name;
+      statJson["calls"] = stats.calls;
+      statJson["deferred_calls"] = stats.deferredCalls;
+      statJson["over_budget_calls"] = stats.overBudgetCalls;
+      statJson["total_ms"] = static_cast<double>(
+                                       stats.total.total_microseconds()) / 1000;
+      statJson["max_ms"] = static_cast<double>(
+                                       stats.max.total_microseconds()) / 1000;
+      if (stats.budget.is_special())
+         statJson["budget_ms"] = json::Value();
+      else
+         statJson["budget_ms"] = static_cast<int>(
+                                       stats.budget.total_milliseconds());
+      statJson["demoted"] = stats.demoted;
+      statsJson.push_back(statJson);
+   }
+   return statsJson;
+}
+
 
 core::system::ProcessSupervisor& processSupervisor()
 {
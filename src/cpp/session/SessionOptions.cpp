@@ -34,6 +34,7 @@
 #include <core/r_util/RVersionsPosix.hpp>
 
 #include <monitor/MonitorConstants.hpp>
+#include <monitor/metrics/Registry.hpp>
 
 #include <r/session/RSession.hpp>
 
@@ -172,12 +173,52 @@ core::ProgramStatus Options::read(int argc, char * const argv[])
       ("session-rprofile-on-resume-default",
           value<bool>(&rProfileOnResumeDefault_)->default_value(false),
           "default user setting for running Rprofile on resume")
+      ("session-lazy-workspace-restore",
+          value<bool>(&lazyWorkspaceRestore_)->default_value(false),
+          "restore suspended workspace objects on first use")
       ("session-save-action-default",
        value<std::string>(&saveActionDefault)->default_value(""),
          "default save action (yes, no, or ask)")
       ("show-help-home",
        value<bool>(&showHelpHome_)->default_value(false),
-         "show help home page at startup");
+         "show help home page at startup")
+      ("session-metrics-path",
+       value<std::string>(&metricsPath_)->default_value(""),
+         "path (file or unix socket) to export metrics to; %u and %p are "
+         "replaced with the user and process id and relative paths are "
+         "within the user scratch path (defaults to "
+         "rsession-metrics-%p.txt when the path is a directory)")
+      ("session-metrics-interval-seconds",
+       value<int>(&metricsIntervalSeconds_)->default_value(10),
+         "metrics export interval")
+      ("session-handler-budget-ms",
+       value<int>(&handlerBudgetMs_)->default_value(100),
+         "time budget for event handlers before they are deferred (0 for none)")
+      ("session-worker-threads",
+       value<int>(&workerThreads_)->default_value(0),
+         "threads used for background work (0 to choose automatically)")
+      ("session-find-index-mb",
+       value<int>(&findIndexMb_)->default_value(32),
+         "size of the project text index used by find in files (0 to disable)")
+      ("session-build-jobs",
+       value<int>(&buildJobs_)->default_value(0),
+         "parallel jobs used by package builds and tests (0 for one per core, up to 4)")
+      ("session-r-workers",
+       value<int>(&rWorkers_)->default_value(2),
+         "resident R processes used for background R jobs (0 to disable)")
+      ("session-r-worker-jobs",
+       value<int>(&rWorkerJobs_)->default_value(50),
+         "jobs run by a resident R process before it is replaced (0 for no limit)")
+      ("session-r-worker-memory-mb",
+       value<int>(&rWorkerMemoryMb_)->default_value(1024),
+         "memory use after which a resident R process is replaced (0 for no limit)")
+      ("session-shared-package-info-path",
+       value<std::string>(&sharedPackageInfoPath_)->default_value(""),
+         "read-only directory of package completion information shared by "
+         "sessions (e.g. a copy of an administrator's package-information-cache)")
+      ("session-trace-enabled",
+       value<bool>(&traceEnabled_)->default_value(false),
+         "record trace spans from startup");
 
    // allow options
    options_description allow("allow");
@@ -430,6 +471,19 @@ core::ProgramStatus Options::read(int argc, char * const argv[])
    if (standalone())
       core::system::setenv("HOME", userHomePath_);
 
+   // every session exports its own metrics: expand the user and process
+   // placeholders and keep relative paths within the user scratch path
+   if (!metricsPath_.empty())
+   {
+      metricsPath_ = monitor::metrics::expandExportPath(metricsPath_,
+                                                        userIdentity_);
+      FilePath metricsPath = FilePath(userScratchPath_).complete(metricsPath_);
+      if (metricsPath.isDirectory())
+         metricsPath = metricsPath.complete(monitor::metrics::expandExportPath(
+                                     "rsession-metrics-%p.txt", userIdentity_));
+      metricsPath_ = metricsPath.absolutePath();
+   }
+
    // session timeout seconds is always -1 in desktop mode
    if (programMode_ == kSessionProgramModeDesktop)
       timeoutMinutes_ = 0;
@@ -56,8 +56,10 @@ Error PersistentState::initialize()
    Error error = settings_.initialize(statePath);
    if (error)
       return error;
+   settings_.setWriteBehind(module_context::scheduleSettingsWrite);
 
-   // session settings
+   // session settings (written immediately since the abend flag must
+   // reach the disk before a crash can occur)
    scratchPath = module_context::sessionScratchPath();
    statePath = scratchPath.complete("session-persistent-state");
    return sessionSettings_.initialize(statePath);
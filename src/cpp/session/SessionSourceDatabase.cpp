@@ -15,13 +15,16 @@
 
 #include <session/SessionSourceDatabase.hpp>
 
+#include <set>
 #include <string>
 #include <vector>
 #include <algorithm>
 
 #include <boost/bind.hpp>
+#include <boost/algorithm/string.hpp>
 #include <boost/foreach.hpp>
 #include <boost/regex.hpp>
+#include <boost/unordered_map.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <core/Log.hpp>
@@ -42,6 +45,7 @@
 #include <session/SessionModuleContext.hpp>
 #include <session/projects/SessionProjects.hpp>
 
+#include "SessionSourceDatabaseStorage.hpp"
 #include "SessionSourceDatabaseSupervisor.hpp"
 
 // NOTE: if a file is deleted then its properties database entry is not
@@ -69,9 +73,128 @@ const char * const SourceDocument::SourceDocumentTypeCpp       = "cpp";
 
 namespace {
 
-// cached mapping of document id to document path (facilitates efficient path
-// lookup)
-std::map<std::string, std::string> s_idToPath;
+// index of document ids and paths (maintained by the source database events).
+// documents are found by aliased path and by file (using both the resolved
+// and the real path so that lookups for file change events, which report
+// absolute paths, don't need to alias the path). several documents may
+// have the same path, in which case lookups return the smallest id
+class DocumentIndex : boost::noncopyable
+{
+public:
+   void update(const std::string& id, const std::string& path)
+   {
+      boost::unordered_map<std::string, std::string>::iterator it =
+                                                         idToPath_.find(id);
+      if (it != idToPath_.end())
+      {
+         if (it->second == path)
+            return;
+         remove(id);
+      }
+
+      idToPath_[id] = path;
+      if (path.empty())
+         return;
+
+      pathToIds_[path].insert(id);
+
+      // index the file by its resolved and real paths
+      std::vector<std::string>& files = idToFiles_[id];
+      FilePath filePath = module_context::resolveAliasedPath(path);
+      files.push_back(filePath.absolutePath());
+      FilePath realPath;
+      Error error = core::system::realPath(filePath, &realPath);
+      if (!error && realPath.absolutePath() != files.front())
+         files.push_back(realPath.absolutePath());
+      BOOST_FOREACH(const std::string& file, files)
+      {
+         fileToIds_[file].insert(id);
+      }
+   }
+
+   void remove(const std::string& id)
+   {
+      boost::unordered_map<std::string, std::string>::iterator it =
+                                                         idToPath_.find(id);
+      if (it == idToPath_.end())
+         return;
+
+      removeId(&pathToIds_, it->second, id);
+      idToPath_.erase(it);
+
+      boost::unordered_map<std::string, std::vector<std::string> >::iterator
+                                             filesIt = idToFiles_.find(id);
+      if (filesIt != idToFiles_.end())
+      {
+         BOOST_FOREACH(const std::string& file, filesIt->second)
+         {
+            removeId(&fileToIds_, file, id);
+         }
+         idToFiles_.erase(filesIt);
+      }
+   }
+
+   void clear()
+   {
+      idToPath_.clear();
+      pathToIds_.clear();
+      idToFiles_.clear();
+      fileToIds_.clear();
+   }
+
+   bool getPath(const std::string& id, std::string* pPath) const
+   {
+      boost::unordered_map<std::string, std::string>::const_iterator it =
+                                                         idToPath_.find(id);
+      if (it == idToPath_.end())
+         return false;
+      *pPath = it->second;
+      return true;
+   }
+
+   bool getIdForPath(const std::string& path, std::string* pId) const
+   {
+      return findId(pathToIds_, path, pId);
+   }
+
+   bool getIdForFile(const std::string& file, std::string* pId) const
+   {
+      return findId(fileToIds_, file, pId);
+   }
+
+private:
+   typedef boost::unordered_map<std::string, std::set<std::string> > IdMap;
+
+   static void removeId(IdMap* pMap,
+                        const std::string& key,
+                        const std::string& id)
+   {
+      IdMap::iterator it = pMap->find(key);
+      if (it == pMap->end())
+         return;
+      it->second.erase(id);
+      if (it->second.empty())
+         pMap->erase(it);
+   }
+
+   static bool findId(const IdMap& map,
+                      const std::string& key,
+                      std::string* pId)
+   {
+      IdMap::const_iterator it = map.find(key);
+      if (it == map.end())
+         return false;
+      *pId = *(it->second.begin());
+      return true;
+   }
+
+   boost::unordered_map<std::string, std::string> idToPath_;
+   IdMap pathToIds_;
+   boost::unordered_map<std::string, std::vector<std::string> > idToFiles_;
+   IdMap fileToIds_;
+};
+
+DocumentIndex s_documentIndex;
 
 struct PropertiesDatabase
 {
@@ -214,6 +337,7 @@ std::string pathFromProjectPath(json::Value projPathJson)
 }  // anonymous namespace
 
 SourceDocument::SourceDocument(const std::string& type)
+   : flatContentsValid_(false)
 {
    FilePath srcDBPath = source_database::path();
    FilePath docPath = file_utils::uniqueFilePath(srcDBPath);
@@ -226,7 +350,40 @@ SourceDocument::SourceDocument(const std::string& type)
    relativeOrder_ = 0;
    lastContentUpdate_ = date_time::millisecondsSinceEpoch();
 }
-   
+
+void SourceDocument::copyFrom(const SourceDocument& other)
+{
+   id_ = other.id_;
+   path_ = other.path_;
+   type_ = other.type_;
+   contents_ = other.contents_;
+   flatContents_.clear();
+   flatContentsValid_ = false;
+   hash_ = other.hash_;
+   encoding_ = other.encoding_;
+   folds_ = other.folds_;
+   lastKnownWriteTime_ = other.lastKnownWriteTime_;
+   lastContentUpdate_ = other.lastContentUpdate_;
+   dirty_ = other.dirty_;
+   created_ = other.created_;
+   sourceOnSave_ = other.sourceOnSave_;
+   relativeOrder_ = other.relativeOrder_;
+   collabServer_ = other.collabServer_;
+   sourceWindow_ = other.sourceWindow_;
+   properties_ = other.properties_;
+}
+
+const std::string& SourceDocument::contents() const
+{
+   // flatten on demand (edits via replaceContents don't need the
+   // contents as a single string)
+   if (!flatContentsValid_)
+   {
+      flatContents_ = contents_.str();
+      flatContentsValid_ = true;
+   }
+   return flatContents_;
+}
 
 std::string SourceDocument::getProperty(const std::string& name) const
 {
@@ -253,8 +410,39 @@ bool SourceDocument::isUntitled() const
 // set contents from string
 void SourceDocument::setContents(const std::string& contents)
 {
-   contents_ = contents;
-   hash_ = hash::crc32Hash(contents_);
+   contents_.assign(contents);
+   onContentsChanged();
+}
+
+Error SourceDocument::replaceContents(std::size_t offset,
+                                      std::size_t length,
+                                      const std::string& replacement,
+                                      std::size_t* pByteOffset,
+                                      std::size_t* pByteLength)
+{
+   std::size_t begin, end;
+   if (!contents_.byteOffset(offset, &begin) ||
+       !contents_.byteOffset(offset + length, &end))
+   {
+      return systemError(boost::system::errc::illegal_byte_sequence,
+                         ERROR_LOCATION);
+   }
+
+   contents_.replace(begin, end - begin, replacement);
+   onContentsChanged();
+
+   *pByteOffset = begin;
+   *pByteLength = end - begin;
+   return Success();
+}
+
+void SourceDocument::onContentsChanged()
+{
+   flatContents_.clear();
+   flatContentsValid_ = false;
+
+   // equivalent to hash::crc32Hash(contents()) without flattening
+   hash_ = safe_convert::numberToString(contents_.crc32());
    lastContentUpdate_ = date_time::millisecondsSinceEpoch();
 }
 
@@ -315,7 +503,7 @@ Error SourceDocument::updateDirty()
          if (error)
             return error;
 
-         if (contents_.length() == contents.length() && hash_ == hash::crc32Hash(contents))
+         if (contents_.size() == contents.length() && hash_ == hash::crc32Hash(contents))
             dirty_ = false;
       }
    }
@@ -392,7 +580,19 @@ Error SourceDocument::readFromJson(json::Object* pDocJson)
       json::Value type = docJson["type"];
       type_ = !type.is_null() ? type.get_str() : std::string();
 
-      setContents(docJson["contents"].get_str());
+      // the contents are absent from metadata-only records (in which case
+      // we keep the current contents and take the hash as recorded)
+      json::Value contents = docJson["contents"];
+      if (!contents.is_null())
+      {
+         setContents(contents.get_str());
+      }
+      else
+      {
+         json::Value hash = docJson["hash"];
+         if (!hash.is_null())
+            hash_ = hash.get_str();
+      }
       dirty_ = docJson["dirty"].get_bool();
       created_ = docJson["created"].get_real();
       sourceOnSave_ = docJson["source_on_save"].get_bool();
@@ -438,6 +638,14 @@ Error SourceDocument::readFromJson(json::Object* pDocJson)
 }
    
 void SourceDocument::writeToJson(json::Object* pDocJson) const
+{
+   writeMetadataToJson(pDocJson);
+
+   json::Object& jsonDoc = *pDocJson;
+   jsonDoc["contents"] = contents();
+}
+
+void SourceDocument::writeMetadataToJson(json::Object* pDocJson) const
 {
    json::Object& jsonDoc = *pDocJson;
    jsonDoc["id"] = id();
@@ -445,7 +653,6 @@ void SourceDocument::writeToJson(json::Object* pDocJson) const
    jsonDoc["project_path"] = pathToProjectPath(path_);
    jsonDoc["type"] = !type().empty() ? type_ : json::Value();
    jsonDoc["hash"] = hash();
-   jsonDoc["contents"] = contents();
    jsonDoc["dirty"] = dirty();
    jsonDoc["created"] = created();
    jsonDoc["source_on_save"] = sourceOnSave();
@@ -459,19 +666,36 @@ void SourceDocument::writeToJson(json::Object* pDocJson) const
    jsonDoc["source_window"] = sourceWindow_;
    jsonDoc["last_content_update"] = json::Value(
          static_cast<boost::int64_t>(lastContentUpdate_));
-
 }
 
-Error SourceDocument::writeToFile(const FilePath& filePath) const
+Error SourceDocument::readFromFile(const FilePath& filePath,
+                                   bool includeContents)
 {
-   // get json representation
-   json::Object jsonDoc ;
-   writeToJson(&jsonDoc);
-   std::ostringstream ostr ;
-   json::writeFormatted(jsonDoc, ostr);
+   json::Object metadata;
+   std::string contents;
+   Error error = storage::readDocument(filePath,
+                                       &metadata,
+                                       includeContents ? &contents : NULL);
+   if (error)
+      return error;
 
-   // write to file
-   return writeStringToFile(filePath, ostr.str());
+   // set the contents first so the metadata determines the content
+   // update time
+   if (includeContents)
+      setContents(contents);
+
+   return readFromJson(&metadata);
+}
+
+Error SourceDocument::writeToFile(const FilePath& filePath,
+                                  bool legacyFormat) const
+{
+   json::Object metadata;
+   writeMetadataToJson(&metadata);
+   if (legacyFormat)
+      return storage::writeLegacyDocument(filePath, metadata, contents());
+   else
+      return storage::writeDocument(filePath, metadata, contents());
 }
 
 void SourceDocument::editProperty(const json::Object::value_type& property)
@@ -519,35 +743,139 @@ FilePath path()
    return s_sourceDBPath;
 }
    
-Error get(const std::string& id, boost::shared_ptr<SourceDocument> pDoc)
+namespace {
+
+// persisted documents are kept in memory (keyed by id) so that reading a
+// document doesn't require reading and parsing it from disk. copies share
+// contents with the cache so this costs little beyond the documents the
+// client already has open
+std::map<std::string, boost::shared_ptr<SourceDocument> > s_documentCache;
+
+// edits made by putEdit are appended to a journal alongside the document.
+// once the journal grows larger than the document (or this minimum) it is
+// compacted by rewriting the document
+const char * const kJournalExt = ".journal";
+const uintmax_t kMinJournalCompactSize = 64 * 1024;
+
+FilePath journalPath(const std::string& id)
 {
-   FilePath filePath = source_database::path().complete(id);
-   if (filePath.exists())
+   return source_database::path().complete(id + kJournalExt);
+}
+
+void cacheDocument(boost::shared_ptr<SourceDocument> pDoc)
+{
+   boost::shared_ptr<SourceDocument> pCached(new SourceDocument());
+   pCached->copyFrom(*pDoc);
+   s_documentCache[pDoc->id()] = pCached;
+}
+
+// apply the journaled edits to a document read with its contents
+Error applyJournal(const FilePath& journalFile,
+                   boost::shared_ptr<SourceDocument> pDoc)
+{
+   std::vector<storage::JournalEntry> entries;
+   Error error = storage::readJournal(journalFile, true, &entries);
+   if (error)
+      return error;
+   if (entries.empty())
+      return Success();
+
+   std::string contents = pDoc->contents();
+   BOOST_FOREACH(const storage::JournalEntry& entry, entries)
    {
-      // read the contents of the file
-      std::string contents ;
-      Error error = readStringFromFile(filePath, &contents,
-                                       options().sourceLineEnding());
-      if (error)
-         return error;
-   
-      // parse the json
-      json::Value value;
-      if ( !json::parse(contents, &value) )
+      if (entry.offset + entry.length > contents.size())
       {
          return systemError(boost::system::errc::invalid_argument,
                             ERROR_LOCATION);
       }
-      
-      // initialize doc from json
-      json::Object jsonDoc = value.get_obj();
-      return pDoc->readFromJson(&jsonDoc);
+      contents.replace(entry.offset, entry.length, entry.text);
    }
-   else
+
+   // verify the result against the hash recorded with the last entry then
+   // apply the document state which accompanied it
+   json::Object metadata = entries.back().metadata;
+   pDoc->setContents(contents);
+   std::string hash = pDoc->hash();
+   error = pDoc->readFromJson(&metadata);
+   if (error)
+      return error;
+   if (pDoc->hash() != hash)
+      return systemError(boost::system::errc::bad_message, ERROR_LOCATION);
+
+   return Success();
+}
+
+// apply the document state recorded with the last journal entry to a
+// document read without its contents
+Error applyJournalMetadata(const FilePath& journalFile,
+                           boost::shared_ptr<SourceDocument> pDoc)
+{
+   std::vector<storage::JournalEntry> entries;
+   Error error = storage::readJournal(journalFile, false, &entries);
+   if (error)
+      return error;
+   if (entries.empty())
+      return Success();
+
+   return pDoc->readFromJson(&(entries.back().metadata));
+}
+
+Error read(const std::string& id,
+           bool includeContents,
+           boost::shared_ptr<SourceDocument> pDoc)
+{
+   FilePath filePath = source_database::path().complete(id);
+   if (!filePath.exists())
    {
       return systemError(boost::system::errc::no_such_file_or_directory,
                          ERROR_LOCATION);
    }
+
+   Error error = pDoc->readFromFile(filePath, includeContents);
+   if (error)
+      return error;
+
+   // apply any edits journaled since the document was written (if the
+   // journal can't be applied we fall back to the document as written)
+   FilePath journalFile = journalPath(id);
+   if (journalFile.exists())
+   {
+      boost::shared_ptr<SourceDocument> pJournaled(new SourceDocument());
+      pJournaled->copyFrom(*pDoc);
+      error = includeContents ? applyJournal(journalFile, pJournaled) :
+                                applyJournalMetadata(journalFile, pJournaled);
+      if (error)
+      {
+         error.addProperty("journal", journalFile);
+         LOG_ERROR(error);
+      }
+      else
+      {
+         pDoc->copyFrom(*pJournaled);
+      }
+   }
+
+   return Success();
+}
+
+} // anonymous namespace
+
+Error get(const std::string& id, boost::shared_ptr<SourceDocument> pDoc)
+{
+   std::map<std::string, boost::shared_ptr<SourceDocument> >::const_iterator
+                                                it = s_documentCache.find(id);
+   if (it != s_documentCache.end())
+   {
+      pDoc->copyFrom(*(it->second));
+      return Success();
+   }
+
+   Error error = read(id, true, pDoc);
+   if (error)
+      return error;
+
+   cacheDocument(pDoc);
+   return Success();
 }
 
 Error getDurableProperties(const std::string& path, json::Object* pProperties)
@@ -563,6 +891,8 @@ bool isSourceDocument(const FilePath& filePath)
       return false;
    else if (filePath.filename() == "lock_file")
       return false;
+   else if (filePath.extension() == kJournalExt)
+      return false;
    else
       return true;
 }
@@ -600,8 +930,10 @@ bool isSafeSourceDocument(const FilePath& docDbPath,
       }
    }
 
-   // get the size of the file in KB
-   uintmax_t docSizeKb = docDbPath.size() / 1024;
+   // get the size of the file in KB (the file may not yet reflect
+   // journaled edits so account for the contents as well)
+   uintmax_t docSizeKb = std::max(docDbPath.size(),
+                                  uintmax_t(pDoc->contentsSize())) / 1024;
    std::string kbStr = safe_convert::numberToString(docSizeKb);
 
    // if it's larger than 5MB then always drop it (that's the limit
@@ -635,7 +967,8 @@ bool isSafeSourceDocument(const FilePath& docDbPath,
 }
 
 
-Error list(std::vector<boost::shared_ptr<SourceDocument> >* pDocs)
+Error list(std::vector<boost::shared_ptr<SourceDocument> >* pDocs,
+           bool includeContents)
 {
    std::vector<FilePath> files ;
    Error error = source_database::path().children(&files);
@@ -646,9 +979,13 @@ Error list(std::vector<boost::shared_ptr<SourceDocument> >* pDocs)
    {
       if (isSourceDocument(filePath))
       {
-         // get the source doc
+         // get the source doc (documents we already have in memory are
+         // always returned with their contents)
+         std::string id = filePath.filename();
          boost::shared_ptr<SourceDocument> pDoc(new SourceDocument()) ;
-         Error error = source_database::get(filePath.filename(), pDoc);
+         Error error = (includeContents || s_documentCache.count(id)) ?
+                                 source_database::get(id, pDoc) :
+                                 read(id, false, pDoc);
          if (!error)
          {
             // safety filter
@@ -671,6 +1008,98 @@ Error put(boost::shared_ptr<SourceDocument> pDoc)
    if (error)
       return error ;
 
+   // the file now includes any journaled edits
+   error = journalPath(pDoc->id()).removeIfExists();
+   if (error)
+      LOG_ERROR(error);
+
+   cacheDocument(pDoc);
+
+   // write properties to durable storage (if there is a path)
+   if (!pDoc->path().empty())
+   {
+      error = putProperties(pDoc->path(), pDoc->properties());
+      if (error)
+         LOG_ERROR(error);
+   }
+
+   return Success();
+}
+
+Error putEdit(boost::shared_ptr<SourceDocument> pDoc,
+              std::size_t byteOffset,
+              std::size_t byteLength,
+              const std::string& replacement)
+{
+   // the journal is relative to the document file so if we haven't
+   // written one yet write the whole document
+   FilePath filePath = source_database::path().complete(pDoc->id());
+   if (!filePath.exists())
+      return put(pDoc);
+
+   // compact rather than append if the journal has grown large
+   FilePath journalFile = journalPath(pDoc->id());
+   if (journalFile.exists() &&
+       journalFile.size() > std::max(kMinJournalCompactSize, filePath.size()))
+   {
+      return put(pDoc);
+   }
+
+   // append the edit (falling back to writing the whole document)
+   storage::JournalEntry entry;
+   pDoc->writeMetadataToJson(&entry.metadata);
+   entry.offset = byteOffset;
+   entry.length = byteLength;
+   entry.text = replacement;
+   Error error = storage::appendJournalEntry(journalFile, entry);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return put(pDoc);
+   }
+
+   cacheDocument(pDoc);
+
+   // write properties to durable storage (if there is a path)
+   if (!pDoc->path().empty())
+   {
+      error = putProperties(pDoc->path(), pDoc->properties());
+      if (error)
+         LOG_ERROR(error);
+   }
+
+   return Success();
+}
+
+Error putMetadata(boost::shared_ptr<SourceDocument> pDoc)
+{
+   FilePath filePath = source_database::path().complete(pDoc->id());
+   if (!filePath.exists())
+   {
+      return systemError(boost::system::errc::no_such_file_or_directory,
+                         ERROR_LOCATION);
+   }
+
+   // journal the new metadata (an entry without an edit)
+   storage::JournalEntry entry;
+   pDoc->writeMetadataToJson(&entry.metadata);
+   Error error = storage::appendJournalEntry(journalPath(pDoc->id()), entry);
+   if (error)
+      return error;
+
+   // update the cached document (if any) while retaining its contents
+   std::map<std::string, boost::shared_ptr<SourceDocument> >::iterator
+                                       it = s_documentCache.find(pDoc->id());
+   if (it != s_documentCache.end())
+   {
+      error = it->second->readFromJson(&entry.metadata);
+      if (error)
+      {
+         LOG_ERROR(error);
+         s_documentCache.erase(it);
+      }
+   }
+
    // write properties to durable storage (if there is a path)
    if (!pDoc->path().empty())
    {
@@ -684,11 +1113,19 @@ Error put(boost::shared_ptr<SourceDocument> pDoc)
    
 Error remove(const std::string& id)
 {
+   s_documentCache.erase(id);
+
+   Error error = journalPath(id).removeIfExists();
+   if (error)
+      LOG_ERROR(error);
+
    return source_database::path().complete(id).removeIfExists();
 }
    
 Error removeAll()
 {
+   s_documentCache.clear();
+
    std::vector<FilePath> files ;
    Error error = source_database::path().children(&files);
    if (error)
@@ -706,13 +1143,11 @@ Error removeAll()
 
 Error getPath(const std::string& id, std::string* pPath)
 {
-   std::map<std::string, std::string>::iterator it = s_idToPath.find(id);
-   if (it == s_idToPath.end())
+   if (!s_documentIndex.getPath(id, pPath))
    {
       return systemError(boost::system::errc::no_such_file_or_directory,
                          ERROR_LOCATION);
    }
-   *pPath = it->second;
    return Success();
 }
 
@@ -728,25 +1163,36 @@ Error getPath(const std::string& id, core::FilePath* pPath)
 
 Error getId(const std::string& path, std::string* pId)
 {
-   for (std::map<std::string, std::string>::iterator it = s_idToPath.begin();
-        it != s_idToPath.end();
-        it++)
+   if (!s_documentIndex.getIdForPath(path, pId))
    {
-      if (it->second == path)
-      {
-         *pId = it->first;
-         return Success();
-      }
+      return systemError(boost::system::errc::no_such_file_or_directory,
+                         ERROR_LOCATION);
    }
-   return systemError(boost::system::errc::no_such_file_or_directory,
-                      ERROR_LOCATION);
+   return Success();
 }
 
 Error getId(const FilePath& path, std::string* pId)
 {
+   // try the file index first (avoids aliasing the path)
+   if (s_documentIndex.getIdForFile(path.absolutePath(), pId))
+      return Success();
+
    return getId(module_context::createAliasedPath(FileInfo(path)), pId);
 }
 
+void getIds(const std::vector<core::system::FileChangeEvent>& events,
+            std::vector<std::string>* pIds)
+{
+   pIds->clear();
+   pIds->reserve(events.size());
+   BOOST_FOREACH(const core::system::FileChangeEvent& event, events)
+   {
+      std::string id;
+      s_documentIndex.getIdForFile(event.fileInfo().absolutePath(), &id);
+      pIds->push_back(id);
+   }
+}
+
 namespace {
 
 void onQuit()
@@ -765,25 +1211,23 @@ void onShutdown(bool)
 
 void onDocUpdated(boost::shared_ptr<SourceDocument> pDoc)
 {
-   s_idToPath[pDoc->id()] = pDoc->path();
+   s_documentIndex.update(pDoc->id(), pDoc->path());
 }
 
 void onDocRemoved(const std::string& id, const std::string& path)
 {
-   std::map<std::string, std::string>::iterator it = s_idToPath.find(id);
-   if (it != s_idToPath.end())
-      s_idToPath.erase(it);
+   s_documentIndex.remove(id);
 }
 
 void onDocRenamed(const std::string &, 
                   boost::shared_ptr<SourceDocument> pDoc)
 {
-   s_idToPath[pDoc->id()] = pDoc->path();
+   s_documentIndex.update(pDoc->id(), pDoc->path());
 }
 
 void onRemoveAll()
 {
-   s_idToPath.clear();
+   s_documentIndex.clear();
 }
 
 } // anonymous namespace
@@ -0,0 +1,283 @@
+/*
+ * SessionSourceDatabaseStorage.cpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionSourceDatabaseStorage.hpp"
+
+#include <iostream>
+#include <sstream>
+
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace session {
+namespace source_database {
+namespace storage {
+
+namespace {
+
+const char kDocumentMagic[] = { 'R', 'S', 'D', 'B' };
+const boost::uint32_t kDocumentVersion = 1;
+
+void appendUInt32(boost::uint32_t value, std::string* pBuffer)
+{
+   pBuffer->push_back(static_cast<char>((value >> 24) & 0xFF));
+   pBuffer->push_back(static_cast<char>((value >> 16) & 0xFF));
+   pBuffer->push_back(static_cast<char>((value >> 8) & 0xFF));
+   pBuffer->push_back(static_cast<char>(value & 0xFF));
+}
+
+bool readUInt32(std::istream& input, boost::uint32_t* pValue)
+{
+   unsigned char bytes[4];
+   if (!input.read(reinterpret_cast<char*>(bytes), 4))
+      return false;
+
+   *pValue = (static_cast<boost::uint32_t>(bytes[0]) << 24) |
+             (static_cast<boost::uint32_t>(bytes[1]) << 16) |
+             (static_cast<boost::uint32_t>(bytes[2]) << 8) |
+             static_cast<boost::uint32_t>(bytes[3]);
+   return true;
+}
+
+bool readBytes(std::istream& input, std::size_t size, std::string* pBytes)
+{
+   pBytes->resize(size);
+   if (size == 0)
+      return true;
+   return !!input.read(&(*pBytes)[0], size);
+}
+
+std::string metadataAsString(const json::Object& metadata)
+{
+   std::ostringstream ostr;
+   json::write(metadata, ostr);
+   return ostr.str();
+}
+
+Error parseMetadata(const std::string& metadata, json::Object* pMetadata)
+{
+   json::Value value;
+   if (!json::parse(metadata, &value) || !json::isType<json::Object>(value))
+      return systemError(boost::system::errc::bad_message, ERROR_LOCATION);
+
+   *pMetadata = value.get_obj();
+   return Success();
+}
+
+Error writeBytes(const FilePath& filePath,
+                 const std::string& bytes,
+                 bool truncate)
+{
+   boost::shared_ptr<std::ostream> pOutput;
+   Error error = filePath.open_w(&pOutput, truncate);
+   if (error)
+      return error;
+
+   pOutput->write(bytes.data(), bytes.size());
+   pOutput->flush();
+   if (!pOutput->good())
+   {
+      error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+      error.addProperty("path", filePath);
+      return error;
+   }
+
+   return Success();
+}
+
+Error readLegacyDocument(const FilePath& filePath,
+                         json::Object* pMetadata,
+                         std::string* pContents)
+{
+   std::string document;
+   Error error = readStringFromFile(filePath, &document);
+   if (error)
+      return error;
+
+   error = parseMetadata(document, pMetadata);
+   if (error)
+   {
+      error.addProperty("path", filePath);
+      return error;
+   }
+
+   json::Object::iterator it = pMetadata->find("contents");
+   if (it == pMetadata->end() || !json::isType<std::string>(it->second))
+      return systemError(boost::system::errc::bad_message, ERROR_LOCATION);
+
+   if (pContents)
+      *pContents = it->second.get_str();
+   pMetadata->erase(it);
+
+   return Success();
+}
+
+} // anonymous namespace
+
+Error writeDocument(const FilePath& filePath,
+                    const json::Object& metadata,
+                    const std::string& contents)
+{
+   std::string metadataBytes = metadataAsString(metadata);
+
+   std::string document(kDocumentMagic, sizeof(kDocumentMagic));
+   appendUInt32(kDocumentVersion, &document);
+   appendUInt32(static_cast<boost::uint32_t>(metadataBytes.size()), &document);
+   appendUInt32(static_cast<boost::uint32_t>(contents.size()), &document);
+   document.reserve(document.size() + metadataBytes.size() + contents.size());
+   document.append(metadataBytes);
+   document.append(contents);
+
+   return writeBytes(filePath, document, true);
+}
+
+Error writeLegacyDocument(const FilePath& filePath,
+                          const json::Object& metadata,
+                          const std::string& contents)
+{
+   json::Object document = metadata;
+   document["contents"] = contents;
+
+   std::ostringstream ostr;
+   json::writeFormatted(document, ostr);
+   return writeStringToFile(filePath, ostr.str());
+}
+
+Error readDocument(const FilePath& filePath,
+                   json::Object* pMetadata,
+                   std::string* pContents)
+{
+   boost::shared_ptr<std::istream> pInput;
+   Error error = filePath.open_r(&pInput);
+   if (error)
+      return error;
+
+   // documents which don't begin with the magic number were written as json
+   std::string magic;
+   if (!readBytes(*pInput, sizeof(kDocumentMagic), &magic) ||
+       magic != std::string(kDocumentMagic, sizeof(kDocumentMagic)))
+   {
+      pInput.reset();
+      return readLegacyDocument(filePath, pMetadata, pContents);
+   }
+
+   boost::uint32_t version, metadataSize, contentsSize;
+   std::string metadata;
+   if (!readUInt32(*pInput, &version) ||
+       !readUInt32(*pInput, &metadataSize) ||
+       !readUInt32(*pInput, &contentsSize) ||
+       16 + uintmax_t(metadataSize) + contentsSize > filePath.size() ||
+       !readBytes(*pInput, metadataSize, &metadata) ||
+       (pContents && !readBytes(*pInput, contentsSize, pContents)))
+   {
+      error = systemError(boost::system::errc::bad_message, ERROR_LOCATION);
+      error.addProperty("path", filePath);
+      return error;
+   }
+
+   if (version > kDocumentVersion)
+   {
+      error = systemError(boost::system::errc::not_supported, ERROR_LOCATION);
+      error.addProperty("path", filePath);
+      return error;
+   }
+
+   error = parseMetadata(metadata, pMetadata);
+   if (error)
+      error.addProperty("path", filePath);
+   return error;
+}
+
+Error appendJournalEntry(const FilePath& filePath, const JournalEntry& entry)
+{
+   std::string metadataBytes = metadataAsString(entry.metadata);
+
+   std::string record;
+   appendUInt32(static_cast<boost::uint32_t>(metadataBytes.size()), &record);
+   appendUInt32(static_cast<boost::uint32_t>(entry.offset), &record);
+   appendUInt32(static_cast<boost::uint32_t>(entry.length), &record);
+   appendUInt32(static_cast<boost::uint32_t>(entry.text.size()), &record);
+   record.append(metadataBytes);
+   record.append(entry.text);
+
+   return writeBytes(filePath, record, false);
+}
+
+Error readJournal(const FilePath& filePath,
+                  bool includeText,
+                  std::vector<JournalEntry>* pEntries)
+{
+   boost::shared_ptr<std::istream> pInput;
+   Error error = filePath.open_r(&pInput);
+   if (error)
+      return error;
+
+   // track our position so we can detect a truncated final entry when
+   // skipping its text
+   uintmax_t size = filePath.size();
+   uintmax_t position = 0;
+   while (true)
+   {
+      JournalEntry entry;
+      boost::uint32_t metadataSize, offset, length, textSize;
+      std::string metadata;
+      if (!readUInt32(*pInput, &metadataSize) ||
+          !readUInt32(*pInput, &offset) ||
+          !readUInt32(*pInput, &length) ||
+          !readUInt32(*pInput, &textSize))
+      {
+         break;
+      }
+
+      position += 16 + uintmax_t(metadataSize) + textSize;
+      if (position > size || !readBytes(*pInput, metadataSize, &metadata))
+         break;
+
+      if (includeText)
+      {
+         if (!readBytes(*pInput, textSize, &entry.text))
+            break;
+      }
+      else if (!pInput->seekg(textSize, std::ios_base::cur))
+      {
+         break;
+      }
+
+      error = parseMetadata(metadata, &entry.metadata);
+      if (error)
+      {
+         error.addProperty("path", filePath);
+         return error;
+      }
+
+      entry.offset = offset;
+      entry.length = length;
+      pEntries->push_back(entry);
+   }
+
+   return Success();
+}
+
+} // namespace storage
+} // namespace source_database
+} // namespace session
+} // namespace rstudio
@@ -0,0 +1,91 @@
+/*
+ * SessionSourceDatabaseStorage.hpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_SOURCE_DATABASE_STORAGE_HPP
+#define SESSION_SOURCE_DATABASE_STORAGE_HPP
+
+#include <string>
+#include <vector>
+
+#include <core/json/Json.hpp>
+
+namespace rstudio {
+namespace core {
+   class Error;
+   class FilePath;
+}
+}
+
+namespace rstudio {
+namespace session {
+namespace source_database {
+namespace storage {
+
+// documents are stored as a binary record with separate metadata (the
+// document's json representation less its contents) and contents segments
+// so that the metadata can be read without reading the contents:
+//
+//    "RSDB" <version> <metadata size> <contents size> <metadata> <contents>
+//
+// (sizes are 32-bit big endian integers). documents written as json by
+// earlier versions are read transparently
+core::Error writeDocument(const core::FilePath& filePath,
+                          const core::json::Object& metadata,
+                          const std::string& contents);
+
+// earlier versions can only read documents written as json (the metadata
+// plus a contents field), so documents which may be read by another
+// version (e.g. those persisted when the session ends) are written this way
+core::Error writeLegacyDocument(const core::FilePath& filePath,
+                                const core::json::Object& metadata,
+                                const std::string& contents);
+
+// pContents may be NULL to skip reading the contents
+core::Error readDocument(const core::FilePath& filePath,
+                         core::json::Object* pMetadata,
+                         std::string* pContents);
+
+// edits to a document are appended to its journal. each entry replaces the
+// bytes [offset, offset + length) of the contents with text and carries the
+// document's metadata as of the edit (an entry with no length or text only
+// updates the metadata):
+//
+//    <metadata size> <offset> <length> <text size> <metadata> <text>
+//
+struct JournalEntry
+{
+   JournalEntry() : offset(0), length(0) {}
+   core::json::Object metadata;
+   std::size_t offset;
+   std::size_t length;
+   std::string text;
+};
+
+core::Error appendJournalEntry(const core::FilePath& filePath,
+                               const JournalEntry& entry);
+
+// read the complete entries in the journal (an incomplete final entry, as
+// left by an interrupted append, is ignored). if includeText is false the
+// text of each entry is skipped
+core::Error readJournal(const core::FilePath& filePath,
+                        bool includeText,
+                        std::vector<JournalEntry>* pEntries);
+
+} // namespace storage
+} // namespace source_database
+} // namespace session
+} // namespace rstudio
+
+#endif // SESSION_SOURCE_DATABASE_STORAGE_HPP
@@ -462,13 +462,15 @@ Error saveMostRecentDocuments()
       if (error)
          return error;
 
-      // write the docs into the mru directories
+      // write the docs into the mru directories (as json, since they may
+      // be read by an earlier version)
       BOOST_FOREACH(boost::shared_ptr<SourceDocument> pDoc, sourceDocs)
       {
          FilePath targetDir = pDoc->isUntitled() ? mostRecentDirUntitled :
                                                    mostRecentDir;
 
-         Error error = pDoc->writeToFile(targetDir.childPath(pDoc->id()));
+         Error error = pDoc->writeToFile(targetDir.childPath(pDoc->id()),
+                                         true);
          if (error)
             LOG_ERROR(error);
       }
@@ -502,7 +504,8 @@ Error detachFromSourceDatabase()
    if (error)
       return error;
 
-   // now write the source database entries to the appropriate places
+   // now write the source database entries to the appropriate places (as
+   // json, since the next session to read them may be an earlier version)
    BOOST_FOREACH(boost::shared_ptr<SourceDocument> pDoc, sourceDocs)
    {
       if (pDoc->isUntitled())
@@ -514,13 +517,13 @@ Error detachFromSourceDatabase()
          if (targetPath.exists())
             targetPath = file_utils::uniqueFilePath(untitledDir);
 
-         error = pDoc->writeToFile(targetPath);
+         error = pDoc->writeToFile(targetPath, true);
          if (error)
             LOG_ERROR(error);
       }
       else
       {
-         error = pDoc->writeToFile(titledDir.complete(pDoc->id()));
+         error = pDoc->writeToFile(titledDir.complete(pDoc->id()), true);
          if (error)
             LOG_ERROR(error);
       }
@@ -211,6 +211,9 @@ Error UserSettings::initialize()
    Error error = settings_.initialize(settingsFilePath_);
    if (error)
       return error;
+   settings_.setWriteBehind(module_context::scheduleSettingsWrite);
+   settings_.addChangeHandler(
+               boost::bind(&UserSettings::onSettingChanged, this, _1, _2));
 
    // register routines for reading/writing UI prefs from R code
    R_CallMethodDef readUiPrefMethodDef ;
@@ -243,6 +246,7 @@ void UserSettings::onSettingsFileChanged(
    }
 
    // re-read the settings from disk
+   settingsChanged_ = false;
    Error error = settings_.initialize(settingsFilePath_);
    if (error)
    {
@@ -250,6 +254,11 @@ void UserSettings::onSettingsFileChanged(
       return;
    }
 
+   // nothing more to do if no values changed (e.g. this is the change
+   // event for our own write)
+   if (!settingsChanged_)
+      return;
+
    // update prefs cache
    updatePrefsCache(uiPrefs());
 
@@ -269,6 +278,10 @@ void UserSettings::onSettingsFileChanged(
    onChanged();
 }
 
+void UserSettings::onSettingChanged(const std::string&, const std::string&)
+{
+   settingsChanged_ = true;
+}
 
 std::string UserSettings::contextId() const
 {
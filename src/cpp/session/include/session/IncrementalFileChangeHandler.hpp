@@ -25,6 +25,7 @@
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <core/FileInfo.hpp>
+#include <core/Trace.hpp>
 
 #include <core/system/FileChangeEvent.hpp>
 
@@ -124,6 +125,8 @@ private:
 
    void dequeAndProcess()
    {
+      TRACE_SCOPE("index", "incremental_file_changes");
+
       boost::posix_time::ptime workStart = now();
       boost::posix_time::ptime workUntil = workStart + incrementalWorkPeriod_;
       while (!queue_.empty() && (now() < workUntil))
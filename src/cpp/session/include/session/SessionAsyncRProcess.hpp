@@ -21,10 +21,11 @@
 
 #include <core/system/Types.hpp>
 
-namespace core
-{
+namespace rstudio {
+namespace core {
    class FilePath;
 }
+}
 
 namespace rstudio {
 namespace session {
@@ -36,7 +37,12 @@ enum AsyncRProcessOptions
    R_PROCESS_REDIRECTSTDERR = 1 << 1,
    R_PROCESS_VANILLA        = 1 << 2,
    R_PROCESS_AUGMENTED      = 1 << 3,
-   R_PROCESS_NO_RDATA       = 1 << 4
+   R_PROCESS_NO_RDATA       = 1 << 4,
+
+   // run the command on a resident R process (when the pool is enabled).
+   // the command runs in the process's global environment, so it should
+   // only be used by commands which don't depend on a fresh R session
+   R_PROCESS_POOLED         = 1 << 5
 };
 
 inline AsyncRProcessOptions operator | (AsyncRProcessOptions lhs,
@@ -81,6 +87,8 @@ protected:
    virtual void onCompleted(int exitStatus) = 0;
 
 private:
+   friend class RWorker;
+
    void onProcessCompleted(int exitStatus);
    bool isRunning_;
    bool terminationRequested_;
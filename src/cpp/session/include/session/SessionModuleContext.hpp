@@ -18,10 +18,14 @@
 
 #include <string>
 
+#include <boost/bind.hpp>
 #include <boost/utility.hpp>
 #include <boost/function.hpp>
 #include <boost/signals.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 #include <core/HtmlUtils.hpp>
 #include <core/system/System.hpp>
@@ -32,6 +36,7 @@
 #include <core/r_util/RToolsInfo.hpp>
 #include <core/r_util/RActiveSessions.hpp>
 #include <core/Thread.hpp>
+#include <core/WorkerPool.hpp>
 
 #include <session/SessionOptions.hpp>
 #include <session/SessionClientEvent.hpp>
@@ -306,23 +311,114 @@ struct firstNonEmpty
 };
 
 
+namespace detail {
+
+struct SignalHandlerStats;
+
+// a handler connected to a NamedSignal (see below)
+class SignalSlot : boost::noncopyable,
+                   public boost::enable_shared_from_this<SignalSlot>
+{
+public:
+   SignalSlot(const std::string& signal,
+              const std::string& name,
+              const boost::posix_time::time_duration& budget);
+
+   void setConnection(const boost::signals::connection& connection)
+   {
+      connection_ = connection;
+   }
+
+   void invoke(const boost::function<void()>& call);
+
+private:
+   void execute(const boost::function<void()>& call);
+   void defer(const boost::function<void()>& call);
+   static void executeDeferred(boost::weak_ptr<SignalSlot> pWeakSlot);
+
+   boost::shared_ptr<SignalHandlerStats> pStats_;
+   boost::signals::connection connection_;
+   bool deferred_;
+   boost::function<void()> deferredCall_;
+};
+
+} // namespace detail
+
+// signal whose handlers are connected with a name (typically that of the
+// module connecting them). the time spent in each handler is recorded
+// (see signalHandlerStats) and traced, and handlers which consistently
+// exceed their time budget are demoted to run during idle time (with
+// calls made while a deferred call is pending coalesced into it) until
+// they are back within budget
+template <typename Arg>
+class NamedSignal : boost::noncopyable
+{
+public:
+   typedef boost::function<void(Arg)> Handler;
+
+   explicit NamedSignal(const std::string& name) : name_(name) {}
+
+   // the budget defaults to the session's handler budget. handlers which
+   // must always run when the signal fires should pass pos_infin
+   boost::signals::connection connect(
+         const std::string& name,
+         const Handler& handler,
+         const boost::posix_time::time_duration& budget =
+                                       boost::posix_time::not_a_date_time)
+   {
+      boost::shared_ptr<detail::SignalSlot> pSlot(
+                              new detail::SignalSlot(name_, name, budget));
+      boost::signals::connection connection = signal_.connect(
+                  boost::bind(&NamedSignal::invoke, pSlot, handler, _1));
+      pSlot->setConnection(connection);
+      return connection;
+   }
+
+   void operator()(Arg arg)
+   {
+      signal_(arg);
+   }
+
+private:
+   static void invoke(boost::shared_ptr<detail::SignalSlot> pSlot,
+                      const Handler& handler,
+                      Arg arg)
+   {
+      pSlot->invoke(boost::bind(handler, arg));
+   }
+
+   std::string name_;
+   boost::signal<void(Arg)> signal_;
+};
+
+// time spent in the handlers of each NamedSignal (and whether they have
+// been demoted to idle time)
+core::json::Array signalHandlerStats();
+
 // session events
 struct Events : boost::noncopyable
 {
+   Events()
+      : onConsolePrompt("onConsolePrompt"),
+        onDetectChanges("onDetectChanges"),
+        onBackgroundProcessing("onBackgroundProcessing")
+   {
+   }
+
    boost::signal<void (core::json::Object*)> onSessionInfo;
    boost::signal<void ()>                    onClientInit;
    boost::signal<void ()>                    onBeforeExecute;
-   boost::signal<void(const std::string&)>   onConsolePrompt;
+   NamedSignal<const std::string&>           onConsolePrompt;
    boost::signal<void(const std::string&)>   onConsoleInput;
    boost::signal<void(const std::string&, const std::string&)>  
                                              onActiveConsoleChanged;
    boost::signal<void (ConsoleOutputType, const std::string&)>
                                              onConsoleOutput;
-   boost::signal<void (ChangeSource)>        onDetectChanges;
+   NamedSignal<ChangeSource>                 onDetectChanges;
    boost::signal<void (core::FilePath)>      onSourceEditorFileSaved;
    boost::signal<void(bool)>                 onDeferredInit;
    boost::signal<void(bool)>                 afterSessionInitHook;
-   boost::signal<void(bool)>                 onBackgroundProcessing;
+   NamedSignal<bool>                         onBackgroundProcessing;
    boost::signal<void(bool)>                 onShutdown;
    boost::signal<void ()>                    onQuit;
    boost::signal<void (const std::string&)>  onPackageLoaded;
@@ -384,6 +480,22 @@ void scheduleDelayedWork(const boost::posix_time::time_duration& period,
                          const boost::function<void()> &execute,
                          bool idleOnly = true);
 
+// schedule work which doesn't touch R (file i/o, hashing, etc.) on a pool
+// of background threads so that it can proceed while R is busy. if
+// provided, onCompleted is called back on the main thread (during
+// background processing) once the work is done. cancelling the returned
+// handle prevents work which hasn't started from running and suppresses
+// the completion; long running work should check
+// core::WorkerPool::cancelled periodically and return early if it is set
+core::WorkHandle scheduleBackgroundWork(
+         const boost::function<void()>& work,
+         const boost::function<void()>& onCompleted = boost::function<void()>(),
+         core::WorkPriority priority = core::WorkPriorityNormal);
+
+// write-behind scheduler for core::Settings (coalesces the writes made
+// within a short window into a single write)
+void scheduleSettingsWrite(const boost::function<void()>& write);
+
 
 core::string_utils::LineEnding lineEndings(const core::FilePath& filePath);
 
@@ -150,6 +150,8 @@ public:
 
    bool rProfileOnResumeDefault() const { return rProfileOnResumeDefault_; }
 
+   bool lazyWorkspaceRestore() const { return lazyWorkspaceRestore_; }
+
    int saveActionDefault() const { return saveActionDefault_; }
 
    unsigned int authMinimumUserId() const { return authMinimumUserId_; }
@@ -451,6 +453,61 @@ public:
       return monitorSharedSecret_.c_str();
    }
 
+   std::string metricsPath() const
+   {
+      return metricsPath_.c_str();
+   }
+
+   int metricsIntervalSeconds() const
+   {
+      return metricsIntervalSeconds_;
+   }
+
+   bool traceEnabled() const
+   {
+      return traceEnabled_;
+   }
+
+   int handlerBudgetMs() const
+   {
+      return handlerBudgetMs_;
+   }
+
+   int workerThreads() const
+   {
+      return workerThreads_;
+   }
+
+   int findIndexMb() const
+   {
+      return findIndexMb_;
+   }
+
+   int buildJobs() const
+   {
+      return buildJobs_;
+   }
+
+   int rWorkers() const
+   {
+      return rWorkers_;
+   }
+
+   int rWorkerJobs() const
+   {
+      return rWorkerJobs_;
+   }
+
+   int rWorkerMemoryMb() const
+   {
+      return rWorkerMemoryMb_;
+   }
+
+   std::string sharedPackageInfoPath() const
+   {
+      return std::string(sharedPackageInfoPath_.c_str());
+   }
+
    bool standalone() const
    {
       return standalone_;
@@ -512,6 +569,7 @@ private:
    bool createProfile_;
    bool createPublicFolder_;
    bool rProfileOnResumeDefault_;
+   bool lazyWorkspaceRestore_;
    int saveActionDefault_;
    bool standalone_;
    std::string authRequiredUserGroup_;
@@ -588,6 +646,17 @@ private:
 
    // monitor
    std::string monitorSharedSecret_;
+   std::string metricsPath_;
+   int metricsIntervalSeconds_;
+   bool traceEnabled_;
+   int handlerBudgetMs_;
+   int workerThreads_;
+   int findIndexMb_;
+   int buildJobs_;
+   int rWorkers_;
+   int rWorkerJobs_;
+   int rWorkerMemoryMb_;
+   std::string sharedPackageInfoPath_;
 
    // overlay options
    std::map<std::string,std::string> overlayOptions_;
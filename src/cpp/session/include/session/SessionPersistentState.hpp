@@ -64,6 +64,9 @@ public:
    // get underlying settings
    core::Settings& settings() { return settings_; }
 
+   // write any pending changes
+   void flush() { settings_.flush(); }
+
 private:
    bool serverMode_;
    std::string desktopClientId_;
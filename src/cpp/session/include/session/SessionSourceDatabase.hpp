@@ -25,6 +25,8 @@
 
 #include <core/FilePath.hpp>
 #include <core/json/Json.hpp>
+#include <core/system/FileChangeEvent.hpp>
+#include <core/text/Rope.hpp>
 
 namespace rstudio {
 namespace core {
@@ -42,13 +44,16 @@ class SourceDocument : boost::noncopyable
 public:
    SourceDocument(const std::string& type = std::string());
    virtual ~SourceDocument() {}
-   // COPYING: via compiler
+   // COPYING: via copyFrom (contents are shared until edited)
+
+   void copyFrom(const SourceDocument& other);
 
    // accessors
    const std::string& id() const { return id_; }
    const std::string& path() const { return path_; }
    const std::string& type() const { return type_; }
-   const std::string& contents() const { return contents_; }
+   const std::string& contents() const;
+   std::size_t contentsSize() const { return contents_.size(); }
    const std::string& hash() const { return hash_; }
    const std::string& encoding() const { return encoding_; }
    bool dirty() const { return dirty_; }
@@ -68,6 +73,16 @@ public:
    // set contents from string
    void setContents(const std::string& contents);
 
+   // replace the characters [offset, offset + length) of the contents,
+   // providing the equivalent byte range (fails if the contents preceding
+   // the range aren't valid UTF-8). only the affected part of the contents
+   // is rebuilt and the hash is updated incrementally
+   core::Error replaceContents(std::size_t offset,
+                               std::size_t length,
+                               const std::string& replacement,
+                               std::size_t* pByteOffset,
+                               std::size_t* pByteLength);
+
    // set contents from file
    core::Error setPathAndContents(const std::string& path,
                                   bool allowSubstChars = true);
@@ -141,16 +156,30 @@ public:
    core::Error readFromJson(core::json::Object* pDocJson);
    void writeToJson(core::json::Object* pDocJson) const;
 
-   core::Error writeToFile(const core::FilePath& filePath) const;
+   // everything but the contents. readFromJson accepts this form, in
+   // which case the current contents are left as-is (and the hash is
+   // taken from the json)
+   void writeMetadataToJson(core::json::Object* pDocJson) const;
+
+   core::Error readFromFile(const core::FilePath& filePath,
+                            bool includeContents = true);
+   // documents are written in a binary format unless legacyFormat is
+   // true, in which case they are written as json (which earlier versions
+   // can read)
+   core::Error writeToFile(const core::FilePath& filePath,
+                           bool legacyFormat = false) const;
 
 private:
    void editProperty(const core::json::Object::value_type& property);
+   void onContentsChanged();
 
 private:
    std::string id_;
    std::string path_;
    std::string type_;
-   std::string contents_;
+   core::text::Rope contents_;
+   mutable std::string flatContents_;
+   mutable bool flatContentsValid_;
    std::string hash_;
    std::string encoding_;
    std::string folds_;
@@ -184,8 +213,20 @@ core::FilePath path();
 core::Error get(const std::string& id, boost::shared_ptr<SourceDocument> pDoc);
 core::Error getDurableProperties(const std::string& path,
                                  core::json::Object* pProperties);
-core::Error list(std::vector<boost::shared_ptr<SourceDocument> >* pDocs);
+// documents listed without their contents may only be persisted using
+// putMetadata (listing them this way doesn't read the contents from disk)
+core::Error list(std::vector<boost::shared_ptr<SourceDocument> >* pDocs,
+                 bool includeContents = true);
 core::Error put(boost::shared_ptr<SourceDocument> pDoc);
+core::Error putMetadata(boost::shared_ptr<SourceDocument> pDoc);
+
+// persist a document which was changed by replaceContents (the byte range
+// and replacement are those of the edit). the edit is appended to the
+// document's journal rather than rewriting the whole document
+core::Error putEdit(boost::shared_ptr<SourceDocument> pDoc,
+                    std::size_t byteOffset,
+                    std::size_t byteLength,
+                    const std::string& replacement);
 core::Error remove(const std::string& id);
 core::Error removeAll();
 core::Error getPath(const std::string& id, std::string* pPath);
@@ -193,6 +234,11 @@ core::Error getPath(const std::string& id, core::FilePath* pPath);
 core::Error getId(const std::string& path, std::string* pId);
 core::Error getId(const core::FilePath& path, std::string* pId);
 
+// look up the documents corresponding to a set of file change events (the
+// id is empty for files which aren't open)
+void getIds(const std::vector<core::system::FileChangeEvent>& events,
+            std::vector<std::string>* pIds);
+
 // source database events
 struct Events : boost::noncopyable
 {
@@ -54,7 +54,7 @@ struct BioconductorMirror
 class UserSettings : boost::noncopyable
 {
 private:
-   UserSettings() {}
+   UserSettings() : settingsChanged_(false) {}
    friend UserSettings& userSettings();
 
 public:
@@ -70,6 +70,9 @@ public:
    void beginUpdate() { settings_.beginUpdate(); }
    void endUpdate() { settings_.endUpdate(); }
 
+   // write any pending changes
+   void flush() { settings_.flush(); }
+
    // context id
    std::string contextId() const;
    void setContextId(const std::string& contextId);
@@ -213,6 +216,7 @@ private:
 
    void onSettingsFileChanged(
                         const core::system::FileChangeEvent& changeEvent);
+   void onSettingChanged(const std::string& name, const std::string& value);
 
    core::FilePath getWorkingDirectoryValue(const std::string& key) const;
    void setWorkingDirectoryValue(const std::string& key,
@@ -232,6 +236,7 @@ private:
 private:
    core::FilePath settingsFilePath_;
    core::Settings settings_;
+   bool settingsChanged_;
 
    // cached prefs values
    mutable boost::scoped_ptr<bool> pUseSpacesForTab_;
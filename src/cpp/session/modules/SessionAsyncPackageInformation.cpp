@@ -18,6 +18,7 @@
 
 #include "SessionAsyncPackageInformation.hpp"
 
+#include <map>
 #include <string>
 #include <vector>
 #include <sstream>
@@ -26,10 +27,16 @@
 #include <core/json/Json.hpp>
 #include <core/json/JsonRpc.hpp>
 #include <core/Error.hpp>
+#include <core/Hash.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/system/System.hpp>
+#include <core/text/DcfParser.hpp>
 
 #include <boost/format.hpp>
+#include <boost/foreach.hpp>
 #include <boost/algorithm/string.hpp>
 
+#include <session/SessionOptions.hpp>
 #include <session/SessionModuleContext.hpp>
 
 #include <core/Macros.hpp>
@@ -142,6 +149,295 @@ bool fillFunctionInfo(const json::Object& functionObjectJson,
    
 }
 
+Error readPackageInformation(const json::Object& informationJson,
+                             core::r_util::PackageInformation* pPkgInfo)
+{
+   json::Array exportsJson;
+   json::Array typesJson;
+   json::Object functionInfoJson;
+
+   Error error = json::readObject(informationJson,
+                                  "package", &pPkgInfo->package,
+                                  "exports", &exportsJson,
+                                  "types", &typesJson,
+                                  "function_info", &functionInfoJson);
+   if (error)
+      return error;
+
+   if (!json::fillVectorString(exportsJson, &(pPkgInfo->exports)))
+      LOG_ERROR_MESSAGE("Failed to read JSON 'objects' array to vector");
+
+   if (!json::fillVectorInt(typesJson, &(pPkgInfo->types)))
+      LOG_ERROR_MESSAGE("Failed to read JSON 'types' array to vector");
+
+   if (!fillFunctionInfo(functionInfoJson, pPkgInfo->package, &(pPkgInfo->functionInfo)))
+      LOG_ERROR_MESSAGE("Failed to read JSON 'functions' object to map");
+
+   return Success();
+}
+
+// Package information is cached on disk (one file per installed package)
+// so that it needn't be recomputed by every session. Entries are keyed by
+// the package's name, version, build stamp and library, along with the R
+// code which extracts the information, and are written to a temporary file
+// and then moved into place so that any number of sessions can read them
+// concurrently. An optional shared cache (e.g. populated for the site
+// library by an administrator) is consulted before the user's own. Sessions
+// only read the shared cache (entries they compute are written to the
+// user's cache) so that one user can't supply information to others.
+const char * const kPackageInformationCacheVersion = "1";
+
+// the package cache key of each package being updated
+std::map<std::string, std::string> s_packageCacheKeys;
+
+FilePath userPackageInformationCachePath()
+{
+   return module_context::userScratchPath().complete(
+                                          "package-information-cache");
+}
+
+FilePath sharedPackageInformationCachePath()
+{
+   std::string path = session::options().sharedPackageInfoPath();
+   if (path.empty())
+      return FilePath();
+   return module_context::resolveAliasedPath(path);
+}
+
+// hash of the R code which extracts package information (so that entries
+// written by other versions of RStudio aren't used)
+std::string extractionCodeHash()
+{
+   static std::string hash;
+   if (hash.empty())
+   {
+      FilePath modulesPath = session::options().modulesRSourcePath();
+      std::string code;
+      const char* files[] = { "SessionCodeTools.R", "SessionRCompletions.R" };
+      BOOST_FOREACH(const char* file, files)
+      {
+         std::string contents;
+         Error error = readStringFromFile(modulesPath.complete(file), &contents);
+         if (error)
+            LOG_ERROR(error);
+         code += contents;
+      }
+      hash = core::hash::crc32HexHash(code);
+   }
+   return hash;
+}
+
+std::string packageCacheFilePrefix(const std::string& package,
+                                   const FilePath& libPath)
+{
+   return package + "-" +
+          core::hash::crc32HexHash(libPath.absolutePath()) + "-";
+}
+
+// the key of the package as it is installed in the first library which has
+// it (the one R will load it from). returns an empty string if it isn't
+// installed (or its DESCRIPTION can't be read)
+std::string packageCacheKey(const std::string& package,
+                            const std::vector<FilePath>& libPaths,
+                            FilePath* pLibPath)
+{
+   BOOST_FOREACH(const FilePath& libPath, libPaths)
+   {
+      if (libPath.empty())
+         continue;
+
+      FilePath descPath = libPath.complete(package).childPath("DESCRIPTION");
+      if (!descPath.exists())
+         continue;
+
+      std::map<std::string, std::string> fields;
+      std::string errMsg;
+      Error error = text::parseDcfFile(descPath, true, &fields, &errMsg);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return std::string();
+      }
+
+      *pLibPath = libPath;
+      return std::string(kPackageInformationCacheVersion) + "|" +
+             extractionCodeHash() + "|" +
+             package + "|" +
+             fields["Version"] + "|" +
+             core::hash::crc32HexHash(fields["Built"]) + "|" +
+             libPath.absolutePath();
+   }
+
+   return std::string();
+}
+
+FilePath packageCacheFilePath(const FilePath& cachePath,
+                              const std::string& package,
+                              const FilePath& libPath,
+                              const std::string& key)
+{
+   return cachePath.complete(packageCacheFilePrefix(package, libPath) +
+                             core::hash::crc32HexHash(key) + ".json");
+}
+
+bool readCachedPackageInformation(const FilePath& cacheFilePath,
+                                  const std::string& key,
+                                  core::r_util::PackageInformation* pPkgInfo)
+{
+   if (!cacheFilePath.exists())
+      return false;
+
+   std::string contents;
+   Error error = readStringFromFile(cacheFilePath, &contents);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return false;
+   }
+
+   // the full key is stored along with the information so that entries
+   // whose keys have the same hash aren't confused
+   json::Value cachedJson;
+   std::string cachedKey;
+   json::Object informationJson;
+   if (!json::parse(contents, &cachedJson) ||
+       !json::isType<json::Object>(cachedJson) ||
+       json::readObject(cachedJson.get_obj(),
+                        "key", &cachedKey,
+                        "information", &informationJson) ||
+       cachedKey != key)
+   {
+      return false;
+   }
+
+   error = readPackageInformation(informationJson, pPkgInfo);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return false;
+   }
+
+   return true;
+}
+
+Error writeCachedPackageInformation(const FilePath& cachePath,
+                                    const std::string& package,
+                                    const FilePath& libPath,
+                                    const std::string& key,
+                                    const json::Object& informationJson)
+{
+   Error error = cachePath.ensureDirectory();
+   if (error)
+      return error;
+
+   json::Object cachedJson;
+   cachedJson["key"] = key;
+   cachedJson["information"] = informationJson;
+   std::ostringstream ostr;
+   json::write(cachedJson, ostr);
+
+   // write to a temporary file and then move it into place so that other
+   // sessions never read a partially written entry
+   FilePath cacheFilePath = packageCacheFilePath(cachePath, package, libPath, key);
+   FilePath tempFilePath = cachePath.childPath(
+            "." + cacheFilePath.filename() + "-" + core::system::generateUuid());
+   error = writeStringToFile(tempFilePath, ostr.str());
+   if (!error)
+      error = tempFilePath.move(cacheFilePath);
+   if (error)
+   {
+      Error removeError = tempFilePath.removeIfExists();
+      if (removeError)
+         LOG_ERROR(removeError);
+      return error;
+   }
+
+   // remove entries for other installs of the package in the same library
+   std::string prefix = packageCacheFilePrefix(package, libPath);
+   std::vector<FilePath> children;
+   error = cachePath.children(&children);
+   if (error)
+      LOG_ERROR(error);
+   BOOST_FOREACH(const FilePath& child, children)
+   {
+      if (child != cacheFilePath &&
+          boost::algorithm::starts_with(child.filename(), prefix))
+      {
+         Error error = child.removeIfExists();
+         if (error)
+            LOG_ERROR(error);
+      }
+   }
+
+   return Success();
+}
+
+// add the information for the packages which have cached information and
+// return those which don't (recording their keys for when they're updated)
+std::vector<std::string> addCachedPackageInformation(
+                                    const std::vector<std::string>& packages)
+{
+   std::vector<std::string> uncached;
+   s_packageCacheKeys.clear();
+
+   std::vector<FilePath> libPaths = module_context::getLibPaths();
+   FilePath sharedCachePath = sharedPackageInformationCachePath();
+   FilePath userCachePath = userPackageInformationCachePath();
+
+   BOOST_FOREACH(const std::string& package, packages)
+   {
+      FilePath libPath;
+      std::string key = packageCacheKey(package, libPaths, &libPath);
+      if (key.empty())
+      {
+         uncached.push_back(package);
+         continue;
+      }
+
+      core::r_util::PackageInformation pkgInfo;
+      if ((!sharedCachePath.empty() &&
+           readCachedPackageInformation(
+              packageCacheFilePath(sharedCachePath, package, libPath, key),
+              key,
+              &pkgInfo)) ||
+          readCachedPackageInformation(
+              packageCacheFilePath(userCachePath, package, libPath, key),
+              key,
+              &pkgInfo))
+      {
+         DEBUG("Using cached entry for package: '" << package << "'");
+         RSourceIndex::addPackageInformation(package, pkgInfo);
+         continue;
+      }
+
+      s_packageCacheKeys[package] = key;
+      uncached.push_back(package);
+   }
+
+   return uncached;
+}
+
+void cachePackageInformation(const std::string& package,
+                             const json::Object& informationJson)
+{
+   std::map<std::string, std::string>::const_iterator it =
+                                          s_packageCacheKeys.find(package);
+   if (it == s_packageCacheKeys.end())
+      return;
+
+   // the library is the last component of the key
+   const std::string& key = it->second;
+   FilePath libPath(key.substr(key.rfind('|') + 1));
+
+   Error error = writeCachedPackageInformation(userPackageInformationCachePath(),
+                                               package,
+                                               libPath,
+                                               key,
+                                               informationJson);
+   if (error)
+      LOG_ERROR(error);
+}
+
 } // anonymous namespace
 
 void AsyncPackageInformationProcess::onCompleted(int exitStatus)
@@ -177,10 +473,6 @@ void AsyncPackageInformationProcess::onCompleted(int exitStatus)
    // }
    for (std::size_t i = 0; i < n; ++i)
    {
-      json::Array exportsJson;
-      json::Array typesJson;
-      json::Object functionInfoJson;
-      
       core::r_util::PackageInformation pkgInfo;
 
       if (splat[i].empty())
@@ -205,12 +497,7 @@ void AsyncPackageInformationProcess::onCompleted(int exitStatus)
       if (!json::isType<json::Object>(value))
          continue;
       
-      Error error = json::readObject(value.get_obj(),
-                                     "package", &pkgInfo.package,
-                                     "exports", &exportsJson,
-                                     "types", &typesJson,
-                                     "function_info", &functionInfoJson);
-
+      Error error = readPackageInformation(value.get_obj(), &pkgInfo);
       if (error)
       {
          LOG_ERROR(error);
@@ -219,17 +506,9 @@ void AsyncPackageInformationProcess::onCompleted(int exitStatus)
 
       DEBUG("Adding entry for package: '" << pkgInfo.package << "'");
 
-      if (!json::fillVectorString(exportsJson, &(pkgInfo.exports)))
-         LOG_ERROR_MESSAGE("Failed to read JSON 'objects' array to vector");
-
-      if (!json::fillVectorInt(typesJson, &(pkgInfo.types)))
-         LOG_ERROR_MESSAGE("Failed to read JSON 'types' array to vector");
-
-      if (!fillFunctionInfo(functionInfoJson, pkgInfo.package, &(pkgInfo.functionInfo)))
-         LOG_ERROR_MESSAGE("Failed to read JSON 'functions' object to map");
-      
-      // Update the index
+      // Update the index (and the cache)
       core::r_util::RSourceIndex::addPackageInformation(pkgInfo.package, pkgInfo);
+      cachePackageInformation(pkgInfo.package, value.get_obj());
    }
 
 }
@@ -245,8 +524,10 @@ void AsyncPackageInformationProcess::update()
    s_isUpdating_ = true;
    s_updateRequested_ = false;
    
-   s_pkgsToUpdate_ =
-      RSourceIndex::getAllUnindexedPackages();
+   // packages whose information has been cached (by this or another
+   // session) needn't be updated
+   s_pkgsToUpdate_ = addCachedPackageInformation(
+      RSourceIndex::getAllUnindexedPackages());
    
    // alias for readability
    const std::vector<std::string>& pkgs = s_pkgsToUpdate_;
@@ -304,7 +585,8 @@ void AsyncPackageInformationProcess::update()
    pProcess->start(
             finalCmd.c_str(),
             core::FilePath(),
-            async_r::R_PROCESS_VANILLA | async_r::R_PROCESS_AUGMENTED,
+            async_r::R_PROCESS_VANILLA | async_r::R_PROCESS_AUGMENTED |
+            async_r::R_PROCESS_POOLED,
             sources);
    
 }
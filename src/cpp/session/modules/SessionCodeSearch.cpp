@@ -19,6 +19,7 @@
 #include "SessionCodeSearch.hpp"
 
 #include <iostream>
+#include <map>
 #include <vector>
 #include <set>
 
@@ -35,6 +36,7 @@
 #include <core/FilePath.hpp>
 #include <core/FileSerializer.hpp>
 #include <core/SafeConvert.hpp>
+#include <core/Trace.hpp>
 #include <core/collection/Tree.hpp>
 
 #include <core/r_util/RSourceIndex.hpp>
@@ -427,7 +429,7 @@ class SourceFileIndex : boost::noncopyable
 {
 public:
    SourceFileIndex()
-      : pEntries_(new EntryTree()), indexing_(false)
+      : pEntries_(new EntryTree()), indexing_(false), generation_(0)
    {
    }
 
@@ -772,6 +774,7 @@ public:
    {
       indexing_ = false;
       indexingQueue_ = std::queue<core::system::FileChangeEvent>();
+      pendingReads_.clear();
       pEntries_->clear();
    }
 
@@ -781,6 +784,8 @@ private:
    {
       using namespace rstudio::core::system;
 
+      TRACE_SCOPE("index", "code_search");
+
       if (!indexingQueue_.empty())
       {
          // remove the event from the queue
@@ -814,43 +819,93 @@ private:
       return indexing_;
    }
 
-   void updateIndexEntry(const FileInfo& fileInfo)
+   struct SourceFileContents
    {
-      // index the source if necessary
-      boost::shared_ptr<r_util::RSourceIndex> pIndex;
+      Error error;
+      std::string code;
+   };
+
+   // runs on a background thread (so touches nothing but its arguments)
+   static void readSourceFile(const FilePath& filePath,
+                              const std::string& encoding,
+                              boost::shared_ptr<SourceFileContents> pContents)
+   {
+      pContents->error = module_context::readAndDecodeFile(filePath,
+                                                           encoding,
+                                                           true,
+                                                           &pContents->code);
+   }
 
-      // read the file
+   void updateIndexEntry(const FileInfo& fileInfo)
+   {
       FilePath filePath(fileInfo.absolutePath());
 
       // filter certain directories (e.g. those that exist in build directories)
       if (isWithinIgnoredDirectory(filePath))
          return;
 
-      if (isIndexableSourceFile(fileInfo))
+      // files which aren't indexed get an entry with no index
+      if (!isIndexableSourceFile(fileInfo))
+      {
+         pendingReads_.erase(fileInfo.absolutePath());
+         addIndexEntry(fileInfo, boost::shared_ptr<r_util::RSourceIndex>());
+         return;
+      }
+
+      // read the file in the background and index it once it's read (the
+      // index itself must be built on the main thread since it updates the
+      // global set of inferred packages). the generation allows us to drop
+      // reads which are superseded by a later change to the file
+      unsigned long generation = ++generation_;
+      pendingReads_[fileInfo.absolutePath()] = generation;
+
+      boost::shared_ptr<SourceFileContents> pContents(new SourceFileContents());
+      module_context::scheduleBackgroundWork(
+               boost::bind(readSourceFile,
+                           filePath,
+                           projects::projectContext().defaultEncoding(),
+                           pContents),
+               boost::bind(&SourceFileIndex::onSourceFileRead,
+                           this,
+                           fileInfo,
+                           generation,
+                           pContents),
+               core::WorkPriorityLow);
+   }
+
+   void onSourceFileRead(const FileInfo& fileInfo,
+                         unsigned long generation,
+                         boost::shared_ptr<SourceFileContents> pContents)
+   {
+      std::map<std::string, unsigned long>::iterator it =
+                                 pendingReads_.find(fileInfo.absolutePath());
+      if (it == pendingReads_.end() || it->second != generation)
+         return;
+      pendingReads_.erase(it);
+
+      FilePath filePath(fileInfo.absolutePath());
+      if (pContents->error)
       {
-         std::string code;
-         Error error = module_context::readAndDecodeFile(
-                                 filePath,
-                                 projects::projectContext().defaultEncoding(),
-                                 true,
-                                 &code);
-         if (error)
+         // log if not path not found error (this can happen if the
+         // file was removed after entering the indexing queue)
+         if (!core::isPathNotFoundError(pContents->error))
          {
-            // log if not path not found error (this can happen if the
-            // file was removed after entering the indexing queue)
-            if (!core::isPathNotFoundError(error))
-            {
-               error.addProperty("src-file", filePath.absolutePath());
-               LOG_ERROR(error);
-            }
-            return;
+            pContents->error.addProperty("src-file", filePath.absolutePath());
+            LOG_ERROR(pContents->error);
          }
-
-         // add index entry
-         std::string context = module_context::createAliasedPath(filePath);
-         pIndex.reset(new r_util::RSourceIndex(context, code));
+         return;
       }
 
+      // add index entry
+      TRACE_SCOPE("index", "code_search_index");
+      std::string context = module_context::createAliasedPath(filePath);
+      addIndexEntry(fileInfo, boost::shared_ptr<r_util::RSourceIndex>(
+                          new r_util::RSourceIndex(context, pContents->code)));
+   }
+
+   void addIndexEntry(const FileInfo& fileInfo,
+                      boost::shared_ptr<r_util::RSourceIndex> pIndex)
+   {
       // attempt to add the entry
       Entry entry(fileInfo, pIndex);
       pEntries_->insertEntry(entry);
@@ -861,6 +916,9 @@ private:
 
    void removeIndexEntry(const FileInfo& fileInfo)
    {
+      // discard any read of the file which is in progress
+      pendingReads_.erase(fileInfo.absolutePath());
+
       // create a fake entry with a null source index to pass to find
       Entry entry(fileInfo, boost::shared_ptr<r_util::RSourceIndex>());
 
@@ -933,6 +991,10 @@ private:
    // indexing queue
    bool indexing_;
    std::queue<core::system::FileChangeEvent> indexingQueue_;
+
+   // files being read in the background (and the generation of the read)
+   unsigned long generation_;
+   std::map<std::string, unsigned long> pendingReads_;
 };
 
 } // anonymous namespace
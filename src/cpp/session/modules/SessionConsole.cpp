@@ -173,7 +173,7 @@ Error initialize()
    using boost::bind;
    using namespace module_context;
    events().onClientInit.connect(bind(onClientInit));
-   events().onDetectChanges.connect(bind(onDetectChanges, _1));
+   events().onDetectChanges.connect("console", bind(onDetectChanges, _1));
 
    rmarkdown::notebook::events().onChunkExecCompleted.connect(
          bind(onChunkExecCompleted));
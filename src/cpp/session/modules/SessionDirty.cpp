@@ -173,7 +173,8 @@ Error initialize()
    // subscribe to events
    using boost::bind;
    module_context::events().onClientInit.connect(bind(onClientInit));
-   module_context::events().onDetectChanges.connect(bind(onDetectChanges, _1));
+   module_context::events().onDetectChanges.connect("dirty",
+                                                    bind(onDetectChanges, _1));
    source_database::events().onDocUpdated.connect(onDocUpdated);
    source_database::events().onDocRemoved.connect(onDocRemoved);
    source_database::events().onRemoveAll.connect(onRemoveAll);
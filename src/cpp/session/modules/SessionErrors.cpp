@@ -201,7 +201,8 @@ Error initialize()
 
    // Check to see whether the error handler has changed immediately after init
    // (to find changes from e.g. .Rprofile) and after every console prompt.
-   events().onConsolePrompt.connect(bind(detectHandlerChange,
+   events().onConsolePrompt.connect("errors",
+                                    bind(detectHandlerChange,
                                          pErrorHandler, false));
    events().onDeferredInit.connect(bind(detectHandlerChange,
                                         pErrorHandler, true));
@@ -24,8 +24,10 @@
 #include <sstream>
 #include <algorithm>
 
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
@@ -191,21 +193,48 @@ core::Error getFileContents(const json::JsonRpcRequest& request,
    return Success();
 }
    
-Error listFiles(const json::JsonRpcRequest& request, json::JsonRpcResponse* pResponse)
+// state shared between the background and main thread portions of listFiles
+struct ListFilesState
 {
-   // get args
-   std::string path;
-   bool monitor;
-   Error error = json::readParams(request.params, &path, &monitor);
-   if (error)
-      return error;
-   FilePath targetPath = module_context::resolveAliasedPath(path) ;
+   ListFilesState() : browseable(true) {}
 
-   json::Object result;
-   
-   // if this includes a request for monitoring
+   FilesListing listing;
+   bool browseable;
+};
+
+// listing requests which have been made (used to ensure that only the most
+// recent request starts monitoring if they complete out of order)
+unsigned long s_listFilesRequests = 0;
+
+// scan the directory on a background thread (all of the file system access
+// required for the listing is done here)
+void scanFilesListing(const FilePath& targetPath,
+                      boost::shared_ptr<ListFilesState> pState)
+{
+   FilesListingMonitor::scanFiles(targetPath, &pState->listing);
+
+#ifndef _WIN32
+   // on *nix systems, see if browsing above this path is possible
+   Error error = core::system::isFileReadable(targetPath.parent(),
+                                              &pState->browseable);
+   if (error && !core::isPathNotFoundError(error))
+      LOG_ERROR(error);
+#endif
+}
+
+void endListFiles(const FilePath& targetPath,
+                  bool monitor,
+                  unsigned long request,
+                  boost::shared_ptr<ListFilesState> pState,
+                  const json::JsonRpcFunctionContinuation& continuation)
+{
+   json::JsonRpcResponse response;
+
+   // if this includes a request for monitoring (and a later listing hasn't
+   // superseded this one)
+   Error error;
    core::json::Array jsonFiles;
-   if (monitor)
+   if (monitor && request == s_listFilesRequests)
    {
       // always stop existing if we have one
       s_filesListingMonitor.stop();
@@ -213,39 +242,68 @@ Error listFiles(const json::JsonRpcRequest& request, json::JsonRpcResponse* pRes
       // install a monitor only if we aren't already covered by the project monitor
       if (!session::projects::projectContext().isMonitoringDirectory(targetPath))
       {
-         error = s_filesListingMonitor.start(targetPath, &jsonFiles);
-         if (error)
-            return error;
+         error = s_filesListingMonitor.start(targetPath,
+                                             pState->listing,
+                                             &jsonFiles);
       }
       else
       {
-         error = FilesListingMonitor::listFiles(targetPath, &jsonFiles);
-         if (error)
-            return error;
+         error = FilesListingMonitor::listFiles(targetPath,
+                                                pState->listing,
+                                                &jsonFiles);
       }
    }
    else
    {
-      error = FilesListingMonitor::listFiles(targetPath, &jsonFiles);
-      if (error)
-         return error;
+      error = FilesListingMonitor::listFiles(targetPath,
+                                             pState->listing,
+                                             &jsonFiles);
    }
 
-   result["files"] = jsonFiles;
+   if (error)
+   {
+      continuation(error, &response);
+      return;
+   }
 
-   bool browseable = true;
+   json::Object result;
+   result["files"] = jsonFiles;
+   result["is_parent_browseable"] = pState->browseable;
 
-#ifndef _WIN32
-   // on *nix systems, see if browsing above this path is possible
-   error = core::system::isFileReadable(targetPath.parent(), &browseable);
-   if (error && !core::isPathNotFoundError(error))
-      LOG_ERROR(error);
-#endif
+   response.setResult(result);
+   continuation(Success(), &response);
+}
 
-   result["is_parent_browseable"] = browseable;
+// directories can be slow to list (e.g. network file systems) so the listing
+// is done in the background and the result returned once it is complete
+void listFiles(const json::JsonRpcRequest& request,
+               const json::JsonRpcFunctionContinuation& continuation)
+{
+   // get args
+   std::string path;
+   bool monitor;
+   Error error = json::readParams(request.params, &path, &monitor);
+   if (error)
+   {
+      json::JsonRpcResponse response;
+      continuation(error, &response);
+      return;
+   }
+   FilePath targetPath = module_context::resolveAliasedPath(path) ;
 
-   pResponse->setResult(result);
-   return Success();
+   if (monitor)
+      s_listFilesRequests++;
+
+   boost::shared_ptr<ListFilesState> pState(new ListFilesState());
+   module_context::scheduleBackgroundWork(
+            boost::bind(scanFilesListing, targetPath, pState),
+            boost::bind(endListFiles,
+                        targetPath,
+                        monitor,
+                        s_listFilesRequests,
+                        pState,
+                        continuation),
+            core::WorkPriorityHigh);
 }
 
 
@@ -1016,7 +1074,7 @@ Error initialize()
       (bind(registerRpcMethod, "stat", stat))
       (bind(registerRpcMethod, "is_text_file", isTextFile))
       (bind(registerRpcMethod, "get_file_contents", getFileContents))
-      (bind(registerRpcMethod, "list_files", listFiles))
+      (bind(registerAsyncRpcMethod, "list_files", listFiles))
       (bind(registerRpcMethod, "create_folder", createFolder))
       (bind(registerRpcMethod, "delete_files", deleteFiles))
       (bind(registerRpcMethod, "copy_file", copyFile))
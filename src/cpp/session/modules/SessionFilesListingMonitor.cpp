@@ -42,23 +42,27 @@ namespace modules {
 namespace files {
 
 Error FilesListingMonitor::start(const FilePath& filePath, json::Array* pJsonFiles)
+{
+   FilesListing listing;
+   scanFiles(filePath, &listing);
+   return start(filePath, listing, pJsonFiles);
+}
+
+Error FilesListingMonitor::start(const FilePath& filePath,
+                                 const FilesListing& listing,
+                                 json::Array* pJsonFiles)
 {
    // always stop existing
    stop();
 
-   // scan the directory (populates pJsonFiles out parameter)
-   std::vector<FilePath> files;
-   Error error = listFiles(filePath, &files, pJsonFiles);
+   // produce the listing (populates pJsonFiles out parameter)
+   Error error = listFiles(filePath, listing, pJsonFiles);
    if (error)
       return error;
 
-   // copy the file listing into a vector of FileInfo which we will order so that it can
-   // be compared with the initial scan of the file montor for changes
-   std::vector<FileInfo> prevFiles;
-   std::transform(files.begin(),
-                  files.end(),
-                  std::back_inserter(prevFiles),
-                  core::toFileInfo);
+   // the file listing is ordered so that it can be compared with the
+   // initial scan of the file montor for changes
+   const std::vector<FileInfo>& prevFiles = listing.files;
 
    // kickoff new monitor
    core::system::file_monitor::Callbacks cb;
@@ -169,32 +173,52 @@ void FilesListingMonitor::onUnregistered(core::system::file_monitor::Handle hand
    }
 }
 
+void FilesListingMonitor::scanFiles(const FilePath& rootPath,
+                                    FilesListing* pListing)
+{
+   // enumerate the files
+   std::vector<FilePath> files;
+   pListing->error = rootPath.children(&files);
+   if (pListing->error)
+      return;
+
+   // sort the files by name
+   std::sort(files.begin(), files.end(), core::compareAbsolutePathNoCase);
+
+   BOOST_FOREACH(const FilePath& filePath, files)
+   {
+      FileInfo fileInfo(filePath);
+      pListing->files.push_back(fileInfo);
+
+      // files which may have been deleted after the listing
+      if (filePath.exists())
+      {
+         pListing->items.push_back(std::make_pair(
+                        fileInfo, module_context::createFileSystemItem(fileInfo)));
+      }
+   }
+}
+
 Error FilesListingMonitor::listFiles(const FilePath& rootPath,
-                                     std::vector<FilePath>* pFiles,
+                                     const FilesListing& listing,
                                      json::Array* pJsonFiles)
 {
-   // enumerate the files
-   pFiles->clear();
-   core::Error error = rootPath.children(pFiles) ;
-   if (error)
-      return error;
+   if (listing.error)
+      return listing.error;
 
    using namespace source_control;
    boost::shared_ptr<FileDecorationContext> pCtx =
                   source_control::fileDecorationContext(rootPath);
 
-   // sort the files by name
-   std::sort(pFiles->begin(), pFiles->end(), core::compareAbsolutePathNoCase);
-
    // produce json listing
-   BOOST_FOREACH( core::FilePath& filePath, *pFiles)
+   typedef std::pair<FileInfo, json::Object> Item;
+   BOOST_FOREACH(const Item& item, listing.items)
    {
-      // files which may have been deleted after the listing or which
-      // are not end-user visible
-      if (filePath.exists() && module_context::fileListingFilter(core::FileInfo(filePath)))
+      // files which are not end-user visible
+      if (module_context::fileListingFilter(item.first))
       {
-         core::json::Object fileObject = module_context::createFileSystemItem(filePath);
-         pCtx->decorateFile(filePath, &fileObject);
+         core::json::Object fileObject = item.second;
+         pCtx->decorateFile(FilePath(item.first.absolutePath()), &fileObject);
          pJsonFiles->push_back(fileObject) ;
       }
    }
@@ -17,10 +17,13 @@
 #define SESSION_SESSION_FILES_LISTING_MONITOR_HPP
 
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <boost/utility.hpp>
 
+#include <core/Error.hpp>
+#include <core/FileInfo.hpp>
 #include <core/collection/Tree.hpp>
 
 #include <core/json/Json.hpp>
@@ -28,9 +31,7 @@
 
 namespace rstudio {
 namespace core {
-   class Error;
    class FilePath;
-   class FileInfo;
    namespace system {
       class FileChangeEvent;
    }
@@ -47,12 +48,29 @@ namespace modules {
 
 namespace files {
 
+// the contents of a directory as scanned by FilesListingMonitor::scanFiles
+struct FilesListing
+{
+   core::Error error;
+
+   // every file in the directory (sorted by name)
+   std::vector<core::FileInfo> files;
+
+   // file system items for the files which still existed once listed
+   std::vector<std::pair<core::FileInfo, core::json::Object> > items;
+};
+
 class FilesListingMonitor : boost::noncopyable
 {
 public:
    // kickoff monitoring
    core::Error start(const core::FilePath& filePath, core::json::Array* pJsonFiles);
 
+   // kickoff monitoring using a listing which has already been scanned
+   core::Error start(const core::FilePath& filePath,
+                     const FilesListing& listing,
+                     core::json::Array* pJsonFiles);
+
    void stop();
 
    // what path are we currently monitoring?
@@ -63,10 +81,24 @@ public:
    static core::Error listFiles(const core::FilePath& rootPath,
                                 core::json::Array* pJsonFiles)
    {
-      std::vector<core::FilePath> files;
-      return listFiles(rootPath, &files, pJsonFiles);
+      FilesListing listing;
+      scanFiles(rootPath, &listing);
+      return listFiles(rootPath, listing, pJsonFiles);
    }
 
+   // scan the files in a directory. this performs all of the file system
+   // access required for a listing and doesn't modify any session state so
+   // it can be called on a background thread
+   static void scanFiles(const core::FilePath& rootPath,
+                         FilesListing* pListing);
+
+   // produce the json listing for a scanned directory (filtering out files
+   // which aren't end-user visible and decorating the files with their
+   // source control status)
+   static core::Error listFiles(const core::FilePath& rootPath,
+                                const FilesListing& listing,
+                                core::json::Array* pJsonFiles);
+
 private:
    // stateful handlers for registration and unregistration
    void onRegistered(core::system::file_monitor::Handle handle,
@@ -76,11 +108,6 @@ private:
 
    void onUnregistered(core::system::file_monitor::Handle handle);
 
-   // helpers
-   static core::Error listFiles(const core::FilePath& rootPath,
-                                std::vector<core::FilePath>* pFiles,
-                                core::json::Array* pJsonFiles);
-
 private:
    core::FilePath currentPath_;
    core::system::file_monitor::Handle currentHandle_;
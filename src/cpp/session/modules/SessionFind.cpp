@@ -16,16 +16,20 @@
 #include "SessionFind.hpp"
 
 #include <algorithm>
+#include <deque>
+#include <set>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/bind.hpp>
 #include <boost/enable_shared_from_this.hpp>
 
 #include <core/Exec.hpp>
+#include <core/FileSearch.hpp>
 #include <core/StringUtils.hpp>
-#include <core/system/Environment.hpp>
-#include <core/system/Process.hpp>
-#include <core/system/ShellUtils.hpp>
+#include <core/Thread.hpp>
+#include <core/TrigramIndex.hpp>
+#include <core/system/FileChangeEvent.hpp>
+#include <core/system/System.hpp>
 
 #include <r/RUtil.hpp>
 
@@ -193,20 +197,34 @@ FindInFilesState& findResults()
    return *s_pFindResults;
 }
 
-class GrepOperation : public boost::enable_shared_from_this<GrepOperation>
+// directories which are never searched (along with the website output
+// directory, if any)
+const char * const kExcludedDirectories[] = {
+   ".Rproj.user", ".git", ".svn", "packrat/lib", "packrat/src"
+};
+
+// interval at which matches are collected and sent to the client
+const int kFindResultIntervalMs = 100;
+
+class FindOperation : public boost::enable_shared_from_this<FindOperation>
 {
 public:
-   static boost::shared_ptr<GrepOperation> create(const std::string& encoding,
-                                                  const FilePath& tempFile)
+   static boost::shared_ptr<FindOperation> create(
+                              const std::string& encoding,
+                              const FilePath& rootPath,
+                              const file_search::SearchOptions& options)
    {
-      return boost::shared_ptr<GrepOperation>(new GrepOperation(encoding,
-                                                                tempFile));
+      return boost::shared_ptr<FindOperation>(new FindOperation(encoding,
+                                                                rootPath,
+                                                                options));
    }
 
 private:
-   GrepOperation(const std::string& encoding,
-                 const FilePath& tempFile)
-      : firstDecodeError_(true), encoding_(encoding), tempFile_(tempFile)
+   FindOperation(const std::string& encoding,
+                 const FilePath& rootPath,
+                 const file_search::SearchOptions& options)
+      : firstDecodeError_(true), encoding_(encoding),
+        search_(rootPath, options)
    {
       handle_ = core::system::generateUuid(false);
    }
@@ -217,26 +235,22 @@ public:
       return handle_;
    }
 
-   core::system::ProcessCallbacks createProcessCallbacks()
+   Error start()
    {
-      core::system::ProcessCallbacks callbacks;
-      callbacks.onContinue = boost::bind(&GrepOperation::onContinue,
-                                         shared_from_this(),
-                                         _1);
-      callbacks.onStdout = boost::bind(&GrepOperation::onStdout,
-                                       shared_from_this(),
-                                       _1, _2);
-      callbacks.onStderr = boost::bind(&GrepOperation::onStderr,
-                                       shared_from_this(),
-                                       _1, _2);
-      callbacks.onExit = boost::bind(&GrepOperation::onExit,
-                                     shared_from_this(),
-                                     _1);
-      return callbacks;
+      Error error = search_.start();
+      if (error)
+         return error;
+
+      module_context::schedulePeriodicWork(
+               boost::posix_time::milliseconds(kFindResultIntervalMs),
+               boost::bind(&FindOperation::onPeriodicWork, shared_from_this()),
+               false,   // not only when idle
+               false);  // not immediately
+      return Success();
    }
 
 private:
-   bool onContinue(const core::system::ProcessOperations& ops) const
+   bool onContinue() const
    {
       return findResults().isRunning() && findResults().handle() == handle();
    }
@@ -250,7 +264,7 @@ private:
       Error error = r::util::iconvstr(encoded, encoding_, "UTF-8", true,
                                       &decoded);
 
-      // Log error, but only once per grep operation
+      // Log error, but only once per find operation
       if (error && firstDecodeError_)
       {
          firstDecodeError_ = false;
@@ -260,41 +274,49 @@ private:
       return decoded;
    }
 
-   void processContents(std::string* pContent,
+   void processContents(const file_search::LineMatch& match,
+                        std::string* pContent,
                         json::Array* pMatchOn,
                         json::Array* pMatchOff)
    {
-      using namespace boost;
-
+      // trim the line (adjusting the match offsets accordingly)
+      const std::string& line = match.contents;
+      std::size_t begin = line.find_first_not_of(" \t\n\v\f\r");
+      if (begin == std::string::npos)
+         begin = line.size();
+      std::size_t end = line.find_last_not_of(" \t\n\v\f\r");
+      end = (end == std::string::npos) ? begin : end + 1;
+
+      // decode the text up to each match boundary so that the offsets can
+      // be given in characters
       std::string decodedLine;
-
-      std::string::iterator inputPos = pContent->begin();
-
-      smatch match;
-      while (regex_search(std::string(inputPos, pContent->end()), match,
-                          regex("\x1B\\[(\\d\\d)?m(\x1B\\[K)?")))
+      std::size_t inputPos = begin;
+      typedef std::pair<std::size_t, std::size_t> Range;
+      BOOST_FOREACH(const Range& range, match.matches)
       {
-         std::string match1 = match[1];
-
-         decodedLine.append(decode(
-               std::string(inputPos, inputPos + match.position())));
-
-         inputPos += match.position() + match.length();
-
-         size_t charSize;
-         Error error = string_utils::utf8Distance(decodedLine.begin(),
-                                                  decodedLine.end(),
-                                                  &charSize);
-         if (error)
-            charSize = decodedLine.size();
-
-         if (match1 == "01")
-            pMatchOn->push_back(static_cast<int>(charSize));
-         else
-            pMatchOff->push_back(static_cast<int>(charSize));
+         for (int i = 0; i < 2; i++)
+         {
+            std::size_t pos = (i == 0) ? range.first : range.second;
+            pos = std::min(std::max(pos, begin), end);
+
+            decodedLine.append(decode(line.substr(inputPos, pos - inputPos)));
+            inputPos = pos;
+
+            size_t charSize;
+            Error error = string_utils::utf8Distance(decodedLine.begin(),
+                                                     decodedLine.end(),
+                                                     &charSize);
+            if (error)
+               charSize = decodedLine.size();
+
+            if (i == 0)
+               pMatchOn->push_back(static_cast<int>(charSize));
+            else
+               pMatchOff->push_back(static_cast<int>(charSize));
+         }
       }
-      if (inputPos != pContent->end())
-         decodedLine.append(decode(std::string(inputPos, pContent->end())));
+      if (inputPos < end)
+         decodedLine.append(decode(line.substr(inputPos, end - inputPos)));
 
       if (decodedLine.size() > 300)
       {
@@ -305,71 +327,38 @@ private:
       *pContent = decodedLine;
    }
 
-   void onStdout(const core::system::ProcessOperations& ops, const std::string& data)
+   bool onPeriodicWork()
    {
+      // stop if this find has been stopped or superseded
+      if (!onContinue())
+      {
+         search_.stop();
+         onCompleted();
+         return false;
+      }
+
+      std::vector<file_search::LineMatch> matches;
+      bool more = search_.takeMatches(&matches);
+
       json::Array files;
       json::Array lineNums;
       json::Array contents;
       json::Array matchOns;
       json::Array matchOffs;
 
-      int recordsToProcess = MAX_COUNT + 1 - findResults().resultCount();
-      if (recordsToProcess < 0)
-         recordsToProcess = 0;
-
-      std::string websiteOutputDir = module_context::websiteOutputDir();
-      if (!websiteOutputDir.empty())
-         websiteOutputDir = "/" + websiteOutputDir + "/";
-
-      stdOutBuf_.append(data);
-      size_t nextLineStart = 0;
-      size_t pos = -1;
-      while (recordsToProcess &&
-             std::string::npos != (pos = stdOutBuf_.find('\n', pos + 1)))
+      BOOST_FOREACH(const file_search::LineMatch& match, matches)
       {
-         std::string line = stdOutBuf_.substr(nextLineStart, pos - nextLineStart);
-         nextLineStart = pos + 1;
+         std::string file = module_context::createAliasedPath(match.file);
 
-         boost::smatch match;
-         if (boost::regex_match(line, match, boost::regex("^((?:[a-zA-Z]:)?[^:]+):(\\d+):(.*)")))
-         {
-            std::string file = module_context::createAliasedPath(
-                  FilePath(string_utils::systemToUtf8(match[1])));
-
-            if (file.find("/.Rproj.user/") != std::string::npos)
-               continue;
-            if (file.find("/.git/") != std::string::npos)
-               continue;
-            if (file.find("/.svn/") != std::string::npos)
-               continue;
-            if (file.find("/packrat/lib/") != std::string::npos)
-               continue;
-            if (file.find("/packrat/src/") != std::string::npos)
-               continue;
-
-            if (!websiteOutputDir.empty() &&
-                file.find(websiteOutputDir) != std::string::npos)
-               continue;
-
-            int lineNum = safe_convert::stringTo<int>(std::string(match[2]), -1);
-            std::string lineContents = match[3];
-            boost::algorithm::trim(lineContents);
-            json::Array matchOn, matchOff;
-            processContents(&lineContents, &matchOn, &matchOff);
-
-            files.push_back(file);
-            lineNums.push_back(lineNum);
-            contents.push_back(lineContents);
-            matchOns.push_back(matchOn);
-            matchOffs.push_back(matchOff);
-
-            recordsToProcess--;
-         }
-      }
+         std::string lineContents;
+         json::Array matchOn, matchOff;
+         processContents(match, &lineContents, &matchOn, &matchOff);
 
-      if (nextLineStart)
-      {
-         stdOutBuf_.erase(0, nextLineStart);
+         files.push_back(file);
+         lineNums.push_back(match.line);
+         contents.push_back(lineContents);
+         matchOns.push_back(matchOn);
+         matchOffs.push_back(matchOff);
       }
 
       if (files.size() > 0)
@@ -395,31 +384,446 @@ private:
                   ClientEvent(client_events::kFindResult, result));
       }
 
-      if (recordsToProcess <= 0)
-         findResults().onFindEnd(handle());
-   }
+      if (!more)
+      {
+         onCompleted();
+         return false;
+      }
 
-   void onStderr(const core::system::ProcessOperations& ops, const std::string& data)
-   {
-      LOG_ERROR_MESSAGE("grep: " + data);
+      return true;
    }
 
-   void onExit(int exitCode)
+   void onCompleted()
    {
       findResults().onFindEnd(handle());
       module_context::enqueClientEvent(
             ClientEvent(client_events::kFindOperationEnded, handle()));
-      if (!tempFile_.empty())
-         tempFile_.removeIfExists();
    }
 
    bool firstDecodeError_;
    std::string encoding_;
-   FilePath tempFile_;
-   std::string stdOutBuf_;
+   file_search::FileSearch search_;
    std::string handle_;
 };
 
+// number of files indexed by each unit of background work
+const std::size_t kIndexBatchSize = 64;
+
+// minimum interval between saves of the index while the session is running
+const long kSaveIntervalSeconds = 300;
+
+// delay before indexing files again which were written in the same second
+// as they were indexed
+const long kReindexDelaySeconds = 2;
+
+bool isExcludedPath(const std::string& path)
+{
+   BOOST_FOREACH(const char* dir, kExcludedDirectories)
+   {
+      if (path.find(std::string("/") + dir + "/") != std::string::npos)
+         return true;
+   }
+
+   std::string websiteOutputDir = module_context::websiteOutputDir();
+   if (!websiteOutputDir.empty() &&
+       path.find("/" + websiteOutputDir + "/") != std::string::npos)
+      return true;
+
+   return false;
+}
+
+struct IndexedFile
+{
+   IndexedFile() : lastWriteTime(0), indexTime(0), indexable(false) {}
+
+   FilePath filePath;
+   std::time_t lastWriteTime;
+   std::time_t indexTime;
+   bool indexable;
+   file_search::Trigrams trigrams;
+};
+
+typedef std::vector<IndexedFile> IndexedFiles;
+
+// the trigrams of the files in the project (used to skip the files which
+// can't contain a match). this is maintained in the background from the
+// project file monitor and saved in the project scratch path when the
+// session exits so it needn't be rebuilt
+class ProjectTextIndex : boost::noncopyable
+{
+public:
+   ProjectTextIndex()
+      : enabled_(false),
+        indexing_(false),
+        dirty_(false),
+        saving_(false),
+        reindexScheduled_(false),
+        generation_(0)
+   {
+   }
+
+   void onMonitoringEnabled(const tree<core::FileInfo>& files)
+   {
+      if (session::options().findIndexMb() <= 0)
+         return;
+
+      generation_++;
+      enabled_ = false;
+      queue_.clear();
+
+      // load the saved index in the background then index any files which
+      // have changed since it was saved
+      boost::shared_ptr<file_search::TrigramIndex> pIndex(
+                                 new file_search::TrigramIndex(maxBytes()));
+      boost::shared_ptr<std::vector<FileInfo> > pFiles(
+                                 new std::vector<FileInfo>());
+      for (tree<FileInfo>::leaf_iterator it = files.begin_leaf();
+           it != files.end_leaf(); ++it)
+      {
+         if (!it->isDirectory() && !isExcludedPath(it->absolutePath()))
+            pFiles->push_back(*it);
+      }
+
+      module_context::scheduleBackgroundWork(
+               boost::bind(readIndex, indexPath(), pIndex),
+               boost::bind(&ProjectTextIndex::onIndexRead, this,
+                           generation_, pIndex, pFiles),
+               core::WorkPriorityLow);
+   }
+
+   void onFilesChanged(const std::vector<core::system::FileChangeEvent>& events)
+   {
+      if (!enabled_)
+         return;
+
+      BOOST_FOREACH(const core::system::FileChangeEvent& event, events)
+      {
+         const FileInfo& fileInfo = event.fileInfo();
+         if (isExcludedPath(fileInfo.absolutePath()))
+            continue;
+
+         switch(event.type())
+         {
+         case core::system::FileChangeEvent::FileAdded:
+         case core::system::FileChangeEvent::FileModified:
+            if (!fileInfo.isDirectory())
+               queue_.push_back(FilePath(fileInfo.absolutePath()));
+            break;
+
+         case core::system::FileChangeEvent::FileRemoved:
+            remove(fileInfo);
+            break;
+
+         default:
+            break;
+         }
+      }
+
+      indexNextBatch();
+   }
+
+   void onMonitoringDisabled()
+   {
+      save();
+
+      generation_++;
+      enabled_ = false;
+      queue_.clear();
+      pIndex_.reset();
+   }
+
+   // write the index in the background (a copy is written so that the
+   // index can continue to be updated meanwhile)
+   void save()
+   {
+      if (!enabled_ || !dirty_ || saving_)
+         return;
+
+      boost::shared_ptr<const file_search::TrigramIndex> pIndex(
+                                 new file_search::TrigramIndex(*pIndex_));
+      dirty_ = false;
+      saving_ = true;
+      lastSaved_ = boost::posix_time::second_clock::universal_time();
+      module_context::scheduleBackgroundWork(
+               boost::bind(writeIndex, indexPath(), pIndex),
+               boost::bind(&ProjectTextIndex::onIndexWritten, this),
+               core::WorkPriorityLow);
+   }
+
+   // write the index on this thread (when the session exits, as work in
+   // the background wouldn't complete)
+   void saveNow()
+   {
+      if (!enabled_ || !dirty_)
+         return;
+
+      writeIndex(indexPath(), pIndex_);
+      dirty_ = false;
+   }
+
+   // files within the directory which can't contain a match for the
+   // pattern (NULL if the index doesn't cover the directory)
+   boost::shared_ptr<const file_search::ExcludedFiles> excludedFiles(
+                                             const FilePath& dirPath,
+                                             const std::string& pattern,
+                                             bool asRegex,
+                                             bool ignoreCase)
+   {
+      boost::shared_ptr<file_search::ExcludedFiles> pExcluded;
+      if (!enabled_ ||
+          !dirPath.isWithin(projects::projectContext().directory()))
+      {
+         return pExcluded;
+      }
+
+      std::string literal = file_search::FileSearch::requiredLiteral(
+                                                pattern, asRegex, ignoreCase);
+      pExcluded.reset(new file_search::ExcludedFiles());
+      pIndex_->excludedFiles(literal, pExcluded.get());
+      return pExcluded;
+   }
+
+private:
+   static std::size_t maxBytes()
+   {
+      return static_cast<std::size_t>(session::options().findIndexMb()) *
+             1024 * 1024;
+   }
+
+   static FilePath indexPath()
+   {
+      return module_context::scopedScratchPath().childPath(
+                                                   "find-index/trigrams");
+   }
+
+   static void readIndex(const FilePath& path,
+                         boost::shared_ptr<file_search::TrigramIndex> pIndex)
+   {
+      if (!path.exists())
+         return;
+
+      Error error = pIndex->read(path);
+      if (error)
+         LOG_ERROR(error);
+   }
+
+   static void writeIndex(
+                     const FilePath& path,
+                     boost::shared_ptr<const file_search::TrigramIndex> pIndex)
+   {
+      Error error = path.parent().ensureDirectory();
+      if (!error)
+         error = pIndex->write(path);
+      if (error)
+         LOG_ERROR(error);
+   }
+
+   void onIndexWritten()
+   {
+      saving_ = false;
+   }
+
+   static void computeTrigrams(boost::shared_ptr<IndexedFiles> pFiles)
+   {
+      BOOST_FOREACH(IndexedFile& file, *pFiles)
+      {
+         file.lastWriteTime = file.filePath.lastWriteTime();
+         file.indexTime = std::time(NULL);
+         file.indexable = file.filePath.exists() &&
+                          file_search::TrigramIndex::computeTrigrams(
+                                                   file.filePath,
+                                                   &file.trigrams);
+      }
+   }
+
+   void onIndexRead(unsigned long generation,
+                    boost::shared_ptr<file_search::TrigramIndex> pIndex,
+                    boost::shared_ptr<std::vector<FileInfo> > pFiles)
+   {
+      if (generation != generation_)
+         return;
+
+      pIndex_ = pIndex;
+      enabled_ = true;
+
+      // remove files which no longer exist
+      std::set<std::string> paths;
+      BOOST_FOREACH(const FileInfo& fileInfo, *pFiles)
+      {
+         paths.insert(fileInfo.absolutePath());
+      }
+      BOOST_FOREACH(const std::string& path, pIndex_->paths())
+      {
+         if (paths.find(path) == paths.end())
+         {
+            pIndex_->remove(path);
+            dirty_ = true;
+         }
+      }
+
+      // index files which have changed
+      BOOST_FOREACH(const FileInfo& fileInfo, *pFiles)
+      {
+         if (!pIndex_->isCurrent(fileInfo.absolutePath(),
+                                 fileInfo.lastWriteTime()))
+         {
+            queue_.push_back(FilePath(fileInfo.absolutePath()));
+         }
+      }
+
+      indexNextBatch();
+   }
+
+   void indexNextBatch()
+   {
+      if (indexing_ || queue_.empty())
+         return;
+
+      boost::shared_ptr<IndexedFiles> pFiles(new IndexedFiles());
+      while (!queue_.empty() && pFiles->size() < kIndexBatchSize)
+      {
+         IndexedFile file;
+         file.filePath = queue_.front();
+         pFiles->push_back(file);
+         queue_.pop_front();
+      }
+
+      indexing_ = true;
+      module_context::scheduleBackgroundWork(
+               boost::bind(computeTrigrams, pFiles),
+               boost::bind(&ProjectTextIndex::onBatchIndexed, this,
+                           generation_, pFiles),
+               core::WorkPriorityLow);
+   }
+
+   void onBatchIndexed(unsigned long generation,
+                       boost::shared_ptr<IndexedFiles> pFiles)
+   {
+      indexing_ = false;
+      if (generation != generation_)
+         return;
+
+      // files which can't be indexed (or don't fit within the budget) are
+      // left out of the index (and so are always searched). write times
+      // only have a resolution of seconds so a file written in the second
+      // it was indexed could have changed since without its write time
+      // changing. these are left out too, and indexed again shortly
+      bool reindex = false;
+      BOOST_FOREACH(const IndexedFile& file, *pFiles)
+      {
+         std::string path = file.filePath.absolutePath();
+         bool racy = file.lastWriteTime >= file.indexTime;
+         if (racy)
+         {
+            racyFiles_.push_back(file.filePath);
+            reindex = true;
+         }
+
+         if (!file.indexable || racy ||
+             !pIndex_->update(path, file.lastWriteTime, file.trigrams))
+         {
+            pIndex_->remove(path);
+         }
+      }
+      dirty_ = true;
+
+      if (reindex && !reindexScheduled_)
+      {
+         reindexScheduled_ = true;
+         module_context::scheduleDelayedWork(
+                  boost::posix_time::seconds(kReindexDelaySeconds),
+                  boost::bind(&ProjectTextIndex::reindexRacyFiles, this,
+                              generation_),
+                  false);
+      }
+
+      indexNextBatch();
+
+      // save the index once it has caught up with the changes (so there's
+      // usually nothing left to save when the session exits)
+      if (!indexing_ &&
+          (lastSaved_.is_not_a_date_time() ||
+           boost::posix_time::second_clock::universal_time() - lastSaved_ >
+                        boost::posix_time::seconds(kSaveIntervalSeconds)))
+      {
+         save();
+      }
+   }
+
+   void reindexRacyFiles(unsigned long generation)
+   {
+      reindexScheduled_ = false;
+      if (generation != generation_)
+      {
+         racyFiles_.clear();
+         return;
+      }
+
+      queue_.insert(queue_.end(), racyFiles_.begin(), racyFiles_.end());
+      racyFiles_.clear();
+      indexNextBatch();
+   }
+
+   void remove(const FileInfo& fileInfo)
+   {
+      std::string path = fileInfo.absolutePath();
+      pIndex_->remove(path);
+
+      // removing a directory removes the files within it
+      if (fileInfo.isDirectory())
+      {
+         std::string prefix = path + "/";
+         BOOST_FOREACH(const std::string& indexed, pIndex_->paths())
+         {
+            if (boost::algorithm::starts_with(indexed, prefix))
+               pIndex_->remove(indexed);
+         }
+      }
+
+      dirty_ = true;
+   }
+
+private:
+   bool enabled_;
+   bool indexing_;
+   bool dirty_;
+   bool saving_;
+   bool reindexScheduled_;
+   boost::posix_time::ptime lastSaved_;
+   unsigned long generation_;
+   boost::shared_ptr<file_search::TrigramIndex> pIndex_;
+   std::deque<FilePath> queue_;
+   std::vector<FilePath> racyFiles_;
+};
+
+ProjectTextIndex& projectTextIndex()
+{
+   static ProjectTextIndex* s_pIndex = NULL;
+   if (s_pIndex == NULL)
+      s_pIndex = new ProjectTextIndex();
+   return *s_pIndex;
+}
+
+void onFileMonitorEnabled(const tree<core::FileInfo>& files)
+{
+   projectTextIndex().onMonitoringEnabled(files);
+}
+
+void onFilesChanged(const std::vector<core::system::FileChangeEvent>& events)
+{
+   projectTextIndex().onFilesChanged(events);
+}
+
+void onFileMonitorDisabled()
+{
+   projectTextIndex().onMonitoringDisabled();
+}
+
+void onShutdown(bool)
+{
+   projectTextIndex().saveNow();
+}
+
 } // namespace
 
 core::Error beginFind(const json::JsonRpcRequest& request,
@@ -439,26 +843,6 @@ core::Error beginFind(const json::JsonRpcRequest& request,
    if (error)
       return error;
 
-   core::system::ProcessOptions options;
-
-   core::system::Options childEnv;
-   core::system::environment(&childEnv);
-   core::system::setenv(&childEnv, "GREP_COLOR", "01");
-   core::system::setenv(&childEnv, "GREP_COLORS", "ne:fn=:ln=:se=:mt=01");
-#ifdef _WIN32
-   FilePath gnuGrepPath = session::options().gnugrepPath();
-   core::system::addToPath(
-            &childEnv,
-            string_utils::utf8ToSystem(gnuGrepPath.absolutePath()));
-#endif
-   options.environment = childEnv;
-
-   // Put the grep pattern in a file
-   FilePath tempFile = module_context::tempFile("rs_grep", "txt");
-   boost::shared_ptr<std::ostream> pStream;
-   error = tempFile.open_w(&pStream);
-   if (error)
-      return error;
    std::string encoding = projects::projectContext().hasProject() ?
                           projects::projectContext().defaultEncoding() :
                           userSettings().defaultEncoding();
@@ -474,56 +858,52 @@ core::Error beginFind(const json::JsonRpcRequest& request,
       encodedString = searchString;
    }
 
-   *pStream << encodedString << std::endl;
-   pStream.reset(); // release file handle
-
-   boost::shared_ptr<GrepOperation> ptrGrepOp = GrepOperation::create(encoding,
-                                                                      tempFile);
-   core::system::ProcessCallbacks callbacks =
-                                       ptrGrepOp->createProcessCallbacks();
-
-#ifdef _WIN32
-   shell_utils::ShellCommand cmd(gnuGrepPath.complete("grep"));
-#else
-   shell_utils::ShellCommand cmd("grep");
-#endif
-   cmd << "-rHn" << "--binary-files=without-match" << "--color=always";
-#ifndef _WIN32
-   cmd << "--devices=skip";
-#endif
-
-   if (ignoreCase)
-      cmd << "-i";
-
-   // Use -f to pass pattern via file, so we don't have to worry about
-   // escaping double quotes, etc.
-   cmd << "-f";
-   cmd << tempFile;
-   if (!asRegex)
-      cmd << "-F";
+   file_search::SearchOptions options;
+   options.pattern = encodedString;
+   options.asRegex = asRegex;
+   options.ignoreCase = ignoreCase;
+   options.maxMatches = MAX_COUNT + 1;
+   options.threads = std::max(2U, std::min(8U,
+                                 boost::thread::hardware_concurrency()));
 
    BOOST_FOREACH(json::Value filePattern, filePatterns)
    {
-      cmd << "--include=" + filePattern.get_str();
+      options.filePatterns.push_back(filePattern.get_str());
    }
 
-   cmd << shell_utils::EscapeFilesOnly << "--" << shell_utils::EscapeAll;
-   cmd << module_context::resolveAliasedPath(directory);
+   // excluded directories are pruned rather than searched and filtered
+   std::copy(kExcludedDirectories,
+             kExcludedDirectories + (sizeof(kExcludedDirectories) /
+                                     sizeof(kExcludedDirectories[0])),
+             std::back_inserter(options.excludeDirectories));
+   std::string websiteOutputDir = module_context::websiteOutputDir();
+   if (!websiteOutputDir.empty())
+      options.excludeDirectories.push_back(websiteOutputDir);
+
+   // use the project index to skip files which can't contain a match
+   FilePath rootPath = module_context::resolveAliasedPath(directory);
+   options.pExcludedFiles = projectTextIndex().excludedFiles(rootPath,
+                                                             encodedString,
+                                                             asRegex,
+                                                             ignoreCase);
+
+   boost::shared_ptr<FindOperation> ptrFindOp = FindOperation::create(
+                           encoding,
+                           rootPath,
+                           options);
 
    // Clear existing results
    findResults().clear();
 
-   error = module_context::processSupervisor().runCommand(cmd,
-                                                          options,
-                                                          callbacks);
+   error = ptrFindOp->start();
    if (error)
       return error;
 
-   findResults().onFindBegin(ptrGrepOp->handle(),
+   findResults().onFindBegin(ptrFindOp->handle(),
                              searchString,
                              directory,
                              asRegex);
-   pResponse->setResult(ptrGrepOp->handle());
+   pResponse->setResult(ptrFindOp->handle());
 
    return Success();
 }
@@ -586,6 +966,15 @@ core::Error initialize()
    // register suspend handler
    addSuspendHandler(SuspendHandler(bind(onSuspend, _2), onResume));
 
+   // maintain the project text index (no-op if there is no project)
+   session::projects::FileMonitorCallbacks cb;
+   cb.onMonitoringEnabled = onFileMonitorEnabled;
+   cb.onFilesChanged = onFilesChanged;
+   cb.onMonitoringDisabled = onFileMonitorDisabled;
+   projects::projectContext().subscribeToFileMonitor("Find in files indexing",
+                                                     cb);
+   events().onShutdown.connect(onShutdown);
+
    // install handlers
    ExecBlock initBlock ;
    initBlock.addFunctions()
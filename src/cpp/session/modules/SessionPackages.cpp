@@ -504,7 +504,8 @@ void onDeferredInit(bool newSession)
 
    // monitor libPaths for changes
    detectLibPathsChanges();
-   module_context::events().onDetectChanges.connect(onDetectChanges);
+   module_context::events().onDetectChanges.connect("packages",
+                                                    onDetectChanges);
 
    // ensure we have a secure connection to CRAN
    module_context::reconcileSecureDownloadConfiguration();
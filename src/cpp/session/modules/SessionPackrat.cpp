@@ -233,13 +233,11 @@ bool addDescContent(int level, const FilePath& path, std::string* pDescContent)
    return true;
 }
 
-// computes a hash of the content of all DESCRIPTION files in the Packrat
-// private library
-std::string computeLibraryHash()
+// computes a hash of the content of all DESCRIPTION files in the given
+// library (this doesn't depend on any session state so it can be called
+// from a background thread)
+std::string computeLibraryHash(const FilePath& libraryPath)
 {
-   FilePath libraryPath = 
-      projects::projectContext().directory().complete(kPackratLibPath);
-
    // find all DESCRIPTION files in the library and concatenate them to form
    // a hashable state
    std::string descFileContent;
@@ -252,6 +250,14 @@ std::string computeLibraryHash()
    return hash::crc32HexHash(descFileContent);
 }
 
+// computes a hash of the content of all DESCRIPTION files in the Packrat
+// private library
+std::string computeLibraryHash()
+{
+   return computeLibraryHash(
+      projects::projectContext().directory().complete(kPackratLibPath));
+}
+
 // computes the hash of the current project's lockfile
 std::string computeLockfileHash()
 {
@@ -565,6 +571,59 @@ void onLibraryUpdate(const std::string& oldHash, const std::string& newHash)
       packages::enquePackageStateChanged();
 }
 
+// hashing the library reads every DESCRIPTION file within it so it is done
+// on a background thread. changes which arrive while a hash is being
+// computed are coalesced into a single further check
+bool s_libraryHashRunning = false;
+bool s_libraryHashPending = false;
+
+void checkLibraryHash();
+
+void computeLibraryHashInBackground(const FilePath& libraryPath,
+                                    boost::shared_ptr<std::string> pHash)
+{
+   *pHash = computeLibraryHash(libraryPath);
+}
+
+void onLibraryHashComputed(boost::shared_ptr<std::string> pNewHash)
+{
+   s_libraryHashRunning = false;
+
+   // the library changed again while we were hashing it
+   if (s_libraryHashPending)
+   {
+      s_libraryHashPending = false;
+      checkLibraryHash();
+      return;
+   }
+
+   // a Packrat action started while we were hashing (the hashes are
+   // resolved once it completes)
+   if (s_runningPackratAction != PACKRAT_ACTION_NONE)
+      return;
+
+   std::string oldHash = getHash(HASH_TYPE_LIBRARY, HASH_STATE_OBSERVED);
+   if (oldHash != *pNewHash)
+      onLibraryUpdate(oldHash, *pNewHash);
+}
+
+void checkLibraryHash()
+{
+   if (s_libraryHashRunning)
+   {
+      s_libraryHashPending = true;
+      return;
+   }
+
+   s_libraryHashRunning = true;
+   FilePath libraryPath =
+      projects::projectContext().directory().complete(kPackratLibPath);
+   boost::shared_ptr<std::string> pHash(new std::string());
+   module_context::scheduleBackgroundWork(
+            boost::bind(computeLibraryHashInBackground, libraryPath, pHash),
+            boost::bind(onLibraryHashComputed, pHash));
+}
+
 void onFileChanged(FilePath sourceFilePath)
 {
    // ignore file changes while Packrat is running
@@ -595,7 +654,7 @@ void onFileChanged(FilePath sourceFilePath)
          return;
       }
       PACKRAT_TRACE("detected change to library file " << sourceFilePath);
-      checkHashes(HASH_TYPE_LIBRARY, HASH_STATE_OBSERVED, onLibraryUpdate);
+      checkLibraryHash();
    }
 }
 
@@ -703,7 +762,7 @@ Error initPackratMonitoring()
    cb.onFilesChanged = onFilesChanged;
    projects::projectContext().subscribeToFileMonitor("Packrat", cb);
    module_context::events().onSourceEditorFileSaved.connect(onFileChanged);
-   module_context::events().onConsolePrompt.connect(onConsolePrompt);
+   module_context::events().onConsolePrompt.connect("packrat", onConsolePrompt);
 
    return Success();
 }
@@ -856,7 +915,8 @@ void afterSessionInitHook(bool newSession)
       if (error)
          LOG_ERROR(error);
 
-      module_context::events().onDetectChanges.connect(onDetectChanges);
+      module_context::events().onDetectChanges.connect("packrat",
+                                                       onDetectChanges);
 
       // check whether there are pending actions and if there are then
       // ensure that the packages pane is activated. we do this on a
@@ -51,6 +51,9 @@ namespace {
 
 // locations
 #define kGraphics "/graphics"
+
+// time of the last render (used to limit renders during animations)
+boost::posix_time::ptime s_lastRenderTime(boost::posix_time::not_a_date_time);
    
 Error nextPlot(const json::JsonRpcRequest& request, 
                json::JsonRpcResponse* pResponse)
@@ -650,6 +653,9 @@ void handleGraphicsRequest(const http::Request& request,
    // calculate the path to the png
    using namespace rstudio::r::session;
    FilePath imagePath = graphics::display().imagePath(filename);
+
+   // the image may still be being encoded in the background
+   graphics::waitForImage(imagePath);
       
    // if it exists then return it
    if (imagePath.exists())
@@ -731,6 +737,7 @@ void detectChanges(bool activatePlots)
                                              _1,
                                              activatePlots,
                                              false));
+      s_lastRenderTime = boost::posix_time::microsec_clock::universal_time();
    }
 }
 
@@ -751,10 +758,19 @@ void onBackgroundProcessing(bool isIdle)
       // we don't want this to spill over inot incrementally rendering all
       // plots as this will slow down overall plotting performance
       // considerably.
+      //
+      // we also coalesce renders into a frame budget so that animations
+      // which change faster than we can render don't queue up a render
+      // (and corresponding image) for every intermediate frame
       using namespace boost::posix_time;
       const int kChangeWindowMs = 50;
-      if ((graphics::display().lastChange() + milliseconds(kChangeWindowMs)) <
-           boost::posix_time::microsec_clock::universal_time())
+      const int kFrameBudgetMs = 100;
+      ptime now = microsec_clock::universal_time();
+      bool withinFrameBudget = !s_lastRenderTime.is_not_a_date_time() &&
+                   (s_lastRenderTime + milliseconds(kFrameBudgetMs)) > now;
+      if (!withinFrameBudget &&
+          (graphics::display().lastChange() + milliseconds(kChangeWindowMs)) <
+           now)
       {
          detectChanges(isIdle); // activate plots only when idle
       }
@@ -858,9 +874,12 @@ Error initialize()
    // subscribe to events
    using boost::bind;
    module_context::events().onClientInit.connect(bind(onClientInit));
-   module_context::events().onDetectChanges.connect(bind(onDetectChanges, _1));
+   module_context::events().onDetectChanges.connect("plots",
+                                                    bind(onDetectChanges, _1));
    module_context::events().onBeforeExecute.connect(bind(onBeforeExecute));
-   module_context::events().onBackgroundProcessing.connect(onBackgroundProcessing);
+   module_context::events().onBackgroundProcessing.connect(
+                                                "plots",
+                                                onBackgroundProcessing);
 
    RS_REGISTER_CALL_METHOD(rs_emitBeforeNewPlot, 0);
    RS_REGISTER_CALL_METHOD(rs_emitNewPlot, 0);
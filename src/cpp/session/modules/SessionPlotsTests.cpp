@@ -0,0 +1,126 @@
+/*
+ * SessionPlotsTests.cpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <tests/TestThat.hpp>
+
+#include <boost/make_shared.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/system/System.hpp>
+
+#include <r/session/RGraphicsPngWriter.hpp>
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace plots {
+
+using namespace core;
+using namespace r::session::graphics;
+
+namespace {
+
+boost::shared_ptr<png_writer::Raster> testRaster(unsigned int color)
+{
+   boost::shared_ptr<png_writer::Raster> pRaster =
+                                 boost::make_shared<png_writer::Raster>();
+   pRaster->width = 3;
+   pRaster->height = 2;
+   pRaster->pixels.assign(6, color);
+   return pRaster;
+}
+
+FilePath testImagePath()
+{
+   return FilePath("/tmp").complete(
+            "rstudio-png-writer-" + core::system::generateShortenedUuid() +
+            ".png");
+}
+
+unsigned int readUInt32(const std::string& data, std::size_t offset)
+{
+   return (static_cast<unsigned char>(data[offset]) << 24) |
+          (static_cast<unsigned char>(data[offset + 1]) << 16) |
+          (static_cast<unsigned char>(data[offset + 2]) << 8) |
+          static_cast<unsigned char>(data[offset + 3]);
+}
+
+} // anonymous namespace
+
+context("PngWriter")
+{
+   test_that("rasters are written as png images")
+   {
+      FilePath imagePath = testImagePath();
+      expect_false(png_writer::write(*testRaster(0xFF0000FF), imagePath));
+
+      std::string png;
+      expect_false(readStringFromFile(imagePath, &png));
+      expect_true(png.size() > 33);
+      expect_true(png.substr(1, 3) == "PNG");
+      expect_true(png.substr(12, 4) == "IHDR");
+      expect_true(readUInt32(png, 16) == 3);
+      expect_true(readUInt32(png, 20) == 2);
+      expect_false(FilePath(imagePath.absolutePath() + ".partial").exists());
+
+      imagePath.remove();
+   }
+
+   test_that("invalid rasters are not written")
+   {
+      FilePath imagePath = testImagePath();
+      boost::shared_ptr<png_writer::Raster> pRaster = testRaster(0);
+      pRaster->pixels.pop_back();
+      expect_true(png_writer::write(*pRaster, imagePath));
+      expect_false(imagePath.exists());
+   }
+
+   test_that("queued writes are complete once waited for")
+   {
+      FilePath imagePath = testImagePath();
+      png_writer::writeAsync(testRaster(0xFFFFFFFF), imagePath);
+      png_writer::waitFor(imagePath);
+      expect_true(imagePath.exists());
+
+      // nothing is left to cancel once the write completed
+      expect_false(png_writer::cancel(imagePath));
+
+      imagePath.remove();
+   }
+
+   test_that("all queued writes complete")
+   {
+      std::vector<FilePath> imagePaths;
+      for (int i = 0; i < 5; i++)
+      {
+         imagePaths.push_back(testImagePath());
+         png_writer::writeAsync(testRaster(0xFF000000 + i), imagePaths.back());
+      }
+
+      png_writer::waitForAll();
+      for (std::size_t i = 0; i < imagePaths.size(); i++)
+      {
+         expect_true(imagePaths[i].exists());
+         imagePaths[i].remove();
+      }
+   }
+}
+
+} // namespace plots
+} // namespace modules
+} // namespace session
+} // namespace rstudio
@@ -104,7 +104,7 @@ void detectExtendedType(boost::shared_ptr<SourceDocument> pDoc)
 int numSourceDocuments()
 {
    std::vector<boost::shared_ptr<SourceDocument> > docs;
-   source_database::list(&docs);
+   source_database::list(&docs, false);
    return docs.size();
 }
 
@@ -122,6 +122,25 @@ Error sourceDatabasePutWithUpdatedContents(
 
    return Success();
 }
+
+// as above for a document edited via replaceContents
+Error sourceDatabasePutEditWithUpdatedContents(
+                              boost::shared_ptr<SourceDocument> pDoc,
+                              std::size_t byteOffset,
+                              std::size_t byteLength,
+                              const std::string& replacement)
+{
+   Error error = source_database::putEdit(pDoc,
+                                          byteOffset,
+                                          byteLength,
+                                          replacement);
+   if (error)
+      return error;
+
+   source_database::events().onDocUpdated(pDoc);
+
+   return Success();
+}
    
 Error newDocument(const json::JsonRpcRequest& request,
                   json::JsonRpcResponse* pResponse)
@@ -245,38 +264,20 @@ Error openDocument(const json::JsonRpcRequest& request,
    return Success();
 } 
 
-Error saveDocumentCore(const std::string& contents,
-                       const json::Value& jsonPath,
-                       const json::Value& jsonType,
-                       const json::Value& jsonEncoding,
-                       const json::Value& jsonFoldSpec,
-                       const json::Value& jsonChunkOutput,
-                       boost::shared_ptr<SourceDocument> pDoc)
+// apply the type, encoding, fold spec and chunk output which accompany a
+// save (each may be null, in which case it's left as-is)
+void updateDocumentMetadata(const json::Value& jsonType,
+                            const json::Value& jsonEncoding,
+                            const json::Value& jsonFoldSpec,
+                            const json::Value& jsonChunkOutput,
+                            boost::shared_ptr<SourceDocument> pDoc)
 {
-   // check whether we have a path and if we do get/resolve its value
-   std::string oldPath, path;
-   FilePath fullDocPath;
-   bool hasPath = json::isType<std::string>(jsonPath);
-   if (hasPath)
-   {
-      oldPath = pDoc->path();
-      path = jsonPath.get_str();
-      fullDocPath = module_context::resolveAliasedPath(path);
-   }
-
-   // update dirty state: dirty if there was no path AND the new contents
-   // are different from the old contents (and was thus a content autosave
-   // as distinct from a fold-spec or scroll-position/selection autosave)
-   pDoc->setDirty(!hasPath && (contents != pDoc->contents()));
-   
    bool hasType = json::isType<std::string>(jsonType);
    if (hasType)
    {
       pDoc->setType(jsonType.get_str());
    }
    
-   Error error;
-   
    bool hasEncoding = json::isType<std::string>(jsonEncoding);
    if (hasEncoding)
    {
@@ -297,11 +298,41 @@ Error saveDocumentCore(const std::string& contents,
    {
       time_t docTime = pDoc->dirty() ? std::time(NULL) : 
                                        pDoc->lastKnownWriteTime();
-      error = rmarkdown::notebook::setChunkDefs(pDoc->path(), pDoc->id(),
+      Error error = rmarkdown::notebook::setChunkDefs(pDoc->path(), pDoc->id(),
             docTime, jsonChunkOutput.get_array());
       if (error)
          LOG_ERROR(error);
    }
+}
+
+Error saveDocumentCore(const std::string& contents,
+                       const json::Value& jsonPath,
+                       const json::Value& jsonType,
+                       const json::Value& jsonEncoding,
+                       const json::Value& jsonFoldSpec,
+                       const json::Value& jsonChunkOutput,
+                       boost::shared_ptr<SourceDocument> pDoc)
+{
+   // check whether we have a path and if we do get/resolve its value
+   std::string oldPath, path;
+   FilePath fullDocPath;
+   bool hasPath = json::isType<std::string>(jsonPath);
+   if (hasPath)
+   {
+      oldPath = pDoc->path();
+      path = jsonPath.get_str();
+      fullDocPath = module_context::resolveAliasedPath(path);
+   }
+
+   // update dirty state: dirty if there was no path AND the new contents
+   // are different from the old contents (and was thus a content autosave
+   // as distinct from a fold-spec or scroll-position/selection autosave)
+   pDoc->setDirty(!hasPath && (contents != pDoc->contents()));
+
+   updateDocumentMetadata(jsonType, jsonEncoding, jsonFoldSpec,
+                          jsonChunkOutput, pDoc);
+
+   Error error;
 
    // handle document (varies depending upon whether we have a path)
    if (hasPath)
@@ -415,8 +446,6 @@ Error saveDocument(const json::JsonRpcRequest& request,
 Error saveDocumentDiff(const json::JsonRpcRequest& request,
                        json::JsonRpcResponse* pResponse)
 {
-   using namespace rstudio::core::string_utils;
-
    // unique id and jsonPath (can be null for auto-save)
    std::string id;
    json::Value jsonPath, jsonType, jsonEncoding, jsonFoldSpec, jsonChunkOutput;
@@ -461,32 +490,49 @@ Error saveDocumentDiff(const json::JsonRpcRequest& request,
    // Don't even attempt anything if we're not working off the same original
    if (pDoc->hash() == hash)
    {
-      std::string contents(pDoc->contents());
+      if (offset < 0 || length < 0)
+         return Success();
 
-      // Offset and length are specified in characters, but contents
-      // is in UTF8 bytes. Convert before using.
-      std::string::iterator rangeBegin = contents.begin();
-      error = utf8Advance(rangeBegin, offset, contents.end(), &rangeBegin);
+      // Offset and length are specified in characters, apply the edit
+      // (this only touches the affected part of the document)
+      std::size_t byteOffset, byteLength;
+      error = pDoc->replaceContents(offset, length, replacement,
+                                    &byteOffset, &byteLength);
       if (error)
          return Success(); // UTF8 decoding failed. Abort differential save.
 
-      std::string::iterator rangeEnd = rangeBegin;
-      error = utf8Advance(rangeEnd, length, contents.end(), &rangeEnd);
-      if (error)
-         return Success(); // UTF8 decoding failed. Abort differential save.
+      if (hasPath)
+      {
+         // saving to a file writes the whole document regardless
+         std::string contents(pDoc->contents());
+         error = saveDocumentCore(contents, jsonPath, jsonType, jsonEncoding,
+                                  jsonFoldSpec, jsonChunkOutput, pDoc);
+         if (error)
+            return error;
 
-      contents.erase(rangeBegin, rangeEnd);
-      contents.insert(rangeBegin, replacement.begin(), replacement.end());
-      
-      error = saveDocumentCore(contents, jsonPath, jsonType, jsonEncoding,
-                               jsonFoldSpec, jsonChunkOutput, pDoc);
-      if (error)
-         return error;
-      
-      // write to the source_database
-      error = sourceDatabasePutWithUpdatedContents(pDoc);
-      if (error)
-         return error;
+         // write to the source_database
+         error = sourceDatabasePutWithUpdatedContents(pDoc);
+         if (error)
+            return error;
+      }
+      else
+      {
+         // autosave: as in saveDocumentCore the document is dirty if the
+         // contents changed
+         pDoc->setDirty(byteLength != replacement.size() ||
+                        pDoc->hash() != hash);
+
+         updateDocumentMetadata(jsonType, jsonEncoding, jsonFoldSpec,
+                                jsonChunkOutput, pDoc);
+
+         // journal the edit in the source_database
+         error = sourceDatabasePutEditWithUpdatedContents(pDoc,
+                                                          byteOffset,
+                                                          byteLength,
+                                                          replacement);
+         if (error)
+            return error;
+      }
 
       pResponse->setResult(pDoc->hash());
    }
@@ -987,7 +1033,7 @@ Error setDocOrder(const json::JsonRpcRequest& request,
    Error error = json::readParams(request.params, &ids);
    if (error)
       return error;
-   source_database::list(&docs);
+   source_database::list(&docs, false);
 
    BOOST_FOREACH( boost::shared_ptr<SourceDocument>& pDoc, docs )
    {
@@ -999,7 +1045,7 @@ Error setDocOrder(const json::JsonRpcRequest& request,
              pDoc->relativeOrder() != static_cast<int>(i + 1))
          {
             pDoc->setRelativeOrder(i + 1);
-            source_database::put(pDoc);
+            source_database::putMetadata(pDoc);
          }
       }
    }
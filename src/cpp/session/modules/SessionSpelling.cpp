@@ -15,10 +15,16 @@
 
 #include "SessionSpelling.hpp"
 
+#include <algorithm>
+
+#include <boost/bind.hpp>
 #include <boost/shared_ptr.hpp>
 
 #include <core/Error.hpp>
 #include <core/Exec.hpp>
+#include <core/Thread.hpp>
+
+#include <core/collection/LruCache.hpp>
 
 #include <core/spelling/HunspellSpellingEngine.hpp>
 
@@ -42,13 +48,49 @@ namespace {
 // underlying spelling engine
 boost::scoped_ptr<core::spelling::SpellingEngine> s_pSpellingEngine;
 
+// engine used to check words in the background. hunspell isn't thread safe
+// so this is a separate instance which is only used with its mutex held
+struct BackgroundSpellingEngine
+{
+   boost::mutex mutex;
+   boost::scoped_ptr<core::spelling::SpellingEngine> pEngine;
+};
+boost::shared_ptr<BackgroundSpellingEngine> s_pBackgroundEngine;
+
+// cache of whether words are spelled correctly. the cache is cleared (and the
+// generation incremented) when the language or custom dictionaries change so
+// that results from checks which were in flight at the time aren't cached
+const std::size_t kWordCacheSize = 50000;
+core::collection::LruCache<std::string, bool> s_wordCache(kWordCacheSize);
+unsigned long s_dictionaryGeneration = 0;
+std::string s_wordCacheLanguage;
+
+void invalidateWordCache()
+{
+   s_wordCache.clear();
+   s_dictionaryGeneration++;
+}
+
+Error checkWord(const std::string& word, bool* pCorrect)
+{
+   if (s_wordCache.get(word, pCorrect))
+      return Success();
+
+   Error error = s_pSpellingEngine->checkSpelling(word, pCorrect);
+   if (error)
+      return error;
+
+   s_wordCache.insert(word, *pCorrect);
+   return Success();
+}
+
 // R function for testing & debugging
 SEXP rs_checkSpelling(SEXP wordSEXP)
 {
    bool isCorrect;
    std::string word = r::sexp::asString(wordSEXP);
 
-   Error error = s_pSpellingEngine->checkSpelling(word, &isCorrect);
+   Error error = checkWord(word, &isCorrect);
 
    // We'll return true here so as not to tie up the front end.
    if (error)
@@ -78,7 +120,14 @@ FilePath userDictionariesDir()
 
 void syncSpellingEngineDictionaries()
 {
-   s_pSpellingEngine->useDictionary(userSettings().spellingLanguage());
+   std::string langId = userSettings().spellingLanguage();
+   if (langId != s_wordCacheLanguage)
+   {
+      s_wordCacheLanguage = langId;
+      invalidateWordCache();
+   }
+
+   s_pSpellingEngine->useDictionary(langId);
 }
 
 
@@ -97,15 +146,99 @@ FilePath allLanguagesDir()
 }
 
 
-Error checkSpelling(const json::JsonRpcRequest& request,
-                    json::JsonRpcResponse* pResponse)
+// words which weren't in the cache when a check was requested (these are
+// checked in the background and the results merged on the main thread)
+struct CheckSpellingState
+{
+   std::string langId;
+   std::vector<std::size_t> indexes;
+   std::vector<std::string> words;
+   std::vector<bool> correct;
+   Error error;
+};
+
+void checkWordsInBackground(boost::shared_ptr<BackgroundSpellingEngine> pEngine,
+                            boost::shared_ptr<CheckSpellingState> pState)
+{
+   LOCK_MUTEX(pEngine->mutex)
+   {
+      // picks up the language and any custom dictionary changes
+      pEngine->pEngine->useDictionary(pState->langId);
+
+      pState->correct.reserve(pState->words.size());
+      for (std::size_t i = 0; i < pState->words.size(); i++)
+      {
+         bool isCorrect = true;
+         Error error = pEngine->pEngine->checkSpelling(pState->words[i],
+                                                       &isCorrect);
+         if (error)
+         {
+            pState->error = error;
+            return;
+         }
+
+         pState->correct.push_back(isCorrect);
+      }
+   }
+   END_LOCK_MUTEX
+}
+
+void endCheckSpelling(unsigned long generation,
+                      json::Array misspelledIndexes,
+                      boost::shared_ptr<CheckSpellingState> pState,
+                      const json::JsonRpcFunctionContinuation& continuation)
+{
+   json::JsonRpcResponse response;
+   if (pState->error)
+   {
+      continuation(pState->error, &response);
+      return;
+   }
+
+   // don't cache results computed against dictionaries which have since
+   // been changed (they are still correct for the document as requested)
+   bool cacheResults = (generation == s_dictionaryGeneration);
+
+   std::vector<int> indexes;
+   for (std::size_t i = 0; i < pState->correct.size(); i++)
+   {
+      if (cacheResults)
+         s_wordCache.insert(pState->words[i], pState->correct[i]);
+
+      if (!pState->correct[i])
+         indexes.push_back(static_cast<int>(pState->indexes[i]));
+   }
+
+   // merge with the misspellings found in the cache (the client expects
+   // the indexes in order)
+   for (std::size_t i = 0; i < misspelledIndexes.size(); i++)
+      indexes.push_back(misspelledIndexes[i].get_int());
+   std::sort(indexes.begin(), indexes.end());
+
+   json::Array result;
+   std::copy(indexes.begin(), indexes.end(), std::back_inserter(result));
+   response.setResult(result);
+   continuation(Success(), &response);
+}
+
+// the client sends the words for the visible portion of documents as they
+// are scrolled, so most words are answered from the cache. the remaining
+// words are checked in the background so that checking long documents
+// doesn't block R
+void checkSpelling(const json::JsonRpcRequest& request,
+                   const json::JsonRpcFunctionContinuation& continuation)
 {
    json::Array words;
    Error error = json::readParams(request.params, &words);
    if (error)
-      return error;
+   {
+      json::JsonRpcResponse response;
+      continuation(error, &response);
+      return;
+   }
 
    json::Array misspelledIndexes;
+   boost::shared_ptr<CheckSpellingState> pState(new CheckSpellingState());
    for (std::size_t i=0; i<words.size(); i++)
    {
       if (!json::isType<std::string>(words[i]))
@@ -116,17 +249,36 @@ Error checkSpelling(const json::JsonRpcRequest& request,
 
       std::string word = words[i].get_str();
       bool isCorrect = true;
-      error = s_pSpellingEngine->checkSpelling(word, &isCorrect);
-      if (error)
-         return error;
-
-      if (!isCorrect)
-         misspelledIndexes.push_back(static_cast<int>(i));
+      if (s_wordCache.get(word, &isCorrect))
+      {
+         if (!isCorrect)
+            misspelledIndexes.push_back(static_cast<int>(i));
+      }
+      else
+      {
+         pState->indexes.push_back(i);
+         pState->words.push_back(word);
+      }
    }
 
-   pResponse->setResult(misspelledIndexes);
+   // respond immediately if everything was in the cache
+   if (pState->words.empty())
+   {
+      json::JsonRpcResponse response;
+      response.setResult(misspelledIndexes);
+      continuation(Success(), &response);
+      return;
+   }
 
-   return Success();
+   pState->langId = userSettings().spellingLanguage();
+   module_context::scheduleBackgroundWork(
+            boost::bind(checkWordsInBackground, s_pBackgroundEngine, pState),
+            boost::bind(endCheckSpelling,
+                        s_dictionaryGeneration,
+                        misspelledIndexes,
+                        pState,
+                        continuation),
+            core::WorkPriorityHigh);
 }
 
 Error suggestionList(const json::JsonRpcRequest& request,
@@ -194,6 +346,7 @@ Error addCustomDictionary(const json::JsonRpcRequest& request,
       return error;
 
    // sync spelling engine
+   invalidateWordCache();
    syncSpellingEngineDictionaries();
 
    // return
@@ -218,6 +371,7 @@ Error removeCustomDictionary(const json::JsonRpcRequest& request,
       return error;
 
    // sync spelling engine
+   invalidateWordCache();
    syncSpellingEngineDictionaries();
 
    // return
@@ -306,6 +460,15 @@ Error initialize()
                                              hunspellDictionaryManager(),
                                              &r::util::iconvstr);
    s_pSpellingEngine.reset(pHunspell);
+   s_wordCacheLanguage = userSettings().spellingLanguage();
+
+   // the background engine runs off the main thread so it can't call into
+   // R to convert encodings
+   s_pBackgroundEngine.reset(new BackgroundSpellingEngine());
+   s_pBackgroundEngine->pEngine.reset(new HunspellSpellingEngine(
+                                             userSettings().spellingLanguage(),
+                                             hunspellDictionaryManager(),
+                                             &string_utils::iconvstr));
 
    // connect to user settings changed
    userSettings().onChanged.connect(onUserSettingsChanged);
@@ -315,7 +478,7 @@ Error initialize()
    using namespace module_context;
    ExecBlock initBlock ;
    initBlock.addFunctions()
-      (bind(registerRpcMethod, "check_spelling", checkSpelling))
+      (bind(registerAsyncRpcMethod, "check_spelling", checkSpelling))
       (bind(registerRpcMethod, "suggestion_list", suggestionList))
       (bind(registerRpcMethod, "get_word_chars", getWordChars))
       (bind(registerRpcMethod, "add_custom_dictionary", addCustomDictionary))
@@ -0,0 +1,88 @@
+/*
+ * SessionTrace.cpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionTrace.hpp"
+
+#include <boost/bind.hpp>
+
+#include <core/Error.hpp>
+#include <core/Exec.hpp>
+#include <core/FilePath.hpp>
+#include <core/Trace.hpp>
+
+#include <session/SessionModuleContext.hpp>
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace session {
+namespace modules { 
+namespace trace {
+
+namespace {
+
+Error setTraceEnabled(const json::JsonRpcRequest& request,
+                      json::JsonRpcResponse* pResponse)
+{
+   bool enabled;
+   Error error = json::readParams(request.params, &enabled);
+   if (error)
+      return error;
+
+   // start each trace afresh
+   if (enabled && !core::trace::enabled())
+      core::trace::clear();
+
+   core::trace::setEnabled(enabled);
+   return Success();
+}
+
+Error writeTrace(const json::JsonRpcRequest& request,
+                 json::JsonRpcResponse* pResponse)
+{
+   FilePath traceFile = module_context::tempFile("trace", "json");
+   Error error = core::trace::write(traceFile);
+   if (error)
+      return error;
+
+   pResponse->setResult(module_context::createAliasedPath(traceFile));
+   return Success();
+}
+
+Error getSignalHandlerStats(const json::JsonRpcRequest& request,
+                            json::JsonRpcResponse* pResponse)
+{
+   pResponse->setResult(module_context::signalHandlerStats());
+   return Success();
+}
+
+} // anonymous namespace
+
+Error initialize()
+{
+   using boost::bind;
+   using namespace module_context;
+   ExecBlock initBlock;
+   initBlock.addFunctions()
+      (bind(registerRpcMethod, "set_trace_enabled", setTraceEnabled))
+      (bind(registerRpcMethod, "write_trace", writeTrace))
+      (bind(registerRpcMethod, "get_signal_handler_stats", getSignalHandlerStats));
+   return initBlock.execute();
+}
+
+} // namespace trace
+} // namespace modules
+} // namespace session
+} // namespace rstudio
@@ -186,6 +186,52 @@ Error setClientState(const json::JsonRpcRequest& request,
 }
    
      
+// resizing the graphics device requires a full replay of the display list
+// so we debounce changes to the graphics size (e.g. while the user is
+// dragging a splitter) and apply them during idle time. in the meantime
+// the client scales the currently rendered plot to fit the pane.
+const int kGraphicsResizeDebounceMs = 250;
+r::session::RClientMetrics s_appliedMetrics;
+r::session::RClientMetrics s_pendingMetrics;
+bool s_pendingGraphicsResize = false;
+boost::posix_time::ptime s_lastGraphicsResize;
+
+bool graphicsSizeChanged(const r::session::RClientMetrics& metrics)
+{
+   return metrics.graphicsWidth != s_appliedMetrics.graphicsWidth ||
+          metrics.graphicsHeight != s_appliedMetrics.graphicsHeight ||
+          metrics.devicePixelRatio != s_appliedMetrics.devicePixelRatio;
+}
+
+void applyClientMetrics(const r::session::RClientMetrics& metrics)
+{
+   r::session::setClientMetrics(metrics);
+   s_appliedMetrics = metrics;
+}
+
+void applyPendingGraphicsResize()
+{
+   using namespace boost::posix_time;
+
+   // may have been superseded by an immediate update
+   if (!s_pendingGraphicsResize)
+      return;
+
+   // wait for the size to settle
+   time_duration sinceLastResize =
+         microsec_clock::universal_time() - s_lastGraphicsResize;
+   if (sinceLastResize < milliseconds(kGraphicsResizeDebounceMs))
+   {
+      module_context::scheduleDelayedWork(
+               milliseconds(kGraphicsResizeDebounceMs) - sinceLastResize,
+               applyPendingGraphicsResize);
+      return;
+   }
+
+   s_pendingGraphicsResize = false;
+   applyClientMetrics(s_pendingMetrics);
+}
+
 // IN: WorkbenchMetrics object
 // OUT: Void
 Error setWorkbenchMetrics(const json::JsonRpcRequest& request, 
@@ -201,8 +247,33 @@ Error setWorkbenchMetrics(const json::JsonRpcRequest& request,
    if (error)
       return error;
    
-   // set the metrics
-   r::session::setClientMetrics(metrics);
+   // apply immediately if this is the first time we've been called or
+   // if the graphics size hasn't changed (e.g. console width only)
+   if (s_appliedMetrics.graphicsWidth == 0 || !graphicsSizeChanged(metrics))
+   {
+      s_pendingGraphicsResize = false;
+      applyClientMetrics(metrics);
+      return Success();
+   }
+
+   // apply the console width now (keeping the current graphics size)
+   if (metrics.consoleWidth != s_appliedMetrics.consoleWidth)
+   {
+      r::session::RClientMetrics consoleMetrics = s_appliedMetrics;
+      consoleMetrics.consoleWidth = metrics.consoleWidth;
+      applyClientMetrics(consoleMetrics);
+   }
+
+   // defer the graphics resize
+   s_pendingMetrics = metrics;
+   s_lastGraphicsResize = boost::posix_time::microsec_clock::universal_time();
+   if (!s_pendingGraphicsResize)
+   {
+      s_pendingGraphicsResize = true;
+      module_context::scheduleDelayedWork(
+         boost::posix_time::milliseconds(kGraphicsResizeDebounceMs),
+         applyPendingGraphicsResize);
+   }
    
    return Success();
 }
@@ -15,6 +15,8 @@
 
 #include "SessionBuild.hpp"
 
+#include <deque>
+#include <cstring>
 #include <vector>
 
 #include <boost/utility.hpp>
@@ -22,6 +24,7 @@
 #include <boost/format.hpp>
 #include <boost/scope_exit.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string/join.hpp>
 
@@ -49,6 +52,7 @@
 #include <session/SessionModuleContext.hpp>
 
 #include "SessionBuildErrors.hpp"
+#include "SessionBuildParallel.hpp"
 #include "SessionSourceCpp.hpp"
 #include "SessionInstallRtools.hpp"
 
@@ -102,6 +106,38 @@ namespace build {
 
 namespace {
 
+// test files run by testthat
+bool isNotTestthatFile(const FilePath& filePath)
+{
+   return filePath.isDirectory() ||
+          !boost::algorithm::starts_with(filePath.filename(), "test") ||
+          filePath.extensionLowerCase() != ".r";
+}
+
+// filter argument which selects a single file for devtools::test (the
+// filter is a regex matched against the file's name without its "test-"
+// prefix and extension)
+std::string testthatFilter(const FilePath& testFile)
+{
+   std::string name = testFile.stem();
+   if (boost::algorithm::starts_with(name, "test-"))
+      name = name.substr(5);
+   else if (boost::algorithm::starts_with(name, "test"))
+      name = name.substr(4);
+
+   std::string filter = "'^";
+   BOOST_FOREACH(char ch, name)
+   {
+      if (std::strchr("\\^$.|?*+()[]{}", ch))
+         filter.append("\\\\");
+      else if (ch == '\'')
+         filter.append("\\");
+      filter.push_back(ch);
+   }
+   filter.append("$'");
+   return filter;
+}
+
 // track whether to force a package rebuild. we do this if the user
 // saves a header file (since the R CMD INSTALL makefile doesn't
 // force a rebuild for those changes)
@@ -212,6 +248,16 @@ const char * const kCheckPackage = "check-package";
 const char * const kBuildAndReload = "build-all";
 const char * const kRebuildAll = "rebuild-all";
 
+// output is sent to the client once this much has accumulated or once the
+// oldest output has been waiting for this long
+const std::size_t kMaxPendingOutputBytes = 64 * 1024;
+const boost::posix_time::time_duration kPendingOutputInterval =
+                                    boost::posix_time::milliseconds(100);
+
+// limits on the output retained for reloading the client
+const std::size_t kMaxOutputBytes = 1024 * 1024;
+const std::size_t kOutputChunkBytes = 16 * 1024;
+
 class Build : boost::noncopyable,
               public boost::enable_shared_from_this<Build>
 {
@@ -226,7 +272,8 @@ public:
 
 private:
    Build()
-      : isRunning_(false), terminationRequested_(false), restartR_(false),
+      : isRunning_(false), terminationRequested_(false), outputBytes_(0),
+        outputTruncated_(false), pendingOutputBytes_(0), restartR_(false),
         usedDevtools_(false)
    {
    }
@@ -548,11 +595,12 @@ private:
       }
 #endif
 
-      // use both the R and gcc error parsers
-      CompileErrorParsers parsers;
-      parsers.add(rErrorParser(packagePath.complete("R")));
-      parsers.add(gccErrorParser(packagePath.complete("src")));
-      initErrorParser(packagePath, parsers);
+      // use both the R and gcc error scanners
+      boost::shared_ptr<CompileErrorScanners> pScanners(
+                                             new CompileErrorScanners());
+      pScanners->add(rErrorScanner(packagePath.complete("R")));
+      pScanners->add(gccErrorScanner(packagePath.complete("src")));
+      initErrorScanner(packagePath, pScanners);
 
       // make a copy of options so we can customize the environment
       core::system::ProcessOptions pkgOptions(options);
@@ -572,6 +620,15 @@ private:
       // set the not cran env var
       core::system::setenv(&childEnv, "NOT_CRAN", "true");
 
+      // compile package sources in parallel (unless MAKEFLAGS is already
+      // set, in which case we respect it)
+      if (core::system::getenv(childEnv, "MAKEFLAGS").empty())
+      {
+         core::system::setenv(&childEnv,
+                              "MAKEFLAGS",
+                              "-j" + safe_convert::numberToString(buildJobs()));
+      }
+
       // turn off external applications launching
       core::system::setenv(&childEnv, "R_BROWSER", "false");
       core::system::setenv(&childEnv, "R_PDFVIEWER", "false");
@@ -926,9 +983,93 @@ private:
                             const core::system::ProcessOptions& pkgOptions,
                             const core::system::ProcessCallbacks& cb)
    {
-      std::string command = "devtools::test()";
-      enqueCommandString(command);
-      devtoolsExecute(command, packagePath, pkgOptions, cb);
+      // run the testthat files in parallel if there is more than one of
+      // them and we can run more than one job
+      std::vector<FilePath> testFiles;
+      FilePath testthatPath = packagePath.complete("tests/testthat");
+      if (testthatPath.exists())
+      {
+         Error error = testthatPath.children(&testFiles);
+         if (error)
+            LOG_ERROR(error);
+         testFiles.erase(std::remove_if(testFiles.begin(),
+                                        testFiles.end(),
+                                        isNotTestthatFile),
+                         testFiles.end());
+      }
+
+      std::size_t jobs = buildJobs();
+      if (jobs < 2 || testFiles.size() < 2)
+      {
+         std::string command = "devtools::test()";
+         enqueCommandString(command);
+         devtoolsExecute(command, packagePath, pkgOptions, cb);
+         return;
+      }
+
+      FilePath rScriptPath;
+      Error error = module_context::rScriptPath(&rScriptPath);
+      if (error)
+      {
+         terminateWithError("Locating R script", error);
+         return;
+      }
+
+      // each file is tested in its own R process (which loads the package
+      // with devtools)
+      std::vector<ParallelCommand> commands;
+      BOOST_FOREACH(const FilePath& testFile, testFiles)
+      {
+         ParallelCommand command;
+         command.label = "devtools::test(filter = " +
+                         testthatFilter(testFile) + ")";
+         command.executable = string_utils::utf8ToSystem(
+                                             rScriptPath.absolutePath());
+         command.args.push_back("--slave");
+         command.args.push_back("--vanilla");
+         command.args.push_back("-e");
+         command.args.push_back(command.label);
+         command.options = pkgOptions;
+         command.options.workingDir = packagePath;
+         commands.push_back(command);
+      }
+
+      usedDevtools_ = true;
+      boost::format fmt("Testing %1% files in parallel (%2% jobs)");
+      enqueCommandString(boost::str(fmt % commands.size() %
+                                    std::min(jobs, commands.size())));
+
+      // compile the package's code first (otherwise each of the test
+      // processes would try to compile it)
+      if (packagePath.complete("src").exists())
+      {
+         std::string command = "devtools::compile_dll()";
+         enqueCommandString(command);
+
+         core::system::ProcessCallbacks compileCb = cb;
+         compileCb.onExit = boost::bind(&Build::onTestsCompiled,
+                                        Build::shared_from_this(),
+                                        _1,
+                                        commands,
+                                        jobs,
+                                        cb);
+         devtoolsExecute(command, packagePath, pkgOptions, compileCb);
+      }
+      else
+      {
+         runParallelCommands(commands, jobs, cb);
+      }
+   }
+
+   void onTestsCompiled(int exitStatus,
+                        const std::vector<ParallelCommand>& commands,
+                        std::size_t jobs,
+                        const core::system::ProcessCallbacks& cb)
+   {
+      if (exitStatus != EXIT_SUCCESS || terminationRequested_)
+         cb.onExit(exitStatus);
+      else
+         runParallelCommands(commands, jobs, cb);
    }
 
    void testPackage(const FilePath& packagePath,
@@ -944,34 +1085,38 @@ private:
       }
 
       // navigate to the tests directory and source all R
-      // scripts within
+      // scripts within (each in its own R process)
       FilePath testsPath = packagePath.complete("tests");
+      std::vector<FilePath> testFiles;
+      error = testsPath.children(&testFiles);
+      if (error)
+      {
+         terminateWithError("Listing tests", error);
+         return;
+      }
 
-      // construct a shell command to execute
-      shell_utils::ShellCommand cmd(rScriptPath);
-      cmd << "--slave";
-      cmd << "--vanilla";
-      cmd << "-e";
-      std::vector<std::string> rSourceCommands;
-
-      boost::format fmt(
-         "setwd('%1%'); "
-         "invisible(lapply(list.files(pattern = '\\\\.[rR]$'), function(x) { "
-         "    system(paste(shQuote('%2%'), '--vanilla --slave -f', shQuote(x))) "
-         "}))"
-      );
-
-      cmd << boost::str(fmt %
-                        testsPath.absolutePath() %
-                        rScriptPath.absolutePath());
+      std::vector<ParallelCommand> commands;
+      BOOST_FOREACH(const FilePath& testFile, testFiles)
+      {
+         if (testFile.isDirectory() || testFile.extensionLowerCase() != ".r")
+            continue;
+
+         ParallelCommand command;
+         command.label = testFile.filename();
+         command.executable = string_utils::utf8ToSystem(
+                                             rScriptPath.absolutePath());
+         command.args.push_back("--vanilla");
+         command.args.push_back("--slave");
+         command.args.push_back("-f");
+         command.args.push_back(testFile.filename());
+         command.options = pkgOptions;
+         command.options.workingDir = testsPath;
+         commands.push_back(command);
+      }
 
-      pkgOptions.workingDir = testsPath;
       enqueCommandString("Sourcing R files in 'tests' directory");
       successMessage_ = "\nTests complete";
-      module_context::processSupervisor().runCommand(cmd,
-                                                     pkgOptions,
-                                                     cb);
-
+      runParallelCommands(commands, buildJobs(), cb);
    }
 
    void devtoolsBuildPackage(const FilePath& packagePath,
@@ -1086,8 +1231,8 @@ private:
          return;
       }
 
-      // install the gcc error parser
-      initErrorParser(targetPath, gccErrorParser(targetPath));
+      // install the gcc error scanner
+      initErrorScanner(targetPath, gccErrorScanner(targetPath));
 
       std::string make = "make";
       if (!options_.makefileArgs.empty())
@@ -1228,6 +1373,13 @@ public:
    json::Array outputAsJson() const
    {
       json::Array outputJson;
+      if (outputTruncated_)
+      {
+         outputJson.push_back(module_context::compileOutputAsJson(
+               module_context::CompileOutput(
+                        module_context::kCompileOutputNormal,
+                        "[Earlier output truncated]\n")));
+      }
       std::transform(output_.begin(),
                      output_.end(),
                      std::back_inserter(outputJson),
@@ -1254,36 +1406,41 @@ public:
 private:
    bool onContinue()
    {
+      // send output which has been waiting long enough
+      if (!pendingOutput_.empty() &&
+          (boost::posix_time::microsec_clock::universal_time() -
+              pendingOutputTime_) >= kPendingOutputInterval)
+      {
+         flushBuildOutput();
+      }
+
       return !terminationRequested_;
    }
 
    void outputWithFilter(const std::string& output)
    {
-      // split into lines
-      std::vector<std::string> lines;
-      boost::algorithm::split(lines, output,  boost::algorithm::is_any_of("\n"));
-
       // apply filter to each line
-      int size = lines.size();
-      for (int i=0; i<size; i++)
+      using namespace module_context;
+      std::size_t begin = 0;
+      while (begin < output.size())
       {
-         // apply filter
-         using namespace module_context;
-         std::string line = lines.at(i);
+         std::size_t end = output.find('\n', begin);
+         std::size_t next = (end == std::string::npos) ? output.size() : end + 1;
+         std::string line = output.substr(begin, next - begin);
          int type = errorOutputFilterFunction_(line) ?
                                  kCompileOutputError : kCompileOutputNormal;
 
-         // add newline if this wasn't the last line
-         if (i != (size-1))
-            line.append("\n");
-
          // enque the output
          enqueBuildOutput(type, line);
+         begin = next;
       }
    }
 
    void onStandardOutput(const std::string& output)
    {
+      if (pErrorScanner_)
+         pErrorScanner_->scanOutput(output);
+
       if (errorOutputFilterFunction_)
          outputWithFilter(output);
       else
@@ -1292,6 +1449,9 @@ private:
 
    void onStandardError(const std::string& output)
    {
+      if (pErrorScanner_)
+         pErrorScanner_->scanOutput(output);
+
       if (errorOutputFilterFunction_)
          outputWithFilter(output);
       else
@@ -1302,10 +1462,10 @@ private:
    {
       using namespace module_context;
 
-      // call the error parser if one has been specified
-      if (errorParser_)
+      // collect the errors found by the error scanner (if there is one)
+      if (pErrorScanner_)
       {
-         std::vector<SourceMarker> errors = errorParser_(outputAsText());
+         std::vector<SourceMarker> errors = pErrorScanner_->finish();
          if (!errors.empty())
          {
             errorsJson_ = sourceMarkersAsJson(errors);
@@ -1333,7 +1493,8 @@ private:
          // never restart R after a failed build
          restartR_ = false;
 
-         // take other actions
+         // take other actions (after sending the output that preceded them)
+         flushBuildOutput();
          if (failureFunction_)
             failureFunction_();
       }
@@ -1342,6 +1503,7 @@ private:
          if (!successMessage_.empty())
             enqueBuildOutput(kCompileOutputNormal, successMessage_ + "\n");
 
+         flushBuildOutput();
          if (successFunction_)
             successFunction_();
       }
@@ -1349,16 +1511,71 @@ private:
       enqueBuildCompleted();
    }
 
+   // output is sent to the client in batches (consecutive output of the
+   // same type is combined into a single event) once enough has accumulated
+   // or it has been waiting long enough
    void enqueBuildOutput(int type, const std::string& output)
    {
-      module_context::CompileOutput compileOutput(type, output);
+      if (output.empty())
+         return;
 
-      output_.push_back(compileOutput);
+      addOutput(type, output);
 
-      ClientEvent event(client_events::kBuildOutput,
-                        compileOutputAsJson(compileOutput));
+      if (!pendingOutput_.empty() && pendingOutput_.back().type == type)
+      {
+         pendingOutput_.back().output.append(output);
+      }
+      else
+      {
+         if (pendingOutput_.empty())
+         {
+            pendingOutputTime_ =
+                  boost::posix_time::microsec_clock::universal_time();
+         }
+         pendingOutput_.push_back(module_context::CompileOutput(type, output));
+      }
 
-      module_context::enqueClientEvent(event);
+      pendingOutputBytes_ += output.size();
+      if (pendingOutputBytes_ >= kMaxPendingOutputBytes)
+         flushBuildOutput();
+   }
+
+   void flushBuildOutput()
+   {
+      BOOST_FOREACH(const module_context::CompileOutput& compileOutput,
+                    pendingOutput_)
+      {
+         ClientEvent event(client_events::kBuildOutput,
+                           compileOutputAsJson(compileOutput));
+         module_context::enqueClientEvent(event);
+      }
+
+      pendingOutput_.clear();
+      pendingOutputBytes_ = 0;
+   }
+
+   // keep the most recent output (for reloading the client and for
+   // suspend) discarding the oldest once there is too much of it
+   void addOutput(int type, const std::string& output)
+   {
+      if (!output_.empty() &&
+          output_.back().type == type &&
+          output_.back().output.size() < kOutputChunkBytes)
+      {
+         output_.back().output.append(output);
+      }
+      else
+      {
+         output_.push_back(module_context::CompileOutput(type, output));
+      }
+
+      outputBytes_ += output.size();
+      while (outputBytes_ > kMaxOutputBytes && output_.size() > 1)
+      {
+         outputBytes_ -= output_.front().output.size();
+         output_.pop_front();
+         outputTruncated_ = true;
+      }
    }
 
    void enqueCommandString(const std::string& cmd)
@@ -1369,6 +1586,8 @@ private:
 
    void enqueBuildErrors(const json::Array& errors)
    {
+      flushBuildOutput();
+
       json::Object jsonData;
       jsonData["base_dir"] = errorsBaseDir_;
       jsonData["errors"] = errors;
@@ -1434,6 +1653,9 @@ private:
                           buildToolsWarning_ + "\n\n");
       }
 
+      // send any output which is still pending
+      flushBuildOutput();
+
       // enque event
       std::string afterRestartCommand;
       if (restartR_)
@@ -1474,7 +1696,8 @@ private:
       return type + " package written to " + written;
    }
 
-   void initErrorParser(const FilePath& baseDir, CompileErrorParser parser)
+   void initErrorScanner(const FilePath& baseDir,
+                         boost::shared_ptr<CompileErrorScanner> pScanner)
    {
       // set base dir -- make sure it ends with a / so the slash is
       // excluded from error display
@@ -1485,14 +1708,19 @@ private:
          errorsBaseDir_.append("/");
       }
 
-      errorParser_ = parser;
+      pErrorScanner_ = pScanner;
    }
 
 private:
    bool isRunning_;
    bool terminationRequested_;
-   std::vector<module_context::CompileOutput> output_;
-   CompileErrorParser errorParser_;
+   std::deque<module_context::CompileOutput> output_;
+   std::size_t outputBytes_;
+   bool outputTruncated_;
+   std::vector<module_context::CompileOutput> pendingOutput_;
+   std::size_t pendingOutputBytes_;
+   boost::posix_time::ptime pendingOutputTime_;
+   boost::shared_ptr<CompileErrorScanner> pErrorScanner_;
    std::string errorsBaseDir_;
    json::Array errorsJson_;
    r_util::RPackageInfo pkgInfo_;
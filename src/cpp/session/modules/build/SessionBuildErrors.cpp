@@ -15,10 +15,11 @@
 
 #include "SessionBuildErrors.hpp"
 
+#include <map>
+#include <cstring>
 #include <algorithm>
 
 #include <boost/bind.hpp>
-#include <boost/regex.hpp>
 #include <boost/foreach.hpp>
 #include <boost/format.hpp>
 #include <boost/algorithm/string/predicate.hpp>
@@ -93,114 +94,335 @@ FilePath scanForRSourceFile(const FilePath& basePath,
    return FilePath();
 }
 
-std::vector<module_context::SourceMarker> parseRErrors(
-                                       const FilePath& basePath,
-                                       const std::string& output)
+bool isDigit(char ch)
+{
+   return ch >= '0' && ch <= '9';
+}
+
+// advance past a run of digits starting at pos, returning false if there
+// are none
+bool skipDigits(const std::string& str, std::size_t* pPos)
+{
+   std::size_t begin = *pPos;
+   while (*pPos < str.size() && isDigit(str[*pPos]))
+      ++(*pPos);
+   return *pPos > begin;
+}
+
+bool hasPrefixAt(const std::string& str, std::size_t pos, const char* prefix)
 {
-   using namespace module_context;
-   std::vector<SourceMarker> errors;
-
-   boost::regex re("^Error in parse\\(outFile\\) : ([0-9]+?):([0-9]+?): (.+?)\\n"
-                   "([0-9]+?): (.*?)\\n([0-9]+?): (.+?)$");
-   boost::sregex_iterator iter(output.begin(), output.end(), re,
-                               boost::regex_constants::match_not_dot_newline);
-   boost::sregex_iterator end;
-   for (; iter != end; iter++)
+   std::size_t length = std::strlen(prefix);
+   return str.size() >= pos + length &&
+          str.compare(pos, length, prefix) == 0;
+}
+
+// match the "<line>:<column>: <message>" remainder of the first line of an
+// R parse error
+bool parseRErrorPosition(const std::string& text,
+                         std::string* pLine,
+                         std::string* pColumn,
+                         std::string* pMessage)
+{
+   std::size_t pos = 0;
+   if (!skipDigits(text, &pos) || !hasPrefixAt(text, pos, ":"))
+      return false;
+   *pLine = text.substr(0, pos);
+
+   std::size_t columnBegin = ++pos;
+   if (!skipDigits(text, &pos) || !hasPrefixAt(text, pos, ": "))
+      return false;
+   *pColumn = text.substr(columnBegin, pos - columnBegin);
+
+   pos += 2;
+   if (pos >= text.size())
+      return false;
+   *pMessage = text.substr(pos);
+   return true;
+}
+
+// match a "<line>: <contents>" line of the context R prints for a parse
+// error
+bool parseRContextLine(const std::string& text,
+                       std::string* pLine,
+                       std::string* pContents)
+{
+   std::size_t pos = 0;
+   if (!skipDigits(text, &pos) || !hasPrefixAt(text, pos, ": "))
+      return false;
+
+   *pLine = text.substr(0, pos);
+   *pContents = text.substr(pos + 2);
+   return true;
+}
+
+struct RParseError
+{
+   std::string line;
+   std::string column;
+   std::string message;
+   std::string diagLine;
+   std::string lineContents;
+   std::string nextLineContents;
+};
+
+// matches parse errors reported while installing a package, e.g.
+//
+//    Error in parse(outFile) : 10:3: unexpected symbol
+//    9: foo <- function() {
+//    10:   bar baz
+//
+class RErrorScanner : public CompileErrorScanner
+{
+public:
+   explicit RErrorScanner(const FilePath& basePath)
+      : basePath_(basePath), lineCount_(0)
+   {
+   }
+
+   void scanLine(const std::string& line)
    {
-      boost::smatch match = *iter;
-      BOOST_ASSERT(match.size() == 8);
-
-      // first part is straightforward
-      std::string line = match[1];
-      std::string column = match[2];
-      std::string message = match[3];
-
-      // we need to guess the file based on the contextual information
-      // provided in the error message
-      int diagLine = core::safe_convert::stringTo<int>(match[4], -1);
-      if (diagLine != -1)
+      lines_[0].swap(lines_[1]);
+      lines_[1].swap(lines_[2]);
+      lines_[2] = line;
+      if (++lineCount_ < 3)
+         return;
+
+      static const char * const kErrorPrefix = "Error in parse(outFile) : ";
+      if (!hasPrefixAt(lines_[0], 0, kErrorPrefix))
+         return;
+
+      RParseError error;
+      std::string nextLine;
+      if (parseRErrorPosition(lines_[0].substr(std::strlen(kErrorPrefix)),
+                              &error.line,
+                              &error.column,
+                              &error.message) &&
+          parseRContextLine(lines_[1], &error.diagLine, &error.lineContents) &&
+          parseRContextLine(lines_[2], &nextLine, &error.nextLineContents) &&
+          !error.nextLineContents.empty())
       {
-         FilePath rSrcFile = scanForRSourceFile(basePath,
+         errors_.push_back(error);
+      }
+   }
+
+   std::vector<module_context::SourceMarker> errors()
+   {
+      using namespace module_context;
+      std::vector<SourceMarker> errors;
+
+      BOOST_FOREACH(const RParseError& error, errors_)
+      {
+         // we need to guess the file based on the contextual information
+         // provided in the error message
+         int diagLine = core::safe_convert::stringTo<int>(error.diagLine, -1);
+         if (diagLine == -1)
+            continue;
+
+         FilePath rSrcFile = scanForRSourceFile(basePath_,
                                                 diagLine,
-                                                match[5],
-                                                match[7]);
+                                                error.lineContents,
+                                                error.nextLineContents);
          if (!rSrcFile.empty())
          {
             // create error and add it
             SourceMarker err(SourceMarker::Error,
                              rSrcFile,
-                             core::safe_convert::stringTo<int>(line, 1),
-                             core::safe_convert::stringTo<int>(column, 1),
-                             core::html_utils::HTML(message),
+                             core::safe_convert::stringTo<int>(error.line, 1),
+                             core::safe_convert::stringTo<int>(error.column, 1),
+                             core::html_utils::HTML(error.message),
                              false);
             errors.push_back(err);
          }
       }
 
+      return errors;
    }
 
-   return errors;
+private:
+   FilePath basePath_;
+   std::string lines_[3];
+   std::size_t lineCount_;
+   std::vector<RParseError> errors_;
+};
+
+struct GccDiagnostic
+{
+   std::string file;
+   std::string line;
+   std::string column;
+   std::string type;
+   std::string message;
+};
+
+// match "<file>:<line>:[<column>:] (error|warning): <message>"
+bool parseGccDiagnostic(const std::string& text, GccDiagnostic* pDiagnostic)
+{
+   // the file name can itself contain colons (e.g. C:/...) so try each
+   // colon in turn as the end of it
+   for (std::size_t colon = text.find(':', 1);
+        colon != std::string::npos;
+        colon = text.find(':', colon + 1))
+   {
+      std::size_t pos = colon + 1;
+      if (!skipDigits(text, &pos) || !hasPrefixAt(text, pos, ":"))
+         continue;
+      std::string line = text.substr(colon + 1, pos - colon - 1);
+      ++pos;
+
+      // optional column
+      std::string column;
+      std::size_t columnEnd = pos;
+      if (skipDigits(text, &columnEnd) && hasPrefixAt(text, columnEnd, ":"))
+      {
+         column = text.substr(pos, columnEnd - pos);
+         pos = columnEnd + 1;
+      }
+
+      std::string type;
+      if (hasPrefixAt(text, pos, " error: "))
+         type = "error";
+      else if (hasPrefixAt(text, pos, " warning: "))
+         type = "warning";
+      else
+         continue;
+
+      pos += type.size() + 3;
+      if (pos >= text.size())
+         continue;
+
+      pDiagnostic->file = text.substr(0, colon);
+      pDiagnostic->line = line;
+      pDiagnostic->column = column.empty() ? "1" : column;
+      pDiagnostic->type = type;
+      pDiagnostic->message = text.substr(pos);
+      return true;
+   }
 
+   return false;
 }
 
+// match "... from <file>:<line>..." (as printed by gcc ahead of errors
+// within included files)
+bool parseIncludedFrom(const std::string& text,
+                       std::string* pFile,
+                       std::string* pLine)
+{
+   for (std::size_t from = text.find("from ");
+        from != std::string::npos;
+        from = text.find("from ", from + 1))
+   {
+      std::size_t fileBegin = from + 5;
+      for (std::size_t colon = text.find(':', fileBegin + 1);
+           colon != std::string::npos;
+           colon = text.find(':', colon + 1))
+      {
+         std::size_t pos = colon + 1;
+         if (skipDigits(text, &pos) && pos < text.size())
+         {
+            *pFile = text.substr(fileBegin, colon - fileBegin);
+            *pLine = text.substr(colon + 1, pos - colon - 1);
+            return true;
+         }
+      }
+   }
+
+   return false;
+}
 
-std::vector<module_context::SourceMarker> parseGccErrors(
-                                           const FilePath& basePath,
-                                           const std::string& output)
+// matches standard gcc error and warning lines but also picks up "from"
+// prefixed errors and substitutes the from file for the error/warning file
+class GccErrorScanner : public CompileErrorScanner
 {
-   // check to see if we are in a package
-   std::string pkgInclude;
-   using namespace projects;
-   if (projectContext().hasProject() &&
-       (projectContext().config().buildType == r_util::kBuildTypePackage))
+public:
+   explicit GccErrorScanner(const FilePath& basePath)
+      : basePath_(basePath), previousLineMatched_(false)
    {
-      pkgInclude = "/" + projectContext().packageInfo().name() + "/include/";
    }
 
-   using namespace module_context;
-   std::vector<SourceMarker> errors;
-
-   // parse standard gcc errors and warning lines but also pickup "from"
-   // prefixed errors and substitute the from file for the error/warning file
-   boost::regex re("(?:from (.+?):([0-9]+?).+?\\n)?"
-                   "^(.+?):([0-9]+?):(?:([0-9]+?):)? (error|warning): (.+)$");
-   boost::sregex_iterator iter(output.begin(), output.end(), re,
-                               boost::regex_constants::match_not_dot_newline);
-   boost::sregex_iterator end;
-   for (; iter != end; iter++)
+   void scanLine(const std::string& line)
    {
-      boost::smatch match = *iter;
-      BOOST_ASSERT(match.size() == 8);
+      GccDiagnostic diagnostic;
+      bool matched = parseGccDiagnostic(line, &diagnostic);
+      if (matched)
+      {
+         std::string fromFile, fromLine;
+         if (!previousLineMatched_ &&
+             parseIncludedFrom(previousLine_, &fromFile, &fromLine) &&
+             FilePath::isRootPath(fromFile))
+         {
+            diagnostic.file = fromFile;
+            diagnostic.line = fromLine;
+            diagnostic.column = "1";
+         }
+
+         diagnostics_.push_back(diagnostic);
+      }
 
-      std::string file, line, column, type, message;
-      std::string match1 = match[1];
-      if (!match1.empty() && FilePath::isRootPath(match[1]))
+      previousLine_ = line;
+      previousLineMatched_ = matched;
+   }
+
+   std::vector<module_context::SourceMarker> errors()
+   {
+      // check to see if we are in a package
+      std::string pkgInclude;
+      using namespace projects;
+      if (projectContext().hasProject() &&
+          (projectContext().config().buildType == r_util::kBuildTypePackage))
       {
-         file = match[1];
-         line = match[2];
-         column = "1";
+         pkgInclude = "/" + projectContext().packageInfo().name() + "/include/";
       }
-      else
+
+      using namespace module_context;
+      std::vector<SourceMarker> errors;
+
+      // files are resolved once each (template errors can report thousands
+      // of diagnostics against the same few files)
+      std::map<std::string,FilePath> resolvedFiles;
+
+      BOOST_FOREACH(const GccDiagnostic& diagnostic, diagnostics_)
       {
-         file = match[3];
-         line = match[4];
-         column = match[5];
-         if (column.empty())
-            column = "1";
+         std::map<std::string,FilePath>::const_iterator it =
+                                    resolvedFiles.find(diagnostic.file);
+         if (it == resolvedFiles.end())
+         {
+            it = resolvedFiles.insert(std::make_pair(
+                     diagnostic.file,
+                     resolveFile(diagnostic.file, pkgInclude))).first;
+         }
+
+         // skip if the file doesn't exist (or is Makeconf)
+         const FilePath& filePath = it->second;
+         if (filePath.empty())
+            continue;
+
+         // create marker and add it
+         SourceMarker err(module_context::sourceMarkerTypeFromString(
+                                                         diagnostic.type),
+                          filePath,
+                          core::safe_convert::stringTo<int>(diagnostic.line, 1),
+                          core::safe_convert::stringTo<int>(diagnostic.column, 1),
+                          core::html_utils::HTML(diagnostic.message),
+                          true);
+         errors.push_back(err);
       }
-      type = match[6];
-      message = match[7];
 
+      return errors;
+   }
+
+private:
+   FilePath resolveFile(const std::string& file, const std::string& pkgInclude)
+   {
       // resolve file path
       FilePath filePath;
       if (FilePath::isRootPath(file))
          filePath = FilePath(file);
       else
-         filePath = basePath.childPath(file);
+         filePath = basePath_.childPath(file);
 
       // skip if the file doesn't exist
       if (!filePath.exists())
-         continue;
+         return FilePath();
 
       FilePath realPath;
       Error error = core::system::realPath(filePath, &realPath);
@@ -224,6 +446,7 @@ std::vector<module_context::SourceMarker> parseGccErrors(
             std::string relativePath = path.substr(pos);
 
             // does this file exist? if so substitute it
+            using namespace projects;
             FilePath includePath = projectContext().buildTargetPath()
                              .childPath("inst/include/" + relativePath);
             if (includePath.exists())
@@ -233,23 +456,103 @@ std::vector<module_context::SourceMarker> parseGccErrors(
 
       // don't show warnings from Makeconf
       if (filePath.filename() == "Makeconf")
-         continue;
+         return FilePath();
 
-      // create marker and add it
-      SourceMarker err(module_context::sourceMarkerTypeFromString(type),
-                       filePath,
-                       core::safe_convert::stringTo<int>(line, 1),
-                       core::safe_convert::stringTo<int>(column, 1),
-                       core::html_utils::HTML(message),
-                       true);
-      errors.push_back(err);
+      return filePath;
    }
 
-   return errors;
+private:
+   FilePath basePath_;
+   std::string previousLine_;
+   bool previousLineMatched_;
+   std::vector<GccDiagnostic> diagnostics_;
+};
+
+std::vector<module_context::SourceMarker> parseErrors(
+                              boost::shared_ptr<CompileErrorScanner> pScanner,
+                              const std::string& output)
+{
+   pScanner->scanOutput(output);
+   return pScanner->finish();
+}
+
+std::vector<module_context::SourceMarker> parseRErrors(
+                                       const FilePath& basePath,
+                                       const std::string& output)
+{
+   return parseErrors(rErrorScanner(basePath), output);
+}
+
+std::vector<module_context::SourceMarker> parseGccErrors(
+                                           const FilePath& basePath,
+                                           const std::string& output)
+{
+   return parseErrors(gccErrorScanner(basePath), output);
 }
 
 } // anonymous namespace
 
+void CompileErrorScanner::scanOutput(const std::string& output)
+{
+   std::size_t begin = 0;
+   while (true)
+   {
+      std::size_t end = output.find('\n', begin);
+      if (end == std::string::npos)
+      {
+         partialLine_.append(output, begin, std::string::npos);
+         break;
+      }
+
+      // strip the line ending
+      std::size_t lineEnd = end;
+      if (lineEnd > begin && output[lineEnd - 1] == '\r')
+         --lineEnd;
+
+      if (partialLine_.empty())
+      {
+         scanLine(output.substr(begin, lineEnd - begin));
+      }
+      else
+      {
+         partialLine_.append(output, begin, lineEnd - begin);
+         if (!partialLine_.empty() &&
+             partialLine_[partialLine_.size() - 1] == '\r')
+         {
+            partialLine_.erase(partialLine_.size() - 1);
+         }
+         scanLine(partialLine_);
+         partialLine_.clear();
+      }
+
+      begin = end + 1;
+   }
+}
+
+std::vector<module_context::SourceMarker> CompileErrorScanner::finish()
+{
+   if (!partialLine_.empty())
+   {
+      scanLine(partialLine_);
+      partialLine_.clear();
+   }
+
+   return errors();
+}
+
+boost::shared_ptr<CompileErrorScanner> gccErrorScanner(
+                                          const FilePath& basePath)
+{
+   return boost::shared_ptr<CompileErrorScanner>(
+                                          new GccErrorScanner(basePath));
+}
+
+boost::shared_ptr<CompileErrorScanner> rErrorScanner(const FilePath& basePath)
+{
+   return boost::shared_ptr<CompileErrorScanner>(
+                                          new RErrorScanner(basePath));
+}
+
 CompileErrorParser gccErrorParser(const FilePath& basePath)
 {
    return boost::bind(parseGccErrors, basePath, _1);
@@ -19,8 +19,10 @@
 #include <string>
 #include <vector>
 
+#include <boost/utility.hpp>
 #include <boost/function.hpp>
 #include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include <core/FilePath.hpp>
 #include <core/json/Json.hpp>
@@ -35,26 +37,63 @@ namespace build {
 typedef boost::function<std::vector<module_context::SourceMarker>(const std::string&)>
                                                          CompileErrorParser;
 
-class CompileErrorParsers
+// scans compiler or R output for errors a line at a time as the output
+// arrives (so that the output needn't be kept around to be parsed at the
+// end of a build). errors are only resolved to source markers (which
+// requires looking at the filesystem) when they are requested
+class CompileErrorScanner : boost::noncopyable
 {
 public:
-   CompileErrorParsers()
+   virtual ~CompileErrorScanner()
    {
    }
 
-   void add(CompileErrorParser parser)
+   // scan a chunk of output (lines may be split across chunks)
+   void scanOutput(const std::string& output);
+
+   // scan any trailing partial line and return all of the errors found
+   std::vector<module_context::SourceMarker> finish();
+
+public:
+   // scan a single line of output (without its line ending)
+   virtual void scanLine(const std::string& line) = 0;
+
+   virtual std::vector<module_context::SourceMarker> errors() = 0;
+
+private:
+   std::string partialLine_;
+};
+
+class CompileErrorScanners : public CompileErrorScanner
+{
+public:
+   CompileErrorScanners()
    {
-      parsers_.push_back(parser);
+   }
+
+   void add(boost::shared_ptr<CompileErrorScanner> pScanner)
+   {
+      scanners_.push_back(pScanner);
    }
 
 public:
-   std::vector<module_context::SourceMarker> operator()(const std::string& output)
+   void scanLine(const std::string& line)
+   {
+      BOOST_FOREACH(const boost::shared_ptr<CompileErrorScanner>& pScanner,
+                    scanners_)
+      {
+         pScanner->scanLine(line);
+      }
+   }
+
+   std::vector<module_context::SourceMarker> errors()
    {
       using namespace module_context;
       std::vector<SourceMarker> allErrors;
-      BOOST_FOREACH(const CompileErrorParser& parser, parsers_)
+      BOOST_FOREACH(const boost::shared_ptr<CompileErrorScanner>& pScanner,
+                    scanners_)
       {
-         std::vector<SourceMarker> errors = parser(output);
+         std::vector<SourceMarker> errors = pScanner->errors();
          std::copy(errors.begin(), errors.end(), std::back_inserter(allErrors));
       }
 
@@ -62,9 +101,15 @@ public:
    }
 
 private:
-   std::vector<CompileErrorParser> parsers_;
+   std::vector<boost::shared_ptr<CompileErrorScanner> > scanners_;
 };
 
+boost::shared_ptr<CompileErrorScanner> gccErrorScanner(
+                                          const core::FilePath& basePath);
+
+boost::shared_ptr<CompileErrorScanner> rErrorScanner(
+                                          const core::FilePath& basePath);
+
 CompileErrorParser gccErrorParser(const core::FilePath& basePath);
 
 CompileErrorParser rErrorParser(const core::FilePath& basePath);
@@ -0,0 +1,284 @@
+/*
+ * SessionBuildParallel.cpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionBuildParallel.hpp"
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+#include <boost/foreach.hpp>
+#include <boost/utility.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+
+#include <core/Error.hpp>
+#include <core/BoostThread.hpp>
+
+#include <session/SessionOptions.hpp>
+#include <session/SessionModuleContext.hpp>
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace build {
+
+namespace {
+
+// jobs used when the number isn't configured (beyond this the builds and
+// tests of typical packages are limited by memory rather than cores)
+const std::size_t kMaxDefaultBuildJobs = 4;
+
+// operations passed to output callbacks (output of a command may be passed
+// on after it has exited, so these don't operate on the process)
+class CommandOutputOperations : public core::system::ProcessOperations
+{
+public:
+   Error writeToStdin(const std::string&, bool)
+   {
+      return notRunningError(ERROR_LOCATION);
+   }
+
+   Error ptySetSize(int, int)
+   {
+      return notRunningError(ERROR_LOCATION);
+   }
+
+   Error ptyInterrupt()
+   {
+      return notRunningError(ERROR_LOCATION);
+   }
+
+   Error terminate()
+   {
+      return notRunningError(ERROR_LOCATION);
+   }
+
+private:
+   static Error notRunningError(const ErrorLocation& location)
+   {
+      return systemError(boost::system::errc::no_such_process, location);
+   }
+};
+
+// the output of the earliest command which hasn't yet been reported is
+// passed on as it arrives. output of the commands started after it is
+// held until it is their turn, so commands are reported in order
+class ParallelCommands : boost::noncopyable,
+                         public boost::enable_shared_from_this<ParallelCommands>
+{
+public:
+   static void run(const std::vector<ParallelCommand>& commands,
+                   std::size_t jobs,
+                   const core::system::ProcessCallbacks& cb)
+   {
+      boost::shared_ptr<ParallelCommands> pCommands(
+                                 new ParallelCommands(commands, jobs, cb));
+      pCommands->startCommands();
+   }
+
+private:
+   ParallelCommands(const std::vector<ParallelCommand>& commands,
+                    std::size_t jobs,
+                    const core::system::ProcessCallbacks& cb)
+      : commands_(commands),
+        output_(commands.size()),
+        exited_(commands.size(), false),
+        exitStatuses_(commands.size(), EXIT_SUCCESS),
+        jobs_(std::max(jobs, static_cast<std::size_t>(1))),
+        cb_(cb),
+        next_(0),
+        current_(0),
+        running_(0),
+        exitStatus_(EXIT_SUCCESS),
+        terminated_(false)
+   {
+   }
+
+   struct Output
+   {
+      Output(bool isError, const std::string& text)
+         : isError(isError), text(text)
+      {
+      }
+
+      bool isError;
+      std::string text;
+   };
+
+   void startCommands()
+   {
+      while (!terminated_ && running_ < jobs_ && next_ < commands_.size())
+         startCommand(next_++);
+
+      if (running_ == 0 && (terminated_ || next_ == commands_.size()))
+      {
+         if (cb_.onExit)
+            cb_.onExit(exitStatus_);
+      }
+   }
+
+   void startCommand(std::size_t index)
+   {
+      const ParallelCommand& command = commands_[index];
+
+      if (index == current_)
+         showCommand(index);
+
+      core::system::ProcessCallbacks cb;
+      cb.onContinue = boost::bind(&ParallelCommands::onContinue,
+                                  shared_from_this(), _1);
+      cb.onStdout = boost::bind(&ParallelCommands::onOutput,
+                                shared_from_this(), index, false, _2);
+      cb.onStderr = boost::bind(&ParallelCommands::onOutput,
+                                shared_from_this(), index, true, _2);
+      cb.onExit = boost::bind(&ParallelCommands::onExit,
+                              shared_from_this(), index, _1);
+
+      Error error = module_context::processSupervisor().runProgram(
+                                                         command.executable,
+                                                         command.args,
+                                                         command.options,
+                                                         cb);
+      if (error)
+      {
+         onOutput(index, true, error.summary() + "\n");
+         commandExited(index, EXIT_FAILURE);
+         return;
+      }
+
+      running_++;
+   }
+
+   bool onContinue(core::system::ProcessOperations& operations)
+   {
+      if (cb_.onContinue && !cb_.onContinue(operations))
+         terminated_ = true;
+
+      return !terminated_;
+   }
+
+   void onOutput(std::size_t index, bool isError, const std::string& text)
+   {
+      if (index == current_)
+      {
+         writeOutput(isError, text);
+         return;
+      }
+
+      std::vector<Output>& output = output_[index];
+      if (!output.empty() && output.back().isError == isError)
+         output.back().text.append(text);
+      else
+         output.push_back(Output(isError, text));
+   }
+
+   void onExit(std::size_t index, int exitStatus)
+   {
+      running_--;
+      commandExited(index, exitStatus);
+      startCommands();
+   }
+
+   void commandExited(std::size_t index, int exitStatus)
+   {
+      exited_[index] = true;
+      exitStatuses_[index] = exitStatus;
+      if (exitStatus != EXIT_SUCCESS && exitStatus_ == EXIT_SUCCESS)
+         exitStatus_ = exitStatus;
+
+      // finish reporting the current command (and any after it which have
+      // already exited) then move on to the next one
+      while (current_ < commands_.size() && exited_[current_])
+      {
+         finishCommand(current_);
+         current_++;
+         if (current_ < next_)
+            showCommand(current_);
+      }
+   }
+
+   // start reporting a command (passing on any output held so far)
+   void showCommand(std::size_t index)
+   {
+      writeOutput(false, "==> " + commands_[index].label + "\n\n");
+
+      BOOST_FOREACH(const Output& output, output_[index])
+      {
+         writeOutput(output.isError, output.text);
+      }
+      output_[index].clear();
+   }
+
+   void finishCommand(std::size_t index)
+   {
+      if (exitStatuses_[index] != EXIT_SUCCESS)
+      {
+         boost::format fmt("\n%1% exited with status %2%.\n");
+         writeOutput(true, boost::str(fmt % commands_[index].label %
+                                            exitStatuses_[index]));
+      }
+
+      writeOutput(false, "\n");
+   }
+
+   void writeOutput(bool isError, const std::string& text)
+   {
+      CommandOutputOperations operations;
+      if (isError && cb_.onStderr)
+         cb_.onStderr(operations, text);
+      else if (!isError && cb_.onStdout)
+         cb_.onStdout(operations, text);
+   }
+
+private:
+   std::vector<ParallelCommand> commands_;
+   std::vector<std::vector<Output> > output_;
+   std::vector<bool> exited_;
+   std::vector<int> exitStatuses_;
+   std::size_t jobs_;
+   core::system::ProcessCallbacks cb_;
+   std::size_t next_;
+   std::size_t current_;
+   std::size_t running_;
+   int exitStatus_;
+   bool terminated_;
+};
+
+} // anonymous namespace
+
+std::size_t buildJobs()
+{
+   int jobs = session::options().buildJobs();
+   if (jobs > 0)
+      return static_cast<std::size_t>(jobs);
+
+   std::size_t cores = std::max(1U, boost::thread::hardware_concurrency());
+   return std::min(cores, kMaxDefaultBuildJobs);
+}
+
+void runParallelCommands(const std::vector<ParallelCommand>& commands,
+                         std::size_t jobs,
+                         const core::system::ProcessCallbacks& cb)
+{
+   ParallelCommands::run(commands, jobs, cb);
+}
+
+} // namespace build
+} // namespace modules
+} // namespace session
+} // namespace rstudio
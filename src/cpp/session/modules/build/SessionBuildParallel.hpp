@@ -0,0 +1,61 @@
+/*
+ * SessionBuildParallel.hpp
+ *
+ * Copyright (C) 2009-16 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_BUILD_PARALLEL_HPP
+#define SESSION_BUILD_PARALLEL_HPP
+
+#include <string>
+#include <vector>
+
+#include <core/system/Process.hpp>
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace build {
+
+// number of jobs to use for parallel build steps (the session-build-jobs
+// option, or one per core up to a limit if that isn't set)
+std::size_t buildJobs();
+
+struct ParallelCommand
+{
+   // shown ahead of the command's output
+   std::string label;
+
+   std::string executable;
+   std::vector<std::string> args;
+   core::system::ProcessOptions options;
+};
+
+// run a set of independent commands, at most jobs at a time. the callbacks
+// are used as they would be for a single process: onContinue is called while
+// any of the commands are running (returning false terminates all of them),
+// the output of each command is passed to onStdout and onStderr, and onExit
+// is called once every command has exited (with the exit status of the
+// first command that failed). output is reported one command at a time (in
+// order) so that the output of concurrent commands isn't interleaved: the
+// output of the earliest unreported command is passed on as it arrives while
+// that of later commands is held until the commands before them exit
+void runParallelCommands(const std::vector<ParallelCommand>& commands,
+                         std::size_t jobs,
+                         const core::system::ProcessCallbacks& cb);
+
+} // namespace build
+} // namespace modules
+} // namespace session
+} // namespace rstudio
+
+#endif // SESSION_BUILD_PARALLEL_HPP
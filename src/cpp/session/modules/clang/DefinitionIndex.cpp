@@ -15,12 +15,20 @@
 
 #include "DefinitionIndex.hpp"
 
-#include <deque>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include <boost/cstdint.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/unordered_map.hpp>
 
 #include <core/FilePath.hpp>
 #include <core/DateTime.hpp>
+#include <core/Hash.hpp>
 #include <core/PerformanceTimer.hpp>
 #include <core/FileSerializer.hpp>
+#include <core/WorkerPool.hpp>
 #include <core/libclang/LibClang.hpp>
 #include <core/system/ProcessArgs.hpp>
 #include <session/IncrementalFileChangeHandler.hpp>
@@ -46,16 +54,35 @@ bool s_initialized = false;
 
 struct CppDefinitions
 {
+   CppDefinitions() : fileLastWrite(0) {}
    std::string file;
    std::time_t fileLastWrite;
-   std::deque<CppDefinition> definitions;
+   std::vector<CppDefinition> definitions;
 };
 
 // store definitions by file
-typedef std::map<std::string,CppDefinitions> DefinitionsByFile;
+typedef boost::unordered_map<std::string,CppDefinitions> DefinitionsByFile;
 DefinitionsByFile s_definitionsByFile;
 
-// visitor used to populate deque
+// location of each definition (by a hash of its USR) within
+// s_definitionsByFile, used to look up definitions without a scan
+struct DefinitionRef
+{
+   DefinitionRef(const std::string& file, std::size_t index)
+      : file(file), index(index)
+   {
+   }
+   std::string file;
+   std::size_t index;
+};
+typedef boost::unordered_multimap<std::size_t,DefinitionRef> DefinitionsByUSR;
+DefinitionsByUSR s_definitionsByUSR;
+
+// files which are being indexed in the background
+typedef boost::unordered_map<std::string,WorkHandle> PendingFiles;
+PendingFiles s_pendingFiles;
+
+// visitor used to populate definitions
 bool insertDefinition(const CppDefinition& definition,
                       CppDefinitions* pDefinitions)
 {
@@ -171,15 +198,284 @@ CXChildVisitResult cursorVisitor(CXCursor cxCursor,
    }
 }
 
+std::size_t hashUSR(const std::string& USR)
+{
+   return boost::hash<std::string>()(USR);
+}
+
+void removeDefinitions(const std::string& file)
+{
+   DefinitionsByFile::iterator it = s_definitionsByFile.find(file);
+   if (it == s_definitionsByFile.end())
+      return;
+
+   BOOST_FOREACH(const CppDefinition& definition, it->second.definitions)
+   {
+      std::pair<DefinitionsByUSR::iterator,DefinitionsByUSR::iterator> range =
+                  s_definitionsByUSR.equal_range(hashUSR(definition.USR));
+      for (DefinitionsByUSR::iterator refIt = range.first;
+           refIt != range.second; )
+      {
+         if (refIt->second.file == file)
+            refIt = s_definitionsByUSR.erase(refIt);
+         else
+            ++refIt;
+      }
+   }
+
+   s_definitionsByFile.erase(it);
+}
+
+void insertDefinitions(const CppDefinitions& definitions)
+{
+   removeDefinitions(definitions.file);
+
+   s_definitionsByFile[definitions.file] = definitions;
+   for (std::size_t i = 0; i < definitions.definitions.size(); i++)
+   {
+      s_definitionsByUSR.insert(std::make_pair(
+                         hashUSR(definitions.definitions[i].USR),
+                         DefinitionRef(definitions.file, i)));
+   }
+}
+
+// the index is stored on disk as one binary file per source file (named
+// for a hash of the source file's path) so that each can be written as
+// soon as the source file has been indexed
+const char * const kIndexFileHeader = "RSTUDIO-CPP-DEFINITIONS";
+const boost::uint32_t kIndexFileVersion = 1;
+
+// sanity limit on the size of strings read from index files
+const boost::uint32_t kMaxIndexString = 1024 * 1024;
+
+FilePath definitionIndexPath()
+{
+   return module_context::scopedScratchPath().childPath(
+                                                   "cpp-definition-index");
+}
+
+FilePath definitionIndexFilePath(const std::string& file)
+{
+   return definitionIndexPath().childPath(hash::crc32HexHash(file));
+}
+
+template <typename T>
+void writeValue(std::ostream& ostr, const T& value)
+{
+   ostr.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void writeString(std::ostream& ostr, const std::string& value)
+{
+   writeValue(ostr, static_cast<boost::uint32_t>(value.size()));
+   ostr.write(value.data(), value.size());
+}
+
+template <typename T>
+bool readValue(std::istream& istr, T* pValue)
+{
+   istr.read(reinterpret_cast<char*>(pValue), sizeof(T));
+   return istr.good();
+}
+
+bool readString(std::istream& istr, std::string* pValue)
+{
+   boost::uint32_t size = 0;
+   if (!readValue(istr, &size) || size > kMaxIndexString)
+      return false;
+
+   pValue->assign(size, '\0');
+   if (size > 0)
+      istr.read(&(*pValue)[0], size);
+   return istr.good();
+}
+
+Error writeDefinitions(const CppDefinitions& definitions,
+                       const FilePath& indexFilePath)
+{
+   boost::shared_ptr<std::ostream> pStream;
+   Error error = indexFilePath.open_w(&pStream);
+   if (error)
+      return error;
+
+   std::ostream& ostr = *pStream;
+   ostr.write(kIndexFileHeader, std::strlen(kIndexFileHeader));
+   writeValue(ostr, kIndexFileVersion);
+   writeString(ostr, definitions.file);
+   writeValue(ostr, static_cast<boost::int64_t>(definitions.fileLastWrite));
+   writeValue(ostr, static_cast<boost::uint32_t>(
+                                          definitions.definitions.size()));
+
+   BOOST_FOREACH(const CppDefinition& definition, definitions.definitions)
+   {
+      // the location's file is only written when it isn't the indexed file
+      // (which it almost always is)
+      std::string locationFile = definition.location.filePath.absolutePath();
+      if (locationFile == definitions.file)
+         locationFile.clear();
+
+      writeValue(ostr, static_cast<boost::uint8_t>(definition.kind));
+      writeString(ostr, definition.USR);
+      writeString(ostr, definition.parentName);
+      writeString(ostr, definition.name);
+      writeString(ostr, locationFile);
+      writeValue(ostr, static_cast<boost::uint32_t>(definition.location.line));
+      writeValue(ostr, static_cast<boost::uint32_t>(
+                                             definition.location.column));
+   }
+
+   ostr.flush();
+   if (!ostr.good())
+   {
+      error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+      error.addProperty("path", indexFilePath);
+      return error;
+   }
+
+   return Success();
+}
+
+bool readDefinitions(const FilePath& indexFilePath,
+                     CppDefinitions* pDefinitions)
+{
+   boost::shared_ptr<std::istream> pStream;
+   Error error = indexFilePath.open_r(&pStream);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return false;
+   }
+
+   std::istream& istr = *pStream;
+
+   std::string header(std::strlen(kIndexFileHeader), '\0');
+   istr.read(&header[0], header.size());
+   boost::uint32_t version = 0;
+   boost::int64_t fileLastWrite = 0;
+   boost::uint32_t count = 0;
+   if (!istr.good() ||
+       header != kIndexFileHeader ||
+       !readValue(istr, &version) || version != kIndexFileVersion ||
+       !readString(istr, &pDefinitions->file) ||
+       !readValue(istr, &fileLastWrite) ||
+       !readValue(istr, &count))
+   {
+      return false;
+   }
+   pDefinitions->fileLastWrite = static_cast<std::time_t>(fileLastWrite);
+
+   pDefinitions->definitions.reserve(std::min(count, kMaxIndexString));
+   for (boost::uint32_t i = 0; i < count; i++)
+   {
+      boost::uint8_t kind = 0;
+      std::string locationFile;
+      boost::uint32_t line = 0, column = 0;
+      CppDefinition definition;
+      if (!readValue(istr, &kind) ||
+          !readString(istr, &definition.USR) ||
+          !readString(istr, &definition.parentName) ||
+          !readString(istr, &definition.name) ||
+          !readString(istr, &locationFile) ||
+          !readValue(istr, &line))
+      {
+         return false;
+      }
+
+      // the last value read can leave the stream at eof
+      istr.read(reinterpret_cast<char*>(&column), sizeof(column));
+      if (istr.gcount() != sizeof(column))
+         return false;
+
+      definition.kind = static_cast<CppDefinitionKind>(kind);
+      definition.location.filePath = FilePath(locationFile.empty() ?
+                                                 pDefinitions->file :
+                                                 locationFile);
+      definition.location.line = line;
+      definition.location.column = column;
+      pDefinitions->definitions.push_back(definition);
+   }
+
+   return true;
+}
+
+// parse a file and collect its definitions (called on a background thread,
+// so it mustn't touch any of the global state above)
+void indexFile(CXIndex index,
+               const std::vector<std::string>& compileArgs,
+               boost::shared_ptr<CppDefinitions> pDefinitions,
+               const FilePath& indexFilePath)
+{
+   // get args in form clang expects
+   core::system::ProcessArgs argsArray(compileArgs);
+
+   // parse the translation unit
+   CXTranslationUnit tu = libclang::clang().parseTranslationUnit(
+                         index,
+                         pDefinitions->file.c_str(),
+                         argsArray.args(),
+                         argsArray.argCount(),
+                         NULL, 0, // no unsaved files
+                         CXTranslationUnit_None |
+                         CXTranslationUnit_Incomplete);
+   if (tu == NULL)
+      return;
+
+   // visit the cursors
+   DefinitionVisitor visitor =
+      boost::bind(insertDefinition, _1, pDefinitions.get());
+   libclang::clang().visitChildren(
+        libclang::clang().getTranslationUnitCursor(tu),
+        cursorVisitor,
+        (CXClientData)&visitor);
+
+   // dispose translation unit
+   libclang::clang().disposeTranslationUnit(tu);
+
+   // save the definitions (unless the file has been changed again since)
+   if (!WorkerPool::cancelled())
+   {
+      Error error = indexFilePath.parent().ensureDirectory();
+      if (!error)
+         error = writeDefinitions(*pDefinitions, indexFilePath);
+      if (error)
+         LOG_ERROR(error);
+   }
+}
+
+void onFileIndexed(boost::shared_ptr<CppDefinitions> pDefinitions)
+{
+   s_pendingFiles.erase(pDefinitions->file);
+   insertDefinitions(*pDefinitions);
+}
+
+// index shared by the background indexing threads. translation units are
+// parsed excluding declarations from the package's precompiled header
+// (which is passed along with the compilation args) so that the header is
+// reused rather than reparsed for each file
+CXIndex definitionsIndex()
+{
+   static CXIndex s_index = NULL;
+   if (s_index == NULL)
+   {
+      s_index = libclang::clang().createIndex(
+                  1 /* Exclude PCH */,
+                  (rSourceIndex().verbose() > 0) ? 1 : 0);
+      libclang::clang().CXIndex_setGlobalOptions(
+                  s_index,
+                  CXGlobalOpt_ThreadBackgroundPriorityForIndexing);
+   }
+   return s_index;
+}
+
 void fileChangeHandler(const core::system::FileChangeEvent& event)
 {
    // alias the filename
    std::string file = event.fileInfo().absolutePath();
 
-   // special case: we write all definitions to disk at shutdown, when
-   // we come back up all of the files will come back in as "add" events,
-   // for this case we need to ignore the add if we already have a fresh
-   // enough index of the file
+   // special case: definitions are written to disk as files are indexed,
+   // when we come back up all of the files will come back in as "add"
+   // events, for this case we need to ignore the add if we already have a
+   // fresh enough index of the file
    if (event.type() == core::system::FileChangeEvent::FileAdded)
    {
       // if we have a definition
@@ -192,58 +488,48 @@ void fileChangeHandler(const core::system::FileChangeEvent& event)
       }
    }
 
+   // cancel any indexing of a previous version of the file
+   PendingFiles::iterator pendingIt = s_pendingFiles.find(file);
+   if (pendingIt != s_pendingFiles.end())
+   {
+      pendingIt->second.cancel();
+      s_pendingFiles.erase(pendingIt);
+   }
+
    // always remove existing definitions
-   s_definitionsByFile.erase(file);
+   removeDefinitions(file);
 
    // if this is an add or an update then re-index
    if (event.type() == core::system::FileChangeEvent::FileAdded ||
        event.type() == core::system::FileChangeEvent::FileModified)
    {    
-      // get the compilation arguments for this file and use them to
-      // create a translation unit
+      // get the compilation arguments for this file (this needs R so is
+      // done here rather than on the background thread)
       std::vector<std::string> compileArgs =
          rCompilationDatabase().compileArgsForTranslationUnit(file, true);
 
       if (!compileArgs.empty())
       {
-         // create index
-         CXIndex index = libclang::clang().createIndex(
-                   1 /* Exclude PCH */,
-                   (rSourceIndex().verbose() > 0) ? 1 : 0);
-
-         // get args in form clang expects
-         core::system::ProcessArgs argsArray(compileArgs);
-
-         // parse the translation unit
-         CXTranslationUnit tu = libclang::clang().parseTranslationUnit(
-                               index,
-                               file.c_str(),
-                               argsArray.args(),
-                               argsArray.argCount(),
-                               NULL, 0, // no unsaved files
-                               CXTranslationUnit_None |
-                               CXTranslationUnit_Incomplete);
-
-
-         // create definitions and wire visitor to it
-         CppDefinitions definitions;
-         definitions.file = file;
-         definitions.fileLastWrite = event.fileInfo().lastWriteTime();
-         s_definitionsByFile[file] = definitions;
-         DefinitionVisitor visitor =
-            boost::bind(insertDefinition, _1, &s_definitionsByFile[file]);
-
-         // visit the cursors
-         libclang::clang().visitChildren(
-              libclang::clang().getTranslationUnitCursor(tu),
-              cursorVisitor,
-              (CXClientData)&visitor);
-
-         // dispose translation unit and index
-         libclang::clang().disposeTranslationUnit(tu);
-         libclang::clang().disposeIndex(index);
+         boost::shared_ptr<CppDefinitions> pDefinitions(new CppDefinitions());
+         pDefinitions->file = file;
+         pDefinitions->fileLastWrite = event.fileInfo().lastWriteTime();
+
+         s_pendingFiles[file] = module_context::scheduleBackgroundWork(
+                  boost::bind(indexFile,
+                              definitionsIndex(),
+                              compileArgs,
+                              pDefinitions,
+                              definitionIndexFilePath(file)),
+                  boost::bind(onFileIndexed, pDefinitions),
+                  WorkPriorityLow);
       }
    }
+   else
+   {
+      Error error = definitionIndexFilePath(file).removeIfExists();
+      if (error)
+         LOG_ERROR(error);
+   }
 }
 
 } // anonymous namespace
@@ -358,14 +644,16 @@ FileLocation findDefinitionLocation(const FileLocation& location)
 
       // if we didn't find it there then look for it in our index
       // of all saved files
-      BOOST_FOREACH(const DefinitionsByFile::value_type& defs,
-                    s_definitionsByFile)
+      std::pair<DefinitionsByUSR::const_iterator,
+                DefinitionsByUSR::const_iterator> range =
+                           s_definitionsByUSR.equal_range(hashUSR(USR));
+      for (DefinitionsByUSR::const_iterator it = range.first;
+           it != range.second; ++it)
       {
-         BOOST_FOREACH(const CppDefinition& def, defs.second.definitions)
-         {
-            if (def.USR == USR)
-               return def.location;
-         }
+         const CppDefinition& def =
+            s_definitionsByFile[it->second.file].definitions[it->second.index];
+         if (def.USR == USR)
+            return def.location;
       }
    }
 
@@ -409,162 +697,47 @@ bool insertMatching(const std::string& term,
 }
 
 
-json::Object cppDefinitionToJson(const CppDefinition& definition)
-{
-   using namespace safe_convert;
-   json::Object definitionJson;
-   definitionJson["usr"] = definition.USR;
-   definitionJson["kind"] = numberTo<int>(definition.kind, 0);
-   definitionJson["parent_name"] = definition.parentName;
-   definitionJson["name"] = definition.name;
-   definitionJson["file"] = definition.location.filePath.absolutePath();
-   definitionJson["line"] = numberTo<int>(definition.location.line, 1);
-   definitionJson["column"] = numberTo<int>(definition.location.column, 1);
-   return definitionJson;
-}
-
-CppDefinition cppDefinitionFromJson(const json::Object& object)
+void loadDefinitionIndex()
 {
-   // read json
-   int kind;
-   int line, column;
-   std::string file;
-   CppDefinition definition;
-   Error error = json::readObject(object,
-                                  "usr", &definition.USR,
-                                  "kind", &kind,
-                                  "parent_name", &definition.parentName,
-                                  "name", &definition.name,
-                                  "file", &file,
-                                  "line", &line,
-                                  "column", &column);
+   // remove the index written by previous versions (which stored all of
+   // the definitions in a single json file)
+   FilePath legacyIndexPath = module_context::scopedScratchPath().childPath(
+                                                      "cpp-definition-cache");
+   Error error = legacyIndexPath.removeIfExists();
    if (error)
-   {
       LOG_ERROR(error);
-      return CppDefinition();
-   }
 
-   // required data transforms
-   using namespace safe_convert;
-   definition.kind = static_cast<CppDefinitionKind>(kind);
-   definition.location.filePath = FilePath(file);
-   definition.location.line = numberTo<unsigned>(line, 1);
-   definition.location.column = numberTo<unsigned>(column, 1);
-
-   // return definition
-   return definition;
-}
-
-FilePath definitionIndexFilePath()
-{
-   return module_context::scopedScratchPath().childPath("cpp-definition-cache");
-}
-
-void loadDefinitionIndex()
-{
-   using namespace safe_convert;
-
-   FilePath indexFilePath = definitionIndexFilePath();
-   if (!indexFilePath.exists())
+   FilePath indexPath = definitionIndexPath();
+   if (!indexPath.exists())
       return;
 
-   std::string contents;
-   Error error = readStringFromFile(indexFilePath, &contents);
+   std::vector<FilePath> indexFiles;
+   error = indexPath.children(&indexFiles);
    if (error)
    {
       LOG_ERROR(error);
       return;
    }
 
-   json::Value indexValueJson;
-   if (!json::parse(contents, &indexValueJson) ||
-       !json::isType<json::Array>(indexValueJson))
-   {
-      LOG_ERROR_MESSAGE("Error parsing definition index: " + contents);
-      return;
-   }
-
-   json::Array indexJson = indexValueJson.get_array();
-   BOOST_FOREACH(const json::Value& definitionsJson, indexJson)
+   BOOST_FOREACH(const FilePath& indexFilePath, indexFiles)
    {
-      if (!json::isType<json::Object>(definitionsJson))
-      {
-         LOG_ERROR_MESSAGE("Unexpected non-object type in definition index");
-         continue;
-      }
-
-      json::Array defsArrayJson;
-      double fileLastWrite;
+      // remove index files which are invalid or which are for files that
+      // no longer exist (or which collide with another file's name)
       CppDefinitions definitions;
-      Error error = json::readObject(definitionsJson.get_obj(),
-                                     "file", &definitions.file,
-                                     "file_last_write", &fileLastWrite,
-                                     "definitions", &defsArrayJson);
-      if (error)
+      if (!readDefinitions(indexFilePath, &definitions) ||
+          !FilePath::exists(definitions.file) ||
+          definitionIndexFilePath(definitions.file) != indexFilePath)
       {
-         LOG_ERROR(error);
-         continue;
-      }
-      definitions.fileLastWrite = numberTo<std::time_t>(fileLastWrite, 0);
-
-      // if the file doesn't exist then bail
-      if (!FilePath::exists(definitions.file))
+         Error error = indexFilePath.remove();
+         if (error)
+            LOG_ERROR(error);
          continue;
-
-      BOOST_FOREACH(const json::Value& defJson, defsArrayJson)
-      {
-         if (!json::isType<json::Object>(defJson))
-         {
-            LOG_ERROR_MESSAGE("Unexpected non-object type in definition index");
-            continue;
-         }
-
-         CppDefinition definition = cppDefinitionFromJson(defJson.get_obj());
-         if (!definition.empty())
-            definitions.definitions.push_back(definition);
       }
 
-      s_definitionsByFile[definitions.file] = definitions;
-   }
-}
-
-
-void saveDefinitionIndex()
-{
-   using namespace safe_convert;
-
-   json::Array indexJson;
-   BOOST_FOREACH(const DefinitionsByFile::value_type& defs, s_definitionsByFile)
-   {
-      const CppDefinitions& definitions = defs.second;
-      json::Object definitionsJson;
-      definitionsJson["file"] = definitions.file;
-      definitionsJson["file_last_write"] = numberTo<double>(
-                                               definitions.fileLastWrite, 0);
-      json::Array defsArrayJson;
-      std::transform(definitions.definitions.begin(),
-                     definitions.definitions.end(),
-                     std::back_inserter(defsArrayJson),
-                     cppDefinitionToJson);
-      definitionsJson["definitions"] = defsArrayJson;
-
-      indexJson.push_back(definitionsJson);
+      insertDefinitions(definitions);
    }
-
-   std::ostringstream ostr;
-   json::writeFormatted(indexJson, ostr);
-   Error error = writeStringToFile(definitionIndexFilePath(), ostr.str());
-   if (error)
-      LOG_ERROR(error);
 }
 
-void onShutdown(bool terminatedNormally)
-{
-   if (terminatedNormally)
-      saveDefinitionIndex();
-}
-
-
 } // anonymous namespace
 
 void searchDefinitions(const std::string& term,
@@ -640,9 +813,6 @@ Error initializeDefinitionIndex()
 
       // set initialized flag
       s_initialized = true;
-
-      // setup handler to save index at shutdown
-      module_context::events().onShutdown.connect(onShutdown);
    }
 
    return Success();
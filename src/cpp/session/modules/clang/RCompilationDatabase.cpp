@@ -168,6 +168,70 @@ std::string packageBuildFileHash()
    return ostr.str();
 }
 
+// contents of a file (empty if it doesn't exist) for use in cache keys
+std::string fileContentsForKey(const FilePath& filePath)
+{
+   std::string contents;
+   if (filePath.exists())
+   {
+      Error error = core::readStringFromFile(filePath, &contents);
+      if (error)
+         LOG_ERROR(error);
+   }
+   return contents;
+}
+
+// inputs which affect the compilation args of any package or file: the
+// version of R and its library paths (which determine the flags R CMD SHLIB
+// uses and where LinkingTo headers are found), the user's Makevars, and the
+// version of libclang
+std::string compilationEnvironmentKey()
+{
+   std::ostringstream ostr;
+   ostr << module_context::rHomeDir() << std::endl
+        << module_context::rVersion() << std::endl
+        << module_context::libPathsString() << std::endl
+        << libclang::clang().version().asString() << std::endl;
+
+   FilePath userRPath = module_context::userHomePath().childPath(".R");
+   ostr << fileContentsForKey(userRPath.childPath("Makevars")) << std::endl
+        << fileContentsForKey(userRPath.childPath("Makevars.win"))
+        << std::endl;
+
+   return ostr.str();
+}
+
+// the package's DESCRIPTION (which includes LinkingTo) and Makevars are
+// keyed by content rather than write time so that the args survive touching
+// or re-checking out those files. the package path is part of the key since
+// the args include paths within the package (so each checkout of a package
+// has its own args, which are shared by all of the sessions using it)
+std::string packageCompilationKey(const FilePath& pkgPath)
+{
+   std::ostringstream ostr;
+   ostr << "package" << std::endl
+        << compilationEnvironmentKey()
+        << pkgPath.absolutePath() << std::endl
+        << fileContentsForKey(pkgPath.childPath("DESCRIPTION")) << std::endl;
+
+   FilePath srcPath = pkgPath.childPath("src");
+   ostr << fileContentsForKey(srcPath.childPath("Makevars")) << std::endl
+        << fileContentsForKey(srcPath.childPath("Makevars.win")) << std::endl;
+
+   return ostr.str();
+}
+
+std::string sourceCppCompilationKey(const FilePath& srcPath,
+                                    const std::string& sourceCppHash)
+{
+   std::ostringstream ostr;
+   ostr << "sourceCpp" << std::endl
+        << compilationEnvironmentKey()
+        << srcPath.absolutePath() << std::endl
+        << sourceCppHash << std::endl;
+   return ostr.str();
+}
+
 std::vector<std::string> parseCompilationResults(const std::string& results)
 {
    // compile args to return
@@ -255,30 +319,34 @@ std::vector<std::string> includesForLinkingTo(const std::string& linkingTo)
 
 
 RCompilationDatabase::RCompilationDatabase()
-   : usePrecompiledHeaders_(true), restoredCompilationConfig_(false)
+   : usePrecompiledHeaders_(true)
 {
 }
 
 void RCompilationDatabase::updateForCurrentPackage()
 {
-   // one time restore of compilation config
-   if (!restoredCompilationConfig_)
-   {
-      restorePackageCompilationConfig();
-      restoredCompilationConfig_ = true;
-   }
-
    // check hash to see if we can avoid this computation
    std::string buildFileHash = packageBuildFileHash();
    if (buildFileHash == packageBuildFileHash_)
       return;
 
+   // use the args cached (by this or another session) for the current
+   // contents of the build files if we have them
+   using namespace projects;
+   FilePath pkgPath = projectContext().buildTargetPath();
+   std::string cacheKey = packageCompilationKey(pkgPath);
+   CompilationConfig cachedConfig;
+   if (readCachedConfig(cacheKey, &cachedConfig))
+   {
+      packageCompilationConfig_ = cachedConfig;
+      packageBuildFileHash_ = buildFileHash;
+      return;
+   }
+
    // start with base args
    std::vector<std::string> args = baseCompilationArgs(true);
 
    // read the package description file
-   using namespace projects;
-   FilePath pkgPath = projectContext().buildTargetPath();
    core::r_util::RPackageInfo pkgInfo;
    Error error = pkgInfo.read(pkgPath);
    if (error)
@@ -334,8 +402,8 @@ void RCompilationDatabase::updateForCurrentPackage()
                                                      srcDir);
       packageBuildFileHash_ = buildFileHash;
 
-      // save them to disk
-      savePackageCompilationConfig();
+      // save them to the cache
+      writeCachedConfig(cacheKey, packageCompilationConfig_);
    }
 
 }
@@ -396,41 +464,65 @@ std::vector<std::string> RCompilationDatabase::compileArgsForPackage(
 
 namespace {
 
-FilePath compilationConfigFilePath()
+// cached configs are stored as one file per key (named for a hash of it)
+const std::size_t kMaxCachedConfigs = 256;
+
+FilePath compilationConfigCachePath()
 {
-   return module_context::scopedScratchPath().complete("cpp-complilation-config");
+   return module_context::userScratchPath().childPath(
+                                              "cpp-compilation-config-cache");
 }
 
+FilePath cachedConfigFilePath(const std::string& key)
+{
+   return compilationConfigCachePath().childPath(
+                                          core::hash::crc32HexHash(key));
+}
 
-} // anonymous namespace
-
-void RCompilationDatabase::savePackageCompilationConfig()
+bool compareLastWriteTime(const FilePath& a, const FilePath& b)
 {
-   json::Object configJson;
-   configJson["args"] = json::toJsonArray(packageCompilationConfig_.args);
-   configJson["pch"] = packageCompilationConfig_.PCH;
-   configJson["is_cpp"] = packageCompilationConfig_.isCpp;
-   configJson["hash"] = packageBuildFileHash_;
+   return a.lastWriteTime() < b.lastWriteTime();
+}
 
-   std::ostringstream ostr;
-   json::writeFormatted(configJson, ostr);
-   Error error = writeStringToFile(compilationConfigFilePath(), ostr.str());
+// remove the least recently written configs when there are too many
+void pruneCachedConfigs()
+{
+   std::vector<FilePath> configFiles;
+   Error error = compilationConfigCachePath().children(&configFiles);
    if (error)
+   {
       LOG_ERROR(error);
+      return;
+   }
+
+   if (configFiles.size() <= kMaxCachedConfigs)
+      return;
+
+   std::sort(configFiles.begin(), configFiles.end(), compareLastWriteTime);
+   std::size_t excess = configFiles.size() - kMaxCachedConfigs;
+   for (std::size_t i = 0; i < excess; i++)
+   {
+      Error error = configFiles[i].removeIfExists();
+      if (error)
+         LOG_ERROR(error);
+   }
 }
 
-void RCompilationDatabase::restorePackageCompilationConfig()
+} // anonymous namespace
+
+bool RCompilationDatabase::readCachedConfig(const std::string& key,
+                                            CompilationConfig* pConfig)
 {
-   FilePath configFilePath = compilationConfigFilePath();
+   FilePath configFilePath = cachedConfigFilePath(key);
    if (!configFilePath.exists())
-      return;
+      return false;
 
    std::string contents;
-   Error error = readStringFromFile(compilationConfigFilePath(), &contents);
+   Error error = readStringFromFile(configFilePath, &contents);
    if (error)
    {
       LOG_ERROR(error);
-      return;
+      return false;
    }
 
    json::Value configJson;
@@ -438,28 +530,78 @@ void RCompilationDatabase::restorePackageCompilationConfig()
        !json::isType<json::Object>(configJson))
    {
       LOG_ERROR_MESSAGE("Error parsing compilation config: " + contents);
-      return;
+      return false;
    }
 
+   // the full key is stored along with the config so that configs whose
+   // keys have the same hash aren't confused
+   std::string configKey;
    json::Array argsJson;
+   CompilationConfig config;
    error = json::readObject(configJson.get_obj(),
+                            "key", &configKey,
                             "args", &argsJson,
-                            "pch", &packageCompilationConfig_.PCH,
-                            "is_cpp", &packageCompilationConfig_.isCpp,
-                            "hash", &packageBuildFileHash_);
+                            "pch", &config.PCH,
+                            "is_cpp", &config.isCpp);
    if (error)
    {
       error.addProperty("json", contents);
       LOG_ERROR(error);
-      return;
+      return false;
    }
 
-   packageCompilationConfig_.args.clear();
+   if (configKey != key)
+      return false;
+
    BOOST_FOREACH(const json::Value& argJson, argsJson)
    {
       if (json::isType<std::string>(argJson))
-         packageCompilationConfig_.args.push_back(argJson.get_str());
+         config.args.push_back(argJson.get_str());
    }
+
+   if (config.empty())
+      return false;
+
+   *pConfig = config;
+   return true;
+}
+
+void RCompilationDatabase::writeCachedConfig(const std::string& key,
+                                             const CompilationConfig& config)
+{
+   json::Object configJson;
+   configJson["key"] = key;
+   configJson["args"] = json::toJsonArray(config.args);
+   configJson["pch"] = config.PCH;
+   configJson["is_cpp"] = config.isCpp;
+
+   Error error = compilationConfigCachePath().ensureDirectory();
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   // write to a temporary file and then move it into place so that other
+   // sessions never read a partially written config
+   FilePath configFilePath = cachedConfigFilePath(key);
+   FilePath tempFilePath = configFilePath.parent().childPath(
+            configFilePath.filename() + "-" + core::system::generateUuid());
+   std::ostringstream ostr;
+   json::writeFormatted(configJson, ostr);
+   error = writeStringToFile(tempFilePath, ostr.str());
+   if (!error)
+      error = tempFilePath.move(configFilePath);
+   if (error)
+   {
+      LOG_ERROR(error);
+      Error removeError = tempFilePath.removeIfExists();
+      if (removeError)
+         LOG_ERROR(removeError);
+      return;
+   }
+
+   pruneCachedConfigs();
 }
 
 void RCompilationDatabase::updateForSourceCpp(const core::FilePath& srcFile)
@@ -486,8 +628,15 @@ void RCompilationDatabase::updateForSourceCpp(const core::FilePath& srcFile)
       return;
    }
 
-   // get config
-   CompilationConfig config = configForSourceCpp(info.rcppPkg, srcFile);
+   // get config (running sourceCpp only if no session has cached it)
+   std::string cacheKey = sourceCppCompilationKey(srcFile, info.hash);
+   CompilationConfig config;
+   if (!readCachedConfig(cacheKey, &config))
+   {
+      config = configForSourceCpp(info.rcppPkg, srcFile);
+      if (!config.empty())
+         writeCachedConfig(cacheKey, config);
+   }
 
    // save it
    if (!config.empty())
@@ -68,9 +68,6 @@ private:
                                      const core::FilePath& pkgPath);
 
 
-   void savePackageCompilationConfig();
-   void restorePackageCompilationConfig();
-
    // struct used to represent compilation settings
    struct CompilationConfig
    {
@@ -79,6 +76,13 @@ private:
       std::string PCH;
       bool isCpp;
    };
+
+   // persistent cache of compilation settings (shared by all of the user's
+   // sessions) keyed by the inputs used to derive them
+   static bool readCachedConfig(const std::string& key,
+                                CompilationConfig* pConfig);
+   static void writeCachedConfig(const std::string& key,
+                                 const CompilationConfig& config);
    CompilationConfig configForSourceCpp(const std::string& rcppPkg,
                                         core::FilePath srcFile);
 
@@ -112,7 +116,6 @@ private:
    std::string packageBuildFileHash_;
    CompilationConfig packageCompilationConfig_;
    bool usePrecompiledHeaders_;
-   bool restoredCompilationConfig_;
 };
 
 core::libclang::CompilationDatabase rCompilationDatabase();
@@ -27,7 +27,9 @@
 #include <r/ROptions.hpp>
 
 #include <session/SessionModuleContext.hpp>
+#include <session/SessionSourceDatabase.hpp>
 #include <session/SessionUserSettings.hpp>
+#include <session/projects/SessionProjects.hpp>
 
 #include <core/libclang/LibClang.hpp>
 
@@ -96,6 +98,18 @@ EmbeddedLibrary embeddedLibClang()
    return embedded;
 }
 
+// number of edits made to each file. the translation unit is reprimed once
+// editing pauses (so a burst of edits results in a single reparse)
+std::map<std::string,unsigned long> s_editCounts;
+
+void primeAfterEdits(const std::string& filename, unsigned long edits)
+{
+   std::map<std::string,unsigned long>::const_iterator it =
+                                             s_editCounts.find(filename);
+   if (it != s_editCounts.end() && it->second == edits)
+      rSourceIndex().primeEditorTranslationUnit(filename);
+}
+
 void onSourceDocUpdated(boost::shared_ptr<source_database::SourceDocument> pDoc)
 {
    // ignore if the file doesn't have a path
@@ -115,13 +129,14 @@ void onSourceDocUpdated(boost::shared_ptr<source_database::SourceDocument> pDoc)
                                         pDoc->contents(),
                                         pDoc->dirty());
 
-   // dirty files indicate active user editing, prime if necessary
+   // dirty files indicate active user editing, (re)parse in the
+   // background once editing pauses
    if (pDoc->dirty())
    {
+      unsigned long edits = ++s_editCounts[filename];
       module_context::scheduleDelayedWork(
-            boost::posix_time::milliseconds(100),
-            boost::bind(&SourceIndex::primeEditorTranslationUnit,
-                        &(rSourceIndex()), filename),
+            boost::posix_time::milliseconds(500),
+            boost::bind(primeAfterEdits, filename, edits),
             true); // require idle
    }
 
@@ -148,6 +163,7 @@ void onSourceDocRemoved(const std::string& id, const std::string& path)
 
    // remove from unsaved files
    rSourceIndex().unsavedFiles().remove(resolvedPath);
+   s_editCounts.erase(resolvedPath);
 
    // remove the translation unit
    rSourceIndex().removeTranslationUnit(resolvedPath);
@@ -156,9 +172,30 @@ void onSourceDocRemoved(const std::string& id, const std::string& path)
 void onAllSourceDocsRemoved()
 {
    rSourceIndex().unsavedFiles().removeAll();
+   s_editCounts.clear();
    rSourceIndex().removeAllTranslationUnits();
 }
 
+// open files which are changed on disk (e.g. by a checkout) are reprimed
+// so that their translation units reflect the change
+void onFilesChanged(const std::vector<core::system::FileChangeEvent>& events)
+{
+   std::vector<std::string> ids;
+   source_database::getIds(events, &ids);
+   for (std::size_t i = 0; i < events.size(); i++)
+   {
+      if (ids[i].empty() ||
+          events[i].type() != core::system::FileChangeEvent::FileModified)
+      {
+         continue;
+      }
+
+      std::string filename = events[i].fileInfo().absolutePath();
+      if (SourceIndex::isSourceFile(filename))
+         rSourceIndex().reprimeEditorTranslationUnit(filename);
+   }
+}
+
 bool cppIndexingDisabled()
 {
    return ! r::options::getOption<bool>("rstudio.indexCpp", true, false);
@@ -259,6 +296,12 @@ Error initialize()
    source_database::events().onDocRemoved.connect(onSourceDocRemoved);
    source_database::events().onRemoveAll.connect(onAllSourceDocsRemoved);
 
+   // keep open files current when they are changed on disk
+   session::projects::FileMonitorCallbacks cb;
+   cb.onFilesChanged = onFilesChanged;
+   projects::projectContext().subscribeToFileMonitor("C/C++ editor indexing",
+                                                     cb);
+
    return Success();
 }
 
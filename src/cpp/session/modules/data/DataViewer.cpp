@@ -956,7 +956,8 @@ Error initialize()
    source_database::events().onDocPendingRemove.connect(onDocPendingRemove);
 
    module_context::events().onShutdown.connect(onShutdown);
-   module_context::events().onDetectChanges.connect(onDetectChanges);
+   module_context::events().onDetectChanges.connect("data_viewer",
+                                                    onDetectChanges);
    module_context::events().onClientInit.connect(onClientInit);
    addSuspendHandler(SuspendHandler(onSuspend, onResume));
 
@@ -110,7 +110,10 @@ private:
       sources.push_back(pathFromModulesSource("SessionDataViewer.R"));
       sources.push_back(pathFromModulesSource("SessionDataImportV2.R"));
 
-      async_r::AsyncRProcess::start(cmd.c_str(), FilePath(), async_r::R_PROCESS_VANILLA, sources);
+      async_r::AsyncRProcess::start(cmd.c_str(), FilePath(),
+                                    async_r::R_PROCESS_VANILLA |
+                                    async_r::R_PROCESS_POOLED,
+                                    sources);
    }
 
    Error readRDS(SEXP* pResult)
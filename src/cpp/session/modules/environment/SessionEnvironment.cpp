@@ -1156,8 +1156,9 @@ Error initialize()
    // subscribe to events
    using boost::bind;
    using namespace session::module_context;
-   events().onDetectChanges.connect(bind(onDetectChanges, _1));
-   events().onConsolePrompt.connect(bind(onConsolePrompt,
+   events().onDetectChanges.connect("environment", bind(onDetectChanges, _1));
+   events().onConsolePrompt.connect("environment",
+                                    bind(onConsolePrompt,
                                          pContextDepth,
                                          pLineDebugState,
                                          pCapturingDebugOutput,
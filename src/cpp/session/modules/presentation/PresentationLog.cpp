@@ -55,7 +55,8 @@ Error Log::initialize()
    using namespace boost;
    using namespace session::module_context;
 
-   events().onConsolePrompt.connect(boost::bind(&Log::onConsolePrompt,
+   events().onConsolePrompt.connect("presentation_log",
+                                    boost::bind(&Log::onConsolePrompt,
                                                 this, _1));
    events().onConsoleInput.connect(boost::bind(&Log::onConsoleInput,
                                                this, _1));
@@ -105,8 +105,7 @@ void cleanUnusedCaches()
 
       // is this document still open? if so, leave the cache alone.
       std::string id;
-      source_database::getId(module_context::createAliasedPath(
-               FileInfo(path)), &id);
+      source_database::getId(path, &id);
       if (!id.empty())
       {
          continue;
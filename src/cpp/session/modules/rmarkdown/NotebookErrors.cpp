@@ -88,6 +88,7 @@ private:
 };
 
 boost::shared_ptr<ErrorState> s_pErrorState;
+boost::signals::connection s_onConsolePrompt;
 
 SEXP rs_recordNotebookError(SEXP errData)
 {
@@ -107,7 +108,7 @@ void onConsolePrompt(const std::string&)
    }
 
    // clean up listener
-   module_context::events().onConsolePrompt.disconnect(onConsolePrompt);
+   s_onConsolePrompt.disconnect();
 }
 
 } // anonymous namespace
@@ -123,7 +124,11 @@ core::Error beginErrorCapture()
    s_pErrorState->connect();
 
    // diconnect when statement finishes
-   module_context::events().onConsolePrompt.connect(onConsolePrompt);
+   s_onConsolePrompt.disconnect();
+   s_onConsolePrompt = module_context::events().onConsolePrompt.connect(
+                                                "notebook_errors",
+                                                onConsolePrompt,
+                                                boost::posix_time::pos_infin);
 
    return Success();
 }
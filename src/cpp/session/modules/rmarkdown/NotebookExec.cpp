@@ -163,7 +163,9 @@ void ChunkExecContext::connect()
 
    // begin capturing console text
    connections_.push_back(module_context::events().onConsolePrompt.connect(
-         boost::bind(&ChunkExecContext::onConsolePrompt, this, _1)));
+         "notebook_exec",
+         boost::bind(&ChunkExecContext::onConsolePrompt, this, _1),
+         boost::posix_time::pos_infin));
    connections_.push_back(module_context::events().onConsoleOutput.connect(
          boost::bind(&ChunkExecContext::onConsoleOutput, this, _1, _2)));
    connections_.push_back(module_context::events().onConsoleInput.connect(
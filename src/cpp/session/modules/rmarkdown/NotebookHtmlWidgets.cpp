@@ -39,6 +39,8 @@ namespace notebook {
 
 namespace {
 
+boost::signals::connection s_onConsolePrompt;
+
 SEXP rs_recordHtmlWidget(SEXP htmlFileSEXP, SEXP depFileSEXP)
 {
    events().onHtmlOutput(FilePath(r::sexp::safeAsString(htmlFileSEXP)), 
@@ -53,7 +55,7 @@ void onConsolePrompt(const std::string&)
    if (error)
       LOG_ERROR(error);
 
-   module_context::events().onConsolePrompt.disconnect(onConsolePrompt);
+   s_onConsolePrompt.disconnect();
 }
 
 bool moveLibFile(const FilePath& from, const FilePath& to, 
@@ -84,7 +86,11 @@ core::Error beginWidgetCapture(
       return error;
 
 
-   module_context::events().onConsolePrompt.connect(onConsolePrompt);
+   s_onConsolePrompt.disconnect();
+   s_onConsolePrompt = module_context::events().onConsolePrompt.connect(
+                                                "notebook_html_widgets",
+                                                onConsolePrompt,
+                                                boost::posix_time::pos_infin);
 
    return Success();
 }
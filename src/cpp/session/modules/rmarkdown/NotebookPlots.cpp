@@ -203,7 +203,9 @@ core::Error beginPlotCapture(const FilePath& plotFolder)
    
    // complete the capture on the next console prompt
    pPlotState->onConsolePrompt = module_context::events().onConsolePrompt.connect(
-         boost::bind(onConsolePrompt, plotFolder, pPlotState, _1));
+         "notebook_plots",
+         boost::bind(onConsolePrompt, plotFolder, pPlotState, _1),
+         boost::posix_time::pos_infin);
 
    pPlotState->onNewPlot = plots::events().onNewPlot.connect(
          boost::bind(onNewPlot, plotFolder, pPlotState));
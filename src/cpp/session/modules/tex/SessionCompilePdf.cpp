@@ -340,29 +340,21 @@ bool isLogEntryFromTargetFile(const core::tex::LogEntry& logEntry,
 }
 
 void getLogEntries(const FilePath& texPath,
+                   const core::tex::LogEntries& latexLogEntries,
                    core::tex::LogEntries* pLogEntries)
 {
-   // latex log file
-   FilePath logPath = ancillaryFilePath(texPath, ".log");
-   if (logPath.exists())
-   {
-      core::tex::LogEntries logEntries;
-      Error error = core::tex::parseLatexLog(logPath, &logEntries);
-      if (error)
-         LOG_ERROR(error);
-
-      filterLatexLog(logEntries, pLogEntries);
+   // latex log entries (parsed as the log was written)
+   filterLatexLog(latexLogEntries, pLogEntries);
 
-      // re-arrange so that issues in the target file always end up at the top
-      // of the error display
-      std::partition(pLogEntries->begin(),
-                     pLogEntries->end(),
-                     boost::bind(isLogEntryFromTargetFile, _1, texPath));
-   }
+   // re-arrange so that issues in the target file always end up at the top
+   // of the error display
+   std::partition(pLogEntries->begin(),
+                  pLogEntries->end(),
+                  boost::bind(isLogEntryFromTargetFile, _1, texPath));
 
    // bibtex log file
    core::tex::LogEntries bibtexLogEntries;
-   logPath = ancillaryFilePath(texPath, ".blg");
+   FilePath logPath = ancillaryFilePath(texPath, ".blg");
    if (logPath.exists())
    {
       Error error = core::tex::parseBibtexLog(logPath, &bibtexLogEntries);
@@ -702,10 +694,12 @@ private:
       enqueOutputEvent("Running " + texProgramPath_.filename() +
                        " on " + texFilePath.filename() + "...");
 
+      core::tex::LogEntries logEntries;
       error = tex::pdflatex::texToPdf(texProgramPath_,
                                       texFilePath,
                                       options,
-                                      &result);
+                                      &result,
+                                      &logEntries);
 
       if (error)
       {
@@ -715,6 +709,7 @@ private:
       {
          onLatexCompileCompleted(result.exitStatus,
                                  texFilePath,
+                                 logEntries,
                                  concordances);
       }
 
@@ -722,11 +717,12 @@ private:
 
    void onLatexCompileCompleted(int exitStatus,
                                 const FilePath& texFilePath,
+                                const core::tex::LogEntries& latexLogEntries,
                                 const rnw_concordance::Concordances& concords)
    {
       // collect errors from the log
       core::tex::LogEntries logEntries;
-      getLogEntries(texFilePath, &logEntries);
+      getLogEntries(texFilePath, latexLogEntries, &logEntries);
 
       // determine whether they will be shown in the list
       // list or within the console
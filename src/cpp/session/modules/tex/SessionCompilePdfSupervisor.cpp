@@ -145,7 +145,8 @@ Error initialize()
 {
    // subscribe to events
    module_context::Events& events = module_context::events();
-   events.onBackgroundProcessing.connect(onBackgroundProcessing);
+   events.onBackgroundProcessing.connect("compile_pdf_supervisor",
+                                         onBackgroundProcessing);
    events.onShutdown.connect(onShutdown);
 
    return Success();
@@ -15,9 +15,13 @@
 
 #include "SessionPdfLatex.hpp"
 
+#include <map>
+
 #include <boost/regex.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/algorithm/string.hpp>
 
+#include <core/Hash.hpp>
 #include <core/system/Environment.hpp>
 #include <core/FileSerializer.hpp>
 
@@ -207,42 +211,288 @@ FilePath programPath(const std::string& name, const std::string& envOverride)
 
 
 
-bool lineIncludes(const std::string& line, const boost::regex& regex)
+// follows the log written by a latex pass, parsing it as the compiler writes
+// it. the log of the previous pass is removed before each pass so all of the
+// log is from the current one (on windows the log can't be opened while the
+// compiler is writing it, in which case it's all read once the pass is done)
+class LatexLogFollower : boost::noncopyable
 {
-    boost::smatch match;
-    return boost::regex_search(line, match, regex);
+public:
+   explicit LatexLogFollower(const FilePath& logFilePath)
+      : logFilePath_(logFilePath)
+   {
+      reset();
+   }
+
+public:
+   // read whatever has been written to the log since the last update
+   Error update()
+   {
+      if (!logFilePath_.exists())
+         return Success();
+
+      uintmax_t size = logFilePath_.size();
+      if (size < offset_)
+         reset();
+      if (size == offset_)
+         return Success();
+
+      boost::shared_ptr<std::istream> pStream;
+      Error error = logFilePath_.open_r(&pStream);
+      if (error)
+         return error;
+
+      std::string output(static_cast<std::size_t>(size - offset_), '\0');
+      pStream->seekg(static_cast<std::streamoff>(offset_));
+      pStream->read(&output[0], output.size());
+      output.resize(static_cast<std::size_t>(pStream->gcount()));
+      offset_ += output.size();
+
+      addOutput(output);
+      return Success();
+   }
+
+   void finish()
+   {
+      Error error = update();
+      if (error)
+         LOG_ERROR(error);
+
+      pParser_->finish();
+   }
+
+   int citationMisses() const { return citationMisses_; }
+   bool rerun() const { return rerun_; }
+
+   const core::tex::LogEntries& logEntries() const
+   {
+      return pParser_->logEntries();
+   }
+
+private:
+   void reset()
+   {
+      pParser_.reset(new core::tex::LatexLogParser(logFilePath_));
+      offset_ = 0;
+      partialLine_.clear();
+      citationMisses_ = 0;
+      rerun_ = false;
+   }
+
+   void addOutput(const std::string& output)
+   {
+      pParser_->addOutput(output);
+
+      // scan complete lines for citation misses and rerun requests
+      partialLine_.append(output);
+      std::string::size_type pos = 0;
+      std::string::size_type next;
+      while ((next = partialLine_.find('\n', pos)) != std::string::npos)
+      {
+         scanLine(partialLine_.substr(pos, next - pos));
+         pos = next + 1;
+      }
+      partialLine_.erase(0, pos);
+   }
+
+   void scanLine(const std::string& line)
+   {
+      static boost::regex missRegex("Warning:.*Citation.*undefined");
+      boost::smatch match;
+      if (boost::regex_search(line, match, missRegex))
+         citationMisses_++;
+
+      if (line.find("Rerun to get") != std::string::npos)
+         rerun_ = true;
+   }
+
+private:
+   FilePath logFilePath_;
+   boost::scoped_ptr<core::tex::LatexLogParser> pParser_;
+   uintmax_t offset_;
+   std::string partialLine_;
+   int citationMisses_;
+   bool rerun_;
+};
+
+void updateLogFollower(LatexLogFollower* pFollower)
+{
+   // errors are expected while the compiler has the log open on windows
+   // (finish reports any error which remains once the pass is done)
+   pFollower->update();
 }
 
-int countCitationMisses(const FilePath& logFilePath)
+struct LatexPass
 {
-   // read the log file
-   std::vector<std::string> lines;
-   Error error = core::readStringVectorFromFile(logFilePath, &lines);
+   LatexPass() : citationMisses(0), rerun(false) {}
+
+   int citationMisses;
+   bool rerun;
+   core::tex::LogEntries logEntries;
+};
+
+Error runLatexPass(const FilePath& texProgramPath,
+                   const core::system::Options& envVars,
+                   const FilePath& texFilePath,
+                   const tex::pdflatex::PdfLatexOptions& options,
+                   LatexPass* pPass,
+                   core::system::ProcessResult* pResult)
+{
+   FilePath logFilePath = texFilePath.parent().complete(
+                                             texFilePath.stem() + ".log");
+   Error error = logFilePath.removeIfExists();
    if (error)
-   {
       LOG_ERROR(error);
-      return 0;
-   }
 
-   // look for misses
-   boost::regex missRegex("Warning:.*Citation.*undefined");
-   int misses = std::count_if(lines.begin(),
-                              lines.end(),
-                              boost::bind(lineIncludes, _1, missRegex));
-   return misses;
+   LatexLogFollower follower(logFilePath);
+   error = utils::runTexCompile(texProgramPath,
+                                envVars,
+                                shellArgs(options),
+                                texFilePath,
+                                boost::bind(updateLogFollower, &follower),
+                                pResult);
+   if (error)
+      return error;
+
+   follower.finish();
+   pPass->citationMisses = follower.citationMisses();
+   pPass->rerun = follower.rerun();
+   pPass->logEntries = follower.logEntries();
+   return Success();
 }
 
-bool logIncludesRerun(const FilePath& logFilePath)
+std::string fileHash(const FilePath& filePath)
 {
-   std::string logContents;
-   Error error = core::readStringFromFile(logFilePath, &logContents);
+   if (!filePath.exists())
+      return std::string();
+
+   std::string contents;
+   Error error = core::readStringFromFile(filePath, &contents);
    if (error)
    {
       LOG_ERROR(error);
-      return false;
+      return std::string();
+   }
+
+   return core::hash::crc32HexHash(contents);
+}
+
+// the main aux file along with those of any \include-d files
+std::vector<FilePath> auxFiles(const FilePath& baseFilePath)
+{
+   static boost::regex inputRegex("^\\\\@input\\{([^}]+)\\}");
+
+   std::vector<FilePath> files;
+   files.push_back(FilePath(baseFilePath.absolutePath() + ".aux"));
+
+   std::vector<std::string> lines;
+   if (files.front().exists() &&
+       !core::readStringVectorFromFile(files.front(), &lines, false))
+   {
+      BOOST_FOREACH(const std::string& line, lines)
+      {
+         boost::smatch match;
+         if (boost::regex_search(line, match, inputRegex))
+            files.push_back(baseFilePath.parent().complete(match[1]));
+      }
+   }
+
+   return files;
+}
+
+// hash of the files written by a pass which are read by the next one (when
+// this doesn't change over a pass there's no need for another)
+std::string passOutputsHash(const FilePath& baseFilePath)
+{
+   std::string hashes;
+   BOOST_FOREACH(const FilePath& auxFile, auxFiles(baseFilePath))
+   {
+      hashes += fileHash(auxFile);
+   }
+
+   // tables of contents, hyperref bookmarks and back references, beamer
+   // navigation and glossaries (and acronyms) of the glossaries package
+   const char* extensions[] = { ".toc", ".lof", ".lot", ".out", ".brf",
+                                ".nav", ".snm",
+                                ".glo", ".gls", ".acn", ".acr" };
+   BOOST_FOREACH(const char* extension, extensions)
+   {
+      hashes += fileHash(FilePath(baseFilePath.absolutePath() + extension));
+   }
+
+   return hashes;
+}
+
+// hash of the inputs to bibtex (the aux file citation and bibliography
+// commands along with the bibliography and style files they refer to).
+// returns an empty string if any bibliography file can't be found next to
+// the tex file (as then we can't tell whether it has changed)
+std::string bibtexInputsHash(const FilePath& baseFilePath)
+{
+   static boost::regex bibRegex("^\\\\(?:citation|bibdata|bibstyle)\\{");
+   static boost::regex bibdataRegex("^\\\\bibdata\\{([^}]*)\\}");
+   static boost::regex bibstyleRegex("^\\\\bibstyle\\{([^}]*)\\}");
+
+   std::string inputs;
+   BOOST_FOREACH(const FilePath& auxFile, auxFiles(baseFilePath))
+   {
+      std::vector<std::string> lines;
+      if (!auxFile.exists() ||
+          core::readStringVectorFromFile(auxFile, &lines, false))
+      {
+         continue;
+      }
+
+      BOOST_FOREACH(const std::string& line, lines)
+      {
+         boost::smatch match;
+         if (!boost::regex_search(line, match, bibRegex))
+            continue;
+
+         inputs += line + "\n";
+
+         if (boost::regex_search(line, match, bibdataRegex))
+         {
+            std::vector<std::string> names;
+            std::string bibdata = match[1];
+            boost::algorithm::split(names, bibdata, boost::is_any_of(","));
+            BOOST_FOREACH(std::string name, names)
+            {
+               boost::algorithm::trim(name);
+               if (!boost::algorithm::ends_with(name, ".bib"))
+                  name += ".bib";
+               FilePath bibFile = baseFilePath.parent().complete(name);
+               if (!bibFile.exists())
+                  return std::string();
+               inputs += fileHash(bibFile);
+            }
+         }
+         else if (boost::regex_search(line, match, bibstyleRegex))
+         {
+            // styles which aren't next to the tex file come with the
+            // tex distribution
+            std::string name = match[1];
+            name += ".bst";
+            inputs += fileHash(baseFilePath.parent().complete(name));
+         }
+      }
    }
 
-   return logContents.find("Rerun to get") != std::string::npos;
+   return core::hash::crc32HexHash(inputs);
+}
+
+// state of the inputs and output of bibtex and makeindex when they were last
+// run for each file (these needn't be run again until it changes)
+typedef std::map<std::string,std::string> ToolStates;
+ToolStates s_bibtexStates;
+ToolStates s_makeindexStates;
+
+bool toolStateChanged(const ToolStates& states,
+                      const FilePath& inputFilePath,
+                      const std::string& state)
+{
+   ToolStates::const_iterator it = states.find(inputFilePath.absolutePath());
+   return it == states.end() || it->second != state;
 }
 
 } // anonymous namespace
@@ -353,46 +603,66 @@ bool latexProgramForFile(const core::tex::TexMagicComments& magicComments,
 core::Error texToPdf(const core::FilePath& texProgramPath,
                      const core::FilePath& texFilePath,
                      const tex::pdflatex::PdfLatexOptions& options,
-                     core::system::ProcessResult* pResult)
+                     core::system::ProcessResult* pResult,
+                     core::tex::LogEntries* pLogEntries)
 {
    // input file paths
    FilePath baseFilePath = texFilePath.parent().complete(texFilePath.stem());
+   FilePath auxFilePath(baseFilePath.absolutePath() + ".aux");
+   FilePath bblFilePath(baseFilePath.absolutePath() + ".bbl");
    FilePath idxFilePath(baseFilePath.absolutePath() + ".idx");
-   FilePath logFilePath(baseFilePath.absolutePath() + ".log");
+   FilePath indFilePath(baseFilePath.absolutePath() + ".ind");
 
    // bibtex and makeindex program paths
    FilePath bibtexProgramPath = programPath("bibtex", "BIBTEX");
    FilePath makeindexProgramPath = programPath("makeindex", "MAKEINDEX");
 
    // args and process options for running bibtex and makeindex
+   core::system::Options envVars = utils::rTexInputsEnvVars();
    core::shell_utils::ShellArgs bibtexArgs;
    bibtexArgs << string_utils::utf8ToSystem(baseFilePath.filename());
    core::shell_utils::ShellArgs makeindexArgs;
    makeindexArgs << string_utils::utf8ToSystem(idxFilePath.filename());
    core::system::ProcessOptions procOptions;
-   procOptions.environment = utils::rTexInputsEnvVars();
+   procOptions.environment = envVars;
    procOptions.workingDir = texFilePath.parent();
 
    // run the initial compile
-   Error error = utils::runTexCompile(texProgramPath,
-                                      utils::rTexInputsEnvVars(),
-                                      shellArgs(options),
-                                      texFilePath,
-                                      pResult);
+   std::string previousOutputsHash = passOutputsHash(baseFilePath);
+   LatexPass pass;
+   Error error = runLatexPass(texProgramPath,
+                              envVars,
+                              texFilePath,
+                              options,
+                              &pass,
+                              pResult);
    if (error)
       return error;
+   *pLogEntries = pass.logEntries;
 
    // count misses
-   int misses = countCitationMisses(logFilePath);
+   int misses = pass.citationMisses;
    int previousMisses = 0;
 
    // resolve citation misses and index
    for (int i=0; i<10; i++)
    {
-      // run bibtex if necessary
-      if (misses > 0 && !bibtexProgramPath.empty())
+      // another pass is needed if the files read by a pass were changed by
+      // the last one (or if the log asks for one)
+      std::string outputsHash = passOutputsHash(baseFilePath);
+      bool rerun = pass.rerun || (outputsHash != previousOutputsHash);
+      previousOutputsHash = outputsHash;
+
+      // run bibtex if necessary (skipping it when it has already been run
+      // with the same inputs, since it would produce the same bbl)
+      std::string bibtexInputs = misses > 0 ? bibtexInputsHash(baseFilePath)
+                                            : std::string();
+      std::string bibtexState = bibtexInputs + fileHash(bblFilePath);
+      if (misses > 0 && !bibtexProgramPath.empty() &&
+          (bibtexInputs.empty() ||
+           toolStateChanged(s_bibtexStates, auxFilePath, bibtexState)))
       {
-         core::system::ProcessResult result;
+         std::string previousBbl = fileHash(bblFilePath);
          Error error = core::system::runProgram(
                string_utils::utf8ToSystem(bibtexProgramPath.absolutePath()),
                bibtexArgs,
@@ -403,12 +673,22 @@ core::Error texToPdf(const core::FilePath& texProgramPath,
             LOG_ERROR(error);
          else if (pResult->exitStatus != EXIT_SUCCESS)
             return Success(); // pass error state on to caller
+
+         std::string bbl = fileHash(bblFilePath);
+         if (!error && !bibtexInputs.empty())
+            s_bibtexStates[auxFilePath.absolutePath()] = bibtexInputs + bbl;
+         if (bbl != previousBbl)
+            rerun = true;
       }
       previousMisses = misses;
 
-      // run makeindex if necessary
-      if (idxFilePath.exists() && !makeindexProgramPath.empty())
+      // run makeindex if necessary (again only when its inputs have changed)
+      std::string makeindexState = fileHash(idxFilePath) +
+                                   fileHash(indFilePath);
+      if (idxFilePath.exists() && !makeindexProgramPath.empty() &&
+          toolStateChanged(s_makeindexStates, idxFilePath, makeindexState))
       {
+         std::string previousInd = fileHash(indFilePath);
          Error error = core::system::runProgram(
                string_utils::utf8ToSystem(makeindexProgramPath.absolutePath()),
                makeindexArgs,
@@ -419,23 +699,37 @@ core::Error texToPdf(const core::FilePath& texProgramPath,
             LOG_ERROR(error);
          else if (pResult->exitStatus != EXIT_SUCCESS)
             return Success(); // pass error state on to caller
+
+         std::string ind = fileHash(indFilePath);
+         if (!error)
+            s_makeindexStates[idxFilePath.absolutePath()] =
+                                                fileHash(idxFilePath) + ind;
+         if (ind != previousInd)
+            rerun = true;
       }
 
+      // nothing which the last pass read has changed
+      if (!rerun)
+         break;
+
       // re-run latex
-      Error error = utils::runTexCompile(texProgramPath,
-                                         utils::rTexInputsEnvVars(),
-                                         shellArgs(options),
-                                         texFilePath,
-                                         pResult);
+      pass = LatexPass();
+      Error error = runLatexPass(texProgramPath,
+                                 envVars,
+                                 texFilePath,
+                                 options,
+                                 &pass,
+                                 pResult);
       if (error)
          return error;
+      *pLogEntries = pass.logEntries;
 
       // count misses
-      misses = countCitationMisses(logFilePath);
+      misses = pass.citationMisses;
 
       // if there is no change in misses and there is no "Rerun to get"
       // in the log file then break
-      if ((misses == previousMisses) && !logIncludesRerun(logFilePath))
+      if ((misses == previousMisses) && !pass.rerun)
          break;
    }
 
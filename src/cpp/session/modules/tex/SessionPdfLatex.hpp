@@ -20,6 +20,7 @@
 
 #include <core/json/Json.hpp>
 
+#include <core/tex/TexLogParser.hpp>
 #include <core/tex/TexMagicComment.hpp>
 
 #include <core/system/Types.hpp>
@@ -71,10 +72,13 @@ struct PdfLatexOptions
    std::string versionInfo;
 };
 
+// the entries of the latex log written by the final pass are returned in
+// pLogEntries (the log is parsed as the compiler writes it)
 core::Error texToPdf(const core::FilePath& texProgramPath,
                      const core::FilePath& texFilePath,
                      const tex::pdflatex::PdfLatexOptions& options,
-                     core::system::ProcessResult* pResult);
+                     core::system::ProcessResult* pResult,
+                     core::tex::LogEntries* pLogEntries);
 
 bool isInstalled();
 
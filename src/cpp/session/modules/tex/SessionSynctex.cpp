@@ -15,6 +15,10 @@
 
 #include "SessionSynctex.hpp"
 
+#include <list>
+
+#include <boost/shared_ptr.hpp>
+
 #include <core/Error.hpp>
 #include <core/FilePath.hpp>
 #include <core/Exec.hpp>
@@ -38,6 +42,67 @@ namespace synctex {
 
 namespace {
 
+// loaded synctex data is kept for the most recently searched pdfs (loading
+// it means reading and indexing the whole synctex file, which takes much
+// longer than a search)
+const std::size_t kMaxCachedSynctex = 4;
+
+struct CachedSynctex
+{
+   FilePath pdfPath;
+   std::time_t pdfWriteTime;
+   uintmax_t pdfSize;
+   boost::shared_ptr<core::tex::Synctex> pSynctex;
+};
+
+// most recently used first
+std::list<CachedSynctex> s_synctexCache;
+
+boost::shared_ptr<core::tex::Synctex> synctexForPdf(const FilePath& pdfPath)
+{
+   // the synctex data is written along with the pdf so it's current so long
+   // as the pdf hasn't changed
+   std::time_t pdfWriteTime = 0;
+   uintmax_t pdfSize = 0;
+   if (pdfPath.exists())
+   {
+      pdfWriteTime = pdfPath.lastWriteTime();
+      pdfSize = pdfPath.size();
+   }
+
+   for (std::list<CachedSynctex>::iterator it = s_synctexCache.begin();
+        it != s_synctexCache.end();
+        ++it)
+   {
+      if (it->pdfPath != pdfPath)
+         continue;
+
+      if (it->pdfWriteTime == pdfWriteTime && it->pdfSize == pdfSize)
+      {
+         s_synctexCache.splice(s_synctexCache.begin(), s_synctexCache, it);
+         return s_synctexCache.front().pSynctex;
+      }
+
+      s_synctexCache.erase(it);
+      break;
+   }
+
+   boost::shared_ptr<core::tex::Synctex> pSynctex(new core::tex::Synctex());
+   if (!pSynctex->parse(pdfPath))
+      return boost::shared_ptr<core::tex::Synctex>();
+
+   CachedSynctex cached;
+   cached.pdfPath = pdfPath;
+   cached.pdfWriteTime = pdfWriteTime;
+   cached.pdfSize = pdfSize;
+   cached.pSynctex = pSynctex;
+   s_synctexCache.push_front(cached);
+   if (s_synctexCache.size() > kMaxCachedSynctex)
+      s_synctexCache.pop_back();
+
+   return pSynctex;
+}
+
 json::Value toJson(const FilePath& pdfFile,
                    const core::tex::PdfLocation& pdfLoc,
                    bool fromClick)
@@ -245,9 +310,10 @@ Error synctexInverseSearch(const json::JsonRpcRequest& request,
       return error;
    FilePath pdfPath = module_context::resolveAliasedPath(file);
 
-   core::tex::Synctex synctex;
-   if (synctex.parse(pdfPath))
+   boost::shared_ptr<core::tex::Synctex> pSynctex = synctexForPdf(pdfPath);
+   if (pSynctex)
    {
+      core::tex::Synctex& synctex = *pSynctex;
       if (!fromClick)
       {
          // find the top of the page content, however override it with
@@ -324,13 +390,13 @@ Error forwardSearch(const FilePath& rootFile,
    // determine pdf
    FilePath pdfFile = rootFile.parent().complete(rootFile.stem() + ".pdf");
 
-   core::tex::Synctex synctex;
-   if (synctex.parse(pdfFile))
+   boost::shared_ptr<core::tex::Synctex> pSynctex = synctexForPdf(pdfFile);
+   if (pSynctex)
    {
       core::tex::SourceLocation srcLoc(inputFile, line, column);
       applyForwardConcordance(rootFile, &srcLoc);
 
-      core::tex::PdfLocation pdfLoc = synctex.forwardSearch(srcLoc);
+      core::tex::PdfLocation pdfLoc = pSynctex->forwardSearch(srcLoc);
       *pPdfLocation = toJson(pdfFile, pdfLoc, fromClick);
    }
    else
@@ -15,6 +15,7 @@
 
 #include "SessionTexUtils.hpp"
 
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string.hpp>
 
@@ -74,6 +75,43 @@ void ignoreOutput(const std::string& output)
 {
 }
 
+core::system::ProcessOptions texCompileOptions(
+                                    const core::system::Options& envVars,
+                                    const FilePath& texFilePath)
+{
+   // copy extra environment variables
+   core::system::Options env;
+   core::system::environment(&env);
+   BOOST_FOREACH(const core::system::Option& var, envVars)
+   {
+      core::system::setenv(&env, var.first, var.second);
+   }
+
+   // set options
+   core::system::ProcessOptions procOptions;
+   procOptions.terminateChildren = true;
+   procOptions.redirectStdErrToStdOut = true;
+   procOptions.environment = env;
+   procOptions.workingDir = texFilePath.parent();
+   return procOptions;
+}
+
+bool pollTexCompile(const boost::function<void()>& onPoll)
+{
+   onPoll();
+   return true;
+}
+
+void appendTexCompileOutput(std::string* pOutput, const std::string& output)
+{
+   pOutput->append(output);
+}
+
+void setTexCompileExitStatus(int* pExitStatus, int exitStatus)
+{
+   *pExitStatus = exitStatus;
+}
+
 } // anonymous namespace
 
 RTexmfPaths rTexmfPaths()
@@ -139,30 +177,49 @@ Error runTexCompile(const FilePath& texProgramPath,
                     const FilePath& texFilePath,
                     core::system::ProcessResult* pResult)
 {
-   // copy extra environment variables
-   core::system::Options env;
-   core::system::environment(&env);
-   BOOST_FOREACH(const core::system::Option& var, envVars)
-   {
-      core::system::setenv(&env, var.first, var.second);
-   }
-
-   // set options
-   core::system::ProcessOptions procOptions;
-   procOptions.terminateChildren = true;
-   procOptions.redirectStdErrToStdOut = true;
-   procOptions.environment = env;
-   procOptions.workingDir = texFilePath.parent();
-
    // run the program
    return core::system::runProgram(
                string_utils::utf8ToSystem(texProgramPath.absolutePath()),
                buildArgs(args, texFilePath),
                "",
-               procOptions,
+               texCompileOptions(envVars, texFilePath),
                pResult);
 }
 
+Error runTexCompile(const FilePath& texProgramPath,
+                    const core::system::Options& envVars,
+                    const shell_utils::ShellArgs& args,
+                    const FilePath& texFilePath,
+                    const boost::function<void()>& onPoll,
+                    core::system::ProcessResult* pResult)
+{
+   pResult->stdOut.clear();
+   pResult->stdErr.clear();
+   pResult->exitStatus = EXIT_FAILURE;
+
+   core::system::ProcessCallbacks cb;
+   cb.onContinue = boost::bind(pollTexCompile, onPoll);
+   cb.onStdout = cb.onStderr = boost::bind(appendTexCompileOutput,
+                                           &pResult->stdOut,
+                                           _2);
+   cb.onExit = boost::bind(setTexCompileExitStatus, &pResult->exitStatus, _1);
+
+   // run the program using a supervisor of its own so that we can wait for
+   // it here (polling as we do)
+   core::system::ProcessSupervisor supervisor;
+   Error error = supervisor.runProgram(
+               string_utils::utf8ToSystem(texProgramPath.absolutePath()),
+               buildArgs(args, texFilePath),
+               texCompileOptions(envVars, texFilePath),
+               cb);
+   if (error)
+      return error;
+
+   supervisor.wait(boost::posix_time::milliseconds(25));
+
+   return Success();
+}
+
 core::Error runTexCompile(
               const core::FilePath& texProgramPath,
               const core::system::Options& envVars,
@@ -53,6 +53,15 @@ core::Error runTexCompile(const core::FilePath& texProgramPath,
                           const core::FilePath& texFilePath,
                           core::system::ProcessResult* pResult);
 
+// run the compile synchronously, calling onPoll periodically while the
+// compiler is running
+core::Error runTexCompile(const core::FilePath& texProgramPath,
+                          const core::system::Options& envVars,
+                          const core::shell_utils::ShellArgs& args,
+                          const core::FilePath& texFilePath,
+                          const boost::function<void()>& onPoll,
+                          core::system::ProcessResult* pResult);
+
 core::Error runTexCompile(
               const core::FilePath& texProgramPath,
               const core::system::Options& envVars,
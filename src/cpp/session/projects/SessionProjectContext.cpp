@@ -33,6 +33,8 @@
 #include <r/RExec.hpp>
 #include <r/RRoutines.hpp>
 
+#include <monitor/metrics/Registry.hpp>
+
 #include <session/SessionUserSettings.hpp>
 #include <session/SessionModuleContext.hpp>
 
@@ -405,6 +407,16 @@ void ProjectContext::fileMonitorRegistered(
 void ProjectContext::fileMonitorFilesChanged(
                    const std::vector<core::system::FileChangeEvent>& events)
 {
+   static const monitor::metrics::Counter changes = monitor::metrics::counter(
+         "rsession_project_file_changes",
+         "File changes reported by the project file monitor");
+   static const monitor::metrics::Histogram duration =
+         monitor::metrics::histogram(
+            "rsession_project_file_changes_duration_seconds",
+            "Time spent dispatching project file changes");
+   changes.increment(events.size());
+   monitor::metrics::ScopedTimer timer(duration);
+
    // notify client (gwt)
    module_context::enqueFileChangedEvents(directory(), events);
 